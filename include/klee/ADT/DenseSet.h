@@ -0,0 +1,163 @@
+//===-- DenseSet.h ----------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_DENSESET_H
+#define KLEE_DENSESET_H
+
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+namespace klee {
+
+/// DenseSet - A set of small unsigned integers (e.g. the byte offsets of
+/// array accesses), stored as a bitmap. Union and intersection work a word
+/// at a time, so they are cheap even for sets spanning large arrays.
+template <class T> class DenseSet {
+  static_assert(std::is_unsigned<T>::value,
+                "DenseSet only holds unsigned integers");
+
+  typedef std::uint64_t word_ty;
+  static constexpr unsigned WordBits = 64;
+
+  std::vector<word_ty> words;
+
+  void grow(std::size_t numWords) {
+    if (words.size() < numWords)
+      words.resize(numWords);
+  }
+
+public:
+  /// Iterates over the elements in increasing order.
+  class iterator {
+    const std::vector<word_ty> *words = nullptr;
+    std::size_t index = 0;
+    word_ty rest = 0; // the bits of words[index] which are still to come
+
+    void skipEmpty() {
+      while (!rest && index < words->size())
+        if (++index < words->size())
+          rest = (*words)[index];
+    }
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = T;
+
+    iterator() = default;
+    iterator(const std::vector<word_ty> *words, std::size_t index)
+        : words(words), index(index),
+          rest(index < words->size() ? (*words)[index] : 0) {
+      skipEmpty();
+    }
+
+    T operator*() const {
+      return index * WordBits + llvm::countTrailingZeros(rest);
+    }
+    iterator &operator++() {
+      rest &= rest - 1;
+      skipEmpty();
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator old = *this;
+      ++*this;
+      return old;
+    }
+    bool operator==(const iterator &b) const {
+      return index == b.index && rest == b.rest;
+    }
+    bool operator!=(const iterator &b) const { return !(*this == b); }
+  };
+
+  DenseSet() {}
+
+  void add(T x) {
+    grow(x / WordBits + 1);
+    words[x / WordBits] |= word_ty(1) << (x % WordBits);
+  }
+
+  /// Add all of [start, end).
+  void add(T start, T end) {
+    if (start >= end)
+      return;
+    grow((end - 1) / WordBits + 1);
+    std::size_t first = start / WordBits, last = (end - 1) / WordBits;
+    word_ty firstMask = ~word_ty(0) << (start % WordBits);
+    word_ty lastMask = ~word_ty(0) >> (WordBits - 1 - (end - 1) % WordBits);
+    if (first == last) {
+      words[first] |= firstMask & lastMask;
+      return;
+    }
+    words[first] |= firstMask;
+    std::fill(words.begin() + first + 1, words.begin() + last, ~word_ty(0));
+    words[last] |= lastMask;
+  }
+
+  // returns true iff set is changed by addition
+  bool add(const DenseSet &b) {
+    grow(b.words.size());
+    word_ty changed = 0;
+    for (std::size_t i = 0, e = b.words.size(); i != e; ++i) {
+      changed |= b.words[i] & ~words[i];
+      words[i] |= b.words[i];
+    }
+    return changed != 0;
+  }
+
+  bool intersects(const DenseSet &b) const {
+    std::size_t n = std::min(words.size(), b.words.size());
+    for (std::size_t i = 0; i != n; ++i)
+      if (words[i] & b.words[i])
+        return true;
+    return false;
+  }
+
+  bool contains(T x) const {
+    return x / WordBits < words.size() &&
+           (words[x / WordBits] >> (x % WordBits) & 1);
+  }
+
+  iterator begin() const { return iterator(&words, 0); }
+  iterator end() const { return iterator(&words, words.size()); }
+
+  void print(llvm::raw_ostream &os) const {
+    bool first = true;
+    os << "{";
+    for (T x : *this) {
+      if (first) {
+        first = false;
+      } else {
+        os << ",";
+      }
+      os << x;
+    }
+    os << "}";
+  }
+};
+
+template <class T>
+inline llvm::raw_ostream &operator<<(llvm::raw_ostream &os,
+                                     const DenseSet<T> &dis) {
+  dis.print(os);
+  return os;
+}
+
+} // namespace klee
+
+#endif /* KLEE_DENSESET_H */
@@ -54,6 +54,36 @@ extern "C" {
 
   void  kTest_free(KTest *);
 
+  /* An archive of many tests in a single file, to which tests are appended
+     and from which they are read by their index. */
+  typedef struct KTestArchive KTestArchive;
+
+  /* return true iff file at path matches KTestArchive header */
+  int   kTest_isKTestArchive(const char *path);
+
+  /* opens the archive for reading, or for appending if writable is set, in
+     which case it is created if it does not exist; returns NULL on
+     (unspecified) error */
+  KTestArchive *kTestArchive_open(const char *path, int writable);
+
+  /* returns the number of tests in the archive */
+  unsigned kTestArchive_numTests(KTestArchive *);
+
+  /* returns the id the test at index was appended with */
+  unsigned kTestArchive_getID(KTestArchive *, unsigned index);
+
+  /* returns NULL on (unspecified) error */
+  KTest* kTestArchive_read(KTestArchive *, unsigned index);
+
+  /* appends the test with the given id, compressed if requested and KLEE
+     was built with zlib; returns 1 on success, 0 on (unspecified) error */
+  int   kTestArchive_append(KTestArchive *, KTest *, unsigned id,
+                            int compressed);
+
+  /* writes the index of a writable archive and closes it; returns 1 on
+     success, 0 on (unspecified) error */
+  int   kTestArchive_close(KTestArchive *);
+
 #ifdef __cplusplus
 }
 #endif
@@ -47,6 +47,27 @@ public:
                                const char *err,
                                const char *suffix,
                                uint32_t) = 0;
+
+  /// Called before a worker process is forked, to write out everything
+  /// which both processes would otherwise write.
+  virtual void prepareFork() = 0;
+
+  /// Called in a worker process forked for parallel exploration, which
+  /// from now on writes its output separately from its parent.
+  virtual void startWorker(unsigned id) = 0;
+
+  /// Called at the end of a worker process. Returns what the process which
+  /// forked the worker passes to mergeWorker().
+  virtual std::string finishWorker() = 0;
+
+  /// Merge the output of worker \a id, which was forked by this process,
+  /// given the result of its finishWorker().
+  virtual void mergeWorker(unsigned id, const std::string &summary) = 0;
+
+  /// Called with states which the interpreter hands over to another
+  /// process instead of exploring them (see Interpreter::requestDonation).
+  /// The states are removed from the interpreter after this returns.
+  virtual void donateStates(const std::vector<const ExecutionState *> &states) = 0;
 };
 
 class Interpreter {
@@ -130,6 +151,11 @@ public:
   // a user specified path. use null to reset.
   virtual void setReplayPath(const std::vector<bool> *path) = 0;
 
+  // supply a list of branch decisions to follow from the start, after
+  // which the interpretation explores the rest of the subtree as
+  // usual. states leaving the path are dropped. use null to reset.
+  virtual void setReplayPathPrefix(const std::vector<bool> *path) = 0;
+
   // supply a set of symbolic bindings that will be used as "seeds"
   // for the search. use null to reset.
   virtual void useSeeds(const std::vector<struct KTest *> *seeds) = 0;
@@ -145,6 +171,28 @@ public:
 
   virtual void setInhibitForking(bool value) = 0;
 
+  /// Hand all states which branched at least \a depth times to the
+  /// InterpreterHandler instead of exploring them. Zero disables this.
+  virtual void setDonationDepth(unsigned depth) = 0;
+
+  /// Ask the interpreter to hand about half of its states to the
+  /// InterpreterHandler at the next instruction. Safe to call from a signal
+  /// handler. Every request is answered by exactly one call to
+  /// InterpreterHandler::donateStates, possibly without any states.
+  virtual void requestDonation() = 0;
+
+  /// Continue in a worker process forked by the caller, which writes its
+  /// output separately from its parent (see InterpreterHandler::startWorker).
+  virtual void startWorker(unsigned id) = 0;
+
+  /// Share -max-instructions, -max-memory and halting with the worker
+  /// processes which the caller forks from now on.
+  virtual void shareLimitsWithWorkers() = 0;
+
+  /// Whether this process or, after shareLimitsWithWorkers(), any worker
+  /// halted exploration.
+  virtual bool getHaltExecution() = 0;
+
   virtual void prepareForEarlyExit() = 0;
 
   /*** State accessor methods ***/
@@ -165,6 +213,14 @@ public:
 
   virtual void getCoveredLines(const ExecutionState &state,
                                std::map<const std::string*, std::set<unsigned> > &res) = 0;
+
+  /// Get the IDs of all instructions covered so far.
+  virtual void getCoveredInstructions(std::vector<unsigned> &res) = 0;
+
+  /// Mark the instructions with the given IDs as covered, e.g. when merging
+  /// the coverage of another process running the same module, and rewrite
+  /// the statistics files.
+  virtual void mergeCoveredInstructions(const std::vector<unsigned> &ids) = 0;
 };
 
 } // End klee namespace
@@ -13,7 +13,9 @@
 #include "klee/Expr/Expr.h"
 #include "klee/Expr/ArrayExprHash.h" // For klee::ArrayHashFn
 
+#include <cstdint>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -59,6 +61,16 @@ public:
                            Expr::Width _domain = Expr::Int32,
                            Expr::Width _range = Expr::Int8);
 
+  /// Create a constant array of bytes, or return the one created by an
+  /// earlier call with the same contents. \param _name is only used if a new
+  /// array is created.
+  const Array *CreateConstantArray(const std::string &_name,
+                                   const std::vector<uint8_t> &contents);
+
+  /// Return the array created by CreateConstantArray with these contents, or
+  /// null if there is none.
+  const Array *findConstantArray(const std::vector<uint8_t> &contents) const;
+
 private:
   typedef std::unordered_set<const Array *, klee::ArrayHashFn,
                              klee::EquivArrayCmpFn>
@@ -66,6 +78,10 @@ private:
   ArrayHashMap cachedSymbolicArrays;
   typedef std::vector<const Array *> ArrayPtrVec;
   ArrayPtrVec concreteArrays;
+  /// The arrays of CreateConstantArray, by the hash of their contents.
+  std::unordered_multimap<std::size_t, const Array *> cachedConstantArrays;
+  /// The byte constants shared by the arrays of CreateConstantArray.
+  std::vector<ref<ConstantExpr>> byteConstants;
 };
 }
 
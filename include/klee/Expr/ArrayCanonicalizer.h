@@ -0,0 +1,77 @@
+//===-- ArrayCanonicalizer.h ------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_ARRAYCANONICALIZER_H
+#define KLEE_ARRAYCANONICALIZER_H
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprHashMap.h"
+
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace klee {
+
+/// CanonicalArrayCache - Provides the arrays which ArrayCanonicalizer renames
+/// to. The same cache always hands out the same array for a given number and
+/// shape, so that queries which are equal up to the names of their arrays
+/// become equal expressions.
+class CanonicalArrayCache {
+  typedef std::tuple<unsigned, unsigned, Expr::Width, Expr::Width> Shape;
+
+  ArrayCache arrayCache;
+  std::map<Shape, std::vector<const Array *>> arrays;
+
+public:
+  /// Get the canonical array number \a id with the size, domain, range and
+  /// constant contents of \a array.
+  const Array *get(unsigned id, const Array *array);
+};
+
+/// ArrayCanonicalizer - Renames the arrays of expressions to canonical arrays,
+/// numbered in order of first occurrence.
+///
+/// The numbering continues across calls, so a query is canonicalized by
+/// visiting its constraints and then its expression with the same
+/// canonicalizer. The mapping is kept in both directions, so results for the
+/// canonical arrays (e.g. models) can be mapped back to the original ones.
+class ArrayCanonicalizer {
+  CanonicalArrayCache &cache;
+  std::unordered_map<const Array *, const Array *> toCanonical;
+  std::unordered_map<const Array *, const Array *> toOriginal;
+  ExprHashMap<ref<Expr>> visitedExprs;
+  std::unordered_map<const UpdateNode *, ref<UpdateNode>> visitedUpdates;
+
+  const Array *rename(const Array *array);
+  UpdateList visitUpdates(const UpdateList &ul);
+
+public:
+  explicit ArrayCanonicalizer(CanonicalArrayCache &cache) : cache(cache) {}
+
+  /// Rename the arrays in \a e.
+  ref<Expr> visit(const ref<Expr> &e);
+
+  /// Rename the arrays in all of \a constraints.
+  ConstraintSet visit(const ConstraintSet &constraints);
+
+  /// Get the canonical array for \a array, or null if \a array did not occur
+  /// in any of the visited expressions.
+  const Array *getCanonical(const Array *array) const;
+
+  /// Get the array which was renamed to \a canonical, or null if none was.
+  const Array *getOriginal(const Array *canonical) const;
+};
+
+} // namespace klee
+
+#endif /* KLEE_ARRAYCANONICALIZER_H */
@@ -0,0 +1,75 @@
+//===-- ConstraintPartition.h -----------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_CONSTRAINTPARTITION_H
+#define KLEE_CONSTRAINTPARTITION_H
+
+#include "klee/Expr/Expr.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace klee {
+
+class Array;
+
+/// ConstraintPartition - Partitions constraints into independent factors.
+///
+/// Two constraints are in the same factor if they read a common byte of an
+/// array, where a read at a symbolic index reads every byte of the array, or
+/// if both are in the same factor as a third constraint. The factors are
+/// maintained with union-find over the bytes and arrays which are read, so
+/// adding a constraint only looks at the reads of that constraint.
+class ConstraintPartition {
+  /// Nodes of the union-find structure.
+  typedef unsigned Node;
+  static constexpr Node NoNode = ~0u;
+
+  /// The nodes for the bytes of an array which have been read at constant
+  /// indices, or a single node for the whole array once it has been read at
+  /// a symbolic index.
+  struct ArrayNodes {
+    Node whole = NoNode;
+    std::unordered_map<unsigned, Node> elements;
+  };
+
+  std::unordered_map<const Array *, ArrayNodes> arrays;
+
+  /// The parent of each node. Paths are compressed on lookup, which does not
+  /// change the partition.
+  mutable std::vector<Node> parents;
+
+  /// The indices of the constraints of each factor, kept at its root.
+  std::vector<std::vector<unsigned>> members;
+
+  Node createNode();
+  Node find(Node node) const;
+  Node unite(Node a, Node b);
+  Node getWholeNode(const Array *array);
+  Node getElementNode(const Array *array, unsigned index);
+
+public:
+  static constexpr unsigned NoIndex = ~0u;
+
+  /// Add \a constraint, which is the constraint number \a index.
+  void add(const ref<Expr> &constraint, unsigned index);
+
+  /// Get the indices of the constraints in the factors which \a e reads
+  /// from, in increasing order.
+  void getDependent(const ref<Expr> &e, std::vector<unsigned> &result) const;
+
+  /// Make constraint i the constraint number \a newIndices[i], or drop it if
+  /// that is NoIndex. Factors are never split, so dropping a constraint may
+  /// leave factors merged which no longer need to be.
+  void renumber(const std::vector<unsigned> &newIndices);
+};
+
+} // namespace klee
+
+#endif /* KLEE_CONSTRAINTPARTITION_H */
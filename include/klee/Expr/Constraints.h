@@ -12,17 +12,127 @@
 
 #include "klee/Expr/Expr.h"
 
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <vector>
+
 namespace klee {
 
+class ConstraintPartition;
+
 /// Resembles a set of constraints that can be passed around
 ///
+/// The constraints are kept in a persistent list of fixed-size chunks, so
+/// copies (e.g. when an ExecutionState forks) share all constraints added so
+/// far and copying takes constant time. A copy only copies the constraints of
+/// its last, partially filled chunk once both the copy and the original have
+/// been extended.
+///
+/// Each chunk also records the hash of the constraints up to each of its
+/// constraints, so that hashing a set takes constant time.
+///
+/// Once getDependentConstraints() has been called, the set also maintains a
+/// partition of its constraints into independent factors, which copies share
+/// until they are extended.
 class ConstraintSet {
   friend class ConstraintManager;
 
+  /// Chunk - A block of up to ChunkSize constraints which follow the
+  /// constraints of its parent. Constraints are only ever appended, so all
+  /// sets which share a chunk see a prefix of its constraints.
+  struct Chunk {
+    static constexpr size_t ChunkSize = 32;
+
+    class ReferenceCounter _refCount;
+    const ref<Chunk> parent;
+    std::vector<ref<Expr>> items;
+    /// hashes[i] is the hash of the constraints up to and including items[i]
+    std::vector<std::size_t> hashes;
+
+    explicit Chunk(ref<Chunk> parent) : parent(std::move(parent)) {
+      // Never reallocate, so that sharing sets can keep iterating.
+      items.reserve(ChunkSize);
+      hashes.reserve(ChunkSize);
+    }
+  };
+
 public:
   using constraints_ty = std::vector<ref<Expr>>;
-  using iterator = constraints_ty::iterator;
-  using const_iterator = constraints_ty::const_iterator;
+
+  /// A random access iterator over the constraints, in the order in which
+  /// they were added. Like vector iterators, they are invalidated by
+  /// push_back().
+  class const_iterator {
+    friend class ConstraintSet;
+
+    const std::vector<const Chunk *> *chunks = nullptr;
+    size_t index = 0;
+
+    const_iterator(const std::vector<const Chunk *> *chunks, size_t index)
+        : chunks(chunks), index(index) {}
+
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = ref<Expr>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const ref<Expr> *;
+    using reference = const ref<Expr> &;
+
+    const_iterator() = default;
+
+    reference operator*() const {
+      return (*chunks)[index / Chunk::ChunkSize]
+          ->items[index % Chunk::ChunkSize];
+    }
+    pointer operator->() const { return &**this; }
+    reference operator[](difference_type n) const { return *(*this + n); }
+
+    const_iterator &operator++() {
+      ++index;
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator old = *this;
+      ++index;
+      return old;
+    }
+    const_iterator &operator--() {
+      --index;
+      return *this;
+    }
+    const_iterator operator--(int) {
+      const_iterator old = *this;
+      --index;
+      return old;
+    }
+    const_iterator &operator+=(difference_type n) {
+      index += n;
+      return *this;
+    }
+    const_iterator &operator-=(difference_type n) {
+      index -= n;
+      return *this;
+    }
+    const_iterator operator+(difference_type n) const {
+      return const_iterator(chunks, index + n);
+    }
+    const_iterator operator-(difference_type n) const {
+      return const_iterator(chunks, index - n);
+    }
+    difference_type operator-(const const_iterator &b) const {
+      return static_cast<difference_type>(index) -
+             static_cast<difference_type>(b.index);
+    }
+
+    bool operator==(const const_iterator &b) const { return index == b.index; }
+    bool operator!=(const const_iterator &b) const { return index != b.index; }
+    bool operator<(const const_iterator &b) const { return index < b.index; }
+    bool operator>(const const_iterator &b) const { return index > b.index; }
+    bool operator<=(const const_iterator &b) const { return index <= b.index; }
+    bool operator>=(const const_iterator &b) const { return index >= b.index; }
+  };
+  using iterator = const_iterator;
 
   using constraint_iterator = const_iterator;
 
@@ -31,17 +141,58 @@ public:
   constraint_iterator end() const;
   size_t size() const noexcept;
 
-  explicit ConstraintSet(constraints_ty cs) : constraints(std::move(cs)) {}
+  explicit ConstraintSet(const constraints_ty &cs);
   ConstraintSet() = default;
 
+  // Copies share the chunks, but not the index into them.
+  ConstraintSet(const ConstraintSet &b)
+      : last(b.last), count(b.count), partition(b.partition) {}
+  ConstraintSet &operator=(const ConstraintSet &b) {
+    last = b.last;
+    count = b.count;
+    chunks.clear();
+    partition = b.partition;
+    return *this;
+  }
+  ConstraintSet(ConstraintSet &&) = default;
+  ConstraintSet &operator=(ConstraintSet &&) = default;
+  ~ConstraintSet();
+
   void push_back(const ref<Expr> &e);
 
-  bool operator==(const ConstraintSet &b) const {
-    return constraints == b.constraints;
-  }
+  bool operator==(const ConstraintSet &b) const;
+
+  /// A structural hash of the constraints and their order, in constant time.
+  std::size_t hash() const;
+
+  /// Get the constraints which are not independent of \a e, in the order in
+  /// which they were added. A constraint is independent of \a e if it has no
+  /// array byte in common with \a e or with a constraint which is not. The
+  /// factors are not split when equalities are rewritten, so the result may
+  /// include constraints which only became independent then.
+  void getDependentConstraints(const ref<Expr> &e,
+                               std::vector<ref<Expr>> &result) const;
 
 private:
-  constraints_ty constraints;
+  /// The chunk holding the last constraint, or null if the set is empty.
+  ref<Chunk> last;
+
+  /// The number of constraints in the set.
+  size_t count = 0;
+
+  /// The chunks from first to last, built on demand for iteration.
+  mutable std::vector<const Chunk *> chunks;
+
+  /// The independent factors of the constraints, built on demand and copied
+  /// before a shared partition is extended.
+  mutable std::shared_ptr<ConstraintPartition> partition;
+
+  const std::vector<const Chunk *> &getChunks() const;
+
+  /// Take over \a partition, the partition of \a old, after the constraints
+  /// of \a old were rewritten into this set.
+  void adoptPartition(std::shared_ptr<ConstraintPartition> partition,
+                      const ConstraintSet &old);
 };
 
 class ExprVisitor;
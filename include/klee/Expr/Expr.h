@@ -20,6 +20,7 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <cstddef>
 #include <map>
 #include <set>
 #include <sstream>
@@ -96,6 +97,16 @@ Todo: Shouldn't bool \c Xor just be written as not equal?
 class Expr {
 public:
   static unsigned count;
+
+  /// Whether expressions are hash-consed (-hash-cons-exprs): the alloc()
+  /// methods then return the live expression equal to the one requested if
+  /// there is one, so that equal expressions are pointer-equal and
+  /// compare() and ExprHashMap lookups stop at the first node. Expressions
+  /// are also allocated from free lists per size from then on.
+  ///
+  /// Like the rest of Expr, this is not thread-safe.
+  static bool hashConsing;
+
   static const unsigned MAGIC_HASH_CONSTANT = 39;
 
   /// The type of an expression is simply its width, in bits.
@@ -238,10 +249,18 @@ protected:
   /// `<` and `>` are binary relations that express the partial order.
   virtual int compareContents(const Expr &b) const = 0;
 
+  /// Return the live expression equal to \a e, which has just been
+  /// allocated, if expressions are hash-consed and there is one; otherwise
+  /// return \a e.
+  static ref<Expr> unique(const ref<Expr> &e);
+
 public:
   Expr() { Expr::count++; }
 
-  virtual ~Expr() { Expr::count--; }
+  virtual ~Expr();
+
+  static void *operator new(std::size_t size);
+  static void operator delete(void *p, std::size_t size);
 
   virtual Kind getKind() const = 0;
 
@@ -474,7 +493,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &src) {
     ref<Expr> r(new NotOptimizedExpr(src));
     r->computeHash();
-    return r;
+    return unique(r);
   }
 
   static ref<Expr> create(ref<Expr> src);
@@ -649,7 +668,7 @@ public:
   static ref<Expr> alloc(const UpdateList &updates, const ref<Expr> &index) {
     ref<Expr> r(new ReadExpr(updates, index));
     r->computeHash();
-    return r;
+    return unique(r);
   }
 
   static ref<Expr> create(const UpdateList &updates, ref<Expr> i);
@@ -699,7 +718,7 @@ public:
                          const ref<Expr> &f) {
     ref<Expr> r(new SelectExpr(c, t, f));
     r->computeHash();
-    return r;
+    return unique(r);
   }
 
   static ref<Expr> create(ref<Expr> c, ref<Expr> t, ref<Expr> f);
@@ -766,7 +785,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {
     ref<Expr> c(new ConcatExpr(l, r));
     c->computeHash();
-    return c;
+    return unique(c);
   }
 
   static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);
@@ -844,7 +863,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &e, unsigned o, Width w) {
     ref<Expr> r(new ExtractExpr(e, o, w));
     r->computeHash();
-    return r;
+    return unique(r);
   }
 
   /// Creates an ExtractExpr with the given bit offset and width
@@ -898,7 +917,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &e) {
     ref<Expr> r(new NotExpr(e));
     r->computeHash();
-    return r;
+    return unique(r);
   }
 
   static ref<Expr> create(const ref<Expr> &e);
@@ -977,7 +996,7 @@ public:
     static ref<Expr> alloc(const ref<Expr> &e, Width w) {                      \
       ref<Expr> r(new _class_kind##Expr(e, w));                                \
       r->computeHash();                                                        \
-      return r;                                                                \
+      return unique(r);                                                        \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &e, Width w);                      \
     Kind getKind() const { return _class_kind; }                               \
@@ -1011,7 +1030,7 @@ CAST_EXPR_CLASS(FPExt)
                            llvm::APFloat::roundingMode rm) {                   \
       ref<Expr> r(new _class_kind##Expr(e, w, rm));                            \
       r->computeHash();                                                        \
-      return r;                                                                \
+      return unique(r);                                                        \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &e, Width w,                       \
                             llvm::APFloat::roundingMode rm);                   \
@@ -1057,7 +1076,7 @@ FP_CAST_EXPR_CLASS(SIToFP)
     static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {           \
       ref<Expr> res(new _class_kind##Expr(l, r));                              \
       res->computeHash();                                                      \
-      return res;                                                              \
+      return unique(res);                                                      \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);           \
     Width getWidth() const { return left->getWidth(); }                        \
@@ -1107,7 +1126,7 @@ ARITHMETIC_EXPR_CLASS(AShr)
                            const llvm::APFloat::roundingMode rm) {             \
       ref<Expr> res(new _class_kind##Expr(l, r, rm));                          \
       res->computeHash();                                                      \
-      return res;                                                              \
+      return unique(res);                                                      \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r,            \
                             llvm::APFloat::roundingMode rm);                   \
@@ -1153,7 +1172,7 @@ FLOAT_ARITHMETIC_EXPR_CLASS(FMin)
     static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {           \
       ref<Expr> res(new _class_kind##Expr(l, r));                              \
       res->computeHash();                                                      \
-      return res;                                                              \
+      return unique(res);                                                      \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);           \
     Kind getKind() const { return _class_kind; }                               \
@@ -1199,7 +1218,7 @@ COMPARISON_EXPR_CLASS(FOGe)
     static ref<Expr> alloc(const ref<Expr> &e) {                               \
       ref<Expr> r(new _class_kind##Expr(e));                                   \
       r->computeHash();                                                        \
-      return r;                                                                \
+      return unique(r);                                                        \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &e);                               \
                                                                                \
@@ -1244,7 +1263,7 @@ FP_PRED_EXPR_CLASS(IsSubnormal)
                            const llvm::APFloat::roundingMode rm) {             \
       ref<Expr> r(new _class_kind##Expr(e, rm));                               \
       r->computeHash();                                                        \
-      return r;                                                                \
+      return unique(r);                                                        \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &e,                                \
                             const llvm::APFloat::roundingMode rm);             \
@@ -1290,7 +1309,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &e) {
     ref<Expr> r(new FAbsExpr(e));
     r->computeHash();
-    return r;
+    return unique(r);
   }
   static ref<Expr> create(const ref<Expr> &e);
 
@@ -1322,7 +1341,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &e) {
     ref<Expr> r(new FNegExpr(e));
     r->computeHash();
-    return r;
+    return unique(r);
   }
   static ref<Expr> create(const ref<Expr> &e);
 
@@ -1428,13 +1447,13 @@ public:
   static ref<ConstantExpr> alloc(const llvm::APInt &v) {
     ref<ConstantExpr> r(new ConstantExpr(v));
     r->computeHash();
-    return r;
+    return cast<ConstantExpr>(unique(r));
   }
 
   static ref<ConstantExpr> alloc(const llvm::APFloat &f) {
     ref<ConstantExpr> r(new ConstantExpr(f));
     r->computeHash();
-    return r;
+    return cast<ConstantExpr>(unique(r));
   }
 
   static ref<ConstantExpr> alloc(uint64_t v, Width w) {
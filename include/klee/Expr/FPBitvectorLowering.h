@@ -0,0 +1,39 @@
+//===-- FPBitvectorLowering.h -----------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_FPBITVECTORLOWERING_H
+#define KLEE_FPBITVECTORLOWERING_H
+
+#include "klee/Expr/Expr.h"
+
+namespace klee {
+
+/// isLowerableFloatingPoint - Return true if \a e is a floating point
+/// operation which lowerFloatingPoint() can rewrite.
+bool isLowerableFloatingPoint(const ref<Expr> &e);
+
+/// lowerFloatingPoint - Rewrite the floating point operation at the root of
+/// \a e into an equivalent expression which only uses bitvector operations
+/// over the IEEE-754 (or x87 fp80) bit patterns of its operands.
+///
+/// Only the root is rewritten, the operands are used as they are, so
+/// bitvector-only solver builders should call this again for any floating
+/// point operations they reach while constructing the result.
+///
+/// The lowering follows the Z3 backend where IEEE-754 leaves the result
+/// unspecified: NaN results use the bit pattern of ConstantExpr::GetNaN(),
+/// FMin and FMax return the other operand if one of them is NaN, and out of
+/// range conversions to integers saturate like llvm::APFloat. FRem is the
+/// IEEE-754 remainder like Z3's fp.rem, which rounds the quotient to nearest
+/// rather than truncating it like the constant folding in llvm::APFloat::mod.
+ref<Expr> lowerFloatingPoint(const ref<Expr> &e);
+
+} // namespace klee
+
+#endif /* KLEE_FPBITVECTORLOWERING_H */
@@ -23,12 +23,16 @@ namespace klee {
     const char SOLVER_QUERIES_SMT2_FILE_NAME[]="solver-queries.smt2";
     const char ALL_QUERIES_KQUERY_FILE_NAME[]="all-queries.kquery";
     const char SOLVER_QUERIES_KQUERY_FILE_NAME[]="solver-queries.kquery";
+    const char PERSISTENT_QUERY_CACHE_FILE_NAME[]="query-cache.sqlite";
 
+    /// \param persistentQueryCachePath - The query cache database to use if
+    /// -use-persistent-query-cache is given without a path.
     Solver *constructSolverChain(Solver *coreSolver,
                                  std::string querySMT2LogPath,
                                  std::string baseSolverQuerySMT2LogPath,
                                  std::string queryKQueryLogPath,
-                                 std::string baseSolverQueryKQueryLogPath);
+                                 std::string baseSolverQueryKQueryLogPath,
+                                 std::string persistentQueryCachePath);
 }
 
 
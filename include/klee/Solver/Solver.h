@@ -14,6 +14,9 @@
 #include "klee/System/Time.h"
 #include "klee/Solver/SolverCmdLine.h"
 
+#include <cstddef>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace klee {
@@ -53,6 +56,11 @@ namespace klee {
       return withExpr(Expr::createIsZero(expr));
     }
 
+    /// A structural hash of the constraints and the expression. It takes
+    /// constant time, so cache layers can key on it without walking the
+    /// constraints.
+    std::size_t hash() const;
+
     /// Dump query
     void dump() const ;
   };
@@ -243,6 +251,14 @@ namespace klee {
   /// \param s - The underlying solver to use.
   Solver *createCexCachingSolver(Solver *s);
 
+  /// createPersistentCachingSolver - Create a solver which caches query
+  /// results in an SQLite database at \a path, so that they are reused by
+  /// later runs. Queries are matched independently of array names.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param path - The database file, which is created if needed.
+  Solver *createPersistentCachingSolver(Solver *s, const std::string &path);
+
   /// createFastCexSolver - Create a "fast counterexample solver", which tries
   /// to quickly compute a satisfying assignment for a constraint set using
   /// value propogation and range analysis.
@@ -274,6 +290,14 @@ namespace klee {
   /// fails.
   Solver *createDummySolver();
 
+  /// createPortfolioSolver - Create a solver which races all of the given
+  /// solvers on every query, each in its own forked process, and returns the
+  /// first successful answer. The portfolio takes ownership of the solvers.
+  ///
+  /// \param solvers - The solvers to race, each with a name for reporting.
+  Solver *
+  createPortfolioSolver(std::vector<std::pair<std::string, Solver *>> solvers);
+
   // Create a solver based on the supplied ``CoreSolverType``.
   Solver *createCoreSolver(CoreSolverType cst);
 }
@@ -24,6 +24,8 @@ namespace stats {
   extern Statistic queryCexCacheHits;
   extern Statistic queryCexCacheMisses;
   extern Statistic queryConstructs;
+  extern Statistic queryPersistentCacheHits;
+  extern Statistic queryPersistentCacheMisses;
   extern Statistic queryCounterexamples;
   extern Statistic queryTime;
   
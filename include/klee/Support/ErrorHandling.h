@@ -23,6 +23,9 @@ namespace klee {
 extern FILE *klee_warning_file;
 extern FILE *klee_message_file;
 
+// The functions below may be called from any thread, their lines are not
+// interleaved.
+
 /// Print "KLEE: ERROR: " followed by the msg in printf format and a
 /// newline on stderr and to warnings.txt, then exit with an error.
 void klee_error(const char *msg, ...)
@@ -12,10 +12,47 @@
 #include "llvm/ADT/APFloat.h"
 #include "llvm/Support/ErrorHandling.h"
 
+#include <cfenv>
+#include <cstdint>
+
 namespace klee {
 
+    /// HostRoundingModeScope - Sets the rounding mode of the host floating
+    /// point environment for the lifetime of the object and restores the
+    /// environment afterwards.
+    ///
+    /// Native evaluations open a scope around every operation. Scopes nested
+    /// in a scope with the same rounding mode do not touch the environment,
+    /// so a run of operations under one rounding mode shares a single switch
+    /// when the caller opens a scope around it. Round to nearest, the host's
+    /// default, needs no switch at all.
+    class HostRoundingModeScope {
+      fenv_t oldEnv;
+      int previousMode;
+      bool switched;
+
+    public:
+      explicit HostRoundingModeScope(llvm::APFloat::roundingMode rm);
+      ~HostRoundingModeScope();
+
+      HostRoundingModeScope(const HostRoundingModeScope &) = delete;
+      HostRoundingModeScope &operator=(const HostRoundingModeScope &) = delete;
+
+      /// The number of times the host environment was switched so far.
+      static std::uint64_t getNumSwitches();
+    };
+
+
     llvm::APFloat evalSqrt(const llvm::APFloat &v, llvm::APFloat::roundingMode rm);
 
+    /// The libm functions which evalLibmFunction() can evaluate natively.
+    enum class LibmFunction { Exp, Log, Sin, Cos, Tan, Pow };
+
+    /// Evaluate \a function with the host's libm. \a y is only used by Pow.
+    llvm::APFloat evalLibmFunction(LibmFunction function, const llvm::APFloat &x,
+                                   const llvm::APFloat &y,
+                                   llvm::APFloat::roundingMode rm);
+
 #if defined(__x86_64__) || defined(__i386__)
     long double GetNativeX87FP80FromLLVMAPInt(const llvm::APInt &apint);
     llvm::APInt GetAPIntFromLongDouble(long double ld);
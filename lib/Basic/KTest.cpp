@@ -8,10 +8,18 @@
 //===----------------------------------------------------------------------===//
 
 #include "klee/ADT/KTest.h"
+#include "klee/Config/config.h"
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif
 
 #define KTEST_VERSION 3
 #define KTEST_MAGIC_SIZE 5
@@ -20,6 +28,17 @@
 // for compatibility reasons
 #define BOUT_MAGIC "BOUT\n"
 
+#define KTEST_ARCHIVE_VERSION 1
+#define KTEST_ARCHIVE_MAGIC_SIZE 8
+#define KTEST_ARCHIVE_MAGIC "KARCHIVE"
+// tags of the records, the index and the end of the index
+#define KTEST_ARCHIVE_TAG_SIZE 4
+#define KTEST_ARCHIVE_RECORD "KREC"
+#define KTEST_ARCHIVE_INDEX "KIDX"
+#define KTEST_ARCHIVE_END "KEND"
+// record flags
+#define KTEST_ARCHIVE_COMPRESSED 1
+
 /***/
 
 static int read_uint32(FILE *f, unsigned *value_out) {
@@ -91,13 +110,10 @@ int kTest_isKTestFile(const char *path) {
   return res;
 }
 
-KTest *kTest_fromFile(const char *path) {
-  FILE *f = fopen(path, "rb");
+static KTest *kTest_read(FILE *f) {
   KTest *res = 0;
   unsigned i, version;
 
-  if (!f) 
-    goto error;
   if (!kTest_checkHeader(f)) 
     goto error;
 
@@ -146,8 +162,6 @@ KTest *kTest_fromFile(const char *path) {
       goto error;
   }
 
-  fclose(f);
-
   return res;
  error:
   if (res) {
@@ -170,17 +184,24 @@ KTest *kTest_fromFile(const char *path) {
     free(res);
   }
 
-  if (f) fclose(f);
-
   return 0;
 }
 
-int kTest_toFile(KTest *bo, const char *path) {
-  FILE *f = fopen(path, "wb");
+KTest *kTest_fromFile(const char *path) {
+  FILE *f = fopen(path, "rb");
+  KTest *res;
+
+  if (!f)
+    return 0;
+  res = kTest_read(f);
+  fclose(f);
+
+  return res;
+}
+
+static int kTest_write(FILE *f, KTest *bo) {
   unsigned i;
 
-  if (!f) 
-    goto error;
   if (fwrite(KTEST_MAGIC, strlen(KTEST_MAGIC), 1, f)!=1)
     goto error;
   if (!write_uint32(f, KTEST_VERSION))
@@ -210,15 +231,23 @@ int kTest_toFile(KTest *bo, const char *path) {
       goto error;
   }
 
-  fclose(f);
-
   return 1;
  error:
-  if (f) fclose(f);
-  
   return 0;
 }
 
+int kTest_toFile(KTest *bo, const char *path) {
+  FILE *f = fopen(path, "wb");
+
+  if (!f)
+    return 0;
+  if (!kTest_write(f, bo)) {
+    fclose(f);
+    return 0;
+  }
+  return fclose(f) == 0;
+}
+
 unsigned kTest_numBytes(KTest *bo) {
   unsigned i, res = 0;
   for (i=0; i<bo->numObjects; i++)
@@ -238,3 +267,294 @@ void kTest_free(KTest *bo) {
   free(bo->objects);
   free(bo);
 }
+
+/***/
+
+/* An archive is a header followed by records, each holding the image of a
+   .ktest file which may be compressed:
+
+     "KREC" id flags storedSize size bytes[storedSize]
+
+   On closing, an index of the offsets of the records is appended:
+
+     "KIDX" numTests { id offset }* indexOffset "KEND"
+
+   where offsets are 64 bit. The index is dropped again when the archive is
+   reopened for appending. Archives without a valid index, e.g. of a killed
+   process, are indexed by scanning the records. */
+
+struct KTestArchive {
+  FILE *f;
+  int writable;
+  unsigned numTests, capacity;
+  unsigned *ids;
+  off_t *offsets;
+};
+
+static int read_uint64(FILE *f, off_t *value_out) {
+  unsigned hi, lo;
+  if (!read_uint32(f, &hi) || !read_uint32(f, &lo))
+    return 0;
+  *value_out = (off_t) (((unsigned long long) hi << 32) | lo);
+  return 1;
+}
+
+static int write_uint64(FILE *f, off_t value) {
+  return write_uint32(f, (unsigned long long) value >> 32) &&
+         write_uint32(f, (unsigned) value);
+}
+
+static int read_tag(FILE *f, const char *tag) {
+  char data[KTEST_ARCHIVE_TAG_SIZE];
+  if (fread(data, KTEST_ARCHIVE_TAG_SIZE, 1, f)!=1)
+    return 0;
+  return memcmp(data, tag, KTEST_ARCHIVE_TAG_SIZE) == 0;
+}
+
+static int kTestArchive_checkHeader(FILE *f) {
+  char header[KTEST_ARCHIVE_MAGIC_SIZE];
+  unsigned version;
+  if (fread(header, KTEST_ARCHIVE_MAGIC_SIZE, 1, f)!=1)
+    return 0;
+  if (memcmp(header, KTEST_ARCHIVE_MAGIC, KTEST_ARCHIVE_MAGIC_SIZE))
+    return 0;
+  if (!read_uint32(f, &version))
+    return 0;
+  return version <= KTEST_ARCHIVE_VERSION;
+}
+
+static int kTestArchive_add(KTestArchive *a, unsigned id, off_t offset) {
+  if (a->numTests == a->capacity) {
+    unsigned capacity = a->capacity ? 2 * a->capacity : 64;
+    unsigned *ids = (unsigned*) realloc(a->ids, capacity * sizeof(*ids));
+    if (!ids)
+      return 0;
+    a->ids = ids;
+    off_t *offsets = (off_t*) realloc(a->offsets, capacity * sizeof(*offsets));
+    if (!offsets)
+      return 0;
+    a->offsets = offsets;
+    a->capacity = capacity;
+  }
+  a->ids[a->numTests] = id;
+  a->offsets[a->numTests] = offset;
+  ++a->numTests;
+  return 1;
+}
+
+/* Read the index at the end of the archive. Sets *end to where the index
+   starts. */
+static int kTestArchive_readIndex(KTestArchive *a, off_t *end) {
+  off_t offset;
+  unsigned i, numTests, id;
+
+  if (fseeko(a->f, -(8 + KTEST_ARCHIVE_TAG_SIZE), SEEK_END) ||
+      !read_uint64(a->f, &offset) || !read_tag(a->f, KTEST_ARCHIVE_END))
+    return 0;
+  if (fseeko(a->f, offset, SEEK_SET) || !read_tag(a->f, KTEST_ARCHIVE_INDEX) ||
+      !read_uint32(a->f, &numTests))
+    return 0;
+  for (i=0; i<numTests; i++) {
+    off_t record;
+    if (!read_uint32(a->f, &id) || !read_uint64(a->f, &record) ||
+        !kTestArchive_add(a, id, record)) {
+      a->numTests = 0;
+      return 0;
+    }
+  }
+  *end = offset;
+  return 1;
+}
+
+/* Index the archive by reading the headers of its records. Sets *end to the
+   end of the last complete record. */
+static int kTestArchive_scan(KTestArchive *a, off_t *end) {
+  off_t offset = KTEST_ARCHIVE_MAGIC_SIZE + 4, size;
+  unsigned id, flags, storedSize, rawSize;
+
+  if (fseeko(a->f, 0, SEEK_END))
+    return 0;
+  size = ftello(a->f);
+  while (fseeko(a->f, offset, SEEK_SET) == 0 &&
+         read_tag(a->f, KTEST_ARCHIVE_RECORD) && read_uint32(a->f, &id) &&
+         read_uint32(a->f, &flags) && read_uint32(a->f, &storedSize) &&
+         read_uint32(a->f, &rawSize)) {
+    off_t next = ftello(a->f) + storedSize;
+    if (next > size)
+      break;
+    if (!kTestArchive_add(a, id, offset))
+      return 0;
+    offset = next;
+  }
+  *end = offset;
+  return 1;
+}
+
+int kTest_isKTestArchive(const char *path) {
+  FILE *f = fopen(path, "rb");
+  int res;
+
+  if (!f)
+    return 0;
+  res = kTestArchive_checkHeader(f);
+  fclose(f);
+
+  return res;
+}
+
+KTestArchive *kTestArchive_open(const char *path, int writable) {
+  KTestArchive *a = (KTestArchive*) calloc(1, sizeof(*a));
+  off_t end;
+
+  if (!a)
+    return 0;
+  a->writable = writable;
+  a->f = fopen(path, writable ? "r+b" : "rb");
+  if (!a->f && writable && errno == ENOENT) {
+    a->f = fopen(path, "w+b");
+    if (!a->f ||
+        fwrite(KTEST_ARCHIVE_MAGIC, KTEST_ARCHIVE_MAGIC_SIZE, 1, a->f)!=1 ||
+        !write_uint32(a->f, KTEST_ARCHIVE_VERSION))
+      goto error;
+    return a;
+  }
+  if (!a->f || !kTestArchive_checkHeader(a->f))
+    goto error;
+  if (!kTestArchive_readIndex(a, &end) && !kTestArchive_scan(a, &end))
+    goto error;
+
+  // Appending starts where the index (or a partial record) was.
+  if (writable &&
+      (fflush(a->f) || ftruncate(fileno(a->f), end) < 0 ||
+       fseeko(a->f, end, SEEK_SET)))
+    goto error;
+
+  return a;
+ error:
+  if (a->f) fclose(a->f);
+  free(a->ids);
+  free(a->offsets);
+  free(a);
+
+  return 0;
+}
+
+unsigned kTestArchive_numTests(KTestArchive *a) {
+  return a->numTests;
+}
+
+unsigned kTestArchive_getID(KTestArchive *a, unsigned index) {
+  return a->ids[index];
+}
+
+KTest *kTestArchive_read(KTestArchive *a, unsigned index) {
+  unsigned id, flags, storedSize, rawSize;
+
+  if (index >= a->numTests)
+    return 0;
+  if (fseeko(a->f, a->offsets[index], SEEK_SET) ||
+      !read_tag(a->f, KTEST_ARCHIVE_RECORD) || !read_uint32(a->f, &id) ||
+      !read_uint32(a->f, &flags) || !read_uint32(a->f, &storedSize) ||
+      !read_uint32(a->f, &rawSize))
+    return 0;
+
+  if (!(flags & KTEST_ARCHIVE_COMPRESSED))
+    return kTest_read(a->f);
+
+#ifdef HAVE_ZLIB_H
+  {
+    unsigned char *stored = (unsigned char*) malloc(storedSize);
+    unsigned char *raw = (unsigned char*) malloc(rawSize);
+    uLongf size = rawSize;
+    KTest *res = 0;
+    FILE *m;
+
+    if (stored && raw && fread(stored, storedSize, 1, a->f)==1 &&
+        uncompress(raw, &size, stored, storedSize) == Z_OK &&
+        size == rawSize && (m = fmemopen(raw, rawSize, "rb"))) {
+      res = kTest_read(m);
+      fclose(m);
+    }
+    free(stored);
+    free(raw);
+    return res;
+  }
+#else
+  return 0;
+#endif
+}
+
+int kTestArchive_append(KTestArchive *a, KTest *bo, unsigned id,
+                        int compressed) {
+  char *raw = 0;
+  size_t rawSize = 0;
+  const void *stored;
+  size_t storedSize;
+  unsigned flags = 0;
+  unsigned char *buffer = 0;
+  off_t offset;
+  FILE *m;
+  int res;
+
+  if (!a->writable)
+    return 0;
+  if (!(m = open_memstream(&raw, &rawSize)))
+    return 0;
+  res = kTest_write(m, bo);
+  if (fclose(m) || !res) {
+    free(raw);
+    return 0;
+  }
+
+  stored = raw;
+  storedSize = rawSize;
+#ifdef HAVE_ZLIB_H
+  if (compressed) {
+    uLongf size = compressBound(rawSize);
+    buffer = (unsigned char*) malloc(size);
+    if (buffer &&
+        compress(buffer, &size, (const Bytef*) raw, rawSize) == Z_OK &&
+        size < rawSize) {
+      stored = buffer;
+      storedSize = size;
+      flags |= KTEST_ARCHIVE_COMPRESSED;
+    }
+  }
+#else
+  (void) compressed;
+#endif
+
+  res = fseeko(a->f, 0, SEEK_END) == 0 && (offset = ftello(a->f)) >= 0 &&
+        fwrite(KTEST_ARCHIVE_RECORD, KTEST_ARCHIVE_TAG_SIZE, 1, a->f)==1 &&
+        write_uint32(a->f, id) && write_uint32(a->f, flags) &&
+        write_uint32(a->f, storedSize) && write_uint32(a->f, rawSize) &&
+        fwrite(stored, storedSize, 1, a->f)==1 &&
+        kTestArchive_add(a, id, offset);
+
+  free(buffer);
+  free(raw);
+  return res;
+}
+
+int kTestArchive_close(KTestArchive *a) {
+  unsigned i;
+  int res = 1;
+  off_t offset = 0;
+
+  if (a->writable) {
+    res = fseeko(a->f, 0, SEEK_END) == 0 && (offset = ftello(a->f)) >= 0 &&
+          fwrite(KTEST_ARCHIVE_INDEX, KTEST_ARCHIVE_TAG_SIZE, 1, a->f)==1 &&
+          write_uint32(a->f, a->numTests);
+    for (i=0; res && i<a->numTests; i++)
+      res = write_uint32(a->f, a->ids[i]) && write_uint64(a->f, a->offsets[i]);
+    res = res && write_uint64(a->f, offset) &&
+          fwrite(KTEST_ARCHIVE_END, KTEST_ARCHIVE_TAG_SIZE, 1, a->f)==1;
+  }
+  if (fclose(a->f))
+    res = 0;
+  free(a->ids);
+  free(a->offsets);
+  free(a);
+
+  return res;
+}
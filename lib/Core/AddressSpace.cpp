@@ -13,6 +13,7 @@
 #include "Memory.h"
 #include "TimingSolver.h"
 
+#include "klee/ADT/Bits.h"
 #include "klee/Expr/Expr.h"
 #include "klee/Statistics/TimerStatIncrementer.h"
 
@@ -20,6 +21,9 @@
 
 using namespace klee;
 
+/// How many objects a single query of AddressSpace::resolve rules out.
+static const std::size_t ResolveChunkSize = 16;
+
 ///
 
 void AddressSpace::bindObject(const MemoryObject *mo, ObjectState *os) {
@@ -105,58 +109,34 @@ bool AddressSpace::resolveOne(ExecutionState &state,
     }
 
     // didn't work, now we have to search
-       
-    MemoryMap::iterator oi = objects.upper_bound(&hack);
-    MemoryMap::iterator begin = objects.begin();
-    MemoryMap::iterator end = objects.end();
-      
-    MemoryMap::iterator start = oi;
-    while (oi!=begin) {
-      --oi;
-      const auto &mo = oi->first;
-
-      bool mayBeTrue;
-      if (!solver->mayBeTrue(state.constraints,
-                             mo->getBoundsCheckPointer(address), mayBeTrue,
-                             state.queryMetaData))
-        return false;
-      if (mayBeTrue) {
-        result.first = oi->first;
-        result.second = oi->second.get();
-        success = true;
-        return true;
-      } else {
-        bool mustBeTrue;
-        if (!solver->mustBeTrue(state.constraints,
-                                UgeExpr::create(address, mo->getBaseExpr()),
-                                mustBeTrue, state.queryMetaData))
-          return false;
-        if (mustBeTrue)
-          break;
-      }
-    }
 
-    // search forwards
-    for (oi=start; oi!=end; ++oi) {
-      const auto &mo = oi->first;
+    ResolutionList candidates;
+    if (!getCandidates(state, solver, address, example, nullptr, candidates,
+                       timer, time::Span()))
+      return false;
 
-      bool mustBeTrue;
-      if (!solver->mustBeTrue(state.constraints,
-                              UltExpr::create(address, mo->getBaseExpr()),
-                              mustBeTrue, state.queryMetaData))
+    for (auto chunk = candidates.cbegin(), ce = candidates.cend(); chunk != ce;
+         chunk += std::min<std::size_t>(ResolveChunkSize, ce - chunk)) {
+      auto chunkEnd = chunk + std::min<std::size_t>(ResolveChunkSize, ce - chunk);
+      bool mayBeTrue;
+      if (!mayPointIntoAny(state, solver, address, chunk, chunkEnd, mayBeTrue))
         return false;
-      if (mustBeTrue) {
-        break;
-      } else {
-        bool mayBeTrue;
+      if (!mayBeTrue)
+        continue;
 
+      for (auto it = chunk; it != chunkEnd; ++it) {
+        if (std::next(it) == chunkEnd) {
+          // the address must point into the last object of the chunk
+          result = *it;
+          success = true;
+          return true;
+        }
         if (!solver->mayBeTrue(state.constraints,
-                               mo->getBoundsCheckPointer(address), mayBeTrue,
-                               state.queryMetaData))
+                               it->first->getBoundsCheckPointer(address),
+                               mayBeTrue, state.queryMetaData))
           return false;
         if (mayBeTrue) {
-          result.first = oi->first;
-          result.second = oi->second.get();
+          result = *it;
           success = true;
           return true;
         }
@@ -204,6 +184,79 @@ int AddressSpace::checkPointerInObject(ExecutionState &state,
   return 2;
 }
 
+bool AddressSpace::getCandidates(ExecutionState &state, TimingSolver *solver,
+                                 ref<Expr> p, uint64_t example,
+                                 const MemoryObject *skip,
+                                 ResolutionList &candidates,
+                                 const TimerStatIncrementer &timer,
+                                 time::Span timeout) const {
+  // The range costs a bounded number of queries however many objects there
+  // are, after which only the objects overlapping it need to be looked at.
+  // It is found by bisection between the example and the ends of the
+  // address space, with queries which may fail or time out.
+  uint64_t min = 0, max = bits64::maxValueOfNBits(p->getWidth());
+  for (uint64_t hi = example; min < hi;) {
+    if (timeout && timeout < timer.delta())
+      return false;
+    uint64_t mid = min + (hi - min) / 2;
+    bool mayBeBelow;
+    if (!solver->mayBeTrue(state.constraints,
+                           UleExpr::create(p, ConstantExpr::create(
+                                                  mid, p->getWidth())),
+                           mayBeBelow, state.queryMetaData))
+      return false;
+    if (mayBeBelow)
+      hi = mid;
+    else
+      min = mid + 1;
+  }
+  for (uint64_t lo = example; lo < max;) {
+    if (timeout && timeout < timer.delta())
+      return false;
+    uint64_t mid = lo + (max - lo) / 2 + 1;
+    bool mayBeAbove;
+    if (!solver->mayBeTrue(state.constraints,
+                           UgeExpr::create(p, ConstantExpr::create(
+                                                  mid, p->getWidth())),
+                           mayBeAbove, state.queryMetaData))
+      return false;
+    if (mayBeAbove)
+      lo = mid;
+    else
+      max = mid - 1;
+  }
+
+  MemoryObject hack(min);
+  MemoryMap::iterator oi = objects.upper_bound(&hack);
+  MemoryMap::iterator begin = objects.begin();
+  MemoryMap::iterator end = objects.end();
+
+  // the object before min may extend into the range
+  if (oi != begin) {
+    --oi;
+    const MemoryObject *mo = oi->first;
+    if (mo->address + mo->size <= min && !(mo->size == 0 && mo->address == min))
+      ++oi;
+  }
+
+  for (; oi != end && oi->first->address <= max; ++oi)
+    if (oi->first != skip)
+      candidates.push_back(std::make_pair(oi->first, oi->second.get()));
+  return true;
+}
+
+bool AddressSpace::mayPointIntoAny(ExecutionState &state, TimingSolver *solver,
+                                   ref<Expr> p,
+                                   ResolutionList::const_iterator begin,
+                                   ResolutionList::const_iterator end,
+                                   bool &result) const {
+  ref<Expr> inBounds = ConstantExpr::create(0, Expr::Bool);
+  for (auto it = begin; it != end; ++it)
+    inBounds = OrExpr::create(inBounds, it->first->getBoundsCheckPointer(p));
+  return solver->mayBeTrue(state.constraints, inBounds, result,
+                           state.queryMetaData);
+}
+
 bool AddressSpace::resolve(ExecutionState &state, TimingSolver *solver,
                            ref<Expr> p, ResolutionList &rl,
                            unsigned maxResolutions, time::Span timeout) const {
@@ -221,70 +274,55 @@ bool AddressSpace::resolve(ExecutionState &state, TimingSolver *solver,
     // not the first, find a cex assuming not the second...
     // etc.
 
-    // XXX how do we smartly amortize the cost of checking to
-    // see if we need to keep searching up/down, in bad cases?
-    // maybe we don't care?
-
-    // XXX we really just need a smart place to start (although
-    // if its a known solution then the code below is guaranteed
-    // to hit the fast path with exactly 2 queries). we could also
-    // just get this by inspection of the expr.
-
+    // Start with the object containing an example value of p: in the
+    // common case p can only point into it, which takes 3 queries.
     ref<ConstantExpr> cex;
     if (!solver->getValue(state.constraints, p, cex, state.queryMetaData))
       return true;
     uint64_t example = cex->getZExtValue();
     MemoryObject hack(example);
 
-    MemoryMap::iterator oi = objects.upper_bound(&hack);
-    MemoryMap::iterator begin = objects.begin();
-    MemoryMap::iterator end = objects.end();
-
-    MemoryMap::iterator start = oi;
-    // search backwards, start with one minus because this
-    // is the object that p *should* be within, which means we
-    // get write off the end with 4 queries
-    while (oi != begin) {
-      --oi;
-      const MemoryObject *mo = oi->first;
-      if (timeout && timeout < timer.delta())
-        return true;
-
-      auto op = std::make_pair<>(mo, oi->second.get());
-
-      int incomplete =
-          checkPointerInObject(state, solver, p, op, rl, maxResolutions);
-      if (incomplete != 2)
-        return incomplete ? true : false;
-
-      bool mustBeTrue;
-      if (!solver->mustBeTrue(state.constraints,
-                              UgeExpr::create(p, mo->getBaseExpr()), mustBeTrue,
-                              state.queryMetaData))
-        return true;
-      if (mustBeTrue)
-        break;
+    const MemoryObject *first = nullptr;
+    if (const auto res = objects.lookup_previous(&hack)) {
+      const MemoryObject *mo = res->first;
+      if ((mo->size == 0 && example == mo->address) ||
+          example - mo->address < mo->size) {
+        first = mo;
+        int incomplete = checkPointerInObject(
+            state, solver, p, std::make_pair<>(mo, res->second.get()), rl,
+            maxResolutions);
+        if (incomplete != 2)
+          return incomplete ? true : false;
+      }
     }
 
-    // search forwards
-    for (oi = start; oi != end; ++oi) {
-      const MemoryObject *mo = oi->first;
+    // Otherwise look at the objects in the feasible range of p, skipping
+    // whole chunks of them that p cannot point into with one query.
+    ResolutionList candidates;
+    if (!getCandidates(state, solver, p, example, first, candidates, timer,
+                       timeout))
+      return true;
+
+    for (auto chunk = candidates.cbegin(), ce = candidates.cend(); chunk != ce;
+         chunk += std::min<std::size_t>(ResolveChunkSize, ce - chunk)) {
+      auto chunkEnd = chunk + std::min<std::size_t>(ResolveChunkSize, ce - chunk);
       if (timeout && timeout < timer.delta())
         return true;
 
-      bool mustBeTrue;
-      if (!solver->mustBeTrue(state.constraints,
-                              UltExpr::create(p, mo->getBaseExpr()), mustBeTrue,
-                              state.queryMetaData))
-        return true;
-      if (mustBeTrue)
-        break;
-      auto op = std::make_pair<>(mo, oi->second.get());
+      if (chunkEnd - chunk > 1) {
+        bool mayBeTrue;
+        if (!mayPointIntoAny(state, solver, p, chunk, chunkEnd, mayBeTrue))
+          return true;
+        if (!mayBeTrue)
+          continue;
+      }
 
-      int incomplete =
-          checkPointerInObject(state, solver, p, op, rl, maxResolutions);
-      if (incomplete != 2)
-        return incomplete ? true : false;
+      for (auto it = chunk; it != chunkEnd; ++it) {
+        int incomplete =
+            checkPointerInObject(state, solver, p, *it, rl, maxResolutions);
+        if (incomplete != 2)
+          return incomplete ? true : false;
+      }
     }
   }
 
@@ -307,7 +345,7 @@ void AddressSpace::copyOutConcretes() {
       auto address = reinterpret_cast<std::uint8_t*>(mo->address);
 
       if (!os->readOnly)
-        memcpy(address, os->concreteStore, mo->size);
+        os->concreteStore.copyTo(address);
     }
   }
 }
@@ -330,12 +368,12 @@ bool AddressSpace::copyInConcretes() {
 bool AddressSpace::copyInConcrete(const MemoryObject *mo, const ObjectState *os,
                                   uint64_t src_address) {
   auto address = reinterpret_cast<std::uint8_t*>(src_address);
-  if (memcmp(address, os->concreteStore, mo->size) != 0) {
+  if (!os->concreteStore.equals(address)) {
     if (os->readOnly) {
       return false;
     } else {
       ObjectState *wos = getWriteable(mo, os);
-      memcpy(wos->concreteStore, address, mo->size);
+      wos->concreteStore.assign(address);
     }
   }
   return true;
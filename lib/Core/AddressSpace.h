@@ -20,6 +20,7 @@ namespace klee {
   class ExecutionState;
   class MemoryObject;
   class ObjectState;
+  class TimerStatIncrementer;
   class TimingSolver;
 
   template<class T> class ref;
@@ -54,6 +55,28 @@ namespace klee {
                              ref<Expr> p, const ObjectPair &op,
                              ResolutionList &rl, unsigned maxResolutions) const;
 
+    /// Get the objects which `p` may point to according to its feasible
+    /// range, in increasing order of address. The object \a skip, which
+    /// has been checked already, is left out. \a example is a feasible
+    /// value of `p`.
+    ///
+    /// \return false iff a query failed or \a timeout (if nonzero) passed
+    /// since \a timer was started.
+    bool getCandidates(ExecutionState &state, TimingSolver *solver,
+                       ref<Expr> p, uint64_t example, const MemoryObject *skip,
+                       ResolutionList &candidates,
+                       const TimerStatIncrementer &timer,
+                       time::Span timeout) const;
+
+    /// Check whether `p` may point into any of the objects in [begin, end)
+    /// with a single query.
+    ///
+    /// \return false iff the query timed out.
+    bool mayPointIntoAny(ExecutionState &state, TimingSolver *solver,
+                         ref<Expr> p, ResolutionList::const_iterator begin,
+                         ResolutionList::const_iterator end,
+                         bool &result) const;
+
   public:
     /// The MemoryObject -> ObjectState map that constitutes the
     /// address space.
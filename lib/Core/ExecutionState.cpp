@@ -74,6 +74,7 @@ ExecutionState::ExecutionState(KFunction *kf) :
     pc(kf->instructions),
     prevPC(pc),
     depth(0),
+    replayPathPosition(0),
     ptreeNode(nullptr),
     steppedInstructions(0),
     instsSinceCovNew(0),
@@ -98,11 +99,12 @@ ExecutionState::ExecutionState(const ExecutionState& state):
     stack(state.stack),
     incomingBBIndex(state.incomingBBIndex),
     depth(state.depth),
+    replayPathPosition(state.replayPathPosition),
     addressSpace(state.addressSpace),
     constraints(state.constraints),
     pathOS(state.pathOS),
     symPathOS(state.symPathOS),
-    coveredLines(state.coveredLines),
+    coveredInstructions(state.coveredInstructions),
     symbolics(state.symbolics),
     arrayNames(state.arrayNames),
     openMergeStack(state.openMergeStack),
@@ -124,7 +126,7 @@ ExecutionState *ExecutionState::branch() {
   auto *falseState = new ExecutionState(*this);
   falseState->setID();
   falseState->coveredNew = false;
-  falseState->coveredLines.clear();
+  falseState->coveredInstructions.clear();
 
   return falseState;
 }
@@ -12,6 +12,7 @@
 
 #include "AddressSpace.h"
 #include "MergeHandler.h"
+#include "PagedArray.h"
 
 #include "klee/ADT/TreeStream.h"
 #include "klee/Expr/Constraints.h"
@@ -176,6 +177,9 @@ public:
   /// @brief Exploration depth, i.e., number of times KLEE branched for this state
   std::uint32_t depth;
 
+  /// @brief Number of branch decisions taken from the replay path
+  std::uint32_t replayPathPosition;
+
   /// @brief Address space used by this state (e.g. Global and Heap)
   AddressSpace addressSpace;
 
@@ -195,8 +199,10 @@ public:
   /// taken to reach/create this state
   TreeOStream symPathOS;
 
-  /// @brief Set containing which lines in which files are covered by this state
-  std::map<const std::string *, std::set<std::uint32_t>> coveredLines;
+  /// @brief Set of the instructions, by InstructionInfo::id, which were first
+  /// covered by this state since it was forked. Its pages are shared between
+  /// copies of the state.
+  CoverageBitArray coveredInstructions;
 
   /// @brief Pointer to the process tree of the current state
   /// Copies of ExecutionState should not copy ptreeNode
@@ -52,6 +52,7 @@
 #include "klee/System/MemoryUsage.h"
 #include "klee/System/Time.h"
 #include "klee/Support/RoundingModeUtil.h"
+#include "klee/util/APFloatEval.h"
 
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/StringExtras.h"
@@ -69,6 +70,7 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Operator.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Errno.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
@@ -81,6 +83,7 @@ typedef unsigned TypeSize;
 #include "llvm/Support/raw_ostream.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cerrno>
 #include <cstring>
@@ -89,6 +92,8 @@ typedef unsigned TypeSize;
 #include <iomanip>
 #include <iosfwd>
 #include <limits>
+#include <pthread.h>
+#include <signal.h>
 #include <sstream>
 #include <string>
 #include <sys/mman.h>
@@ -544,7 +549,8 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
       interpreterHandler->getOutputFilename(ALL_QUERIES_SMT2_FILE_NAME),
       interpreterHandler->getOutputFilename(SOLVER_QUERIES_SMT2_FILE_NAME),
       interpreterHandler->getOutputFilename(ALL_QUERIES_KQUERY_FILE_NAME),
-      interpreterHandler->getOutputFilename(SOLVER_QUERIES_KQUERY_FILE_NAME));
+      interpreterHandler->getOutputFilename(SOLVER_QUERIES_KQUERY_FILE_NAME),
+      interpreterHandler->getOutputFilename(PERSISTENT_QUERY_CACHE_FILE_NAME));
 
   this->solver = new TimingSolver(solver, EqualitySubstitution);
   memory = new MemoryManager(&arrayCache);
@@ -641,7 +647,24 @@ Executor::setModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
   return kmodule->module.get();
 }
 
+namespace klee {
+/// The limits shared by the worker processes of a distributed run, in memory
+/// shared by all of them.
+struct WorkerLimits {
+  /// Set when any worker halts, e.g. for -max-tests or -max-time
+  std::atomic<bool> halt;
+  /// The instructions and memory usage (in MB) of all workers, as last
+  /// reported by each of them
+  std::atomic<uint64_t> instructions;
+  std::atomic<uint64_t> memoryUsage;
+};
+} // namespace klee
+
 Executor::~Executor() {
+  if (workerLimits) {
+    workerLimits->memoryUsage -= reportedMemoryUsage;
+    munmap(workerLimits, sizeof(WorkerLimits));
+  }
   delete memory;
   delete externalDispatcher;
   delete specialFunctionHandler;
@@ -1111,15 +1134,20 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
   }
 
   if (!isSeeding) {
-    if (replayPath && !isInternal) {
-      assert(replayPosition<replayPath->size() &&
+    if (replayPath && !isInternal &&
+        (!replayPathIsPrefix || isReplayingPrefix(current))) {
+      assert(current.replayPathPosition<replayPath->size() &&
              "ran out of branches in replay path mode");
-      bool branch = (*replayPath)[replayPosition++];
+      bool branch = (*replayPath)[current.replayPathPosition++];
       
-      if (res==Solver::True) {
-        assert(branch && "hit invalid branch in replay path mode");
-      } else if (res==Solver::False) {
-        assert(!branch && "hit invalid branch in replay path mode");
+      if (res==Solver::True || res==Solver::False) {
+        if (branch != (res==Solver::True)) {
+          // States forked by Executor::branch do not record their decision
+          // in the path, so the path may not apply to all of them.
+          assert(replayPathIsPrefix && "hit invalid branch in replay path mode");
+          terminateState(current);
+          return StatePair(0, 0);
+        }
       } else {
         // add constraints
         if(branch) {
@@ -1241,7 +1269,7 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
       }
       if (swapInfo) {
         std::swap(trueState->coveredNew, falseState->coveredNew);
-        std::swap(trueState->coveredLines, falseState->coveredLines);
+        trueState->coveredInstructions.swap(falseState->coveredInstructions);
       }
     }
 
@@ -1497,7 +1525,7 @@ void Executor::stepInstruction(ExecutionState &state) {
   ++state.pc;
 
   if (stats::instructions == MaxInstructions)
-    haltExecution = true;
+    setHaltExecution(true);
 }
 
 static inline const llvm::fltSemantics *fpWidthToSemantics(unsigned width) {
@@ -2327,7 +2355,9 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
     ref<Expr> errorCase = ConstantExpr::alloc(1, Expr::Bool);
     SmallPtrSet<BasicBlock *, 5> destinations;
-    // collect and check destinations from label list
+    std::vector<BasicBlock *> candidates;
+    std::vector<ref<Expr>> conditions;
+    // collect destinations from label list
     for (unsigned k = 0; k < numDestinations; ++k) {
       // filter duplicates
       const auto d = bi->getDestination(k);
@@ -2341,21 +2371,23 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       // exclude address from errorCase
       errorCase = AndExpr::create(errorCase, Expr::createIsZero(e));
 
-      // check feasibility
-      bool result;
-      bool success __attribute__((unused)) =
-          solver->mayBeTrue(state.constraints, e, result, state.queryMetaData);
-      assert(success && "FIXME: Unhandled solver failure");
-      if (result) {
-        targets.push_back(d);
-        expressions.push_back(e);
-      }
+      candidates.push_back(d);
+      conditions.push_back(e);
     }
-    // check errorCase feasibility
-    bool result;
+    conditions.push_back(errorCase);
+
+    // check feasibility of the destinations and the errorCase, all at once
+    std::vector<bool> feasible;
     bool success __attribute__((unused)) = solver->mayBeTrue(
-        state.constraints, errorCase, result, state.queryMetaData);
+        state.constraints, conditions, feasible, state.queryMetaData);
     assert(success && "FIXME: Unhandled solver failure");
+    for (unsigned k = 0, e = candidates.size(); k != e; ++k) {
+      if (feasible[k]) {
+        targets.push_back(candidates[k]);
+        expressions.push_back(conditions[k]);
+      }
+    }
+    bool result = feasible.back();
     if (result) {
       expressions.push_back(errorCase);
     }
@@ -2420,6 +2452,11 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       // Track default branch values
       ref<Expr> defaultValue = ConstantExpr::alloc(1, Expr::Bool);
 
+      // The conditions of the cases, in order of the expressions, followed
+      // by the condition of the default case
+      std::vector<ref<Expr>> matches;
+      std::vector<BasicBlock *> matchSuccessors;
+
       // iterate through all non-default cases but in order of the expressions
       for (std::map<ref<Expr>, BasicBlock *>::iterator
                it = expressionOrder.begin(),
@@ -2434,15 +2471,22 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
         // Make sure that the default value does not contain this target's value
         defaultValue = AndExpr::create(defaultValue, Expr::createIsZero(match));
 
-        // Check if control flow could take this case
-        bool result;
-        match = optimizer.optimizeExpr(match, false);
-        bool success = solver->mayBeTrue(state.constraints, match, result,
-                                         state.queryMetaData);
-        assert(success && "FIXME: Unhandled solver failure");
-        (void) success;
-        if (result) {
-          BasicBlock *caseSuccessor = it->second;
+        matches.push_back(optimizer.optimizeExpr(match, false));
+        matchSuccessors.push_back(it->second);
+      }
+      defaultValue = optimizer.optimizeExpr(defaultValue, false);
+      matches.push_back(defaultValue);
+
+      // Check which cases control flow could take, all at once
+      std::vector<bool> feasible;
+      bool success = solver->mayBeTrue(state.constraints, matches, feasible,
+                                       state.queryMetaData);
+      assert(success && "FIXME: Unhandled solver failure");
+      (void) success;
+
+      for (unsigned k = 0, e = matchSuccessors.size(); k != e; ++k) {
+        if (feasible[k]) {
+          BasicBlock *caseSuccessor = matchSuccessors[k];
 
           // Handle the case that a basic block might be the target of multiple
           // switch cases.
@@ -2454,7 +2498,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
               branchTargets.insert(std::make_pair(
                   caseSuccessor, ConstantExpr::alloc(0, Expr::Bool)));
 
-          res.first->second = OrExpr::create(match, res.first->second);
+          res.first->second = OrExpr::create(matches[k], res.first->second);
 
           // Only add basic blocks which have not been target of a branch yet
           if (res.second) {
@@ -2464,13 +2508,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       }
 
       // Check if control could take the default case
-      defaultValue = optimizer.optimizeExpr(defaultValue, false);
-      bool res;
-      bool success = solver->mayBeTrue(state.constraints, defaultValue, res,
-                                       state.queryMetaData);
-      assert(success && "FIXME: Unhandled solver failure");
-      (void) success;
-      if (res) {
+      if (feasible.back()) {
         std::pair<std::map<BasicBlock *, ref<Expr> >::iterator, bool> ret =
             branchTargets.insert(
                 std::make_pair(si->getDefaultDest(), defaultValue));
@@ -3675,6 +3713,42 @@ void Executor::bindInstructionConstants(KInstruction *KI) {
   }
 }
 
+/// Whether \a ki is fp80 arithmetic which, with constant operands, is
+/// evaluated natively in the rounding mode of its state. Such instructions
+/// never fork or terminate the state, query the solver or call out of the
+/// executor.
+static bool isNativeFP80Arithmetic(const KInstruction *ki) {
+#if defined(ENABLE_FP) && defined(__x86_64__)
+  switch (ki->inst->getOpcode()) {
+  case Instruction::FAdd:
+  case Instruction::FSub:
+  case Instruction::FMul:
+  case Instruction::FDiv:
+  case Instruction::FRem:
+  case Instruction::FPTrunc:
+    return ki->inst->getOperand(0)->getType()->isX86_FP80Ty();
+  default:
+    return false;
+  }
+#else
+  return false;
+#endif
+}
+
+void Executor::executeNativeFP80Run(ExecutionState &state, KInstruction *ki) {
+  // The instructions of the run share one switch of the host rounding mode
+  // instead of one each. The searcher is not consulted until the run ends,
+  // and the scope is closed before the timers or anything else runs.
+  HostRoundingModeScope scope(state.roundingMode);
+  executeInstruction(state, ki);
+  // Arithmetic is never the last instruction of its block.
+  while (!haltExecution && isNativeFP80Arithmetic(state.pc)) {
+    ki = state.pc;
+    stepInstruction(state);
+    executeInstruction(state, ki);
+  }
+}
+
 void Executor::bindModuleConstants(ExecutionState &state) {
   for (auto &kfp : kmodule->functions) {
     KFunction *kf = kfp.get();
@@ -3702,7 +3776,11 @@ bool Executor::checkMemoryUsage() {
   // check memory limit
   const auto mallocUsage = util::GetTotalMallocUsage() >> 20U;
   const auto mmapUsage = memory->getUsedDeterministicSize() >> 20U;
-  const auto totalUsage = mallocUsage + mmapUsage;
+  auto totalUsage = mallocUsage + mmapUsage;
+  // Workers share the limit, and each of them terminates the same share of
+  // its states.
+  if (workerLimits)
+    totalUsage = shareMemoryUsage(totalUsage);
   atMemoryLimit = totalUsage > MaxMemory; // inhibit forking
   if (!atMemoryLimit)
     return true;
@@ -3744,6 +3822,62 @@ void Executor::doDumpStates() {
   updateStates(nullptr);
 }
 
+void Executor::startWorker(unsigned id) {
+  interpreterHandler->startWorker(id);
+  if (statsTracker)
+    statsTracker->startWorker();
+}
+
+void Executor::donateStates(const std::vector<ExecutionState *> &donated) {
+  interpreterHandler->donateStates(
+      std::vector<const ExecutionState *>(donated.begin(), donated.end()));
+  for (ExecutionState *es : donated)
+    removedStates.push_back(es);
+  updateStates(nullptr);
+}
+
+void Executor::shareLimitsWithWorkers() {
+  if (workerLimits)
+    return;
+  void *shared = mmap(nullptr, sizeof(WorkerLimits), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED)
+    klee_error("cannot allocate memory for worker limits: %s",
+               llvm::sys::StrError(errno).c_str());
+  workerLimits = new (shared) WorkerLimits();
+  workerLimits->halt = haltExecution;
+  workerLimits->instructions = stats::instructions;
+  workerLimits->memoryUsage = 0;
+  reportedInstructions = stats::instructions;
+  reportedMemoryUsage = 0;
+}
+
+void Executor::shareInstructionCount() {
+  uint64_t total = workerLimits->instructions +=
+      stats::instructions - reportedInstructions;
+  reportedInstructions = stats::instructions;
+  if (MaxInstructions && total >= MaxInstructions)
+    setHaltExecution(true);
+}
+
+uint64_t Executor::shareMemoryUsage(uint64_t usage) {
+  // The memory a worker shares with the process which forked it is counted
+  // for both, erring on the side of terminating states.
+  uint64_t total = workerLimits->memoryUsage += usage - reportedMemoryUsage;
+  reportedMemoryUsage = usage;
+  return total;
+}
+
+void Executor::setHaltExecution(bool value) {
+  haltExecution = value;
+  if (value && workerLimits)
+    workerLimits->halt = true;
+}
+
+bool Executor::getHaltExecution() {
+  return haltExecution || (workerLimits && workerLimits->halt);
+}
+
 void Executor::run(ExecutionState &initialState) {
   bindModuleConstants(initialState);
 
@@ -3822,11 +3956,33 @@ void Executor::run(ExecutionState &initialState) {
 
   // main interpreter loop
   while (!states.empty() && !haltExecution && TriggerTimes>triggerLog.size()) {
+    if (donationRequested.exchange(false)) {
+      // Keep every other state, but only those on their own path.
+      std::vector<ExecutionState *> donated;
+      unsigned i = 0;
+      for (ExecutionState *es : states) {
+        if (!isReplayingPrefix(*es) && !seedMap.count(es) && i++ % 2 == 1)
+          donated.push_back(es);
+      }
+      donateStates(donated);
+      continue;
+    }
+
     ExecutionState &state = searcher->selectState();
+    if (donationDepth && state.depth >= donationDepth &&
+        !isReplayingPrefix(state)) {
+      donateStates({&state});
+      continue;
+    }
+
     KInstruction *ki = state.pc;
     stepInstruction(state);
 
-    executeInstruction(state, ki);
+    if (isNativeFP80Arithmetic(ki) &&
+        state.roundingMode != llvm::APFloat::rmNearestTiesToEven)
+      executeNativeFP80Run(state, ki);
+    else
+      executeInstruction(state, ki);
     timers.invoke();
     if (::dumpStates) dumpStates();
     if (::dumpPTree) dumpPTree();
@@ -3837,12 +3993,26 @@ void Executor::run(ExecutionState &initialState) {
       // update searchers when states were terminated early due to memory pressure
       updateStates(nullptr);
     }
+
+    if (workerLimits) {
+      if ((stats::instructions & 0xFFFFU) == 0)
+        shareInstructionCount();
+      if (workerLimits->halt.load(std::memory_order_relaxed))
+        haltExecution = true;
+    }
   }
 
   delete searcher;
   searcher = nullptr;
 
   doDumpStates();
+
+  // Nothing is left to donate, but the request still gets its answer.
+  if (donationRequested.exchange(false))
+    interpreterHandler->donateStates({});
+
+  if (workerLimits)
+    shareInstructionCount();
 }
 
 std::string Executor::getAddressInfo(ExecutionState &state, 
@@ -3926,6 +4096,11 @@ void Executor::terminateState(ExecutionState &state) {
 
 void Executor::terminateStateEarly(ExecutionState &state, 
                                    const Twine &message) {
+  if (isReplayingPrefix(state)) {
+    // The path ends before the prefix, it is explored by someone else.
+    terminateState(state);
+    return;
+  }
   if (!OnlyOutputTrigger && (!OnlyOutputStatesCoveringNew || state.coveredNew ||
       (AlwaysOutputSeeds && seedMap.count(&state))))
     interpreterHandler->processTestCase(state, (message + "\n").str().c_str(),
@@ -3934,6 +4109,10 @@ void Executor::terminateStateEarly(ExecutionState &state,
 }
 
 void Executor::terminateStateOnExit(ExecutionState &state) {
+  if (isReplayingPrefix(state)) {
+    terminateState(state);
+    return;
+  }
   if (!OnlyOutputTrigger && (!OnlyOutputStatesCoveringNew || state.coveredNew ||
       (AlwaysOutputSeeds && seedMap.count(&state))))
     interpreterHandler->processTestCase(state, 0, 0, state.getID());
@@ -4000,6 +4179,13 @@ void Executor::terminateStateOnError(ExecutionState &state,
                                      enum TerminateReason termReason,
                                      const char *suffix,
                                      const llvm::Twine &info) {
+  if (isReplayingPrefix(state)) {
+    // The error was reported by whoever explored the prefix.
+    if (!EmitAllErrorsInSamePath && termReason != Executor::Trigger)
+      terminateState(state);
+    return;
+  }
+
   std::string message = messaget.str();
   static std::set< std::pair<Instruction*, std::string> > emittedErrors;
   Instruction * lastInst;
@@ -4052,7 +4238,7 @@ void Executor::terminateStateOnError(ExecutionState &state,
   }
 
   if (shouldExitOn(termReason))
-    haltExecution = true;
+    setHaltExecution(true);
 }
 
 // XXX shoot me
@@ -4175,7 +4361,19 @@ void Executor::callExternalFunction(ExecutionState &state,
       return;
   }
 
+  // The SIGPROF signals of -sample-instruction-time would make system calls
+  // of the external function fail with EINTR, so they are held back until
+  // it returns.
+  sigset_t sampleSignals, oldMask;
+  const bool blockSamples = statsTracker && statsTracker->isSampling();
+  if (blockSamples) {
+    sigemptyset(&sampleSignals);
+    sigaddset(&sampleSignals, SIGPROF);
+    pthread_sigmask(SIG_BLOCK, &sampleSignals, &oldMask);
+  }
   bool success = externalDispatcher->executeCall(function, target->inst, args, roundingMode);
+  if (blockSamples)
+    pthread_sigmask(SIG_SETMASK, &oldMask, nullptr);
 
   if (!success) {
     terminateStateOnError(state, "failed external call: " + function->getName(),
@@ -4209,7 +4407,7 @@ void Executor::callExternalFunction(ExecutionState &state,
 ref<Expr> Executor::replaceReadWithSymbolic(ExecutionState &state, 
                                             ref<Expr> e) {
   unsigned n = interpreterOpts.MakeConcreteSymbolic;
-  if (!n || replayKTest || replayPath)
+  if (!n || replayKTest || (replayPath && !replayPathIsPrefix))
     return e;
 
   // right now, we don't replace symbolics (is there any reason to?)
@@ -4845,7 +5043,33 @@ bool Executor::getSymbolicSolution(const ExecutionState &state,
 
 void Executor::getCoveredLines(const ExecutionState &state,
                                std::map<const std::string*, std::set<unsigned> > &res) {
-  res = state.coveredLines;
+  if (instructionInfos.empty()) {
+    instructionInfos.resize(kmodule->infos->getMaxID());
+    for (const auto &kf : kmodule->functions) {
+      for (unsigned i = 0; i < kf->numInstructions; ++i) {
+        const InstructionInfo *info = kf->instructions[i]->info;
+        instructionInfos[info->id] = info;
+      }
+    }
+  }
+
+  res.clear();
+  state.coveredInstructions.forEachSet([&](unsigned id) {
+    const InstructionInfo *info = instructionInfos[id];
+    res[&info->file].insert(info->line);
+  });
+}
+
+void Executor::getCoveredInstructions(std::vector<unsigned> &res) {
+  if (statsTracker)
+    statsTracker->getCoveredInstructions(res);
+}
+
+void Executor::mergeCoveredInstructions(const std::vector<unsigned> &ids) {
+  if (statsTracker) {
+    statsTracker->markInstructionsCovered(ids);
+    statsTracker->done();
+  }
 }
 
 void Executor::doImpliedValueConcretization(ExecutionState &state,
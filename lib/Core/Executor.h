@@ -30,6 +30,7 @@
 #include "llvm/ADT/Twine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <set>
@@ -62,6 +63,7 @@ namespace klee {
   class ExecutionState;
   class ExternalDispatcher;
   class Expr;
+  struct InstructionInfo;
   class InstructionInfoTable;
   struct KFunction;
   struct KInstruction;
@@ -80,6 +82,7 @@ namespace klee {
   class TreeStreamWriter;
   class MergeHandler;
   class MergingSearcher;
+  struct WorkerLimits;
   template<class T> class ref;
 
 
@@ -131,6 +134,8 @@ private:
   static const std::unordered_set <llvm::Intrinsic::ID> supportedFPIntrinsics;
   static const std::unordered_set <llvm::Intrinsic::ID> modelledFPIntrinsics;
   std::unique_ptr<KModule> kmodule;
+  /// The debug info of the instructions by their id, for getCoveredLines.
+  std::vector<const InstructionInfo *> instructionInfos;
   InterpreterHandler *interpreterHandler;
   Searcher *searcher;
 
@@ -182,8 +187,12 @@ private:
   /// When non-null a list of branch decisions to be used for replay.
   const std::vector<bool> *replayPath;
 
-  /// The index into the current \ref replayKTest or \ref replayPath
-  /// object.
+  /// Whether \ref replayPath is only followed up to its end, after which
+  /// states are explored as usual. \see setReplayPathPrefix()
+  bool replayPathIsPrefix = false;
+
+  /// The index into the current \ref replayKTest object. The position in
+  /// \ref replayPath is kept by every state.
   unsigned replayPosition;
 
   /// When non-null a list of "seed" inputs which will be used to
@@ -201,6 +210,14 @@ private:
   /// step.
   bool haltExecution;
 
+  /// States which branched this often are donated, 0 if disabled.
+  /// \see setDonationDepth()
+  unsigned donationDepth = 0;
+
+  /// Signals the executor to donate half of its states at the next
+  /// instruction step. \see requestDonation()
+  std::atomic<bool> donationRequested{false};
+
   /// Whether implied-value concretization is enabled. Currently
   /// false, it is buggy (it needs to validate its writes).
   bool ivcEnabled;
@@ -234,6 +251,15 @@ private:
   /// Typeids used during exception handling
   std::vector<ref<Expr>> eh_typeids;
 
+  /// Limits shared with the worker processes forked after
+  /// shareLimitsWithWorkers(), `nullptr` if this process explores alone
+  WorkerLimits *workerLimits = nullptr;
+
+  /// The instructions and memory usage (in MB) of this process which were
+  /// last added to the totals in workerLimits
+  uint64_t reportedInstructions = 0;
+  uint64_t reportedMemoryUsage = 0;
+
   /// Return the typeid corresponding to a certain `type_info`
   ref<ConstantExpr> getEhTypeidFor(ref<Expr> type_info);
 
@@ -242,6 +268,10 @@ private:
   
   void executeInstruction(ExecutionState &state, KInstruction *ki);
 
+  /// Execute \a ki and the fp80 arithmetic following it in \a state under
+  /// a single switch of the host rounding mode.
+  void executeNativeFP80Run(ExecutionState &state, KInstruction *ki);
+
   void run(ExecutionState &initialState);
 
   // Given a concrete object in our [klee's] address space, add it to 
@@ -260,6 +290,23 @@ private:
 
   void stepInstruction(ExecutionState &state);
   void updateStates(ExecutionState *current);
+
+  /// Add the instructions executed since the last call to the total of all
+  /// workers, halting at -max-instructions.
+  void shareInstructionCount();
+
+  /// Add the change of this worker's memory usage \a usage (in MB) since the
+  /// last call to the total of all workers, and return that total.
+  uint64_t shareMemoryUsage(uint64_t usage);
+
+  /// Whether \a state still follows a path set with setReplayPathPrefix().
+  bool isReplayingPrefix(const ExecutionState &state) const {
+    return replayPathIsPrefix &&
+           state.replayPathPosition < replayPath->size();
+  }
+
+  /// Hand \a donated to the InterpreterHandler and remove them.
+  void donateStates(const std::vector<ExecutionState *> &donated);
   void transferToBasicBlock(llvm::BasicBlock *dst, 
 			    llvm::BasicBlock *src,
 			    ExecutionState &state);
@@ -522,7 +569,12 @@ public:
   void setReplayPath(const std::vector<bool> *path) override {
     assert(!replayKTest && "cannot replay both buffer and path");
     replayPath = path;
-    replayPosition = 0;
+    replayPathIsPrefix = false;
+  }
+
+  void setReplayPathPrefix(const std::vector<bool> *path) override {
+    setReplayPath(path);
+    replayPathIsPrefix = path != nullptr;
   }
 
   llvm::Module *setModule(std::vector<std::unique_ptr<llvm::Module>> &modules,
@@ -537,10 +589,20 @@ public:
 
   /*** Runtime options ***/
 
-  void setHaltExecution(bool value) override { haltExecution = value; }
+  void setHaltExecution(bool value) override;
 
   void setInhibitForking(bool value) override { inhibitForking = value; }
 
+  void setDonationDepth(unsigned depth) override { donationDepth = depth; }
+
+  void requestDonation() override { donationRequested = true; }
+
+  void startWorker(unsigned id) override;
+
+  void shareLimitsWithWorkers() override;
+
+  bool getHaltExecution() override;
+
   void prepareForEarlyExit() override;
 
   /*** State accessor methods ***/
@@ -562,6 +624,10 @@ public:
                        std::map<const std::string *, std::set<unsigned>> &res)
       override;
 
+  void getCoveredInstructions(std::vector<unsigned> &res) override;
+
+  void mergeCoveredInstructions(const std::vector<unsigned> &ids) override;
+
   Expr::Width getWidthForLLVMType(llvm::Type *type) const;
   size_t getAllocationAlignment(const llvm::Value *allocSite) const;
 
@@ -13,7 +13,6 @@
 #include "ExecutionState.h"
 #include "MemoryManager.h"
 
-#include "klee/ADT/BitArray.h"
 #include "klee/Expr/ArrayCache.h"
 #include "klee/Expr/Expr.h"
 #include "klee/Support/OptionCategories.h"
@@ -40,6 +39,17 @@ namespace {
                     cl::cat(SolvingCat));
 }
 
+/// How many of the last concrete writes to an object getUpdates() may put on
+/// top of an existing constant array instead of creating a new one.
+static const unsigned MaxConstantArrayDelta = 8;
+
+/***/
+
+std::uint64_t PagedArrayStats::privateBytes = 0;
+std::uint64_t PagedArrayStats::sharedBytes = 0;
+std::uint64_t CoverageArrayStats::privateBytes = 0;
+std::uint64_t CoverageArrayStats::sharedBytes = 0;
+
 /***/
 
 int MemoryObject::counter = 0;
@@ -76,10 +86,8 @@ void MemoryObject::getAllocInfo(std::string &result) const {
 ObjectState::ObjectState(const MemoryObject *mo)
   : copyOnWriteOwner(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
-    concreteMask(0),
-    flushMask(0),
-    knownSymbolics(0),
+    concreteStore(mo->size),
+    knownSymbolics(mo->size),
     updates(0, 0),
     size(mo->size),
     readOnly(false) {
@@ -89,50 +97,34 @@ ObjectState::ObjectState(const MemoryObject *mo)
         getArrayCache()->CreateArray("tmp_arr" + llvm::utostr(++id), size);
     updates = UpdateList(array, 0);
   }
-  memset(concreteStore, 0, size);
 }
 
 
 ObjectState::ObjectState(const MemoryObject *mo, const Array *array)
   : copyOnWriteOwner(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
-    concreteMask(0),
-    flushMask(0),
-    knownSymbolics(0),
+    concreteStore(mo->size),
+    knownSymbolics(mo->size),
     updates(array, 0),
     size(mo->size),
     readOnly(false) {
   makeSymbolic();
-  memset(concreteStore, 0, size);
 }
 
 ObjectState::ObjectState(const ObjectState &os) 
   : copyOnWriteOwner(0),
     object(os.object),
-    concreteStore(new uint8_t[os.size]),
-    concreteMask(os.concreteMask ? new BitArray(*os.concreteMask, os.size) : 0),
-    flushMask(os.flushMask ? new BitArray(*os.flushMask, os.size) : 0),
-    knownSymbolics(0),
+    concreteStore(os.concreteStore),
+    concreteMask(os.concreteMask ? new PagedBitArray(*os.concreteMask) : 0),
+    flushMask(os.flushMask ? new PagedBitArray(*os.flushMask) : 0),
+    knownSymbolics(os.knownSymbolics),
     updates(os.updates),
     size(os.size),
     readOnly(false) {
   assert(!os.readOnly && "no need to copy read only object?");
-  if (os.knownSymbolics) {
-    knownSymbolics = new ref<Expr>[size];
-    for (unsigned i=0; i<size; i++)
-      knownSymbolics[i] = os.knownSymbolics[i];
-  }
-
-  memcpy(concreteStore, os.concreteStore, size*sizeof(*concreteStore));
 }
 
-ObjectState::~ObjectState() {
-  delete concreteMask;
-  delete flushMask;
-  delete[] knownSymbolics;
-  delete[] concreteStore;
-}
+ObjectState::~ObjectState() {}
 
 ArrayCache *ObjectState::getArrayCache() const {
   assert(object && "object was NULL");
@@ -146,9 +138,6 @@ const UpdateList &ObjectState::getUpdates() const {
   if (!updates.root) {
     // Collect the list of writes, with the oldest writes first.
     
-    // FIXME: We should be able to do this more efficiently, we just need to be
-    // careful to get the interaction with the cache right. In particular we
-    // should avoid creating UpdateNode instances we never use.
     unsigned NumWrites = updates.head ? updates.head->getSize() : 0;
     std::vector< std::pair< ref<Expr>, ref<Expr> > > Writes(NumWrites);
     const auto *un = updates.head.get();
@@ -157,13 +146,11 @@ const UpdateList &ObjectState::getUpdates() const {
       Writes[i] = std::make_pair(un->index, un->value);
     }
 
-    std::vector< ref<ConstantExpr> > Contents(size);
+    std::vector<uint8_t> Contents(size, 0);
 
-    // Initialize to zeros.
-    for (unsigned i = 0, e = size; i != e; ++i)
-      Contents[i] = ConstantExpr::create(0, Expr::Int8);
-
-    // Pull off as many concrete writes as we can.
+    // Pull off as many concrete writes as we can, remembering what the last
+    // few of them overwrote.
+    std::vector<std::pair<unsigned, uint8_t>> Overwritten;
     unsigned Begin = 0, End = Writes.size();
     for (; Begin != End; ++Begin) {
       // Push concrete writes into the constant array.
@@ -175,18 +162,40 @@ const UpdateList &ObjectState::getUpdates() const {
       if (!Value)
         break;
 
-      Contents[Index->getZExtValue()] = Value;
+      unsigned Offset = Index->getZExtValue();
+      if (Overwritten.size() == MaxConstantArrayDelta)
+        Overwritten.erase(Overwritten.begin());
+      Overwritten.emplace_back(Offset, Contents[Offset]);
+      Contents[Offset] = Value->getZExtValue(8);
     }
 
-    static unsigned id = 0;
-    const Array *array = getArrayCache()->CreateArray(
-        "const_arr" + llvm::utostr(++id), size, &Contents[0],
-        &Contents[0] + Contents.size());
+    // Objects with the same contents share their array, which lets the
+    // solver caches recognise queries over them. Failing that, an array
+    // which differs only by the last few writes is reused with these writes
+    // on top of it.
+    ArrayCache *cache = getArrayCache();
+    const Array *array = cache->findConstantArray(Contents);
+    unsigned Base = Begin;
+    if (!array && !Overwritten.empty()) {
+      std::vector<uint8_t> Older(Contents);
+      for (auto it = Overwritten.rbegin(), ie = Overwritten.rend();
+           !array && it != ie; ++it) {
+        Older[it->first] = it->second;
+        --Base;
+        array = cache->findConstantArray(Older);
+      }
+    }
+    if (!array) {
+      static unsigned id = 0;
+      array = cache->CreateConstantArray("const_arr" + llvm::utostr(++id),
+                                         Contents);
+      Base = Begin;
+    }
     updates = UpdateList(array, 0);
 
-    // Apply the remaining (non-constant) writes.
-    for (; Begin != End; ++Begin)
-      updates.extend(Writes[Begin].first, Writes[Begin].second);
+    // Apply the remaining writes.
+    for (; Base != End; ++Base)
+      updates.extend(Writes[Base].first, Writes[Base].second);
   }
 
   return updates;
@@ -204,18 +213,15 @@ void ObjectState::flushToConcreteStore(TimingSolver *solver,
                      "byte %p+%u will have random value",
                      (void *)object->address, i);
       else
-        ce->toMemory(concreteStore + i);
+        concreteStore.set(i, ce->getZExtValue(8));
     }
   }
 }
 
 void ObjectState::makeConcrete() {
-  delete concreteMask;
-  delete flushMask;
-  delete[] knownSymbolics;
-  concreteMask = 0;
-  flushMask = 0;
-  knownSymbolics = 0;
+  concreteMask.reset();
+  flushMask.reset();
+  knownSymbolics.clear();
 }
 
 void ObjectState::makeSymbolic() {
@@ -232,15 +238,13 @@ void ObjectState::makeSymbolic() {
 
 void ObjectState::initializeToZero() {
   makeConcrete();
-  memset(concreteStore, 0, size);
+  concreteStore.fill(0);
 }
 
 void ObjectState::initializeToRandom() {  
   makeConcrete();
-  for (unsigned i=0; i<size; i++) {
-    // randomly selected by 256 sided die
-    concreteStore[i] = 0xAB;
-  }
+  // randomly selected by 256 sided die
+  concreteStore.fill(0xAB);
 }
 
 /*
@@ -260,17 +264,17 @@ void ObjectState::fastRangeCheckOffset(ref<Expr> offset,
 
 void ObjectState::flushRangeForRead(unsigned rangeBase, 
                                     unsigned rangeSize) const {
-  if (!flushMask) flushMask = new BitArray(size, true);
+  if (!flushMask) flushMask.reset(new PagedBitArray(size, true));
  
   for (unsigned offset=rangeBase; offset<rangeBase+rangeSize; offset++) {
     if (!isByteFlushed(offset)) {
       if (isByteConcrete(offset)) {
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       ConstantExpr::create(concreteStore[offset], Expr::Int8));
+                       ConstantExpr::create(concreteStore.get(offset), Expr::Int8));
       } else {
         assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       knownSymbolics[offset]);
+                       knownSymbolics.get(offset));
       }
 
       flushMask->unset(offset);
@@ -280,18 +284,18 @@ void ObjectState::flushRangeForRead(unsigned rangeBase,
 
 void ObjectState::flushRangeForWrite(unsigned rangeBase, 
                                      unsigned rangeSize) {
-  if (!flushMask) flushMask = new BitArray(size, true);
+  if (!flushMask) flushMask.reset(new PagedBitArray(size, true));
 
   for (unsigned offset=rangeBase; offset<rangeBase+rangeSize; offset++) {
     if (!isByteFlushed(offset)) {
       if (isByteConcrete(offset)) {
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       ConstantExpr::create(concreteStore[offset], Expr::Int8));
+                       ConstantExpr::create(concreteStore.get(offset), Expr::Int8));
         markByteSymbolic(offset);
       } else {
         assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       knownSymbolics[offset]);
+                       knownSymbolics.get(offset));
         setKnownSymbolic(offset, 0);
       }
 
@@ -317,7 +321,7 @@ bool ObjectState::isByteFlushed(unsigned offset) const {
 }
 
 bool ObjectState::isByteKnownSymbolic(unsigned offset) const {
-  return knownSymbolics && knownSymbolics[offset].get();
+  return !knownSymbolics.get(offset).isNull();
 }
 
 void ObjectState::markByteConcrete(unsigned offset) {
@@ -327,7 +331,7 @@ void ObjectState::markByteConcrete(unsigned offset) {
 
 void ObjectState::markByteSymbolic(unsigned offset) {
   if (!concreteMask)
-    concreteMask = new BitArray(size, true);
+    concreteMask.reset(new PagedBitArray(size, true));
   concreteMask->unset(offset);
 }
 
@@ -338,7 +342,7 @@ void ObjectState::markByteUnflushed(unsigned offset) {
 
 void ObjectState::markByteFlushed(unsigned offset) {
   if (!flushMask) {
-    flushMask = new BitArray(size, false);
+    flushMask.reset(new PagedBitArray(size, false));
   } else {
     flushMask->unset(offset);
   }
@@ -346,23 +350,18 @@ void ObjectState::markByteFlushed(unsigned offset) {
 
 void ObjectState::setKnownSymbolic(unsigned offset, 
                                    Expr *value /* can be null */) {
-  if (knownSymbolics) {
-    knownSymbolics[offset] = value;
-  } else {
-    if (value) {
-      knownSymbolics = new ref<Expr>[size];
-      knownSymbolics[offset] = value;
-    }
-  }
+  // Avoid copying a shared page if nothing changes.
+  if (knownSymbolics.get(offset).get() != value)
+    knownSymbolics.set(offset, value);
 }
 
 /***/
 
 ref<Expr> ObjectState::read8(unsigned offset) const {
   if (isByteConcrete(offset)) {
-    return ConstantExpr::create(concreteStore[offset], Expr::Int8);
+    return ConstantExpr::create(concreteStore.get(offset), Expr::Int8);
   } else if (isByteKnownSymbolic(offset)) {
-    return knownSymbolics[offset];
+    return knownSymbolics.get(offset);
   } else {
     assert(isByteFlushed(offset) && "unflushed byte without cache value");
     
@@ -390,7 +389,9 @@ ref<Expr> ObjectState::read8(ref<Expr> offset) const {
 
 void ObjectState::write8(unsigned offset, uint8_t value) {
   //assert(read_only == false && "writing to read-only object!");
-  concreteStore[offset] = value;
+  // Avoid copying a shared page if nothing changes.
+  if (concreteStore.get(offset) != value)
+    concreteStore.set(offset, value);
   setKnownSymbolic(offset, 0);
 
   markByteConcrete(offset);
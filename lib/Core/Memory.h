@@ -11,12 +11,14 @@
 #define KLEE_MEMORY_H
 
 #include "Context.h"
+#include "PagedArray.h"
 #include "TimingSolver.h"
 
 #include "klee/Expr/Expr.h"
 
 #include "llvm/ADT/StringExtras.h"
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -27,7 +29,6 @@ namespace llvm {
 namespace klee {
 
 class ArrayCache;
-class BitArray;
 class ExecutionState;
 class MemoryManager;
 class Solver;
@@ -178,15 +179,22 @@ private:
 
   ref<const MemoryObject> object;
 
-  uint8_t *concreteStore;
+  // The contents are split into pages which copies of the object state share
+  // until they write to them, so that forking a state which owns large
+  // objects only copies the pages it changes.
+
+  // mutable because flushToConcreteStore() updates the cache of a const
+  mutable PagedArray<uint8_t> concreteStore;
 
   // XXX cleanup name of flushMask (its backwards or something)
-  BitArray *concreteMask;
+  std::unique_ptr<PagedBitArray> concreteMask;
 
   // mutable because may need flushed during read of const
-  mutable BitArray *flushMask;
+  mutable std::unique_ptr<PagedBitArray> flushMask;
 
-  ref<Expr> *knownSymbolics;
+  // Usually only a handful of bytes are known symbolic, e.g. one field of a
+  // packet header, so these are stored sparsely until there are many.
+  SparsePagedArray<ref<Expr>> knownSymbolics;
 
   // mutable because we may need flush during read of const
   mutable UpdateList updates;
@@ -0,0 +1,375 @@
+//===-- PagedArray.h --------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_PAGEDARRAY_H
+#define KLEE_PAGEDARRAY_H
+
+#include "llvm/Support/MathExtras.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace klee {
+
+/// The bytes held by the pages of all PagedArrays. A page is private while a
+/// single array refers to it and shared once copies of the array do too.
+struct PagedArrayStats {
+  static std::uint64_t privateBytes;
+  static std::uint64_t sharedBytes;
+};
+
+/// The bytes held by the pages of the covered instruction sets of states,
+/// which are counted apart from the object pages in PagedArrayStats.
+struct CoverageArrayStats {
+  static std::uint64_t privateBytes;
+  static std::uint64_t sharedBytes;
+};
+
+/// PagedArray - A fixed-size array split into pages which are shared between
+/// copies of the array until one of them writes to the page. Pages which
+/// were never written to are not allocated at all. A page only holds the
+/// elements it covers, so arrays smaller than a page cost no more than their
+/// elements plus a small header. The bytes of the pages are counted in
+/// \a Stats.
+template <typename T, typename Stats = PagedArrayStats> class PagedArray {
+public:
+  static constexpr unsigned PageBytes = 4096;
+  static constexpr unsigned PageSize =
+      sizeof(T) < PageBytes ? PageBytes / sizeof(T) : 1;
+
+private:
+  /// The header of a page, followed by its elements.
+  struct Page {
+    unsigned refCount;
+    unsigned size;
+
+    T *data() {
+      return reinterpret_cast<T *>(reinterpret_cast<char *>(this) +
+                                   DataOffset);
+    }
+    const T *data() const {
+      return reinterpret_cast<const T *>(
+          reinterpret_cast<const char *>(this) + DataOffset);
+    }
+  };
+
+  static constexpr std::size_t DataOffset =
+      (sizeof(Page) + alignof(T) - 1) / alignof(T) * alignof(T);
+
+  /// The pages, null if all of their elements are still \a initial.
+  std::vector<Page *> pages;
+  unsigned size;
+  T initial;
+
+  static std::size_t getPageBytes(unsigned size) {
+    return DataOffset + size * sizeof(T);
+  }
+
+  /// Allocate a private page of \a size elements, the first \a n of which
+  /// are copied from \a src and the others are \a value.
+  static Page *allocate(unsigned size, const T *src, unsigned n,
+                        const T &value) {
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+                  "over-aligned elements are not supported");
+    Page *page = new (::operator new(getPageBytes(size))) Page{1, size};
+    std::uninitialized_copy(src, src + n, page->data());
+    std::uninitialized_fill(page->data() + n, page->data() + size, value);
+    Stats::privateBytes += getPageBytes(size);
+    return page;
+  }
+
+  static void retain(Page *page) {
+    if (page && page->refCount++ == 1) {
+      Stats::privateBytes -= getPageBytes(page->size);
+      Stats::sharedBytes += getPageBytes(page->size);
+    }
+  }
+
+  static void release(Page *page) {
+    if (!page)
+      return;
+    switch (--page->refCount) {
+    case 0:
+      Stats::privateBytes -= getPageBytes(page->size);
+      for (T *x = page->data(), *e = x + page->size; x != e; ++x)
+        x->~T();
+      page->~Page();
+      ::operator delete(page);
+      break;
+    case 1:
+      Stats::sharedBytes -= getPageBytes(page->size);
+      Stats::privateBytes += getPageBytes(page->size);
+      break;
+    }
+  }
+
+  Page *getWriteablePage(unsigned index) {
+    Page *&page = pages[index];
+    if (!page) {
+      page = allocate(getPageSize(index), nullptr, 0, initial);
+    } else if (page->refCount > 1) {
+      Page *copy = allocate(page->size, page->data(), page->size, initial);
+      release(page);
+      page = copy;
+    }
+    return page;
+  }
+
+  /// The number of elements of page \a index.
+  unsigned getPageSize(unsigned index) const {
+    return std::min(PageSize, size - index * PageSize);
+  }
+
+public:
+  explicit PagedArray(unsigned size, const T &initial = T())
+      : pages((size + PageSize - 1) / PageSize), size(size), initial(initial) {}
+
+  PagedArray(const PagedArray &b)
+      : pages(b.pages), size(b.size), initial(b.initial) {
+    for (Page *page : pages)
+      retain(page);
+  }
+
+  PagedArray &operator=(const PagedArray &b) = delete;
+
+  ~PagedArray() {
+    for (Page *page : pages)
+      release(page);
+  }
+
+  unsigned getSize() const { return size; }
+
+  /// Grow the array to \a newSize elements, which are \a initial.
+  void resize(unsigned newSize) {
+    assert(newSize >= size && "PagedArrays only grow");
+    unsigned last = pages.size() - 1;
+    pages.resize((newSize + PageSize - 1) / PageSize);
+    size = newSize;
+    // A partial last page is replaced by one covering its new elements too.
+    if (last < pages.size() && pages[last] &&
+        pages[last]->size != getPageSize(last)) {
+      Page *page = pages[last];
+      pages[last] = allocate(getPageSize(last), page->data(), page->size,
+                             initial);
+      release(page);
+    }
+  }
+
+  void swap(PagedArray &b) {
+    pages.swap(b.pages);
+    std::swap(size, b.size);
+    std::swap(initial, b.initial);
+  }
+
+  const T &get(unsigned index) const {
+    const Page *page = pages[index / PageSize];
+    return page ? page->data()[index % PageSize] : initial;
+  }
+
+  void set(unsigned index, const T &value) {
+    getWriteablePage(index / PageSize)->data()[index % PageSize] = value;
+  }
+
+  /// Set all elements to \a value, dropping all pages.
+  void fill(const T &value) {
+    for (Page *&page : pages) {
+      release(page);
+      page = nullptr;
+    }
+    initial = value;
+  }
+
+  /// Copy all elements to \a dst.
+  void copyTo(T *dst) const {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "only trivially copyable elements can be copied out");
+    for (unsigned i = 0, e = pages.size(); i != e; ++i, dst += PageSize) {
+      if (pages[i])
+        std::memcpy(dst, pages[i]->data(), getPageSize(i) * sizeof(T));
+      else
+        std::fill(dst, dst + getPageSize(i), initial);
+    }
+  }
+
+  /// Whether the elements are equal to those at \a src.
+  bool equals(const T *src) const {
+    for (unsigned i = 0, e = pages.size(); i != e; ++i, src += PageSize) {
+      unsigned n = getPageSize(i);
+      if (pages[i] ? std::memcmp(src, pages[i]->data(), n * sizeof(T)) != 0
+                   : std::find_if(src, src + n, [&](const T &x) {
+                       return x != initial;
+                     }) != src + n)
+        return false;
+    }
+    return true;
+  }
+
+  /// Copy all elements from \a src. Pages whose elements do not change stay
+  /// shared.
+  void assign(const T *src) {
+    for (unsigned i = 0, e = pages.size(); i != e; ++i, src += PageSize) {
+      unsigned n = getPageSize(i);
+      if (pages[i] && std::memcmp(src, pages[i]->data(), n * sizeof(T)) == 0)
+        continue;
+      if (!pages[i] && std::find_if(src, src + n, [&](const T &x) {
+                         return x != initial;
+                       }) == src + n)
+        continue;
+      std::copy(src, src + n, getWriteablePage(i)->data());
+    }
+  }
+};
+
+template <typename T, typename Stats>
+constexpr unsigned PagedArray<T, Stats>::PageBytes;
+template <typename T, typename Stats>
+constexpr unsigned PagedArray<T, Stats>::PageSize;
+template <typename T, typename Stats>
+constexpr std::size_t PagedArray<T, Stats>::DataOffset;
+
+/// SparsePagedArray - A PagedArray of pointer-like elements which are mostly
+/// null. While few elements are set they are kept in a small sorted vector,
+/// which costs a few bytes per element rather than a page; past MaxSparse
+/// elements the array switches to pages for good.
+template <typename T> class SparsePagedArray {
+public:
+  static constexpr unsigned MaxSparse = 32;
+
+private:
+  typedef std::pair<unsigned, T> entry_ty;
+
+  std::vector<entry_ty> sparse;
+  std::unique_ptr<PagedArray<T>> dense;
+  unsigned size;
+
+  template <typename Vector>
+  static auto find(Vector &sparse, unsigned index) -> decltype(sparse.begin()) {
+    return std::lower_bound(
+        sparse.begin(), sparse.end(), index,
+        [](const entry_ty &e, unsigned index) { return e.first < index; });
+  }
+
+public:
+  explicit SparsePagedArray(unsigned size) : size(size) {}
+
+  SparsePagedArray(const SparsePagedArray &b)
+      : sparse(b.sparse), dense(b.dense ? new PagedArray<T>(*b.dense) : nullptr),
+        size(b.size) {}
+
+  SparsePagedArray &operator=(const SparsePagedArray &b) = delete;
+
+  bool isDense() const { return dense != nullptr; }
+
+  const T &get(unsigned index) const {
+    static const T null{};
+    if (dense)
+      return dense->get(index);
+    auto it = find(sparse, index);
+    return it != sparse.end() && it->first == index ? it->second : null;
+  }
+
+  void set(unsigned index, const T &value) {
+    if (dense) {
+      dense->set(index, value);
+      return;
+    }
+    auto it = find(sparse, index);
+    if (it != sparse.end() && it->first == index) {
+      if (value)
+        it->second = value;
+      else
+        sparse.erase(it);
+    } else if (value) {
+      if (sparse.size() < MaxSparse) {
+        sparse.emplace(it, index, value);
+        return;
+      }
+      dense.reset(new PagedArray<T>(size));
+      for (const entry_ty &e : sparse)
+        dense->set(e.first, e.second);
+      dense->set(index, value);
+      std::vector<entry_ty>().swap(sparse);
+    }
+  }
+
+  /// Set all elements to null.
+  void clear() {
+    std::vector<entry_ty>().swap(sparse);
+    dense.reset();
+  }
+};
+
+template <typename T> constexpr unsigned SparsePagedArray<T>::MaxSparse;
+
+/// BasicPagedBitArray - A bit array whose pages are shared between copies.
+/// Setting a bit to the value it already has does not copy its page.
+template <typename Stats> class BasicPagedBitArray {
+  PagedArray<std::uint32_t, Stats> words;
+
+  void setWord(unsigned index, std::uint32_t word) {
+    if (words.get(index) != word)
+      words.set(index, word);
+  }
+
+public:
+  explicit BasicPagedBitArray(unsigned size = 0, bool value = false)
+      : words((size + 31) / 32, value ? ~0u : 0u) {}
+
+  /// The number of bits, rounded up to whole words.
+  unsigned getSize() const { return words.getSize() * 32; }
+
+  /// Grow the array to at least \a size bits. The new bits are unset, or
+  /// set if the array was constructed or cleared to set bits.
+  void resize(unsigned size) { words.resize((size + 31) / 32); }
+
+  /// Unset all bits, dropping all pages.
+  void clear() { words.fill(0); }
+
+  void swap(BasicPagedBitArray &b) { words.swap(b.words); }
+
+  /// Call \a f with the index of each set bit, in increasing order.
+  template <typename F> void forEachSet(F f) const {
+    for (unsigned i = 0, e = words.getSize(); i != e; ++i)
+      for (std::uint32_t word = words.get(i); word; word &= word - 1)
+        f(i * 32 + llvm::countTrailingZeros(word));
+  }
+
+  bool get(unsigned idx) const {
+    return (words.get(idx / 32) >> (idx & 0x1F)) & 1;
+  }
+  void set(unsigned idx) {
+    setWord(idx / 32, words.get(idx / 32) | (1u << (idx & 0x1F)));
+  }
+  void unset(unsigned idx) {
+    setWord(idx / 32, words.get(idx / 32) & ~(1u << (idx & 0x1F)));
+  }
+  void set(unsigned idx, bool value) {
+    if (value)
+      set(idx);
+    else
+      unset(idx);
+  }
+};
+
+/// The masks of object states.
+typedef BasicPagedBitArray<PagedArrayStats> PagedBitArray;
+/// The instructions covered by a state.
+typedef BasicPagedBitArray<CoverageArrayStats> CoverageBitArray;
+
+} // namespace klee
+
+#endif /* KLEE_PAGEDARRAY_H */
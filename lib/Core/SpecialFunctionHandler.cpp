@@ -48,6 +48,15 @@ cl::opt<bool>
                            "tests (default=false)"),
                   cl::cat(TestGenCat));
 
+cl::opt<bool> NativeFPModels(
+    "native-fp-models", cl::init(false),
+    cl::desc("Handle exp, log, sin, cos, tan and pow (and their float and "
+             "long double variants) natively instead of interpreting the FP "
+             "runtime. Concrete arguments are evaluated by the host, symbolic "
+             "ones give a fresh result constrained to the range of the "
+             "function, which over-approximates it (default=false)"),
+    cl::cat(ModuleCat));
+
 cl::opt<bool>
     SilentKleeAssume("silent-klee-assume", cl::init(false),
                      cl::desc("Silently terminate paths with an infeasible "
@@ -69,17 +78,18 @@ cl::opt<bool>
 static SpecialFunctionHandler::HandlerInfo handlerInfo[] = {
 #define add(name, handler, ret) { name, \
                                   &SpecialFunctionHandler::handler, \
-                                  false, ret, false }
+                                  false, ret, false, false }
 #define addDNR(name, handler) { name, \
                                 &SpecialFunctionHandler::handler, \
-                                true, false, false }
+                                true, false, false, false }
   addDNR("__assert_rtn", handleAssertFail),
   addDNR("__assert_fail", handleAssertFail),
   addDNR("__assert", handleAssertFail),
   addDNR("_assert", handleAssert),
   addDNR("abort", handleAbort),
   addDNR("_exit", handleExit),
-  { "exit", &SpecialFunctionHandler::handleExit, true, false, true },
+  { "exit", &SpecialFunctionHandler::handleExit, true, false, true,
+    false },
   addDNR("klee_abort", handleAbort),
   addDNR("klee_silent_exit", handleSilentExit),
   addDNR("klee_report_error", handleReportError),
@@ -186,6 +196,32 @@ static SpecialFunctionHandler::HandlerInfo handlerInfo[] = {
 #if defined(__x86_64__) || defined(__i386__)
   add("klee_rintl", handleRint, true),
 #endif
+
+  // transcendental functions, see -native-fp-models
+#define addLibm(name, handler) { name, \
+                                 &SpecialFunctionHandler::handler, \
+                                 false, true, false, true }
+  addLibm("exp", handleExp),
+  addLibm("expf", handleExp),
+  addLibm("log", handleLog),
+  addLibm("logf", handleLog),
+  addLibm("sin", handleSin),
+  addLibm("sinf", handleSin),
+  addLibm("cos", handleCos),
+  addLibm("cosf", handleCos),
+  addLibm("tan", handleTan),
+  addLibm("tanf", handleTan),
+  addLibm("pow", handlePow),
+  addLibm("powf", handlePow),
+#if defined(__x86_64__) || defined(__i386__)
+  addLibm("expl", handleExp),
+  addLibm("logl", handleLog),
+  addLibm("sinl", handleSin),
+  addLibm("cosl", handleCos),
+  addLibm("tanl", handleTan),
+  addLibm("powl", handlePow),
+#endif
+#undef addLibm
 #undef addDNR
 #undef add
 };
@@ -224,6 +260,8 @@ void SpecialFunctionHandler::prepare(
 
   for (unsigned i=0; i<N; ++i) {
     HandlerInfo &hi = handlerInfo[i];
+    if (hi.isLibmModel && !NativeFPModels)
+      continue;
     Function *f = executor.kmodule->module->getFunction(hi.name);
 
     // No need to create if the function doesn't exist, since it cannot
@@ -248,6 +286,8 @@ void SpecialFunctionHandler::bind() {
 
   for (unsigned i=0; i<N; ++i) {
     HandlerInfo &hi = handlerInfo[i];
+    if (hi.isLibmModel && !NativeFPModels)
+      continue;
     Function *f = executor.kmodule->module->getFunction(hi.name);
     
     if (f && (!hi.doNotOverride || f->isDeclaration()))
@@ -1108,3 +1148,142 @@ void SpecialFunctionHandler::handleFAbs(ExecutionState &state,
     ref<Expr> result = FAbsExpr::create(arguments[0]);
     executor.bindLocal(target, state, result);
 }
+
+void SpecialFunctionHandler::modelLibmFunction(
+    ExecutionState &state, KInstruction *target,
+    std::vector<ref<Expr> > &arguments, LibmFunction function) {
+  unsigned numArgs = function == LibmFunction::Pow ? 2 : 1;
+  assert(arguments.size() == numArgs &&
+         "invalid number of arguments to libm function");
+  ref<Expr> x = arguments[0];
+  ref<Expr> y = numArgs == 2 ? arguments[1] : x;
+  Expr::Width width = x->getWidth();
+
+  // The host has no rounding mode for ties away from zero.
+  if (isa<ConstantExpr>(x) && isa<ConstantExpr>(y) &&
+      state.roundingMode != llvm::APFloat::rmNearestTiesToAway) {
+    llvm::APFloat result = evalLibmFunction(
+        function, cast<ConstantExpr>(x)->getAPFloatValue(),
+        cast<ConstantExpr>(y)->getAPFloatValue(), state.roundingMode);
+    executor.bindLocal(target, state, ConstantExpr::alloc(result));
+    return;
+  }
+
+  // The result is an uninterpreted function of the arguments.
+  const Array *&array = libmResults[std::make_tuple(
+      function, state.roundingMode,
+      numArgs == 2 ? ConcatExpr::create(x, y) : x)];
+  if (!array) {
+    static unsigned id;
+    array = executor.arrayCache.CreateArray(
+        "libm_result" + llvm::utostr(++id), Expr::getMinBytesForWidth(width));
+  }
+  ref<Expr> result = Expr::createTempRead(array, width);
+
+  const llvm::fltSemantics &semantics =
+      ConstantExpr::widthToFloatSemantics(width);
+  auto constant = [&](int value) -> ref<Expr> {
+    llvm::APFloat f(semantics, std::abs(value));
+    if (value < 0)
+      f.changeSign();
+    return ConstantExpr::alloc(f);
+  };
+  auto infinity = [&](bool negative) -> ref<Expr> {
+    return ConstantExpr::alloc(llvm::APFloat::getInf(semantics, negative));
+  };
+  auto implies = [&](ref<Expr> condition, ref<Expr> consequence) {
+    executor.addConstraint(
+        state, OrExpr::create(Expr::createIsZero(condition), consequence));
+  };
+
+  ref<Expr> zero = constant(0), one = constant(1);
+  ref<Expr> isNaN = IsNaNExpr::create(x);
+  switch (function) {
+  case LibmFunction::Exp:
+    implies(isNaN, IsNaNExpr::create(result));
+    implies(Expr::createIsZero(isNaN), FOGeExpr::create(result, zero));
+    implies(FOEqExpr::create(x, zero), FOEqExpr::create(result, one));
+    implies(FOGtExpr::create(x, zero), FOGeExpr::create(result, one));
+    implies(FOLtExpr::create(x, zero), FOLeExpr::create(result, one));
+    implies(FOEqExpr::create(x, infinity(false)),
+            FOEqExpr::create(result, infinity(false)));
+    implies(FOEqExpr::create(x, infinity(true)),
+            FOEqExpr::create(result, zero));
+    break;
+  case LibmFunction::Log:
+    implies(OrExpr::create(isNaN, FOLtExpr::create(x, zero)),
+            IsNaNExpr::create(result));
+    implies(FOEqExpr::create(x, zero),
+            FOEqExpr::create(result, infinity(true)));
+    implies(FOEqExpr::create(x, one), FOEqExpr::create(result, zero));
+    implies(FOGtExpr::create(x, one), FOGeExpr::create(result, zero));
+    implies(AndExpr::create(FOGtExpr::create(x, zero),
+                            FOLtExpr::create(x, one)),
+            FOLeExpr::create(result, zero));
+    implies(FOEqExpr::create(x, infinity(false)),
+            FOEqExpr::create(result, infinity(false)));
+    break;
+  case LibmFunction::Sin:
+  case LibmFunction::Cos:
+  case LibmFunction::Tan: {
+    ref<Expr> isFinite =
+        Expr::createIsZero(OrExpr::create(isNaN, IsInfiniteExpr::create(x)));
+    implies(Expr::createIsZero(isFinite), IsNaNExpr::create(result));
+    if (function == LibmFunction::Tan)
+      implies(isFinite, Expr::createIsZero(
+                            OrExpr::create(IsNaNExpr::create(result),
+                                           IsInfiniteExpr::create(result))));
+    else
+      implies(isFinite, AndExpr::create(FOGeExpr::create(result, constant(-1)),
+                                        FOLeExpr::create(result, one)));
+    implies(FOEqExpr::create(x, zero),
+            FOEqExpr::create(result,
+                             function == LibmFunction::Cos ? one : zero));
+    break;
+  }
+  case LibmFunction::Pow:
+    implies(FOEqExpr::create(y, zero), FOEqExpr::create(result, one));
+    implies(FOEqExpr::create(x, one), FOEqExpr::create(result, one));
+    implies(AndExpr::create(FOEqExpr::create(y, one),
+                            Expr::createIsZero(isNaN)),
+            FOEqExpr::create(result, x));
+    break;
+  }
+  executor.bindLocal(target, state, result);
+}
+
+void SpecialFunctionHandler::handleExp(ExecutionState &state,
+                                       KInstruction *target,
+                                       std::vector<ref<Expr> > &arguments) {
+  modelLibmFunction(state, target, arguments, LibmFunction::Exp);
+}
+
+void SpecialFunctionHandler::handleLog(ExecutionState &state,
+                                       KInstruction *target,
+                                       std::vector<ref<Expr> > &arguments) {
+  modelLibmFunction(state, target, arguments, LibmFunction::Log);
+}
+
+void SpecialFunctionHandler::handleSin(ExecutionState &state,
+                                       KInstruction *target,
+                                       std::vector<ref<Expr> > &arguments) {
+  modelLibmFunction(state, target, arguments, LibmFunction::Sin);
+}
+
+void SpecialFunctionHandler::handleCos(ExecutionState &state,
+                                       KInstruction *target,
+                                       std::vector<ref<Expr> > &arguments) {
+  modelLibmFunction(state, target, arguments, LibmFunction::Cos);
+}
+
+void SpecialFunctionHandler::handleTan(ExecutionState &state,
+                                       KInstruction *target,
+                                       std::vector<ref<Expr> > &arguments) {
+  modelLibmFunction(state, target, arguments, LibmFunction::Tan);
+}
+
+void SpecialFunctionHandler::handlePow(ExecutionState &state,
+                                       KInstruction *target,
+                                       std::vector<ref<Expr> > &arguments) {
+  modelLibmFunction(state, target, arguments, LibmFunction::Pow);
+}
@@ -10,23 +10,26 @@
 #ifndef KLEE_SPECIALFUNCTIONHANDLER_H
 #define KLEE_SPECIALFUNCTIONHANDLER_H
 
+#include "klee/ADT/Ref.h"
 #include "klee/Config/config.h"
+#include "klee/util/APFloatEval.h"
 
 #include <iterator>
 #include <map>
 #include <vector>
 #include <string>
+#include <tuple>
 
 namespace llvm {
   class Function;
 }
 
 namespace klee {
+  class Array;
   class Executor;
   class Expr;
   class ExecutionState;
   struct KInstruction;
-  template<typename T> class ref;
   
   class SpecialFunctionHandler {
   public:
@@ -40,12 +43,20 @@ namespace klee {
     handlers_ty handlers;
     class Executor &executor;
 
+    /// The fresh results of libm functions on symbolic arguments, by
+    /// function, rounding mode and arguments, so that equal calls give
+    /// equal results.
+    std::map<std::tuple<LibmFunction, llvm::APFloat::roundingMode, ref<Expr>>,
+             const Array *>
+        libmResults;
+
     struct HandlerInfo {
       const char *name;
       SpecialFunctionHandler::Handler handler;
       bool doesNotReturn; /// Intrinsic terminates the process
       bool hasReturnValue; /// Intrinsic has a return value
       bool doNotOverride; /// Intrinsic should not be used if already defined
+      bool isLibmModel; /// Only used with -native-fp-models
     };
 
     // const_iterator to iterate over stored HandlerInfo
@@ -96,6 +107,14 @@ namespace klee {
     /* Convenience routines */
 
     std::string readStringAtAddress(ExecutionState &state, ref<Expr> address);
+
+    /// Bind the result of \a function, computed by the host for concrete
+    /// arguments. For symbolic arguments the result is a fresh value which
+    /// is only constrained to the range of \a function and its exact values
+    /// at special points.
+    void modelLibmFunction(ExecutionState &state, KInstruction *target,
+                           std::vector<ref<Expr> > &arguments,
+                           LibmFunction function);
     
     /* Handlers */
 
@@ -159,6 +178,12 @@ namespace klee {
     HANDLER(handleSqrt);
     HANDLER(handleFAbs);
     HANDLER(handleRint);
+    HANDLER(handleExp);
+    HANDLER(handleLog);
+    HANDLER(handleSin);
+    HANDLER(handleCos);
+    HANDLER(handleTan);
+    HANDLER(handlePow);
 #undef HANDLER
   };
 } // End klee namespace
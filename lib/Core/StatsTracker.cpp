@@ -25,6 +25,7 @@
 #include "CoreStats.h"
 #include "Executor.h"
 #include "MemoryManager.h"
+#include "PagedArray.h"
 #include "UserSearcher.h"
 
 #include "llvm/ADT/SmallBitVector.h"
@@ -44,7 +45,14 @@
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Process.h"
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
+#include <functional>
+#include <numeric>
+#include <queue>
+#include <signal.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 using namespace klee;
@@ -63,6 +71,14 @@ cl::opt<bool> TrackInstructionTime(
         "Enable tracking of time for individual instructions (default=false)"),
     cl::cat(StatsCat));
 
+cl::opt<std::string> SampleInstructionTime(
+    "sample-instruction-time", cl::init(""),
+    cl::desc("Track the time of individual instructions by sampling the "
+             "executed instruction after each given amount of CPU time, "
+             "e.g. 1ms. Unlike --track-instruction-time, this adds almost no "
+             "overhead (default=off)"),
+    cl::cat(StatsCat));
+
 cl::opt<bool>
     OutputStats("output-stats", cl::init(true),
                 cl::desc("Write running stats trace file (default=true)"),
@@ -118,6 +134,16 @@ cl::opt<bool> UseCallPaths("use-call-paths", cl::init(true),
 
 ///
 
+/// The SIGPROF signals of -sample-instruction-time which were not yet
+/// attributed to an instruction.
+static std::atomic<unsigned> pendingSamples(0);
+
+static void sampleHandler(int) {
+  pendingSamples.fetch_add(1, std::memory_order_relaxed);
+}
+
+///
+
 bool StatsTracker::useStatistics() {
   return OutputStats || OutputIStats;
 }
@@ -185,6 +211,13 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
         "--istats-write-after-instructions cannot be enabled at the same "
         "time.");
 
+  samplePeriod = time::Span(SampleInstructionTime);
+  if (samplePeriod && TrackInstructionTime)
+    klee_error("Both options --track-instruction-time and "
+               "--sample-instruction-time cannot be enabled at the same time.");
+  if (!OutputIStats)
+    samplePeriod = time::Span();
+
   KModule *km = executor.kmodule.get();
   if(CommitEvery > 0) {
       statsCommitEvery = CommitEvery;
@@ -231,46 +264,7 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
     sqlite3_config(SQLITE_CONFIG_SINGLETHREAD);
     sqlite3_enable_shared_cache(0);
 
-    // open database
-    auto db_filename = executor.interpreterHandler->getOutputFilename("run.stats");
-    if (sqlite3_open(db_filename.c_str(), &statsFile) != SQLITE_OK) {
-      std::ostringstream errorstream;
-      errorstream << "Can't open database: " << sqlite3_errmsg(statsFile);
-      sqlite3_close(statsFile);
-      klee_error("%s", errorstream.str().c_str());
-    }
-
-    // prepare statements
-    if (sqlite3_prepare_v2(statsFile, "BEGIN TRANSACTION", -1, &transactionBeginStmt, nullptr) != SQLITE_OK) {
-      klee_error("Cannot create prepared statement: %s", sqlite3_errmsg(statsFile));
-    }
-
-    if (sqlite3_prepare_v2(statsFile, "END TRANSACTION", -1, &transactionEndStmt, nullptr) != SQLITE_OK) {
-      klee_error("Cannot create prepared statement: %s", sqlite3_errmsg(statsFile));
-    }
-
-    // set options
-    char *zErrMsg;
-    if (sqlite3_exec(statsFile, "PRAGMA synchronous = OFF", nullptr, nullptr, &zErrMsg) != SQLITE_OK) {
-      klee_error("%s", sqlite3ErrToStringAndFree("Can't set options for database: ", zErrMsg).c_str());
-    }
-
-    // note: we use WAL here a) for speed and b) to prevent creation of new file descriptors (as with TRUNCATE)
-    if (sqlite3_exec(statsFile, "PRAGMA journal_mode = WAL", nullptr, nullptr, &zErrMsg) != SQLITE_OK) {
-      klee_error("%s", sqlite3ErrToStringAndFree("Can't set options for database: ", zErrMsg).c_str());
-    }
-
-    // create table
-    writeStatsHeader();
-
-    // begin transaction
-    auto rc = sqlite3_step(transactionBeginStmt);
-    if (rc != SQLITE_DONE) {
-      klee_warning("Can't begin transaction: %s", sqlite3_errmsg(statsFile));
-    }
-    sqlite3_reset(transactionBeginStmt);
-
-    writeStatsLine();
+    openStatsFile();
 
     if (statsWriteInterval)
       executor.timers.add(std::make_unique<Timer>(statsWriteInterval, [&]{
@@ -296,10 +290,131 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
     } else {
       klee_error("Unable to open instruction level stats file (run.istats).");
     }
+    if (samplePeriod)
+      startSampling();
+  }
+}
+
+void StatsTracker::openStatsFile() {
+  // open database
+  auto db_filename = executor.interpreterHandler->getOutputFilename("run.stats");
+  if (sqlite3_open(db_filename.c_str(), &statsFile) != SQLITE_OK) {
+    std::ostringstream errorstream;
+    errorstream << "Can't open database: " << sqlite3_errmsg(statsFile);
+    sqlite3_close(statsFile);
+    klee_error("%s", errorstream.str().c_str());
+  }
+
+  // prepare statements
+  if (sqlite3_prepare_v2(statsFile, "BEGIN TRANSACTION", -1, &transactionBeginStmt, nullptr) != SQLITE_OK) {
+    klee_error("Cannot create prepared statement: %s", sqlite3_errmsg(statsFile));
+  }
+
+  if (sqlite3_prepare_v2(statsFile, "END TRANSACTION", -1, &transactionEndStmt, nullptr) != SQLITE_OK) {
+    klee_error("Cannot create prepared statement: %s", sqlite3_errmsg(statsFile));
+  }
+
+  // set options
+  char *zErrMsg;
+  if (sqlite3_exec(statsFile, "PRAGMA synchronous = OFF", nullptr, nullptr, &zErrMsg) != SQLITE_OK) {
+    klee_error("%s", sqlite3ErrToStringAndFree("Can't set options for database: ", zErrMsg).c_str());
+  }
+
+  // note: we use WAL here a) for speed and b) to prevent creation of new file descriptors (as with TRUNCATE)
+  if (sqlite3_exec(statsFile, "PRAGMA journal_mode = WAL", nullptr, nullptr, &zErrMsg) != SQLITE_OK) {
+    klee_error("%s", sqlite3ErrToStringAndFree("Can't set options for database: ", zErrMsg).c_str());
+  }
+
+  // create table
+  writeStatsHeader();
+
+  // begin transaction
+  auto rc = sqlite3_step(transactionBeginStmt);
+  if (rc != SQLITE_DONE) {
+    klee_warning("Can't begin transaction: %s", sqlite3_errmsg(statsFile));
+  }
+  sqlite3_reset(transactionBeginStmt);
+
+  writeStatsLine();
+}
+
+void StatsTracker::startWorker() {
+  // SQLite connections must not be used across fork(), so the connection to
+  // the parent's database is abandoned rather than closed.
+  if (statsFile) {
+    statsFile = nullptr;
+    transactionBeginStmt = transactionEndStmt = insertStmt = nullptr;
+    statsWriteCount = 0;
+    openStatsFile();
+  }
+
+  if (istatsFile) {
+    istatsFile = executor.interpreterHandler->openOutputFile("run.istats");
+    if (!istatsFile)
+      klee_error("Unable to open instruction level stats file (run.istats).");
+  }
+
+  // Interval timers are not inherited by forked processes.
+  if (samplePeriod)
+    startSampling();
+}
+
+void StatsTracker::startSampling() {
+  struct sigaction action = {};
+  action.sa_handler = sampleHandler;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGPROF, &action, nullptr) < 0)
+    klee_error("Unable to install SIGPROF handler: %s", strerror(errno));
+
+  itimerval timer;
+  timer.it_interval = timer.it_value = static_cast<timeval>(samplePeriod);
+  if (setitimer(ITIMER_PROF, &timer, nullptr) < 0)
+    klee_error("Unable to start profiling timer: %s", strerror(errno));
+
+  pendingSamples = 0;
+  lastSampleTime = time::getWallTime();
+}
+
+void StatsTracker::takeSamples() {
+  // The CPU time of the samples and the wall time since the last ones are
+  // attributed to the current instruction and call path.
+  const auto now = time::getWallTime();
+  const unsigned samples = pendingSamples.exchange(0, std::memory_order_relaxed);
+  stats::instructionTime += (samplePeriod * samples).toMicroseconds();
+  stats::instructionRealTime += (now - lastSampleTime).toMicroseconds();
+  lastSampleTime = now;
+}
+
+void StatsTracker::getCoveredInstructions(std::vector<unsigned> &res) const {
+  if (!OutputIStats)
+    return;
+  for (unsigned id = 0, e = executor.kmodule->infos->getMaxID(); id != e; ++id)
+    if (theStatisticManager->getIndexedValue(stats::coveredInstructions, id))
+      res.push_back(id);
+}
+
+void StatsTracker::markInstructionsCovered(const std::vector<unsigned> &ids) {
+  if (!OutputIStats)
+    return;
+  theStatisticManager->setContext(nullptr);
+  for (unsigned id : ids) {
+    if (theStatisticManager->getIndexedValue(stats::coveredInstructions, id))
+      continue;
+    // As in stepInstruction, but without a state to credit.
+    theStatisticManager->setIndex(id);
+    ++stats::coveredInstructions;
+    stats::uncoveredInstructions += (uint64_t)-1;
   }
 }
 
 StatsTracker::~StatsTracker() {  
+  if (samplePeriod) {
+    itimerval timer = {};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    signal(SIGPROF, SIG_DFL);
+  }
+
   if (statsFile) {
     auto rc = sqlite3_step(transactionEndStmt);
     if (rc != SQLITE_DONE) {
@@ -345,6 +460,11 @@ void StatsTracker::stepInstruction(ExecutionState &es) {
       }
     }
 
+    // As above, the samples are charged to the instruction which was
+    // executed last, before the index moves on.
+    if (pendingSamples.load(std::memory_order_relaxed))
+      takeSamples();
+
     Instruction *inst = es.pc->inst;
     const InstructionInfo &ii = *es.pc->info;
     StackFrame &sf = es.stack.back();
@@ -362,7 +482,9 @@ void StatsTracker::stepInstruction(ExecutionState &es) {
         //
         // FIXME: This trick no longer works, we should fix this in the line
         // number propogation.
-          es.coveredLines[&ii.file].insert(ii.line);
+        if (es.coveredInstructions.getSize() <= ii.id)
+          es.coveredInstructions.resize(executor.kmodule->infos->getMaxID());
+        es.coveredInstructions.set(ii.id);
 	es.coveredNew = true;
         es.instsSinceCovNew = 1;
 	++stats::coveredInstructions;
@@ -460,7 +582,10 @@ void StatsTracker::writeStatsHeader() {
              << "ResolveTime INTEGER,"
              << "QueryCexCacheMisses INTEGER,"
              << "QueryCexCacheHits INTEGER,"
-             << "ArrayHashTime INTEGER"
+             << "ArrayHashTime INTEGER,"
+             << "SharedMemory INTEGER,"
+             << "PrivateMemory INTEGER,"
+             << "CoverageMemory INTEGER"
          << ')';
   char *zErrMsg = nullptr;
   if(sqlite3_exec(statsFile, create.str().c_str(), nullptr, nullptr, &zErrMsg)) {
@@ -493,7 +618,10 @@ void StatsTracker::writeStatsHeader() {
              << "ResolveTime,"
              << "QueryCexCacheMisses,"
              << "QueryCexCacheHits,"
-             << "ArrayHashTime"
+             << "ArrayHashTime,"
+             << "SharedMemory,"
+             << "PrivateMemory,"
+             << "CoverageMemory"
          << ") VALUES ("
              << "?,"
              << "?,"
@@ -514,6 +642,9 @@ void StatsTracker::writeStatsHeader() {
              << "?,"
              << "?,"
              << "?,"
+             << "?,"
+             << "?,"
+             << "?,"
              << "? "
          << ')';
 
@@ -551,6 +682,10 @@ void StatsTracker::writeStatsLine() {
 #else
   sqlite3_bind_int64(insertStmt, 20, -1LL);
 #endif
+  sqlite3_bind_int64(insertStmt, 21, PagedArrayStats::sharedBytes);
+  sqlite3_bind_int64(insertStmt, 22, PagedArrayStats::privateBytes);
+  sqlite3_bind_int64(insertStmt, 23, CoverageArrayStats::sharedBytes +
+                                         CoverageArrayStats::privateBytes);
   int errCode = sqlite3_step(insertStmt);
   if(errCode != SQLITE_DONE) klee_error("Error writing stats data: %s", sqlite3_errmsg(statsFile));
   sqlite3_reset(insertStmt);
@@ -752,6 +887,52 @@ static std::vector<Instruction*> getSuccs(Instruction *i) {
   return res;
 }
 
+/// The graph over which minDistToUncovered is computed, indexed by
+/// instruction id. The distance of an instruction is the smallest nonzero
+/// one of its source distance (1 if it is uncovered, or one more than the
+/// distance of a callee) and its weight plus the distance of a successor.
+/// Coverage only grows, so the distances are kept between computations and
+/// only those which depended on newly covered instructions are recomputed.
+namespace {
+struct UncoveredGraph {
+  std::vector<unsigned> ids;
+  /// The weight of the edges to the successors, 0 if there are none.
+  std::vector<uint64_t> weights;
+  /// The successors, predecessors and defined callees of instruction i are
+  /// at [begin[i], begin[i+1]).
+  std::vector<unsigned> succBegin, succs;
+  std::vector<unsigned> predBegin, preds;
+  std::vector<unsigned> calleeBegin, callees;
+  /// The uncoveredInstructions values of the last computation.
+  std::vector<uint64_t> uncovered;
+  bool computed = false;
+};
+}
+
+static UncoveredGraph uncoveredGraph;
+
+/// Flatten the (from, to) pairs \a edges into \a begin and \a targets.
+static void buildAdjacency(unsigned numIDs,
+                           std::vector<std::pair<unsigned, unsigned>> &edges,
+                           std::vector<unsigned> &begin,
+                           std::vector<unsigned> &targets) {
+  std::sort(edges.begin(), edges.end());
+  begin.assign(numIDs + 1, 0);
+  targets.clear();
+  targets.reserve(edges.size());
+  for (const auto &edge : edges) {
+    ++begin[edge.first + 1];
+    targets.push_back(edge.second);
+  }
+  std::partial_sum(begin.begin(), begin.end(), begin.begin());
+}
+
+static uint64_t minNonZero(uint64_t a, uint64_t b) {
+  if (!a)
+    return b;
+  return b ? std::min(a, b) : a;
+}
+
 uint64_t klee::computeMinDistToUncovered(const KInstruction *ki,
                                          uint64_t minDistAtRA) {
   StatisticManager &sm = *theStatisticManager;
@@ -915,87 +1096,148 @@ void StatsTracker::computeReachableUncovered() {
         }
       }
     } while (changed);
-  }
 
-  // compute minDistToUncovered, 0 is unreachable
-  std::vector<Instruction *> instructions;
-  for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
-       fnIt != fn_ie; ++fnIt) {
-    // Not sure if I should bother to preorder here.
-    for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end(); 
-         bbIt != bb_ie; ++bbIt) {
-      for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end(); 
-           it != ie; ++it) {
-        Instruction *inst = &*it;
-        unsigned id = infos.getInfo(*inst).id;
-        instructions.push_back(inst);
-        sm.setIndexedValue(stats::minDistToUncovered, 
-                           id, 
-                           sm.getIndexedValue(stats::uncoveredInstructions, id));
-      }
-    }
-  }
-  
-  std::reverse(instructions.begin(), instructions.end());
-  
-  // I'm so lazy it's not even worklisted.
-  bool changed;
-  do {
-    changed = false;
-    for (std::vector<Instruction*>::iterator it = instructions.begin(),
-           ie = instructions.end(); it != ie; ++it) {
-      Instruction *inst = *it;
-      uint64_t best, cur = best = sm.getIndexedValue(stats::minDistToUncovered,
-                                                     infos.getInfo(*inst).id);
-      unsigned bestThrough = 0;
-      
-      if (isa<CallInst>(inst) || isa<InvokeInst>(inst)) {
-        std::vector<Function*> &targets = callTargets[inst];
-        for (std::vector<Function*>::iterator fnIt = targets.begin(),
-               ie = targets.end(); fnIt != ie; ++fnIt) {
-          uint64_t dist = functionShortestPath[*fnIt];
-          if (dist) {
-            dist = 1+dist; // count instruction itself
-            if (bestThrough==0 || dist<bestThrough)
-              bestThrough = dist;
-          }
+    // Build the graph for minDistToUncovered.
+    UncoveredGraph &g = uncoveredGraph;
+    unsigned numIDs = infos.getMaxID();
+    std::vector<std::pair<unsigned, unsigned>> succEdges, calleeEdges;
+    g.weights.assign(numIDs, 0);
+    for (Module::iterator fnIt = m->begin(), fn_ie = m->end();
+         fnIt != fn_ie; ++fnIt) {
+      for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end();
+           bbIt != bb_ie; ++bbIt) {
+        for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end();
+             it != ie; ++it) {
+          Instruction *inst = &*it;
+          unsigned id = infos.getInfo(*inst).id;
+          uint64_t bestThrough = 0;
+          g.ids.push_back(id);
 
-          if (!(*fnIt)->isDeclaration()) {
-            uint64_t calleeDist = sm.getIndexedValue(
-                stats::minDistToUncovered, infos.getFunctionInfo(*(*fnIt)).id);
-            if (calleeDist) {
-              calleeDist = 1+calleeDist; // count instruction itself
-              if (best==0 || calleeDist<best)
-                best = calleeDist;
+          if (isa<CallInst>(inst) || isa<InvokeInst>(inst)) {
+            for (Function *target : callTargets[inst]) {
+              uint64_t dist = functionShortestPath[target];
+              if (dist)
+                bestThrough = minNonZero(bestThrough, 1 + dist);
+              if (!target->isDeclaration())
+                calleeEdges.emplace_back(id,
+                                         infos.getFunctionInfo(*target).id);
             }
+          } else {
+            bestThrough = 1;
           }
+
+          g.weights[id] = bestThrough;
+          if (bestThrough)
+            for (Instruction *succ : getSuccs(inst))
+              succEdges.emplace_back(id, infos.getInfo(*succ).id);
         }
+      }
+    }
+    buildAdjacency(numIDs, calleeEdges, g.calleeBegin, g.callees);
+    buildAdjacency(numIDs, succEdges, g.succBegin, g.succs);
+    for (auto &edge : succEdges)
+      std::swap(edge.first, edge.second);
+    buildAdjacency(numIDs, succEdges, g.predBegin, g.preds);
+    g.uncovered.assign(numIDs, 0);
+  }
+
+  // compute minDistToUncovered, 0 is unreachable
+  UncoveredGraph &g = uncoveredGraph;
+  auto dist = [&](unsigned id) {
+    return sm.getIndexedValue(stats::minDistToUncovered, id);
+  };
+  auto source = [&](unsigned id) {
+    uint64_t best = sm.getIndexedValue(stats::uncoveredInstructions, id);
+    for (unsigned i = g.calleeBegin[id]; i != g.calleeBegin[id + 1]; ++i) {
+      uint64_t calleeDist = dist(g.callees[i]);
+      if (calleeDist)
+        best = minNonZero(best, 1 + calleeDist); // count instruction itself
+    }
+    return best;
+  };
+
+  typedef std::pair<uint64_t, unsigned> entry_ty;
+  std::priority_queue<entry_ty, std::vector<entry_ty>, std::greater<entry_ty>>
+      worklist;
+  auto lower = [&](unsigned id, uint64_t d) {
+    if (d && minNonZero(dist(id), d) != dist(id)) {
+      sm.setIndexedValue(stats::minDistToUncovered, id, d);
+      worklist.emplace(d, id);
+    }
+  };
+
+  if (!g.computed) {
+    g.computed = true;
+    for (unsigned id : g.ids) {
+      g.uncovered[id] = sm.getIndexedValue(stats::uncoveredInstructions, id);
+      sm.setIndexedValue(stats::minDistToUncovered, id, 0);
+    }
+    for (unsigned id : g.ids)
+      lower(id, source(id));
+  } else {
+    // Find the instructions which are no longer uncovered and, transitively,
+    // those whose distance was only due to them.
+    std::vector<unsigned> affected, added;
+    std::vector<bool> isAffected(g.weights.size());
+    for (unsigned id : g.ids) {
+      uint64_t value = sm.getIndexedValue(stats::uncoveredInstructions, id);
+      if (value == g.uncovered[id])
+        continue;
+      if (value < g.uncovered[id]) {
+        isAffected[id] = true;
+        affected.push_back(id);
       } else {
-        bestThrough = 1;
+        added.push_back(id);
       }
-      
-      if (bestThrough) {
-        std::vector<Instruction*> succs = getSuccs(inst);
-        for (std::vector<Instruction*>::iterator it2 = succs.begin(),
-               ie = succs.end(); it2 != ie; ++it2) {
-          uint64_t dist = sm.getIndexedValue(stats::minDistToUncovered,
-                                             infos.getInfo(*(*it2)).id);
-          if (dist) {
-            uint64_t val = bestThrough + dist;
-            if (best==0 || val<best)
-              best = val;
-          }
+      g.uncovered[id] = value;
+    }
+
+    for (std::size_t i = 0; i != affected.size(); ++i) {
+      uint64_t d = dist(affected[i]);
+      if (!d)
+        continue;
+      for (unsigned j = g.predBegin[affected[i]],
+                    je = g.predBegin[affected[i] + 1]; j != je; ++j) {
+        unsigned pred = g.preds[j];
+        if (!isAffected[pred] && dist(pred) == g.weights[pred] + d &&
+            source(pred) != dist(pred)) {
+          isAffected[pred] = true;
+          affected.push_back(pred);
         }
       }
+    }
 
-      if (best != cur) {
-        sm.setIndexedValue(stats::minDistToUncovered, infos.getInfo(*inst).id,
-                           best);
-        changed = true;
+    // Recompute the affected distances from the others.
+    for (unsigned id : affected)
+      sm.setIndexedValue(stats::minDistToUncovered, id, 0);
+    for (unsigned id : affected) {
+      uint64_t best = source(id);
+      for (unsigned j = g.succBegin[id]; j != g.succBegin[id + 1]; ++j) {
+        uint64_t d = dist(g.succs[j]);
+        if (d && !isAffected[g.succs[j]])
+          best = minNonZero(best, g.weights[id] + d);
       }
+      lower(id, best);
     }
-  } while (changed);
+    for (unsigned id : added)
+      lower(id, source(id));
+  }
+
+  // Propagate the lowered distances backwards.
+  while (!worklist.empty()) {
+    entry_ty e = worklist.top();
+    worklist.pop();
+    if (e.first != dist(e.second))
+      continue;
+    for (unsigned j = g.predBegin[e.second]; j != g.predBegin[e.second + 1];
+         ++j)
+      lower(g.preds[j], g.weights[g.preds[j]] + e.first);
+  }
+
+  updateStatesMinDistToUncovered();
+}
 
+void StatsTracker::updateStatesMinDistToUncovered() {
   for (std::set<ExecutionState*>::iterator it = executor.states.begin(),
          ie = executor.states.end(); it != ie; ++it) {
     ExecutionState *es = *it;
@@ -16,6 +16,7 @@
 #include <memory>
 #include <set>
 #include <sqlite3.h>
+#include <vector>
 
 namespace llvm {
   class BranchInst;
@@ -55,15 +56,24 @@ namespace klee {
 
     bool updateMinDistToUncovered;
 
+    // -sample-instruction-time: the CPU time between samples, and when the
+    // last samples were taken
+    time::Span samplePeriod;
+    time::Point lastSampleTime;
+
   public:
     static bool useStatistics();
     static bool useIStats();
 
   private:
     void updateStateStatistics(uint64_t addend);
+    void openStatsFile();
     void writeStatsHeader();
     void writeStatsLine();
     void writeIStats();
+    void startSampling();
+    void takeSamples();
+    void updateStatesMinDistToUncovered();
 
   public:
     StatsTracker(Executor &_executor, std::string _objectFilename,
@@ -90,6 +100,18 @@ namespace klee {
     // called when execution is done and stats files should be flushed
     void done();
 
+    /// Called in a worker process forked for parallel exploration, after
+    /// the interpreter handler has switched to the worker's output
+    /// directory.
+    void startWorker();
+
+    /// Get the IDs of the instructions covered so far.
+    void getCoveredInstructions(std::vector<unsigned> &res) const;
+
+    /// Mark the instructions with the given IDs as covered, e.g. when they
+    /// were covered by a worker process.
+    void markInstructionsCovered(const std::vector<unsigned> &ids);
+
     // process stats for a single instruction step, es is the state
     // about to be stepped
     void stepInstruction(ExecutionState &es);
@@ -97,6 +119,9 @@ namespace klee {
     /// Return duration since execution start.
     time::Span elapsed();
 
+    /// Whether the instruction times are sampled with SIGPROF.
+    bool isSampling() const { return bool(samplePeriod); }
+
     void computeReachableUncovered();
   };
 
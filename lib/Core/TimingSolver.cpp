@@ -12,12 +12,17 @@
 #include "ExecutionState.h"
 
 #include "klee/Config/Version.h"
+#include "klee/Expr/Assignment.h"
+#include "klee/Expr/ExprUtil.h"
 #include "klee/Statistics/Statistics.h"
 #include "klee/Statistics/TimerStatIncrementer.h"
 #include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverImpl.h"
 
 #include "CoreStats.h"
 
+#include <algorithm>
+
 using namespace klee;
 using namespace llvm;
 
@@ -78,6 +83,76 @@ bool TimingSolver::mayBeTrue(const ConstraintSet &constraints, ref<Expr> expr,
   return true;
 }
 
+bool TimingSolver::mayBeTrue(const ConstraintSet &constraints,
+                             const std::vector<ref<Expr>> &conditions,
+                             std::vector<bool> &result,
+                             SolverQueryMetaData &metaData) {
+  result.assign(conditions.size(), false);
+
+  // The conditions which are still undecided, with their indices.
+  std::vector<std::pair<unsigned, ref<Expr>>> open;
+  for (unsigned i = 0, e = conditions.size(); i != e; ++i) {
+    ref<Expr> condition = conditions[i];
+    if (simplifyExprs)
+      condition = ConstraintManager::simplifyExpr(constraints, condition);
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(condition))
+      result[i] = CE->isTrue();
+    else
+      open.emplace_back(i, condition);
+  }
+
+  // Fast path, to avoid timer and OS overhead.
+  if (open.empty())
+    return true;
+
+  TimerStatIncrementer timer(stats::solverTime);
+
+  while (!open.empty()) {
+    ref<Expr> any = open.front().second;
+    for (auto it = open.begin() + 1, ie = open.end(); it != ie; ++it)
+      any = OrExpr::create(any, it->second);
+
+    if (open.size() == 1) {
+      bool res;
+      if (!solver->mustBeFalse(Query(constraints, any), res))
+        return false;
+      result[open.front().first] = !res;
+      break;
+    }
+
+    std::vector<const Array *> objects;
+    findSymbolicObjects(any, objects);
+    std::vector<std::vector<unsigned char>> values;
+    bool hasSolution;
+    if (!solver->impl->computeInitialValues(
+            Query(constraints, Expr::createIsZero(any)), objects, values,
+            hasSolution))
+      return false;
+    if (!hasSolution)
+      break;
+
+    Assignment model(objects, values, true);
+    auto decided = std::remove_if(
+        open.begin(), open.end(),
+        [&](const std::pair<unsigned, ref<Expr>> &condition) {
+          ConstantExpr *CE =
+              dyn_cast<ConstantExpr>(model.evaluate(condition.second));
+          if (!CE || !CE->isTrue())
+            return false;
+          result[condition.first] = true;
+          return true;
+        });
+    // The model satisfies any, so it decides at least one condition.
+    if (decided == open.end())
+      return false;
+    open.erase(decided, open.end());
+  }
+
+  metaData.queryCost += timer.delta();
+
+  return true;
+}
+
 bool TimingSolver::mayBeFalse(const ConstraintSet &constraints, ref<Expr> expr,
                               bool &result, SolverQueryMetaData &metaData) {
   bool res;
@@ -59,6 +59,16 @@ public:
   bool mayBeFalse(const ConstraintSet &, ref<Expr>, bool &result,
                   SolverQueryMetaData &metaData);
 
+  /// Determine for each of \a conditions whether it may be true. Rather
+  /// than asking about each condition, this asks for a model of any of the
+  /// undecided ones at a time: every condition which holds in it is
+  /// feasible, and once there is no model the rest are not. Exclusive
+  /// conditions, like the cases of a switch, thus take one query per
+  /// feasible condition plus one.
+  bool mayBeTrue(const ConstraintSet &,
+                 const std::vector<ref<Expr>> &conditions,
+                 std::vector<bool> &result, SolverQueryMetaData &metaData);
+
   bool getValue(const ConstraintSet &, ref<Expr> expr,
                 ref<ConstantExpr> &result, SolverQueryMetaData &metaData);
 
@@ -7,6 +7,7 @@
 //
 //===----------------------------------------------------------------------===//
 #include "klee/Config/Version.h"
+#include "klee/Support/RoundingModeUtil.h"
 #include "klee/util/APFloatEval.h"
 #include "llvm/Support/raw_ostream.h"
 #include <cfenv>
@@ -14,39 +15,77 @@
 #include <cstdlib>
 
 namespace {
-void change_to_rounding_mode(llvm::APFloat::roundingMode rm) {
-  switch (rm) {
-  case llvm::APFloat::rmNearestTiesToEven:
-    fesetround(FE_TONEAREST);
-    break;
-  case llvm::APFloat::rmTowardPositive:
-    fesetround(FE_UPWARD);
-    break;
-  case llvm::APFloat::rmTowardNegative:
-    fesetround(FE_DOWNWARD);
-    break;
-  case llvm::APFloat::rmTowardZero:
-    fesetround(FE_TOWARDZERO);
-    break;
-  case llvm::APFloat::rmNearestTiesToAway: {
+/// The C rounding mode of the innermost HostRoundingModeScope, or -1 if there
+/// is none.
+thread_local int activeHostRoundingMode = -1;
+thread_local std::uint64_t numHostRoundingModeSwitches = 0;
+
+void checkNativeRoundingMode(llvm::APFloat::roundingMode rm) {
+  if (klee::LLVMRoundingModeToCRoundingMode(rm) == -1) {
     llvm::errs() << "rmNearestTiesToAway not supported natively\n";
     abort();
   }
-  default:
-    llvm_unreachable("Unhandled rounding mode");
+}
+
+template <typename T>
+T applyLibmFunction(klee::LibmFunction function, T x, T y) {
+  switch (function) {
+  case klee::LibmFunction::Exp:
+    return std::exp(x);
+  case klee::LibmFunction::Log:
+    return std::log(x);
+  case klee::LibmFunction::Sin:
+    return std::sin(x);
+  case klee::LibmFunction::Cos:
+    return std::cos(x);
+  case klee::LibmFunction::Tan:
+    return std::tan(x);
+  case klee::LibmFunction::Pow:
+    return std::pow(x, y);
   }
+  llvm_unreachable("Unhandled libm function");
 }
+} // namespace
+
+namespace klee {
 
-void restore_fenv(const fenv_t *oldEnv) {
-  int result = fesetenv(oldEnv);
-  if (result) {
+HostRoundingModeScope::HostRoundingModeScope(llvm::APFloat::roundingMode rm)
+    : previousMode(activeHostRoundingMode), switched(false) {
+  // The host cannot round to nearest with ties away from zero, so nested
+  // native evaluations have to fail or fall back on their own.
+  int mode = LLVMRoundingModeToCRoundingMode(rm);
+  activeHostRoundingMode = mode;
+  if (mode == -1 || mode == previousMode)
+    return;
+  // Nothing else in KLEE changes the host rounding mode, so outside of any
+  // scope it is almost always already round to nearest. fegetround() only
+  // reads the control word, which is much cheaper than fegetenv().
+  if (previousMode == -1 && mode == FE_TONEAREST && fegetround() == mode)
+    return;
+
+  if (fegetenv(&oldEnv)) {
+    llvm::errs() << "Failed to store fenv\n";
+    abort();
+  }
+  if (fesetround(mode)) {
+    llvm::errs() << "Failed to set new rounding mode\n";
+    abort();
+  }
+  switched = true;
+  ++numHostRoundingModeSwitches;
+}
+
+HostRoundingModeScope::~HostRoundingModeScope() {
+  activeHostRoundingMode = previousMode;
+  if (switched && fesetenv(&oldEnv)) {
     llvm::errs() << "Failed to restore fenv\n";
     abort();
   }
 }
-} // namespace
 
-namespace klee {
+std::uint64_t HostRoundingModeScope::getNumSwitches() {
+  return numHostRoundingModeSwitches;
+}
 
 #ifdef __x86_64__
 long double GetNativeX87FP80FromLLVMAPInt(const llvm::APInt &apint) {
@@ -73,14 +112,8 @@ llvm::APFloat evalSqrt(const llvm::APFloat &v, llvm::APFloat::roundingMode rm) {
   //
   // We should figure out how to implement sqrt using APFloat only and
   // upstream the implementation.
+  checkNativeRoundingMode(rm);
 
-  // Store the old floating point environment.
-  fenv_t oldEnv;
-  int result = fegetenv(&oldEnv);
-  if (result != 0) {
-    llvm::errs() << "Failed to store fenv\n";
-    abort();
-  }
 #if LLVM_VERSION_CODE >= LLVM_VERSION(4, 0)
 #define LLVMFltSemantics(str) llvm::APFloat::str()
 #else
@@ -92,20 +125,16 @@ llvm::APFloat evalSqrt(const llvm::APFloat &v, llvm::APFloat::roundingMode rm) {
     float asF = v.convertToFloat();
     assert(sizeof(float) * 8 == 32);
 
-    change_to_rounding_mode(rm);
+    HostRoundingModeScope scope(rm);
     float evaluatedValue = sqrtf(asF); // Calculate natively
-    // Restore floating point environment
-    restore_fenv(&oldEnv);
     resultAPF = llvm::APFloat(evaluatedValue);
 
   } else if (sem == &(LLVMFltSemantics(IEEEdouble))) {
     double asD = v.convertToDouble();
     assert(sizeof(double) * 8 == 64);
 
-    change_to_rounding_mode(rm);
+    HostRoundingModeScope scope(rm);
     double evaluatedValue = sqrt(asD); // Calculate natively
-    // Restore floating point environment
-    restore_fenv(&oldEnv);
     resultAPF = llvm::APFloat(evaluatedValue);
 
   }
@@ -115,10 +144,11 @@ llvm::APFloat evalSqrt(const llvm::APFloat &v, llvm::APFloat::roundingMode rm) {
     assert(apint.getBitWidth() == 80);
     long double asLD = klee::GetNativeX87FP80FromLLVMAPInt(apint);
 
-    change_to_rounding_mode(rm);
-    long double evaluatedValue = sqrtl(asLD); // Calculate natively
-    // Restore floating point environment
-    restore_fenv(&oldEnv);
+    long double evaluatedValue;
+    {
+      HostRoundingModeScope scope(rm);
+      evaluatedValue = sqrtl(asLD); // Calculate natively
+    }
 
     llvm::APInt resultApint = klee::GetAPIntFromLongDouble(evaluatedValue);
 
@@ -132,4 +162,49 @@ llvm::APFloat evalSqrt(const llvm::APFloat &v, llvm::APFloat::roundingMode rm) {
 #undef LLVMFltSemantics
   return resultAPF;
 }
+
+llvm::APFloat evalLibmFunction(LibmFunction function, const llvm::APFloat &x,
+                               const llvm::APFloat &y,
+                               llvm::APFloat::roundingMode rm) {
+  checkNativeRoundingMode(rm);
+#if LLVM_VERSION_CODE >= LLVM_VERSION(4, 0)
+#define LLVMFltSemantics(str) llvm::APFloat::str()
+#else
+#define LLVMFltSemantics(str) llvm::APFloat::str
+#endif
+  const llvm::fltSemantics *sem = &(x.getSemantics());
+  llvm::APFloat resultAPF = llvm::APFloat::getZero(*sem);
+  if (sem == &(LLVMFltSemantics(IEEEsingle))) {
+    HostRoundingModeScope scope(rm);
+    float evaluatedValue = applyLibmFunction(function, x.convertToFloat(),
+                                             y.convertToFloat());
+    resultAPF = llvm::APFloat(evaluatedValue);
+  } else if (sem == &(LLVMFltSemantics(IEEEdouble))) {
+    HostRoundingModeScope scope(rm);
+    double evaluatedValue = applyLibmFunction(function, x.convertToDouble(),
+                                              y.convertToDouble());
+    resultAPF = llvm::APFloat(evaluatedValue);
+  }
+#if defined(__x86_64__) || defined(__i386__)
+  else if (sem == &(LLVMFltSemantics(x87DoubleExtended))) {
+    long double asLD = GetNativeX87FP80FromLLVMAPInt(x.bitcastToAPInt());
+    long double yAsLD = GetNativeX87FP80FromLLVMAPInt(y.bitcastToAPInt());
+
+    long double evaluatedValue;
+    {
+      HostRoundingModeScope scope(rm);
+      evaluatedValue = applyLibmFunction(function, asLD, yAsLD);
+    }
+
+    resultAPF = llvm::APFloat(LLVMFltSemantics(x87DoubleExtended),
+                              GetAPIntFromLongDouble(evaluatedValue));
+  }
+#endif
+  else {
+    llvm::errs() << "Float semantics not supported\n";
+    abort();
+  }
+#undef LLVMFltSemantics
+  return resultAPF;
+}
 } // namespace klee
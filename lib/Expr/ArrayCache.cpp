@@ -1,5 +1,7 @@
 #include "klee/Expr/ArrayCache.h"
 
+#include "llvm/ADT/Hashing.h"
+
 namespace klee {
 
 ArrayCache::~ArrayCache() {
@@ -44,4 +46,49 @@ ArrayCache::CreateArray(const std::string &_name, uint64_t _size,
     return array;
   }
 }
+
+static std::size_t hashContents(const std::vector<uint8_t> &contents) {
+  return llvm::hash_combine_range(contents.begin(), contents.end());
+}
+
+static bool hasContents(const Array *array,
+                        const std::vector<uint8_t> &contents) {
+  if (array->size != contents.size())
+    return false;
+  for (unsigned i = 0, e = contents.size(); i != e; ++i)
+    if (array->constantValues[i]->getZExtValue(8) != contents[i])
+      return false;
+  return true;
+}
+
+const Array *
+ArrayCache::findConstantArray(const std::vector<uint8_t> &contents) const {
+  auto range = cachedConstantArrays.equal_range(hashContents(contents));
+  for (auto it = range.first; it != range.second; ++it)
+    if (hasContents(it->second, contents))
+      return it->second;
+  return nullptr;
+}
+
+const Array *
+ArrayCache::CreateConstantArray(const std::string &_name,
+                                const std::vector<uint8_t> &contents) {
+  assert(!contents.empty() && "constant arrays cannot be empty");
+  if (const Array *array = findConstantArray(contents))
+    return array;
+
+  if (byteConstants.empty())
+    for (unsigned i = 0; i != 256; ++i)
+      byteConstants.push_back(ConstantExpr::create(i, Expr::Int8));
+  std::vector<ref<ConstantExpr>> values;
+  values.reserve(contents.size());
+  for (uint8_t byte : contents)
+    values.push_back(byteConstants[byte]);
+
+  const Array *array =
+      CreateArray(_name, contents.size(), values.data(),
+                  values.data() + values.size(), Expr::Int32, Expr::Int8);
+  cachedConstantArrays.emplace(hashContents(contents), array);
+  return array;
+}
 }
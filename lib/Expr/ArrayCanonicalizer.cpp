@@ -0,0 +1,128 @@
+//===-- ArrayCanonicalizer.cpp --------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/ArrayCanonicalizer.h"
+
+#include "llvm/ADT/SmallVector.h"
+
+#include <string>
+
+using namespace klee;
+
+const Array *CanonicalArrayCache::get(unsigned id, const Array *array) {
+  std::vector<const Array *> &candidates = arrays[Shape(
+      id, array->size, array->getDomain(), array->getRange())];
+  for (const Array *candidate : candidates) {
+    if (candidate->constantValues.size() != array->constantValues.size())
+      continue;
+    bool equal = true;
+    for (unsigned i = 0, e = array->constantValues.size(); equal && i != e;
+         ++i)
+      equal = candidate->constantValues[i]->getAPValue() ==
+              array->constantValues[i]->getAPValue();
+    if (equal)
+      return candidate;
+  }
+
+  // ArrayCache identifies symbolic arrays by name and size only, so the name
+  // has to tell apart arrays which differ in domain or range.
+  std::string name = (array->isSymbolicArray() ? "arr" : "const_arr") +
+                     std::to_string(id);
+  if (array->getDomain() != Expr::Int32 || array->getRange() != Expr::Int8)
+    name += "_" + std::to_string(array->getDomain()) + "_" +
+            std::to_string(array->getRange());
+
+  const Array *canonical;
+  if (array->isSymbolicArray())
+    canonical = arrayCache.CreateArray(name, array->size, nullptr, nullptr,
+                                       array->getDomain(), array->getRange());
+  else
+    canonical = arrayCache.CreateArray(
+        name, array->size, array->constantValues.data(),
+        array->constantValues.data() + array->constantValues.size(),
+        array->getDomain(), array->getRange());
+  candidates.push_back(canonical);
+  return canonical;
+}
+
+const Array *ArrayCanonicalizer::rename(const Array *array) {
+  auto it = toCanonical.find(array);
+  if (it != toCanonical.end())
+    return it->second;
+
+  const Array *canonical = cache.get(toCanonical.size(), array);
+  toCanonical.emplace(array, canonical);
+  toOriginal.emplace(canonical, array);
+  return canonical;
+}
+
+UpdateList ArrayCanonicalizer::visitUpdates(const UpdateList &ul) {
+  const Array *root = rename(ul.root);
+
+  // Rebuild the updates oldest first, reusing the prefixes which were already
+  // rebuilt for other reads.
+  llvm::SmallVector<const UpdateNode *, 8> pending;
+  ref<UpdateNode> head;
+  for (const UpdateNode *un = ul.head.get(); un; un = un->next.get()) {
+    auto it = visitedUpdates.find(un);
+    if (it != visitedUpdates.end()) {
+      head = it->second;
+      break;
+    }
+    pending.push_back(un);
+  }
+  while (!pending.empty()) {
+    const UpdateNode *un = pending.pop_back_val();
+    head = new UpdateNode(head, visit(un->index), visit(un->value));
+    visitedUpdates.emplace(un, head);
+  }
+  return UpdateList(root, head);
+}
+
+ref<Expr> ArrayCanonicalizer::visit(const ref<Expr> &e) {
+  if (isa<ConstantExpr>(e))
+    return e;
+
+  auto it = visitedExprs.find(e);
+  if (it != visitedExprs.end())
+    return it->second;
+
+  ref<Expr> result;
+  if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+    result = ReadExpr::alloc(visitUpdates(re->updates), visit(re->index));
+  } else {
+    bool changed = false;
+    llvm::SmallVector<ref<Expr>, 4> kids(e->getNumKids());
+    for (unsigned i = 0, n = e->getNumKids(); i != n; ++i) {
+      kids[i] = visit(e->getKid(i));
+      changed |= kids[i].get() != e->getKid(i).get();
+    }
+    result = changed ? e->rebuild(kids.data()) : e;
+  }
+
+  visitedExprs.insert(std::make_pair(e, result));
+  return result;
+}
+
+ConstraintSet ArrayCanonicalizer::visit(const ConstraintSet &constraints) {
+  ConstraintSet result;
+  for (const auto &constraint : constraints)
+    result.push_back(visit(constraint));
+  return result;
+}
+
+const Array *ArrayCanonicalizer::getCanonical(const Array *array) const {
+  auto it = toCanonical.find(array);
+  return it == toCanonical.end() ? nullptr : it->second;
+}
+
+const Array *ArrayCanonicalizer::getOriginal(const Array *canonical) const {
+  auto it = toOriginal.find(canonical);
+  return it == toOriginal.end() ? nullptr : it->second;
+}
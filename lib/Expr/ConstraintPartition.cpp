@@ -0,0 +1,156 @@
+//===-- ConstraintPartition.cpp -------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/ConstraintPartition.h"
+
+#include "klee/Expr/ExprUtil.h"
+
+#include <algorithm>
+
+using namespace klee;
+
+namespace {
+/// A read of an array, at a constant index unless \a whole is set.
+struct Access {
+  const Array *array;
+  unsigned index;
+  bool whole;
+};
+
+void findAccesses(const ref<Expr> &e, std::vector<Access> &accesses) {
+  std::vector<ref<ReadExpr>> reads;
+  findReads(e, /* visitUpdates= */ true, reads);
+  for (const auto &re : reads) {
+    const Array *array = re->updates.root;
+
+    // Reads of a constant array don't alias.
+    if (array->isConstantArray() && !re->updates.head)
+      continue;
+
+    if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(re->index))
+      accesses.push_back({array, (unsigned)CE->getZExtValue(32), false});
+    else
+      accesses.push_back({array, 0, true});
+  }
+}
+} // namespace
+
+constexpr ConstraintPartition::Node ConstraintPartition::NoNode;
+constexpr unsigned ConstraintPartition::NoIndex;
+
+ConstraintPartition::Node ConstraintPartition::createNode() {
+  Node node = parents.size();
+  parents.push_back(node);
+  members.emplace_back();
+  return node;
+}
+
+ConstraintPartition::Node ConstraintPartition::find(Node node) const {
+  Node root = node;
+  while (parents[root] != root)
+    root = parents[root];
+  while (parents[node] != root) {
+    Node next = parents[node];
+    parents[node] = root;
+    node = next;
+  }
+  return root;
+}
+
+ConstraintPartition::Node ConstraintPartition::unite(Node a, Node b) {
+  a = find(a);
+  b = find(b);
+  if (a == b)
+    return a;
+
+  // Move the smaller factor into the larger one.
+  if (members[a].size() < members[b].size())
+    std::swap(a, b);
+  parents[b] = a;
+  members[a].insert(members[a].end(), members[b].begin(), members[b].end());
+  std::vector<unsigned>().swap(members[b]);
+  return a;
+}
+
+ConstraintPartition::Node ConstraintPartition::getWholeNode(const Array *array) {
+  ArrayNodes &nodes = arrays[array];
+  if (nodes.whole == NoNode) {
+    nodes.whole = createNode();
+    for (const auto &element : nodes.elements)
+      unite(nodes.whole, element.second);
+    nodes.elements.clear();
+  }
+  return nodes.whole;
+}
+
+ConstraintPartition::Node
+ConstraintPartition::getElementNode(const Array *array, unsigned index) {
+  ArrayNodes &nodes = arrays[array];
+  if (nodes.whole != NoNode)
+    return nodes.whole;
+  auto it = nodes.elements.emplace(index, NoNode).first;
+  if (it->second == NoNode)
+    it->second = createNode();
+  return it->second;
+}
+
+void ConstraintPartition::add(const ref<Expr> &constraint, unsigned index) {
+  std::vector<Access> accesses;
+  findAccesses(constraint, accesses);
+
+  // Constraints which read nothing are independent of everything.
+  Node root = NoNode;
+  for (const Access &access : accesses) {
+    Node node = access.whole ? getWholeNode(access.array)
+                             : getElementNode(access.array, access.index);
+    root = root == NoNode ? find(node) : unite(root, node);
+  }
+  if (root != NoNode)
+    members[root].push_back(index);
+}
+
+void ConstraintPartition::getDependent(const ref<Expr> &e,
+                                       std::vector<unsigned> &result) const {
+  std::vector<Access> accesses;
+  findAccesses(e, accesses);
+
+  std::vector<Node> roots;
+  for (const Access &access : accesses) {
+    auto it = arrays.find(access.array);
+    if (it == arrays.end())
+      continue;
+    const ArrayNodes &nodes = it->second;
+    if (nodes.whole != NoNode) {
+      roots.push_back(find(nodes.whole));
+    } else if (access.whole) {
+      for (const auto &element : nodes.elements)
+        roots.push_back(find(element.second));
+    } else {
+      auto element = nodes.elements.find(access.index);
+      if (element != nodes.elements.end())
+        roots.push_back(find(element->second));
+    }
+  }
+  std::sort(roots.begin(), roots.end());
+  roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+
+  for (Node root : roots)
+    result.insert(result.end(), members[root].begin(), members[root].end());
+  std::sort(result.begin(), result.end());
+}
+
+void ConstraintPartition::renumber(const std::vector<unsigned> &newIndices) {
+  for (auto &factor : members) {
+    auto end = factor.begin();
+    for (unsigned index : factor)
+      if (newIndices[index] != NoIndex)
+        *end++ = newIndices[index];
+    factor.erase(end, factor.end());
+  }
+}
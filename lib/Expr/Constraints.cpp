@@ -9,17 +9,29 @@
 
 #include "klee/Expr/Constraints.h"
 
+#include "klee/Expr/ConstraintPartition.h"
+
 #include "klee/Expr/ExprVisitor.h"
 #include "klee/Module/KModule.h"
 #include "klee/Support/OptionCategories.h"
 
+#include "llvm/ADT/Hashing.h"
 #include "llvm/IR/Function.h"
 #include "llvm/Support/CommandLine.h"
 
+#include <algorithm>
 #include <map>
+#include <unordered_map>
 
 using namespace klee;
 
+namespace klee {
+// Defined here rather than with the solver options in SolverCmdLine.cpp so
+// that kleaverExpr, which kleaverSolver links against, is self-contained.
+llvm::cl::OptionCategory SolvingCat("Constraint solving options",
+                                    "These options impact constraint solving.");
+} // namespace klee
+
 namespace {
 llvm::cl::opt<bool> RewriteEqualities(
     "rewrite-equalities",
@@ -75,6 +87,10 @@ bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor) {
   bool changed = false;
 
   std::swap(constraints, old);
+  // Keep the partition out of the way while the constraints are re-added,
+  // and update it in one go afterwards.
+  std::shared_ptr<ConstraintPartition> partition;
+  partition.swap(old.partition);
   for (auto &ce : old) {
     ref<Expr> e = visitor.visit(ce);
 
@@ -85,6 +101,8 @@ bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor) {
       constraints.push_back(ce);
     }
   }
+  if (partition)
+    constraints.adoptPartition(std::move(partition), old);
 
   return changed;
 }
@@ -163,16 +181,122 @@ void ConstraintManager::addConstraint(const ref<Expr> &e) {
 ConstraintManager::ConstraintManager(ConstraintSet &_constraints)
     : constraints(_constraints) {}
 
-bool ConstraintSet::empty() const { return constraints.empty(); }
+ConstraintSet::ConstraintSet(const constraints_ty &cs) {
+  for (const auto &e : cs)
+    push_back(e);
+}
+
+ConstraintSet::~ConstraintSet() = default;
+
+bool ConstraintSet::empty() const { return count == 0; }
+
+const std::vector<const ConstraintSet::Chunk *> &
+ConstraintSet::getChunks() const {
+  size_t numChunks = (count + Chunk::ChunkSize - 1) / Chunk::ChunkSize;
+  if (chunks.size() == numChunks &&
+      (chunks.empty() || chunks.back() == last.get()))
+    return chunks;
+
+  chunks.resize(numChunks);
+  const Chunk *chunk = last.get();
+  for (size_t i = numChunks; i != 0; --i, chunk = chunk->parent.get())
+    chunks[i - 1] = chunk;
+  return chunks;
+}
 
 klee::ConstraintSet::constraint_iterator ConstraintSet::begin() const {
-  return constraints.begin();
+  return const_iterator(&getChunks(), 0);
 }
 
 klee::ConstraintSet::constraint_iterator ConstraintSet::end() const {
-  return constraints.end();
+  return const_iterator(&getChunks(), count);
+}
+
+size_t ConstraintSet::size() const noexcept { return count; }
+
+void ConstraintSet::push_back(const ref<Expr> &e) {
+  std::size_t prefixHash = hash();
+  size_t offset = count % Chunk::ChunkSize;
+  if (offset == 0) {
+    last = new Chunk(last);
+  } else if (last->items.size() != offset) {
+    // Another set has extended the last chunk, so continue on a copy of the
+    // part which this set shares.
+    ref<Chunk> copy = new Chunk(last->parent);
+    copy->items.assign(last->items.begin(), last->items.begin() + offset);
+    copy->hashes.assign(last->hashes.begin(), last->hashes.begin() + offset);
+    last = copy;
+  }
+  last->items.push_back(e);
+  last->hashes.push_back(llvm::hash_combine(prefixHash, e->hash()));
+  ++count;
+
+  if (partition) {
+    if (partition.use_count() > 1)
+      partition = std::make_shared<ConstraintPartition>(*partition);
+    partition->add(e, count - 1);
+  }
 }
 
-size_t ConstraintSet::size() const noexcept { return constraints.size(); }
+void ConstraintSet::getDependentConstraints(
+    const ref<Expr> &e, std::vector<ref<Expr>> &result) const {
+  if (!partition) {
+    partition = std::make_shared<ConstraintPartition>();
+    unsigned index = 0;
+    for (const auto &constraint : *this)
+      partition->add(constraint, index++);
+  }
+
+  std::vector<unsigned> indices;
+  partition->getDependent(e, indices);
+  const_iterator constraints = begin();
+  for (unsigned index : indices)
+    result.push_back(constraints[index]);
+}
+
+void ConstraintSet::adoptPartition(
+    std::shared_ptr<ConstraintPartition> partition, const ConstraintSet &old) {
+  // Constraints which were kept are found by identity, the others are new.
+  std::unordered_multimap<const Expr *, unsigned> oldIndices;
+  unsigned index = 0;
+  for (const auto &e : old)
+    oldIndices.emplace(e.get(), index++);
+
+  std::vector<unsigned> newIndices(old.size(), ConstraintPartition::NoIndex);
+  std::vector<std::pair<ref<Expr>, unsigned>> added;
+  index = 0;
+  for (const auto &e : *this) {
+    auto it = oldIndices.find(e.get());
+    if (it != oldIndices.end()) {
+      newIndices[it->second] = index;
+      oldIndices.erase(it);
+    } else {
+      added.emplace_back(e, index);
+    }
+    ++index;
+  }
+
+  if (partition.use_count() > 1)
+    partition = std::make_shared<ConstraintPartition>(*partition);
+  partition->renumber(newIndices);
+  for (const auto &constraint : added)
+    partition->add(constraint.first, constraint.second);
+  this->partition = std::move(partition);
+}
 
-void ConstraintSet::push_back(const ref<Expr> &e) { constraints.push_back(e); }
+std::size_t ConstraintSet::hash() const {
+  if (count == 0)
+    return 0;
+  return last->hashes[(count - 1) % Chunk::ChunkSize];
+}
+
+bool ConstraintSet::operator==(const ConstraintSet &b) const {
+  if (count != b.count)
+    return false;
+  // Sets of the same size ending in the same chunk see the same prefix of it.
+  if (last.get() == b.last.get())
+    return true;
+  if (hash() != b.hash())
+    return false;
+  return std::equal(begin(), end(), b.begin());
+}
@@ -22,6 +22,7 @@
 #include "llvm/Support/raw_ostream.h"
 
 #include <cfenv>
+#include <unordered_map>
 #include <sstream>
 
 using namespace klee;
@@ -43,11 +44,107 @@ cl::opt<bool>
     SingleReprForNaN("single-repr-for-nan", cl::init(true),
                      cl::desc("When constant folding produce a consistent bit "
                               "pattern for NaN (default=true)."));
+cl::opt<bool, true> HashConsExprs(
+    "hash-cons-exprs", cl::location(Expr::hashConsing),
+    cl::desc("Share a single instance between structurally equal "
+             "expressions (default=false)"),
+    cl::cat(klee::ExprCat));
+
+/// The live hash-consed expressions, by hash. This is never destroyed, as
+/// expressions may outlive static destructors.
+std::unordered_multimap<unsigned, Expr *> *uniqueExprs = nullptr;
+
+/// Blocks of freed expressions, by size in words. Once an expression has
+/// been allocated from them, all expressions of these sizes are freed to
+/// them, which is fine as the sizes match exactly.
+constexpr std::size_t MaxSlabSize = 256;
+constexpr std::size_t SlabBytes = 64 * 1024;
+void *freeBlocks[MaxSlabSize / sizeof(void *) + 1];
+char *slabBegin = nullptr, *slabEnd = nullptr;
+bool slabsInUse = false;
+
+bool hasSlabSize(std::size_t size) {
+  return size <= MaxSlabSize && size % sizeof(void *) == 0;
+}
 } // namespace
 
 /***/
 
 unsigned Expr::count = 0;
+bool Expr::hashConsing = false;
+
+Expr::~Expr() {
+  Expr::count--;
+  if (uniqueExprs) {
+    auto range = uniqueExprs->equal_range(hashValue);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second == this) {
+        uniqueExprs->erase(it);
+        break;
+      }
+    }
+  }
+}
+
+void *Expr::operator new(std::size_t size) {
+  if (!(hashConsing || slabsInUse) || !hasSlabSize(size))
+    return ::operator new(size);
+  slabsInUse = true;
+
+  void *&head = freeBlocks[size / sizeof(void *)];
+  if (void *p = head) {
+    head = *static_cast<void **>(p);
+    return p;
+  }
+  if (static_cast<std::size_t>(slabEnd - slabBegin) < size) {
+    slabBegin = static_cast<char *>(::operator new(SlabBytes));
+    slabEnd = slabBegin + SlabBytes;
+  }
+  void *p = slabBegin;
+  slabBegin += size;
+  return p;
+}
+
+void Expr::operator delete(void *p, std::size_t size) {
+  if (!slabsInUse || !hasSlabSize(size)) {
+    ::operator delete(p);
+    return;
+  }
+  void *&head = freeBlocks[size / sizeof(void *)];
+  *static_cast<void **>(p) = head;
+  head = p;
+}
+
+ref<Expr> Expr::unique(const ref<Expr> &e) {
+  if (!hashConsing)
+    return e;
+  if (!uniqueExprs)
+    uniqueExprs = new std::unordered_multimap<unsigned, Expr *>();
+
+  // The kids of a hash-consed expression are hash-consed themselves, so
+  // comparing them by address suffices.
+  auto range = uniqueExprs->equal_range(e->hashValue);
+  for (auto it = range.first; it != range.second; ++it) {
+    Expr *candidate = it->second;
+    if (candidate->getKind() != e->getKind() ||
+        candidate->getWidth() != e->getWidth() ||
+        candidate->compareContents(*e) != 0)
+      continue;
+    unsigned i = 0, numKids = e->getNumKids();
+    while (i != numKids && candidate->getKid(i).get() == e->getKid(i).get())
+      ++i;
+    if (i != numKids)
+      continue;
+    // compareContents() does not tell float and integer constants apart
+    if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(candidate))
+      if (ce->isFloat() != cast<ConstantExpr>(e)->isFloat())
+        continue;
+    return candidate;
+  }
+
+  uniqueExprs->emplace(e->hashValue, e.get());
+  return e;
+}
 
 ref<Expr> Expr::createTempRead(const Array *array, Expr::Width w) {
   UpdateList ul(array, 0);
@@ -695,16 +792,8 @@ ref<ConstantExpr> TryNativeX87FP80EvalArith(const ConstantExpr *lhs,
   long double lhsAsNative = GetNativeX87FP80FromLLVMAPInt(lhs->getAPValue());
   long double rhsAsNative = GetNativeX87FP80FromLLVMAPInt(rhs->getAPValue());
   long double nativeResult = false;
-  // Save the floating point environment.
-  fenv_t fpEnv;
-  if (fegetenv(&fpEnv)) {
-    llvm::errs() << "Failed to save floating point environment\n";
-    abort();
-  }
-  if (fesetround(roundingMode)) {
-    llvm::errs() << "Failed to set new rounding mode\n";
-    abort();
-  }
+  // Switches the floating point environment unless the caller already did.
+  HostRoundingModeScope scope(rm);
   switch (op) {
   case Expr::FAdd:
     nativeResult = lhsAsNative + rhsAsNative;
@@ -730,11 +819,6 @@ ref<ConstantExpr> TryNativeX87FP80EvalArith(const ConstantExpr *lhs,
   default:
     llvm_unreachable("Unhandled Expr kind");
   }
-  // Restore the floating point environment
-  if (fesetenv(&fpEnv)) {
-    llvm::errs() << "Failed to restore floating point environment\n";
-    abort();
-  }
 
   llvm::APInt apint = GetAPIntFromLongDouble(nativeResult);
   assert(apint.getBitWidth() == 80);
@@ -761,16 +845,8 @@ ref<ConstantExpr> TryNativeX87FP80EvalCast(const ConstantExpr *ce,
   }
   // Use APInt directly because making an APFloat might change the bit pattern.
   long double argAsNative = GetNativeX87FP80FromLLVMAPInt(ce->getAPValue());
-  // Save the floating point environment.
-  fenv_t fpEnv;
-  if (fegetenv(&fpEnv)) {
-    llvm::errs() << "Failed to save floating point environment\n";
-    abort();
-  }
-  if (fesetround(roundingMode)) {
-    llvm::errs() << "Failed to set new rounding mode\n";
-    abort();
-  }
+  // Switches the floating point environment unless the caller already did.
+  HostRoundingModeScope scope(rm);
   llvm::APInt apint;
   switch (op) {
   case Expr::FPTrunc: {
@@ -842,11 +918,6 @@ ref<ConstantExpr> TryNativeX87FP80EvalCast(const ConstantExpr *ce,
   default:
     llvm_unreachable("Unhandled Expr kind");
   }
-  // Restore the floating point environment
-  if (fesetenv(&fpEnv)) {
-    llvm::errs() << "Failed to restore floating point environment\n";
-    abort();
-  }
   return ConstantExpr::alloc(apint);
 #else
   klee_warning_once(0, "Trying to evaluate x87 fp80 constant non natively."
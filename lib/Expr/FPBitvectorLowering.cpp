@@ -0,0 +1,954 @@
+//===-- FPBitvectorLowering.cpp -------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Bit-precise lowering of floating point operations to bitvector expressions.
+//
+// Operands are unpacked into a sign, special value flags and, for finite
+// non-zero values, an unbiased exponent and a normalized significand. The
+// operations are then computed exactly on integers and the results rounded
+// back into the destination format. This is the same scheme symfpu uses for
+// the SMT solvers which bit-blast the floating point theory.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/FPBitvectorLowering.h"
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include <algorithm>
+#include <utility>
+
+using namespace klee;
+
+namespace {
+
+/// Layout of a floating point format.
+struct FloatFormat {
+  Expr::Width width;
+  unsigned exponentBits;
+  /// Number of significand bits, including the integer bit.
+  unsigned precision;
+  /// Whether the integer bit is stored explicitly (x87 fp80).
+  bool explicitIntegerBit;
+
+  /// Width of unpacked exponents. This leaves room for normalized subnormals
+  /// and for the sums and differences of two exponents.
+  unsigned exponentWidth() const { return exponentBits + 4; }
+  unsigned exponentOffset() const {
+    return precision - (explicitIntegerBit ? 0 : 1);
+  }
+  int bias() const { return (1 << (exponentBits - 1)) - 1; }
+  int minExponent() const { return 1 - bias(); }
+  int maxExponent() const { return bias(); }
+};
+
+FloatFormat getFloatFormat(Expr::Width width) {
+  switch (width) {
+  case Expr::Int16:
+    return {width, 5, 11, false};
+  case Expr::Int32:
+    return {width, 8, 24, false};
+  case Expr::Int64:
+    return {width, 11, 53, false};
+  case Expr::Fl80:
+    return {width, 15, 64, true};
+  case Expr::Int128:
+    return {width, 15, 113, false};
+  default:
+    llvm_unreachable("Unhandled floating point width");
+  }
+}
+
+/// An unpacked floating point value. \a exponent and \a significand are only
+/// meaningful for finite non-zero values, where the significand has its
+/// integer bit set and the value is
+/// significand * 2^(exponent - (precision - 1)).
+struct Unpacked {
+  ref<Expr> isNaN, isInf, isZero, sign;
+  ref<Expr> exponent;
+  ref<Expr> significand;
+};
+
+ref<Expr> constant(uint64_t value, Expr::Width width) {
+  return ConstantExpr::alloc(llvm::APInt(width, value));
+}
+
+ref<Expr> signedConstant(int64_t value, Expr::Width width) {
+  return ConstantExpr::alloc(llvm::APInt(width, value, /*isSigned=*/true));
+}
+
+ref<Expr> allOnes(Expr::Width width) {
+  return ConstantExpr::alloc(llvm::APInt::getAllOnesValue(width));
+}
+
+ref<Expr> boolConstant(bool value) {
+  return ConstantExpr::alloc(value, Expr::Bool);
+}
+
+ref<Expr> notExpr(const ref<Expr> &e) { return Expr::createIsZero(e); }
+
+ref<Expr> isNonZero(const ref<Expr> &e) {
+  return notExpr(Expr::createIsZero(e));
+}
+
+ref<Expr> bit(const ref<Expr> &e, unsigned index) {
+  return ExtractExpr::create(e, index, Expr::Bool);
+}
+
+ref<Expr> ite(const ref<Expr> &c, const ref<Expr> &t, const ref<Expr> &f) {
+  return SelectExpr::create(c, t, f);
+}
+
+/// Place \a b at bit \a index of an otherwise zero \a width bit value. The
+/// solver builders treat single bits as formulas rather than bitvectors, so
+/// they are never concatenated directly.
+ref<Expr> bitAt(const ref<Expr> &b, unsigned index, Expr::Width width) {
+  return ite(b, ConstantExpr::alloc(llvm::APInt::getOneBitSet(width, index)),
+             constant(0, width));
+}
+
+/// Zero extend or truncate \a e to \a width bits.
+ref<Expr> resize(const ref<Expr> &e, Expr::Width width) {
+  if (e->getWidth() == width)
+    return e;
+  if (e->getWidth() < width)
+    return ZExtExpr::create(e, width);
+  return ExtractExpr::create(e, 0, width);
+}
+
+/// Append \a count zero bits below \a e.
+ref<Expr> padRight(const ref<Expr> &e, unsigned count) {
+  if (!count)
+    return e;
+  Expr::Width width = e->getWidth() + count;
+  return ShlExpr::create(ZExtExpr::create(e, width), constant(count, width));
+}
+
+/// Shift \a e left until its top bit is set, returning the shifted value and
+/// the shift amount as a \a countWidth bit value. Zero is left as is.
+std::pair<ref<Expr>, ref<Expr>> normalize(ref<Expr> e, Expr::Width countWidth) {
+  Expr::Width width = e->getWidth();
+  ref<Expr> count = constant(0, countWidth);
+  unsigned step = 1;
+  while (step * 2 < width)
+    step *= 2;
+  // Greedily strip powers of two, the sum of all steps covers any leading
+  // zero count below the width.
+  for (; step; step /= 2) {
+    ref<Expr> topIsZero =
+        Expr::createIsZero(ExtractExpr::create(e, width - step, step));
+    e = ite(topIsZero, ShlExpr::create(e, constant(step, width)), e);
+    count = ite(topIsZero, AddExpr::create(count, constant(step, countWidth)),
+                count);
+  }
+  return std::make_pair(e, count);
+}
+
+Unpacked unpack(const FloatFormat &format, const ref<Expr> &bits) {
+  unsigned fractionBits = format.precision - 1;
+  unsigned exponentOffset = format.exponentOffset();
+  Expr::Width xw = format.exponentWidth();
+
+  ref<Expr> exponentField =
+      ExtractExpr::create(bits, exponentOffset, format.exponentBits);
+  ref<Expr> fraction = ExtractExpr::create(bits, 0, fractionBits);
+  ref<Expr> exponentIsZero = Expr::createIsZero(exponentField);
+  ref<Expr> exponentIsOnes =
+      EqExpr::create(exponentField, allOnes(format.exponentBits));
+  ref<Expr> fractionIsZero = Expr::createIsZero(fraction);
+
+  // The integer bit is implicit except for x87 fp80, where unnormals,
+  // pseudo-infinities and pseudo-NaNs (a clear integer bit with a non-zero
+  // exponent) are invalid operands and behave like NaN. Pseudo-denormals
+  // (a set integer bit with a zero exponent) use the minimum exponent.
+  ref<Expr> invalid = boolConstant(false);
+  ref<Expr> integerBit = notExpr(exponentIsZero);
+  if (format.explicitIntegerBit) {
+    integerBit = bit(bits, fractionBits);
+    invalid = AndExpr::create(notExpr(exponentIsZero), notExpr(integerBit));
+  }
+
+  Unpacked u;
+  u.sign = bit(bits, format.width - 1);
+  u.isNaN = OrExpr::create(
+      invalid, AndExpr::create(exponentIsOnes, notExpr(fractionIsZero)));
+  u.isInf = AndExpr::create(AndExpr::create(exponentIsOnes, fractionIsZero),
+                            notExpr(invalid));
+  u.isZero = AndExpr::create(AndExpr::create(exponentIsZero, fractionIsZero),
+                             notExpr(integerBit));
+
+  ref<Expr> isSubnormal =
+      AndExpr::create(notExpr(integerBit), notExpr(fractionIsZero));
+  ref<Expr> minExponent = signedConstant(format.minExponent(), xw);
+
+  // Normalize subnormals so every finite non-zero value has its integer bit
+  // set.
+  auto subnormal = normalize(ZExtExpr::create(fraction, format.precision), xw);
+  ref<Expr> subnormalExponent = SubExpr::create(minExponent, subnormal.second);
+
+  ref<Expr> normalExponent =
+      ite(exponentIsZero, minExponent,
+          SubExpr::create(ZExtExpr::create(exponentField, xw),
+                          signedConstant(format.bias(), xw)));
+  ref<Expr> normalSignificand =
+      OrExpr::create(ZExtExpr::create(fraction, format.precision),
+                     ConstantExpr::alloc(
+                         llvm::APInt::getOneBitSet(format.precision,
+                                                   fractionBits)));
+
+  u.exponent = ite(isSubnormal, subnormalExponent, normalExponent);
+  u.significand = ite(isSubnormal, subnormal.first, normalSignificand);
+  return u;
+}
+
+ref<Expr> packZero(const FloatFormat &format, const ref<Expr> &sign) {
+  return bitAt(sign, format.width - 1, format.width);
+}
+
+ref<Expr> packInf(const FloatFormat &format, const ref<Expr> &sign) {
+  unsigned offset = format.exponentOffset();
+  llvm::APInt bits = llvm::APInt::getBitsSet(format.width, offset,
+                                             offset + format.exponentBits);
+  if (format.explicitIntegerBit)
+    bits.setBit(format.precision - 1);
+  return OrExpr::create(packZero(format, sign), ConstantExpr::alloc(bits));
+}
+
+ref<Expr> packLargest(const FloatFormat &format, const ref<Expr> &sign) {
+  unsigned offset = format.exponentOffset();
+  llvm::APInt bits = llvm::APInt::getBitsSet(format.width, offset + 1,
+                                             offset + format.exponentBits);
+  bits |= llvm::APInt::getLowBitsSet(format.width, format.explicitIntegerBit
+                                                       ? format.precision
+                                                       : format.precision - 1);
+  return OrExpr::create(packZero(format, sign), ConstantExpr::alloc(bits));
+}
+
+ref<Expr> packNaN(const FloatFormat &format) {
+  return ConstantExpr::GetNaN(format.width);
+}
+
+/// Whether the magnitude should be rounded up, given the least significant
+/// kept bit, the first discarded bit and whether any further bits were set.
+ref<Expr> shouldRoundUp(llvm::APFloat::roundingMode rm, const ref<Expr> &sign,
+                        const ref<Expr> &lsb, const ref<Expr> &guard,
+                        const ref<Expr> &sticky) {
+  switch (rm) {
+  case llvm::APFloat::rmNearestTiesToEven:
+    return AndExpr::create(guard, OrExpr::create(sticky, lsb));
+  case llvm::APFloat::rmNearestTiesToAway:
+    return guard;
+  case llvm::APFloat::rmTowardPositive:
+    return AndExpr::create(notExpr(sign), OrExpr::create(guard, sticky));
+  case llvm::APFloat::rmTowardNegative:
+    return AndExpr::create(sign, OrExpr::create(guard, sticky));
+  case llvm::APFloat::rmTowardZero:
+    return boolConstant(false);
+  default:
+    llvm_unreachable("Unhandled rounding mode");
+  }
+}
+
+/// Whether an overflowing result rounds to infinity rather than to the
+/// largest finite value.
+ref<Expr> overflowsToInfinity(llvm::APFloat::roundingMode rm,
+                              const ref<Expr> &sign) {
+  switch (rm) {
+  case llvm::APFloat::rmNearestTiesToEven:
+  case llvm::APFloat::rmNearestTiesToAway:
+    return boolConstant(true);
+  case llvm::APFloat::rmTowardPositive:
+    return notExpr(sign);
+  case llvm::APFloat::rmTowardNegative:
+    return sign;
+  case llvm::APFloat::rmTowardZero:
+    return boolConstant(false);
+  default:
+    llvm_unreachable("Unhandled rounding mode");
+  }
+}
+
+/// Round the non-zero value
+///   (-1)^sign * significand * 2^(exponent - (width(significand) - 1))
+/// into \a format. The top bit of \a significand must be set and \a sticky
+/// says whether the exact value has further non-zero bits below it.
+ref<Expr> round(const FloatFormat &format, llvm::APFloat::roundingMode rm,
+                const ref<Expr> &sign, ref<Expr> exponent,
+                ref<Expr> significand, ref<Expr> sticky) {
+  unsigned p = format.precision;
+  if (significand->getWidth() < p + 2)
+    significand = padRight(significand, p + 2 - significand->getWidth());
+  Expr::Width sw = significand->getWidth();
+  Expr::Width xw = exponent->getWidth();
+  ref<Expr> minExponent = signedConstant(format.minExponent(), xw);
+
+  // Values below the normal range are denormalized. Shifting by more than
+  // sw - 1 only moves bits further into the sticky region so the distance
+  // can be clamped.
+  ref<Expr> isTiny = SltExpr::create(exponent, minExponent);
+  ref<Expr> distance = SubExpr::create(minExponent, exponent);
+  ref<Expr> maxDistance = constant(sw - 1, xw);
+  distance = ite(UltExpr::create(distance, maxDistance), distance, maxDistance);
+  ref<Expr> shift = resize(ite(isTiny, distance, constant(0, xw)), sw);
+  ref<Expr> shifted = LShrExpr::create(significand, shift);
+  sticky = OrExpr::create(
+      sticky,
+      notExpr(EqExpr::create(ShlExpr::create(shifted, shift), significand)));
+  exponent = ite(isTiny, minExponent, exponent);
+
+  ref<Expr> kept = ExtractExpr::create(shifted, sw - p, p);
+  ref<Expr> guard = bit(shifted, sw - p - 1);
+  sticky = OrExpr::create(
+      sticky, isNonZero(ExtractExpr::create(shifted, 0, sw - p - 1)));
+  ref<Expr> roundUp = shouldRoundUp(rm, sign, bit(kept, 0), guard, sticky);
+
+  ref<Expr> rounded = AddExpr::create(ZExtExpr::create(kept, p + 1),
+                                      ZExtExpr::create(roundUp, p + 1));
+  ref<Expr> carry = bit(rounded, p);
+  ref<Expr> mantissa = ite(carry, ExtractExpr::create(rounded, 1, p),
+                           ExtractExpr::create(rounded, 0, p));
+  exponent = ite(carry, AddExpr::create(exponent, constant(1, xw)), exponent);
+
+  // A clear integer bit means the result is subnormal (or rounded to zero).
+  ref<Expr> isNormal = bit(mantissa, p - 1);
+  ref<Expr> biased = ite(
+      isNormal,
+      ExtractExpr::create(
+          AddExpr::create(exponent, signedConstant(format.bias(), xw)), 0,
+          format.exponentBits),
+      constant(0, format.exponentBits));
+  Expr::Width width = format.width;
+  ref<Expr> res = OrExpr::create(
+      ShlExpr::create(ZExtExpr::create(biased, width),
+                      constant(format.exponentOffset(), width)),
+      ZExtExpr::create(ExtractExpr::create(mantissa, 0, p - 1), width));
+  res = OrExpr::create(packZero(format, sign), res);
+  if (format.explicitIntegerBit)
+    res = OrExpr::create(res, bitAt(isNormal, p - 1, width));
+
+  ref<Expr> overflow =
+      SltExpr::create(signedConstant(format.maxExponent(), xw), exponent);
+  return ite(overflow,
+             ite(overflowsToInfinity(rm, sign), packInf(format, sign),
+                 packLargest(format, sign)),
+             res);
+}
+
+/// Round the non-zero unsigned integer \a magnitude into \a format.
+ref<Expr> roundInteger(const FloatFormat &format,
+                       llvm::APFloat::roundingMode rm, const ref<Expr> &sign,
+                       const ref<Expr> &magnitude) {
+  Expr::Width width = magnitude->getWidth();
+  Expr::Width xw = format.exponentWidth();
+  while ((1u << (xw - 2)) < width)
+    ++xw;
+  auto normalized = normalize(magnitude, xw);
+  ref<Expr> exponent =
+      SubExpr::create(constant(width - 1, xw), normalized.second);
+  return round(format, rm, sign, exponent, normalized.first,
+               boolConstant(false));
+}
+
+/// Round the finite value \a u to an integer, returning the magnitude as an
+/// unsigned \a width bit value. \a width must be large enough for any
+/// magnitude below 2^(maxExponent + 1), values with larger exponents should
+/// be checked for separately.
+ref<Expr> roundToIntegerMagnitude(const FloatFormat &format,
+                                  llvm::APFloat::roundingMode rm,
+                                  const Unpacked &u, unsigned maxExponent,
+                                  Expr::Width width) {
+  unsigned p = format.precision;
+  Expr::Width xw = u.exponent->getWidth();
+
+  // Integral values only need shifting into place.
+  ref<Expr> isIntegral =
+      SleExpr::create(signedConstant(p - 1, xw), u.exponent);
+  ref<Expr> leftShift =
+      SubExpr::create(u.exponent, signedConstant(p - 1, xw));
+  leftShift = ite(UltExpr::create(leftShift, constant(maxExponent, xw)),
+                  leftShift, constant(maxExponent, xw));
+  ref<Expr> integral = ShlExpr::create(ZExtExpr::create(u.significand, width),
+                                       resize(leftShift, width));
+
+  // Otherwise the fraction bits are discarded with rounding. Values below a
+  // quarter round the same way, so the shift can be clamped.
+  Expr::Width fw = p + 2;
+  ref<Expr> rightShift =
+      SubExpr::create(signedConstant(p - 1, xw), u.exponent);
+  rightShift = ite(SltExpr::create(rightShift, signedConstant(p + 1, xw)),
+                   rightShift, signedConstant(p + 1, xw));
+  rightShift = ite(isIntegral, constant(1, xw), rightShift);
+  ref<Expr> significand = ZExtExpr::create(u.significand, fw);
+  ref<Expr> amount = resize(rightShift, fw);
+  ref<Expr> amountLessOne = SubExpr::create(amount, constant(1, fw));
+  ref<Expr> integer = LShrExpr::create(significand, amount);
+  ref<Expr> guard = bit(LShrExpr::create(significand, amountLessOne), 0);
+  ref<Expr> stickyMask = SubExpr::create(
+      ShlExpr::create(constant(1, fw), amountLessOne), constant(1, fw));
+  ref<Expr> sticky = isNonZero(AndExpr::create(significand, stickyMask));
+  ref<Expr> roundUp = shouldRoundUp(rm, u.sign, bit(integer, 0), guard, sticky);
+  ref<Expr> fractional =
+      AddExpr::create(integer, ZExtExpr::create(roundUp, fw));
+
+  return ite(u.isZero, constant(0, width),
+             ite(isIntegral, integral, resize(fractional, width)));
+}
+
+/// A signed integer which orders all non-NaN values of \a u, with both zeros
+/// mapping to zero.
+ref<Expr> orderKey(const FloatFormat &format, const Unpacked &u) {
+  Expr::Width xw = u.exponent->getWidth();
+  Expr::Width mw = 1 + xw + format.precision;
+  // Biasing the exponent by flipping its sign bit makes it order as an
+  // unsigned number.
+  ref<Expr> biasedExponent = XorExpr::create(
+      u.exponent, ConstantExpr::alloc(llvm::APInt::getSignedMinValue(xw)));
+  ref<Expr> magnitude =
+      ZExtExpr::create(ConcatExpr::create(biasedExponent, u.significand), mw);
+  magnitude = ite(u.isInf,
+                  ConstantExpr::alloc(llvm::APInt::getSignedMinValue(mw)),
+                  ite(u.isZero, constant(0, mw), magnitude));
+  magnitude = ZExtExpr::create(magnitude, mw + 1);
+  return ite(u.sign, SubExpr::create(constant(0, mw + 1), magnitude),
+             magnitude);
+}
+
+ref<Expr> notNaN(const Unpacked &a, const Unpacked &b) {
+  return AndExpr::create(notExpr(a.isNaN), notExpr(b.isNaN));
+}
+
+ref<Expr> flipSign(const FloatFormat &format, const ref<Expr> &bits) {
+  return XorExpr::create(
+      bits, ConstantExpr::alloc(llvm::APInt::getSignedMinValue(format.width)));
+}
+
+ref<Expr> lowerAdd(const FloatFormat &format, llvm::APFloat::roundingMode rm,
+                   const ref<Expr> &aBits, const ref<Expr> &bBits) {
+  Unpacked a = unpack(format, aBits);
+  Unpacked b = unpack(format, bBits);
+  unsigned p = format.precision;
+  Expr::Width xw = format.exponentWidth();
+
+  ref<Expr> isNaN = OrExpr::create(
+      OrExpr::create(a.isNaN, b.isNaN),
+      AndExpr::create(AndExpr::create(a.isInf, b.isInf),
+                      XorExpr::create(a.sign, b.sign)));
+  ref<Expr> isInf = OrExpr::create(a.isInf, b.isInf);
+  ref<Expr> infSign = ite(a.isInf, a.sign, b.sign);
+
+  // An exact zero sum is negative only if both operands are, or if rounding
+  // towards negative.
+  ref<Expr> zeroSign =
+      rm == llvm::APFloat::rmTowardNegative ? boolConstant(true)
+                                            : boolConstant(false);
+  ref<Expr> bothZeroSign =
+      ite(EqExpr::create(a.sign, b.sign), a.sign, zeroSign);
+
+  // Order the operands by magnitude and align the smaller one. Shifting it
+  // by more than p + 3 bits cannot change the rounded result, as long as the
+  // bits which are shifted out stay non-zero.
+  ref<Expr> aIsLarger = OrExpr::create(
+      SltExpr::create(b.exponent, a.exponent),
+      AndExpr::create(EqExpr::create(a.exponent, b.exponent),
+                      UleExpr::create(b.significand, a.significand)));
+  ref<Expr> largeSign = ite(aIsLarger, a.sign, b.sign);
+  ref<Expr> largeExponent = ite(aIsLarger, a.exponent, b.exponent);
+  ref<Expr> largeSignificand = ite(aIsLarger, a.significand, b.significand);
+  ref<Expr> smallSign = ite(aIsLarger, b.sign, a.sign);
+  ref<Expr> smallExponent = ite(aIsLarger, b.exponent, a.exponent);
+  ref<Expr> smallSignificand = ite(aIsLarger, b.significand, a.significand);
+
+  Expr::Width sw = 2 * p + 4;
+  ref<Expr> large =
+      padRight(ZExtExpr::create(largeSignificand, p + 1), p + 3);
+  ref<Expr> small =
+      padRight(ZExtExpr::create(smallSignificand, p + 1), p + 3);
+  ref<Expr> distance = SubExpr::create(largeExponent, smallExponent);
+  ref<Expr> maxDistance = constant(p + 3, xw);
+  distance = ite(UltExpr::create(distance, maxDistance), distance, maxDistance);
+  small = LShrExpr::create(small, resize(distance, sw));
+
+  ref<Expr> sum = ite(EqExpr::create(largeSign, smallSign),
+                      AddExpr::create(large, small),
+                      SubExpr::create(large, small));
+  auto normalized = normalize(sum, xw);
+  ref<Expr> exponent =
+      SubExpr::create(AddExpr::create(largeExponent, constant(1, xw)),
+                      normalized.second);
+  ref<Expr> rounded = round(format, rm, largeSign, exponent,
+                            normalized.first, boolConstant(false));
+
+  return ite(
+      isNaN, packNaN(format),
+      ite(isInf, packInf(format, infSign),
+          ite(AndExpr::create(a.isZero, b.isZero),
+              packZero(format, bothZeroSign),
+              ite(a.isZero, bBits,
+                  ite(b.isZero, aBits,
+                      ite(Expr::createIsZero(sum), packZero(format, zeroSign),
+                          rounded))))));
+}
+
+ref<Expr> lowerMul(const FloatFormat &format, llvm::APFloat::roundingMode rm,
+                   const ref<Expr> &aBits, const ref<Expr> &bBits) {
+  Unpacked a = unpack(format, aBits);
+  Unpacked b = unpack(format, bBits);
+  unsigned p = format.precision;
+  Expr::Width xw = format.exponentWidth();
+
+  ref<Expr> sign = XorExpr::create(a.sign, b.sign);
+  ref<Expr> isNaN = OrExpr::create(
+      OrExpr::create(a.isNaN, b.isNaN),
+      OrExpr::create(AndExpr::create(a.isInf, b.isZero),
+                     AndExpr::create(a.isZero, b.isInf)));
+
+  // The product of two significands in [1, 2) is in [1, 4).
+  ref<Expr> product =
+      MulExpr::create(ZExtExpr::create(a.significand, 2 * p),
+                      ZExtExpr::create(b.significand, 2 * p));
+  ref<Expr> top = bit(product, 2 * p - 1);
+  ref<Expr> exponent = AddExpr::create(a.exponent, b.exponent);
+  exponent = ite(top, AddExpr::create(exponent, constant(1, xw)), exponent);
+  ref<Expr> significand =
+      ite(top, product, ShlExpr::create(product, constant(1, 2 * p)));
+
+  return ite(isNaN, packNaN(format),
+             ite(OrExpr::create(a.isInf, b.isInf), packInf(format, sign),
+                 ite(OrExpr::create(a.isZero, b.isZero),
+                     packZero(format, sign),
+                     round(format, rm, sign, exponent, significand,
+                           boolConstant(false)))));
+}
+
+ref<Expr> lowerDiv(const FloatFormat &format, llvm::APFloat::roundingMode rm,
+                   const ref<Expr> &aBits, const ref<Expr> &bBits) {
+  Unpacked a = unpack(format, aBits);
+  Unpacked b = unpack(format, bBits);
+  unsigned p = format.precision;
+  Expr::Width xw = format.exponentWidth();
+
+  ref<Expr> sign = XorExpr::create(a.sign, b.sign);
+  ref<Expr> isNaN = OrExpr::create(
+      OrExpr::create(a.isNaN, b.isNaN),
+      OrExpr::create(AndExpr::create(a.isInf, b.isInf),
+                     AndExpr::create(a.isZero, b.isZero)));
+
+  // The quotient of two significands in [1, 2) is in (1/2, 2), so p + 2
+  // quotient bits hold the result and a guard bit.
+  Expr::Width dw = 2 * p + 2;
+  ref<Expr> dividend =
+      padRight(ZExtExpr::create(a.significand, p + 1), p + 1);
+  ref<Expr> divisor = ZExtExpr::create(b.significand, dw);
+  ref<Expr> quotient = ExtractExpr::create(
+      UDivExpr::create(dividend, divisor), 0, p + 2);
+  ref<Expr> sticky = isNonZero(URemExpr::create(dividend, divisor));
+
+  ref<Expr> top = bit(quotient, p + 1);
+  ref<Expr> exponent = SubExpr::create(a.exponent, b.exponent);
+  exponent = ite(top, exponent, SubExpr::create(exponent, constant(1, xw)));
+  ref<Expr> significand =
+      ite(top, quotient, ShlExpr::create(quotient, constant(1, p + 2)));
+
+  return ite(isNaN, packNaN(format),
+             ite(OrExpr::create(a.isInf, b.isZero), packInf(format, sign),
+                 ite(OrExpr::create(a.isZero, b.isInf),
+                     packZero(format, sign),
+                     round(format, rm, sign, exponent, significand, sticky))));
+}
+
+/// The IEEE-754 remainder a - n * b, where n is a / b rounded to nearest
+/// with ties to even, like Z3's fp.rem and llvm::APFloat::remainder. It is
+/// always exact, so the rounding mode does not matter.
+ref<Expr> lowerRem(const FloatFormat &format, const ref<Expr> &aBits,
+                   const ref<Expr> &bBits) {
+  Unpacked a = unpack(format, aBits);
+  Unpacked b = unpack(format, bBits);
+  unsigned p = format.precision;
+  Expr::Width xw = format.exponentWidth();
+
+  ref<Expr> isNaN = OrExpr::create(OrExpr::create(a.isNaN, b.isNaN),
+                                   OrExpr::create(a.isInf, b.isZero));
+
+  // Work in units of half an ulp of b, so that |a| = ma * 2^s and
+  // |b| = 2 * mb for s = ea - eb + 1. If s is negative then |a| < |b| / 2
+  // and a is its own remainder.
+  ref<Expr> s = AddExpr::create(SubExpr::create(a.exponent, b.exponent),
+                                constant(1, xw));
+  ref<Expr> isSmaller = SltExpr::create(s, constant(0, xw));
+
+  // Reducing modulo 2 * |b| gives both the truncated remainder and the
+  // parity of the truncated quotient. 2^s mod 4 * mb is computed by square
+  // and multiply, s is at most the distance between the largest exponent and
+  // the smallest subnormal one, plus one.
+  unsigned maxS = format.maxExponent() - format.minExponent() + p;
+  unsigned sBits = 0;
+  while (maxS >> sBits)
+    ++sBits;
+  Expr::Width mw = 2 * p + 4;
+  ref<Expr> divisor = ShlExpr::create(
+      ZExtExpr::create(b.significand, p + 2), constant(1, p + 2));
+  ref<Expr> modulus = ShlExpr::create(ZExtExpr::create(divisor, mw),
+                                      constant(1, mw));
+  ref<Expr> power = constant(1, mw);
+  ref<Expr> square = constant(2, mw);
+  for (unsigned i = 0; i < sBits; ++i) {
+    power = ite(bit(s, i),
+                URemExpr::create(MulExpr::create(power, square), modulus),
+                power);
+    if (i + 1 < sBits)
+      square = URemExpr::create(MulExpr::create(square, square), modulus);
+  }
+  ref<Expr> reduced = ExtractExpr::create(
+      URemExpr::create(
+          MulExpr::create(ZExtExpr::create(a.significand, mw), power), modulus),
+      0, p + 2);
+
+  // Round the quotient up, flipping the sign of the remainder, if the
+  // truncated remainder is more than |b| / 2, or exactly half of it with an
+  // odd truncated quotient.
+  ref<Expr> isOdd = UleExpr::create(divisor, reduced);
+  ref<Expr> truncated = ite(isOdd, SubExpr::create(reduced, divisor), reduced);
+  ref<Expr> half = ZExtExpr::create(b.significand, p + 2);
+  ref<Expr> roundsUp = OrExpr::create(
+      UltExpr::create(half, truncated),
+      AndExpr::create(EqExpr::create(half, truncated), isOdd));
+  ref<Expr> remainder =
+      ite(roundsUp, SubExpr::create(divisor, truncated), truncated);
+  ref<Expr> sign = XorExpr::create(a.sign, roundsUp);
+
+  auto normalized = normalize(remainder, xw);
+  ref<Expr> exponent = SubExpr::create(
+      AddExpr::create(b.exponent, constant(1, xw)), normalized.second);
+  ref<Expr> rounded =
+      round(format, llvm::APFloat::rmNearestTiesToEven, sign, exponent,
+            normalized.first, boolConstant(false));
+
+  return ite(isNaN, packNaN(format),
+             ite(OrExpr::create(OrExpr::create(a.isZero, b.isInf), isSmaller),
+                 aBits,
+                 ite(Expr::createIsZero(remainder), packZero(format, a.sign),
+                     rounded)));
+}
+
+ref<Expr> lowerSqrt(const FloatFormat &format, llvm::APFloat::roundingMode rm,
+                    const ref<Expr> &bits) {
+  Unpacked a = unpack(format, bits);
+  unsigned p = format.precision;
+  Expr::Width xw = format.exponentWidth();
+
+  ref<Expr> isNaN = OrExpr::create(
+      a.isNaN, AndExpr::create(a.sign, notExpr(a.isZero)));
+
+  // Make the exponent even so it can be halved exactly.
+  ref<Expr> odd = bit(a.exponent, 0);
+  ref<Expr> significand = ZExtExpr::create(a.significand, p + 1);
+  significand =
+      ite(odd, ShlExpr::create(significand, constant(1, p + 1)), significand);
+  ref<Expr> exponent = ite(
+      odd, SubExpr::create(a.exponent, constant(1, xw)), a.exponent);
+
+  // Digit by digit integer square root of significand * 2^(p + 3), giving a
+  // p + 2 bit root with the top bit set.
+  ref<Expr> radicand = padRight(significand, p + 3);
+  Expr::Width rw = p + 5;
+  ref<Expr> root = constant(0, rw);
+  ref<Expr> remainder = constant(0, rw);
+  for (int i = p + 1; i >= 0; --i) {
+    remainder = OrExpr::create(
+        ShlExpr::create(remainder, constant(2, rw)),
+        ZExtExpr::create(ExtractExpr::create(radicand, 2 * i, 2), rw));
+    ref<Expr> trial = OrExpr::create(ShlExpr::create(root, constant(2, rw)),
+                                     constant(1, rw));
+    ref<Expr> fits = UleExpr::create(trial, remainder);
+    remainder = ite(fits, SubExpr::create(remainder, trial), remainder);
+    root = OrExpr::create(ShlExpr::create(root, constant(1, rw)),
+                          ZExtExpr::create(fits, rw));
+  }
+
+  ref<Expr> rounded =
+      round(format, rm, boolConstant(false),
+            AShrExpr::create(exponent, constant(1, xw)),
+            ExtractExpr::create(root, 0, p + 2), isNonZero(remainder));
+  return ite(isNaN, packNaN(format),
+             ite(OrExpr::create(a.isInf, a.isZero), bits, rounded));
+}
+
+ref<Expr> lowerRint(const FloatFormat &format, llvm::APFloat::roundingMode rm,
+                    const ref<Expr> &bits) {
+  Unpacked a = unpack(format, bits);
+  unsigned p = format.precision;
+  Expr::Width xw = format.exponentWidth();
+
+  // Values with an exponent of at least p - 1 are already integral.
+  ref<Expr> isIntegral =
+      SleExpr::create(signedConstant(p - 1, xw), a.exponent);
+  ref<Expr> magnitude = roundToIntegerMagnitude(format, rm, a, 0, p + 2);
+  ref<Expr> rounded =
+      ite(Expr::createIsZero(magnitude), packZero(format, a.sign),
+          roundInteger(format, rm, a.sign, magnitude));
+  return ite(a.isNaN, packNaN(format),
+             ite(OrExpr::create(OrExpr::create(a.isInf, a.isZero),
+                                isIntegral),
+                 bits, rounded));
+}
+
+ref<Expr> lowerMinMax(const FloatFormat &format, const ref<Expr> &aBits,
+                      const ref<Expr> &bBits, bool isMax) {
+  Unpacked a = unpack(format, aBits);
+  Unpacked b = unpack(format, bBits);
+  ref<Expr> aKey = orderKey(format, a);
+  ref<Expr> bKey = orderKey(format, b);
+  ref<Expr> pickB =
+      isMax ? SltExpr::create(aKey, bKey) : SltExpr::create(bKey, aKey);
+  return ite(a.isNaN, bBits, ite(b.isNaN, aBits, ite(pickB, bBits, aBits)));
+}
+
+ref<Expr> lowerCompare(const FloatFormat &format, Expr::Kind kind,
+                       const ref<Expr> &aBits, const ref<Expr> &bBits) {
+  Unpacked a = unpack(format, aBits);
+  Unpacked b = unpack(format, bBits);
+  ref<Expr> aKey = orderKey(format, a);
+  ref<Expr> bKey = orderKey(format, b);
+  ref<Expr> res;
+  switch (kind) {
+  case Expr::FOEq:
+    res = EqExpr::create(aKey, bKey);
+    break;
+  case Expr::FOLt:
+    res = SltExpr::create(aKey, bKey);
+    break;
+  case Expr::FOLe:
+    res = SleExpr::create(aKey, bKey);
+    break;
+  case Expr::FOGt:
+    res = SltExpr::create(bKey, aKey);
+    break;
+  case Expr::FOGe:
+    res = SleExpr::create(bKey, aKey);
+    break;
+  default:
+    llvm_unreachable("Unhandled floating point comparison");
+  }
+  return AndExpr::create(notNaN(a, b), res);
+}
+
+ref<Expr> lowerClassify(const FloatFormat &format, Expr::Kind kind,
+                        const ref<Expr> &bits) {
+  Unpacked u = unpack(format, bits);
+  ref<Expr> isFiniteNonZero = AndExpr::create(
+      notExpr(OrExpr::create(u.isNaN, u.isInf)), notExpr(u.isZero));
+  ref<Expr> minExponent =
+      signedConstant(format.minExponent(), format.exponentWidth());
+  switch (kind) {
+  case Expr::IsNaN:
+    return u.isNaN;
+  case Expr::IsInfinite:
+    return u.isInf;
+  case Expr::IsNormal:
+    return AndExpr::create(isFiniteNonZero,
+                           SleExpr::create(minExponent, u.exponent));
+  case Expr::IsSubnormal:
+    return AndExpr::create(isFiniteNonZero,
+                           SltExpr::create(u.exponent, minExponent));
+  default:
+    llvm_unreachable("Unhandled floating point predicate");
+  }
+}
+
+ref<Expr> lowerConvert(const FloatFormat &from, const FloatFormat &to,
+                       llvm::APFloat::roundingMode rm, const ref<Expr> &bits) {
+  Unpacked u = unpack(from, bits);
+  Expr::Width xw = std::max(from.exponentWidth(), to.exponentWidth());
+  ref<Expr> rounded =
+      round(to, rm, u.sign, SExtExpr::create(u.exponent, xw), u.significand,
+            boolConstant(false));
+  return ite(u.isNaN, packNaN(to),
+             ite(u.isInf, packInf(to, u.sign),
+                 ite(u.isZero, packZero(to, u.sign), rounded)));
+}
+
+ref<Expr> lowerFromInteger(const FloatFormat &format,
+                           llvm::APFloat::roundingMode rm,
+                           const ref<Expr> &value, bool isSigned) {
+  Expr::Width width = value->getWidth();
+  ref<Expr> sign =
+      isSigned ? bit(value, width - 1) : boolConstant(false);
+  ref<Expr> magnitude =
+      isSigned ? ite(sign, SubExpr::create(constant(0, width), value), value)
+               : value;
+  return ite(Expr::createIsZero(value), packZero(format, boolConstant(false)),
+             roundInteger(format, rm, sign, magnitude));
+}
+
+ref<Expr> lowerToInteger(const FloatFormat &format,
+                         llvm::APFloat::roundingMode rm,
+                         const ref<Expr> &bits, Expr::Width width,
+                         bool isSigned) {
+  Unpacked u = unpack(format, bits);
+  Expr::Width xw = u.exponent->getWidth();
+  while ((1u << (xw - 2)) < width)
+    ++xw;
+  u.exponent = SExtExpr::create(u.exponent, xw);
+
+  // Anything of magnitude 2^width or more overflows, so larger exponents
+  // need no shifting.
+  ref<Expr> isHuge = SleExpr::create(signedConstant(width, xw), u.exponent);
+  Expr::Width mw = std::max(width, format.precision) + 2;
+  ref<Expr> magnitude = roundToIntegerMagnitude(format, rm, u, width, mw);
+
+  ref<Expr> res, overflowValue, overflow;
+  if (isSigned) {
+    llvm::APInt maxPositive = llvm::APInt::getSignedMaxValue(width).zext(mw);
+    ref<Expr> limit = ite(u.sign, ConstantExpr::alloc(maxPositive + 1),
+                          ConstantExpr::alloc(maxPositive));
+    overflow = UltExpr::create(limit, magnitude);
+    overflowValue =
+        ite(u.sign, ConstantExpr::alloc(llvm::APInt::getSignedMinValue(width)),
+            ConstantExpr::alloc(llvm::APInt::getSignedMaxValue(width)));
+    res = ExtractExpr::create(
+        ite(u.sign, SubExpr::create(constant(0, mw), magnitude), magnitude), 0,
+        width);
+  } else {
+    // Negative values which do not round to zero are invalid and give zero,
+    // like llvm::APFloat.
+    overflow = AndExpr::create(
+        notExpr(u.sign),
+        UltExpr::create(ConstantExpr::alloc(
+                            llvm::APInt::getMaxValue(width).zext(mw)),
+                        magnitude));
+    overflowValue = allOnes(width);
+    res = ite(u.sign, constant(0, width),
+              ExtractExpr::create(magnitude, 0, width));
+  }
+
+  overflow = OrExpr::create(
+      overflow, AndExpr::create(OrExpr::create(u.isInf, isHuge),
+                                isSigned ? boolConstant(true)
+                                         : notExpr(u.sign)));
+  if (!isSigned)
+    res = ite(AndExpr::create(u.sign, OrExpr::create(u.isInf, isHuge)),
+              constant(0, width), res);
+  return ite(u.isNaN, constant(0, width),
+             ite(overflow, overflowValue, res));
+}
+
+} // namespace
+
+bool klee::isLowerableFloatingPoint(const ref<Expr> &e) {
+  switch (e->getKind()) {
+  case Expr::FPExt:
+  case Expr::FPTrunc:
+  case Expr::FPToUI:
+  case Expr::FPToSI:
+  case Expr::UIToFP:
+  case Expr::SIToFP:
+  case Expr::FSqrt:
+  case Expr::FAbs:
+  case Expr::FNeg:
+  case Expr::FRint:
+  case Expr::IsNaN:
+  case Expr::IsInfinite:
+  case Expr::IsNormal:
+  case Expr::IsSubnormal:
+  case Expr::FAdd:
+  case Expr::FSub:
+  case Expr::FMul:
+  case Expr::FDiv:
+  case Expr::FRem:
+  case Expr::FMax:
+  case Expr::FMin:
+  case Expr::FOEq:
+  case Expr::FOLt:
+  case Expr::FOLe:
+  case Expr::FOGt:
+  case Expr::FOGe:
+    return true;
+  default:
+    return false;
+  }
+}
+
+ref<Expr> klee::lowerFloatingPoint(const ref<Expr> &e) {
+  assert(isLowerableFloatingPoint(e) && "not a lowerable floating point expr");
+  ref<Expr> kid = e->getKid(0);
+
+  switch (e->getKind()) {
+  case Expr::FPExt:
+    return lowerConvert(getFloatFormat(kid->getWidth()),
+                        getFloatFormat(e->getWidth()),
+                        llvm::APFloat::rmNearestTiesToEven, kid);
+  case Expr::FPTrunc:
+    return lowerConvert(getFloatFormat(kid->getWidth()),
+                        getFloatFormat(e->getWidth()),
+                        cast<FPTruncExpr>(e)->roundingMode, kid);
+  case Expr::FPToUI:
+    return lowerToInteger(getFloatFormat(kid->getWidth()),
+                          cast<FPToUIExpr>(e)->roundingMode, kid,
+                          e->getWidth(), /*isSigned=*/false);
+  case Expr::FPToSI:
+    return lowerToInteger(getFloatFormat(kid->getWidth()),
+                          cast<FPToSIExpr>(e)->roundingMode, kid,
+                          e->getWidth(), /*isSigned=*/true);
+  case Expr::UIToFP:
+    return lowerFromInteger(getFloatFormat(e->getWidth()),
+                            cast<UIToFPExpr>(e)->roundingMode, kid,
+                            /*isSigned=*/false);
+  case Expr::SIToFP:
+    return lowerFromInteger(getFloatFormat(e->getWidth()),
+                            cast<SIToFPExpr>(e)->roundingMode, kid,
+                            /*isSigned=*/true);
+  default:
+    break;
+  }
+
+  FloatFormat format = getFloatFormat(kid->getWidth());
+  switch (e->getKind()) {
+  case Expr::FSqrt:
+    return lowerSqrt(format, cast<FSqrtExpr>(e)->roundingMode, kid);
+  case Expr::FRint:
+    return lowerRint(format, cast<FRintExpr>(e)->roundingMode, kid);
+  case Expr::FAbs:
+    return ZExtExpr::create(ExtractExpr::create(kid, 0, format.width - 1),
+                            format.width);
+  case Expr::FNeg:
+    return flipSign(format, kid);
+  case Expr::IsNaN:
+  case Expr::IsInfinite:
+  case Expr::IsNormal:
+  case Expr::IsSubnormal:
+    return lowerClassify(format, e->getKind(), kid);
+  case Expr::FAdd:
+    return lowerAdd(format, cast<FAddExpr>(e)->roundingMode, kid,
+                    e->getKid(1));
+  case Expr::FSub:
+    return lowerAdd(format, cast<FSubExpr>(e)->roundingMode, kid,
+                    flipSign(format, e->getKid(1)));
+  case Expr::FMul:
+    return lowerMul(format, cast<FMulExpr>(e)->roundingMode, kid,
+                    e->getKid(1));
+  case Expr::FDiv:
+    return lowerDiv(format, cast<FDivExpr>(e)->roundingMode, kid,
+                    e->getKid(1));
+  case Expr::FRem:
+    return lowerRem(format, kid, e->getKid(1));
+  case Expr::FMax:
+    return lowerMinMax(format, kid, e->getKid(1), /*isMax=*/true);
+  case Expr::FMin:
+    return lowerMinMax(format, kid, e->getKid(1), /*isMax=*/false);
+  case Expr::FOEq:
+  case Expr::FOLt:
+  case Expr::FOLe:
+  case Expr::FOGt:
+  case Expr::FOGe:
+    return lowerCompare(format, e->getKind(), kid, e->getKid(1));
+  default:
+    llvm_unreachable("Unhandled floating point expression");
+  }
+}
@@ -10,9 +10,11 @@
 
 #include "klee/Solver/Solver.h"
 
+#include "klee/Expr/ArrayCanonicalizer.h"
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
 #include "klee/Solver/IncompleteSolver.h"
+#include "klee/Solver/SolverCmdLine.h"
 #include "klee/Solver/SolverImpl.h"
 #include "klee/Solver/SolverStats.h"
 
@@ -22,13 +24,17 @@ using namespace klee;
 
 class CachingSolver : public SolverImpl {
 private:
+  struct CacheEntry;
+
   ref<Expr> canonicalizeQuery(ref<Expr> originalQuery,
                               bool &negationUsed);
 
-  void cacheInsert(const Query& query,
+  CacheEntry getCacheEntry(const Query &query, bool &negationUsed);
+
+  void cacheInsert(const CacheEntry &ce, bool negationUsed,
                    IncompleteSolver::PartialValidity result);
 
-  bool cacheLookup(const Query& query,
+  bool cacheLookup(const CacheEntry &ce, bool negationUsed,
                    IncompleteSolver::PartialValidity &result);
   
   struct CacheEntry {
@@ -47,14 +53,8 @@ private:
   };
 
   struct CacheEntryHash {
-    unsigned operator()(const CacheEntry &ce) const {
-      unsigned result = ce.query->hash();
-
-      for (auto const &constraint : ce.constraints) {
-        result ^= constraint->hash();
-      }
-
-      return result;
+    std::size_t operator()(const CacheEntry &ce) const {
+      return Query(ce.constraints, ce.query).hash();
     }
   };
 
@@ -64,6 +64,7 @@ private:
 
   Solver *solver;
   cache_map cache;
+  CanonicalArrayCache canonicalArrays;
 
 public:
   CachingSolver(Solver *s) : solver(s) {}
@@ -105,14 +106,26 @@ ref<Expr> CachingSolver::canonicalizeQuery(ref<Expr> originalQuery,
   }
 }
 
+/** @returns the cache entry for the given query.  With
+    -canonicalize-cached-arrays, the arrays are renamed so that the entry
+    does not depend on their names. */
+CachingSolver::CacheEntry CachingSolver::getCacheEntry(const Query &query,
+                                                       bool &negationUsed) {
+  if (!CanonicalizeCachedArrays)
+    return CacheEntry(query.constraints,
+                      canonicalizeQuery(query.expr, negationUsed));
+
+  ArrayCanonicalizer canonicalizer(canonicalArrays);
+  ConstraintSet constraints = canonicalizer.visit(query.constraints);
+  return CacheEntry(constraints, canonicalizeQuery(
+                                     canonicalizer.visit(query.expr),
+                                     negationUsed));
+}
+
 /** @returns true on a cache hit, false of a cache miss.  Reference
     value result only valid on a cache hit. */
-bool CachingSolver::cacheLookup(const Query& query,
+bool CachingSolver::cacheLookup(const CacheEntry &ce, bool negationUsed,
                                 IncompleteSolver::PartialValidity &result) {
-  bool negationUsed;
-  ref<Expr> canonicalQuery = canonicalizeQuery(query.expr, negationUsed);
-
-  CacheEntry ce(query.constraints, canonicalQuery);
   cache_map::iterator it = cache.find(ce);
   
   if (it != cache.end()) {
@@ -126,12 +139,8 @@ bool CachingSolver::cacheLookup(const Query& query,
 }
 
 /// Inserts the given query, result pair into the cache.
-void CachingSolver::cacheInsert(const Query& query,
+void CachingSolver::cacheInsert(const CacheEntry &ce, bool negationUsed,
                                 IncompleteSolver::PartialValidity result) {
-  bool negationUsed;
-  ref<Expr> canonicalQuery = canonicalizeQuery(query.expr, negationUsed);
-
-  CacheEntry ce(query.constraints, canonicalQuery);
   IncompleteSolver::PartialValidity cachedResult = 
     (negationUsed ? IncompleteSolver::negatePartialValidity(result) : result);
   
@@ -141,7 +150,9 @@ void CachingSolver::cacheInsert(const Query& query,
 bool CachingSolver::computeValidity(const Query& query,
                                     Solver::Validity &result) {
   IncompleteSolver::PartialValidity cachedResult;
-  bool tmp, cacheHit = cacheLookup(query, cachedResult);
+  bool negationUsed;
+  CacheEntry ce = getCacheEntry(query, negationUsed);
+  bool tmp, cacheHit = cacheLookup(ce, negationUsed, cachedResult);
   
   if (cacheHit) {
     switch(cachedResult) {
@@ -162,11 +173,11 @@ bool CachingSolver::computeValidity(const Query& query,
       if (!solver->impl->computeTruth(query, tmp))
         return false;
       if (tmp) {
-        cacheInsert(query, IncompleteSolver::MustBeTrue);
+        cacheInsert(ce, negationUsed, IncompleteSolver::MustBeTrue);
         result = Solver::True;
         return true;
       } else {
-        cacheInsert(query, IncompleteSolver::TrueOrFalse);
+        cacheInsert(ce, negationUsed, IncompleteSolver::TrueOrFalse);
         result = Solver::Unknown;
         return true;
       }
@@ -176,11 +187,11 @@ bool CachingSolver::computeValidity(const Query& query,
       if (!solver->impl->computeTruth(query.negateExpr(), tmp))
         return false;
       if (tmp) {
-        cacheInsert(query, IncompleteSolver::MustBeFalse);
+        cacheInsert(ce, negationUsed, IncompleteSolver::MustBeFalse);
         result = Solver::False;
         return true;
       } else {
-        cacheInsert(query, IncompleteSolver::TrueOrFalse);
+        cacheInsert(ce, negationUsed, IncompleteSolver::TrueOrFalse);
         result = Solver::Unknown;
         return true;
       }
@@ -203,14 +214,16 @@ bool CachingSolver::computeValidity(const Query& query,
     cachedResult = IncompleteSolver::TrueOrFalse; break;
   }
   
-  cacheInsert(query, cachedResult);
+  cacheInsert(ce, negationUsed, cachedResult);
   return true;
 }
 
 bool CachingSolver::computeTruth(const Query& query,
                                  bool &isValid) {
   IncompleteSolver::PartialValidity cachedResult;
-  bool cacheHit = cacheLookup(query, cachedResult);
+  bool negationUsed;
+  CacheEntry ce = getCacheEntry(query, negationUsed);
+  bool cacheHit = cacheLookup(ce, negationUsed, cachedResult);
 
   // a cached result of MayBeTrue forces us to check whether
   // a False assignment exists.
@@ -237,7 +250,7 @@ bool CachingSolver::computeTruth(const Query& query,
     cachedResult = IncompleteSolver::MayBeFalse;
   }
   
-  cacheInsert(query, cachedResult);
+  cacheInsert(ce, negationUsed, cachedResult);
   return true;
 }
 
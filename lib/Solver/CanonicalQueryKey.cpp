@@ -0,0 +1,167 @@
+//===-- CanonicalQueryKey.cpp ---------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CanonicalQueryKey.h"
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Solver/Solver.h"
+
+using namespace klee;
+
+namespace {
+// Tags which separate the different kinds of records in a key.
+enum : char {
+  TagExpr = 'E',
+  TagExprRef = 'e',
+  TagArray = 'A',
+  TagArrayRef = 'a',
+  TagUpdate = 'U',
+  TagUpdateRef = 'u',
+  TagUpdateEnd = 'N',
+  TagConstraint = 'C',
+  TagQuery = 'Q',
+  TagObject = 'O'
+};
+
+bool getRoundingMode(const Expr &e, llvm::APFloat::roundingMode &rm) {
+#define ROUNDING_MODE(_class_kind)                                             \
+  case Expr::_class_kind:                                                      \
+    rm = cast<_class_kind##Expr>(&e)->roundingMode;                            \
+    return true;
+
+  switch (e.getKind()) {
+    ROUNDING_MODE(FPTrunc)
+    ROUNDING_MODE(FPToUI)
+    ROUNDING_MODE(FPToSI)
+    ROUNDING_MODE(UIToFP)
+    ROUNDING_MODE(SIToFP)
+    ROUNDING_MODE(FAdd)
+    ROUNDING_MODE(FSub)
+    ROUNDING_MODE(FMul)
+    ROUNDING_MODE(FDiv)
+    ROUNDING_MODE(FRem)
+    ROUNDING_MODE(FMax)
+    ROUNDING_MODE(FMin)
+    ROUNDING_MODE(FSqrt)
+    ROUNDING_MODE(FRint)
+  default:
+    return false;
+  }
+#undef ROUNDING_MODE
+}
+} // namespace
+
+CanonicalQueryKey::CanonicalQueryKey(
+    const Query &query, const std::vector<const Array *> *objects) {
+  for (const auto &constraint : query.constraints) {
+    key += TagConstraint;
+    writeExpr(constraint);
+  }
+  key += TagQuery;
+  writeExpr(query.expr);
+  if (objects) {
+    for (const auto object : *objects) {
+      key += TagObject;
+      writeArray(object);
+    }
+  }
+}
+
+uint64_t CanonicalQueryKey::hash() const {
+  uint64_t res = UINT64_C(0xcbf29ce484222325);
+  for (unsigned char c : key) {
+    res ^= c;
+    res *= UINT64_C(0x100000001b3);
+  }
+  return res;
+}
+
+void CanonicalQueryKey::writeInt(uint64_t value) {
+  // LEB128, small values are by far the most common.
+  do {
+    unsigned char byte = value & 0x7f;
+    value >>= 7;
+    if (value)
+      byte |= 0x80;
+    key += static_cast<char>(byte);
+  } while (value);
+}
+
+void CanonicalQueryKey::writeArray(const Array *array) {
+  auto it = arrayIds.find(array);
+  if (it != arrayIds.end()) {
+    key += TagArrayRef;
+    writeInt(it->second);
+    return;
+  }
+  unsigned id = arrayIds.size();
+  arrayIds.emplace(array, id);
+
+  key += TagArray;
+  writeInt(array->size);
+  writeInt(array->domain);
+  writeInt(array->range);
+  writeInt(array->constantValues.size());
+  for (const auto &value : array->constantValues)
+    writeExpr(value);
+}
+
+void CanonicalQueryKey::writeUpdates(const UpdateNode *un) {
+  for (; un; un = un->next.get()) {
+    auto it = updateIds.find(un);
+    if (it != updateIds.end()) {
+      key += TagUpdateRef;
+      writeInt(it->second);
+      return;
+    }
+    unsigned id = updateIds.size();
+    updateIds.emplace(un, id);
+
+    key += TagUpdate;
+    writeExpr(un->index);
+    writeExpr(un->value);
+  }
+  key += TagUpdateEnd;
+}
+
+void CanonicalQueryKey::writeExpr(const ref<Expr> &e) {
+  auto it = exprIds.find(e);
+  if (it != exprIds.end()) {
+    key += TagExprRef;
+    writeInt(it->second);
+    return;
+  }
+
+  key += TagExpr;
+  writeInt(e->getKind());
+  writeInt(e->getWidth());
+
+  if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(e)) {
+    const llvm::APInt &value = ce->getAPValue();
+    for (unsigned i = 0; i < value.getNumWords(); ++i)
+      writeInt(value.getRawData()[i]);
+  } else if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+    writeArray(re->updates.root);
+    writeUpdates(re->updates.head.get());
+  } else if (const ExtractExpr *ee = dyn_cast<ExtractExpr>(e)) {
+    writeInt(ee->offset);
+  }
+
+  llvm::APFloat::roundingMode rm;
+  if (getRoundingMode(*e, rm))
+    writeInt(static_cast<uint64_t>(rm));
+
+  unsigned numKids = e->getNumKids();
+  for (unsigned i = 0; i < numKids; ++i)
+    writeExpr(e->getKid(i));
+
+  // Only numbered once complete, so a reference always points backwards.
+  unsigned id = exprIds.size();
+  exprIds.insert(std::make_pair(e, id));
+}
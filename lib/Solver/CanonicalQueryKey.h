@@ -0,0 +1,58 @@
+//===-- CanonicalQueryKey.h -------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_CANONICALQUERYKEY_H
+#define KLEE_CANONICALQUERYKEY_H
+
+#include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprHashMap.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace klee {
+struct Query;
+
+/// CanonicalQueryKey - A serialization of a query which does not depend on
+/// array names or on where the expressions live in memory.
+///
+/// Arrays are numbered in order of first occurrence, so two queries which
+/// only differ in the names of their arrays get the same key. Symbolic arrays
+/// are identified by their size, domain and range, constant arrays also by
+/// their contents. Repeated subexpressions are written once and referred to
+/// by number afterwards.
+class CanonicalQueryKey {
+  std::string key;
+  std::unordered_map<const Array *, unsigned> arrayIds;
+  ExprHashMap<unsigned> exprIds;
+  std::unordered_map<const UpdateNode *, unsigned> updateIds;
+
+  void writeInt(uint64_t value);
+  void writeArray(const Array *array);
+  void writeUpdates(const UpdateNode *un);
+  void writeExpr(const ref<Expr> &e);
+
+public:
+  /// Build the key for \a query. If \a objects is given, the arrays to
+  /// compute values for are part of the key as well, in the given order.
+  explicit CanonicalQueryKey(const Query &query,
+                             const std::vector<const Array *> *objects =
+                                 nullptr);
+
+  const std::string &str() const { return key; }
+
+  /// A 64-bit FNV-1a hash of the key, which is stable across runs.
+  uint64_t hash() const;
+};
+
+} // namespace klee
+
+#endif /* KLEE_CANONICALQUERYKEY_H */
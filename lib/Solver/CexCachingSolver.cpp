@@ -10,6 +10,7 @@
 #include "klee/Solver/Solver.h"
 
 #include "klee/ADT/MapOfSets.h"
+#include "klee/Expr/ArrayCanonicalizer.h"
 #include "klee/Expr/Assignment.h"
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
@@ -17,12 +18,16 @@
 #include "klee/Expr/ExprVisitor.h"
 #include "klee/Support/OptionCategories.h"
 #include "klee/Statistics/TimerStatIncrementer.h"
+#include "klee/Solver/SolverCmdLine.h"
 #include "klee/Solver/SolverImpl.h"
 #include "klee/Solver/SolverStats.h"
 #include "klee/Support/ErrorHandling.h"
 
 #include "llvm/Support/CommandLine.h"
 
+#include <list>
+#include <unordered_map>
+
 using namespace klee;
 using namespace llvm;
 
@@ -50,6 +55,12 @@ cl::opt<bool> CexCacheExperimental(
     cl::desc("Optimization for validity queries (default=false)"),
     cl::cat(SolvingCat));
 
+cl::opt<unsigned> CexCacheRecentQueries(
+    "cex-cache-recent-queries", cl::init(4096),
+    cl::desc("Number of recent queries whose counterexample is looked up "
+             "directly, without building a cache key (default=4096)"),
+    cl::cat(SolvingCat));
+
 } // namespace
 
 ///
@@ -71,18 +82,62 @@ class CexCachingSolver : public SolverImpl {
   MapOfSets<ref<Expr>, Assignment*> cache;
   // memo table
   assignmentsTable_ty assignmentsTable;
+  // arrays the cache entries refer to with -canonicalize-cached-arrays
+  CanonicalArrayCache canonicalArrays;
+
+  /// A query exactly as getAssignment() was asked it.
+  struct QueryEntry {
+    ConstraintSet constraints;
+    ref<Expr> expr;
+
+    bool operator==(const QueryEntry &b) const {
+      return constraints == b.constraints && *expr == *b.expr;
+    }
+  };
+
+  struct QueryEntryHash {
+    std::size_t operator()(const QueryEntry &e) const {
+      return Query(e.constraints, e.expr).hash();
+    }
+  };
+
+  typedef std::list<std::pair<QueryEntry, Assignment *>> recent_queries_ty;
+
+  /// The results of the last -cex-cache-recent-queries queries of
+  /// getAssignment(), most recent first, so that a query which was asked
+  /// shortly before is answered without building and searching for its key.
+  /// Not used with -canonicalize-cached-arrays, as the callers then need
+  /// the renaming done while building the key.
+  recent_queries_ty recentQueries;
+  std::unordered_map<QueryEntry, recent_queries_ty::iterator, QueryEntryHash>
+      queryResults;
+
+  /// Remember \a result as the result of \a entry, forgetting the least
+  /// recent query if there are too many.
+  void rememberResult(QueryEntry entry, Assignment *result);
+
+  /// Rename the arrays of \a e for the cache, if -canonicalize-cached-arrays
+  /// is set. Cache keys and cached assignments always refer to the renamed
+  /// arrays.
+  ref<Expr> canonicalize(ArrayCanonicalizer &canonicalizer,
+                         const ref<Expr> &e) {
+    return CanonicalizeCachedArrays ? canonicalizer.visit(e) : e;
+  }
 
   bool searchForAssignment(KeyType &key, 
                            Assignment *&result);
   
-  bool lookupAssignment(const Query& query, KeyType &key, Assignment *&result);
+  bool lookupAssignment(const Query& query, ArrayCanonicalizer &canonicalizer,
+                        KeyType &key, Assignment *&result);
 
-  bool lookupAssignment(const Query& query, Assignment *&result) {
+  bool lookupAssignment(const Query& query, ArrayCanonicalizer &canonicalizer,
+                        Assignment *&result) {
     KeyType key;
-    return lookupAssignment(query, key, result);
+    return lookupAssignment(query, canonicalizer, key, result);
   }
 
-  bool getAssignment(const Query& query, Assignment *&result);
+  bool getAssignment(const Query& query, ArrayCanonicalizer &canonicalizer,
+                     Assignment *&result);
   
 public:
   CexCachingSolver(Solver *_solver) : solver(_solver) {}
@@ -191,16 +246,20 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
 /// lookupAssignment - Lookup a cached result for the given \arg query.
 ///
 /// \param query - The query to lookup.
+/// \param canonicalizer - Renames the arrays of the query for the cache.
 /// \param key [out] - On return, the key constructed for the query.
 /// \param result [out] - The cached result, if the lookup is successful. This is
 /// either a satisfying assignment (for a satisfiable query), or 0 (for an
 /// unsatisfiable query).
 /// \return True if a cached result was found.
 bool CexCachingSolver::lookupAssignment(const Query &query, 
+                                        ArrayCanonicalizer &canonicalizer,
                                         KeyType &key,
                                         Assignment *&result) {
-  key = KeyType(query.constraints.begin(), query.constraints.end());
-  ref<Expr> neg = Expr::createIsZero(query.expr);
+  key.clear();
+  for (const auto &constraint : query.constraints)
+    key.insert(canonicalize(canonicalizer, constraint));
+  ref<Expr> neg = canonicalize(canonicalizer, Expr::createIsZero(query.expr));
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(neg)) {
     if (CE->isFalse()) {
       result = (Assignment*) 0;
@@ -219,17 +278,52 @@ bool CexCachingSolver::lookupAssignment(const Query &query,
   return found;
 }
 
-bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
+void CexCachingSolver::rememberResult(QueryEntry entry, Assignment *result) {
+  if (!CexCacheRecentQueries || queryResults.count(entry))
+    return;
+  recentQueries.emplace_front(entry, result);
+  queryResults.emplace(std::move(entry), recentQueries.begin());
+  if (queryResults.size() > CexCacheRecentQueries) {
+    queryResults.erase(recentQueries.back().first);
+    recentQueries.pop_back();
+  }
+}
+
+bool CexCachingSolver::getAssignment(const Query& query,
+                                     ArrayCanonicalizer &canonicalizer,
+                                     Assignment *&result) {
+  QueryEntry entry{query.constraints, query.expr};
+  if (!CanonicalizeCachedArrays) {
+    auto it = queryResults.find(entry);
+    if (it != queryResults.end()) {
+      ++stats::queryCexCacheHits;
+      recentQueries.splice(recentQueries.begin(), recentQueries, it->second);
+      result = it->second->second;
+      return true;
+    }
+  }
+
   KeyType key;
-  if (lookupAssignment(query, key, result))
+  if (lookupAssignment(query, canonicalizer, key, result)) {
+    if (!CanonicalizeCachedArrays)
+      rememberResult(std::move(entry), result);
     return true;
+  }
 
   std::vector<const Array*> objects;
   findSymbolicObjects(key.begin(), key.end(), objects);
 
+  // The key refers to the renamed arrays, the solver below gets the query
+  // with the original ones.
+  std::vector<const Array*> queryObjects(objects);
+  if (CanonicalizeCachedArrays) {
+    for (auto &object : queryObjects)
+      object = canonicalizer.getOriginal(object);
+  }
+
   std::vector< std::vector<unsigned char> > values;
   bool hasSolution;
-  if (!solver->impl->computeInitialValues(query, objects, values, 
+  if (!solver->impl->computeInitialValues(query, queryObjects, values,
                                           hasSolution))
     return false;
     
@@ -257,6 +351,8 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
   
   result = binding;
   cache.insert(key, binding);
+  if (!CanonicalizeCachedArrays)
+    rememberResult(std::move(entry), binding);
 
   return true;
 }
@@ -274,20 +370,21 @@ CexCachingSolver::~CexCachingSolver() {
 bool CexCachingSolver::computeValidity(const Query& query,
                                        Solver::Validity &result) {
   TimerStatIncrementer t(stats::cexCacheTime);
+  ArrayCanonicalizer canonicalizer(canonicalArrays);
   Assignment *a;
-  if (!getAssignment(query.withFalse(), a))
+  if (!getAssignment(query.withFalse(), canonicalizer, a))
     return false;
   assert(a && "computeValidity() must have assignment");
-  ref<Expr> q = a->evaluate(query.expr);
+  ref<Expr> q = a->evaluate(canonicalize(canonicalizer, query.expr));
   assert(isa<ConstantExpr>(q) && 
          "assignment evaluation did not result in constant");
 
   if (cast<ConstantExpr>(q)->isTrue()) {
-    if (!getAssignment(query, a))
+    if (!getAssignment(query, canonicalizer, a))
       return false;
     result = !a ? Solver::True : Solver::Unknown;
   } else {
-    if (!getAssignment(query.negateExpr(), a))
+    if (!getAssignment(query.negateExpr(), canonicalizer, a))
       return false;
     result = !a ? Solver::False : Solver::Unknown;
   }
@@ -307,14 +404,15 @@ bool CexCachingSolver::computeTruth(const Query& query,
   // so query cannot be true (valid). This does get hits, but doesn't
   // really seem to be worth the overhead.
 
+  ArrayCanonicalizer canonicalizer(canonicalArrays);
   if (CexCacheExperimental) {
     Assignment *a;
-    if (lookupAssignment(query.negateExpr(), a) && !a)
+    if (lookupAssignment(query.negateExpr(), canonicalizer, a) && !a)
       return false;
   }
 
   Assignment *a;
-  if (!getAssignment(query, a))
+  if (!getAssignment(query, canonicalizer, a))
     return false;
 
   isValid = !a;
@@ -326,11 +424,12 @@ bool CexCachingSolver::computeValue(const Query& query,
                                     ref<Expr> &result) {
   TimerStatIncrementer t(stats::cexCacheTime);
 
+  ArrayCanonicalizer canonicalizer(canonicalArrays);
   Assignment *a;
-  if (!getAssignment(query.withFalse(), a))
+  if (!getAssignment(query.withFalse(), canonicalizer, a))
     return false;
   assert(a && "computeValue() must have assignment");
-  result = a->evaluate(query.expr);  
+  result = a->evaluate(canonicalize(canonicalizer, query.expr));
   assert(isa<ConstantExpr>(result) && 
          "assignment evaluation did not result in constant");
   return true;
@@ -344,8 +443,9 @@ CexCachingSolver::computeInitialValues(const Query& query,
                                          &values,
                                        bool &hasSolution) {
   TimerStatIncrementer t(stats::cexCacheTime);
+  ArrayCanonicalizer canonicalizer(canonicalArrays);
   Assignment *a;
-  if (!getAssignment(query, a))
+  if (!getAssignment(query, canonicalizer, a))
     return false;
   hasSolution = !!a;
   
@@ -357,10 +457,14 @@ CexCachingSolver::computeInitialValues(const Query& query,
   values = std::vector< std::vector<unsigned char> >(objects.size());
   for (unsigned i=0; i < objects.size(); ++i) {
     const Array *os = objects[i];
+    // Map the object to the array the assignment refers to, objects which do
+    // not occur in the query have no binding either way.
+    if (CanonicalizeCachedArrays)
+      os = canonicalizer.getCanonical(os);
     Assignment::bindings_ty::iterator it = a->bindings.find(os);
     
     if (it == a->bindings.end()) {
-      values[i] = std::vector<unsigned char>(os->size, 0);
+      values[i] = std::vector<unsigned char>(objects[i]->size, 0);
     } else {
       values[i] = it->second;
     }
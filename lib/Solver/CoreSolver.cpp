@@ -19,9 +19,65 @@
 #include "llvm/Support/raw_ostream.h"
 
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace klee {
 
+static const char *getPortfolioMemberName(CoreSolverType cst) {
+  switch (cst) {
+  case STP_SOLVER:
+    return "stp";
+  case METASMT_SOLVER:
+    return "metasmt";
+  case Z3_SOLVER:
+    return "z3";
+  case Z3_BITBLAST_SOLVER:
+    return "z3-bitblast";
+  default:
+    llvm_unreachable("Unsupported portfolio solver");
+  }
+}
+
+static Solver *createPortfolioCoreSolver() {
+  std::vector<CoreSolverType> members(PortfolioSolvers.begin(),
+                                      PortfolioSolvers.end());
+  if (members.empty()) {
+#ifdef ENABLE_STP
+    members.push_back(STP_SOLVER);
+#endif
+#ifdef ENABLE_Z3
+#ifdef ENABLE_FP
+    members.push_back(Z3_SOLVER);
+#endif
+    members.push_back(Z3_BITBLAST_SOLVER);
+#endif
+  }
+
+  std::vector<std::pair<std::string, Solver *>> solvers;
+  for (CoreSolverType member : members) {
+    Solver *solver = nullptr;
+    if (member == STP_SOLVER) {
+      // The portfolio already runs every backend in its own process.
+#ifdef ENABLE_STP
+      solver = new STPSolver(/*useForkedSTP=*/false, CoreSolverOptimizeDivides);
+#endif
+    } else {
+      solver = createCoreSolver(member);
+    }
+    if (!solver)
+      continue;
+    solvers.emplace_back(getPortfolioMemberName(member), solver);
+  }
+
+  if (solvers.empty()) {
+    klee_message("No solvers available for the portfolio");
+    return NULL;
+  }
+  klee_message("Using portfolio of %zu solvers", solvers.size());
+  return createPortfolioSolver(std::move(solvers));
+}
+
 Solver *createCoreSolver(CoreSolverType cst) {
   switch (cst) {
   case STP_SOLVER:
@@ -56,6 +112,17 @@ Solver *createCoreSolver(CoreSolverType cst) {
     klee_message("Not compiled with Z3 support");
     return NULL;
 #endif
+  case Z3_BITBLAST_SOLVER:
+#ifdef ENABLE_Z3
+    klee_message("Using Z3 solver backend");
+    klee_message("Using Z3 core builder with floating point lowering");
+    return new Z3Solver(KLEE_CORE);
+#else
+    klee_message("Not compiled with Z3 support");
+    return NULL;
+#endif
+  case PORTFOLIO_SOLVER:
+    return createPortfolioCoreSolver();
   case NO_SOLVER:
     klee_message("Invalid solver");
     return NULL;
@@ -19,9 +19,12 @@
 #include "klee/Support/Debug.h"
 #include "klee/Support/IntEvaluation.h" // FIXME: Use APInt
 
+#include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <cassert>
+#include <cmath>
 #include <map>
 #include <sstream>
 #include <vector>
@@ -299,6 +302,287 @@ inline llvm::raw_ostream &operator<<(llvm::raw_ostream &os,
   return os;
 }
 
+/// FloatRange - A conservative interval over the values of a floating point
+/// type. NaN is unordered so it is tracked separately from the interval, and
+/// signed zeros compare equal so the interval does not distinguish them.
+///
+/// Arithmetic rounds the lower bound towards negative and the upper bound
+/// towards positive infinity, so the result contains the value computed under
+/// any rounding mode.
+class FloatRange {
+private:
+  llvm::APFloat m_min, m_max;
+  bool m_hasNumbers, m_mayBeNaN;
+
+public:
+  FloatRange(const llvm::APFloat &_min, const llvm::APFloat &_max,
+             bool _mayBeNaN)
+      : m_min(_min), m_max(_max),
+        m_hasNumbers(!_min.isNaN() && !_max.isNaN() &&
+                     _min.compare(_max) != llvm::APFloat::cmpGreaterThan),
+        m_mayBeNaN(_mayBeNaN) {}
+  explicit FloatRange(const llvm::APFloat &value)
+      : FloatRange(value, value, value.isNaN()) {}
+
+  /// The range of all values, including NaN.
+  static FloatRange full(const llvm::fltSemantics &sem, bool mayBeNaN = true) {
+    return FloatRange(llvm::APFloat::getInf(sem, true),
+                      llvm::APFloat::getInf(sem, false), mayBeNaN);
+  }
+  /// The range holding nothing but (optionally) NaN.
+  static FloatRange nan(const llvm::fltSemantics &sem, bool mayBeNaN = true) {
+    return FloatRange(llvm::APFloat::getInf(sem, false),
+                      llvm::APFloat::getInf(sem, true), mayBeNaN);
+  }
+
+  const llvm::fltSemantics &getSemantics() const {
+    return m_min.getSemantics();
+  }
+
+  void print(llvm::raw_ostream &os) const {
+    llvm::SmallString<16> lo, hi;
+    m_min.toString(lo);
+    m_max.toString(hi);
+    if (m_hasNumbers)
+      os << "[" << lo << "," << hi << "]";
+    else
+      os << "[]";
+    if (m_mayBeNaN)
+      os << "+NaN";
+  }
+
+  bool isEmpty() const noexcept { return !m_hasNumbers && !m_mayBeNaN; }
+  bool hasNumbers() const noexcept { return m_hasNumbers; }
+  bool mayBeNaN() const noexcept { return m_mayBeNaN; }
+  bool mustBeNaN() const noexcept { return !m_hasNumbers && m_mayBeNaN; }
+  /// Whether the range holds exactly one (non-NaN) value.
+  bool isFixed() const {
+    return m_hasNumbers && !m_mayBeNaN &&
+           m_min.compare(m_max) == llvm::APFloat::cmpEqual;
+  }
+
+  const llvm::APFloat &min() const {
+    assert(m_hasNumbers && "cannot get minimum of range without numbers");
+    return m_min;
+  }
+  const llvm::APFloat &max() const {
+    assert(m_hasNumbers && "cannot get maximum of range without numbers");
+    return m_max;
+  }
+
+  bool contains(const llvm::APFloat &value) const {
+    if (value.isNaN())
+      return m_mayBeNaN;
+    return m_hasNumbers &&
+           m_min.compare(value) != llvm::APFloat::cmpGreaterThan &&
+           m_max.compare(value) != llvm::APFloat::cmpLessThan;
+  }
+  bool containsInfinity(bool negative) const {
+    return contains(llvm::APFloat::getInf(getSemantics(), negative));
+  }
+  bool containsZero() const {
+    return contains(llvm::APFloat::getZero(getSemantics()));
+  }
+
+  FloatRange set_intersection(const FloatRange &b) const {
+    if (!m_hasNumbers || !b.m_hasNumbers)
+      return nan(getSemantics(), m_mayBeNaN && b.m_mayBeNaN);
+    return FloatRange(
+        m_min.compare(b.m_min) == llvm::APFloat::cmpLessThan ? b.m_min : m_min,
+        m_max.compare(b.m_max) == llvm::APFloat::cmpGreaterThan ? b.m_max
+                                                                : m_max,
+        m_mayBeNaN && b.m_mayBeNaN);
+  }
+  FloatRange set_union(const FloatRange &b) const {
+    if (!m_hasNumbers)
+      return FloatRange(b.m_min, b.m_max, m_mayBeNaN || b.m_mayBeNaN);
+    if (!b.m_hasNumbers)
+      return FloatRange(m_min, m_max, m_mayBeNaN || b.m_mayBeNaN);
+    return FloatRange(
+        m_min.compare(b.m_min) == llvm::APFloat::cmpLessThan ? m_min : b.m_min,
+        m_max.compare(b.m_max) == llvm::APFloat::cmpGreaterThan ? m_max
+                                                                : b.m_max,
+        m_mayBeNaN || b.m_mayBeNaN);
+  }
+
+  FloatRange neg() const {
+    if (!m_hasNumbers)
+      return *this;
+    llvm::APFloat lo(m_max), hi(m_min);
+    lo.changeSign();
+    hi.changeSign();
+    return FloatRange(lo, hi, m_mayBeNaN);
+  }
+  FloatRange abs() const {
+    if (!m_hasNumbers || !m_min.isNegative())
+      return *this;
+    if (m_max.isNegative())
+      return neg();
+    // The range straddles zero.
+    llvm::APFloat lo(m_min);
+    lo.changeSign();
+    return FloatRange(llvm::APFloat::getZero(getSemantics()),
+                      lo.compare(m_max) == llvm::APFloat::cmpGreaterThan
+                          ? lo
+                          : m_max,
+                      m_mayBeNaN);
+  }
+
+  /// Convert to \p sem; exact for extensions, rounded outwards otherwise.
+  FloatRange convert(const llvm::fltSemantics &sem) const {
+    if (!m_hasNumbers)
+      return nan(sem, m_mayBeNaN);
+    bool losesInfo;
+    llvm::APFloat lo(m_min), hi(m_max);
+    lo.convert(sem, llvm::APFloat::rmTowardNegative, &losesInfo);
+    hi.convert(sem, llvm::APFloat::rmTowardPositive, &losesInfo);
+    return FloatRange(lo, hi, m_mayBeNaN);
+  }
+
+  FloatRange rint() const {
+    if (!m_hasNumbers)
+      return *this;
+    llvm::APFloat lo(m_min), hi(m_max);
+    lo.roundToIntegral(llvm::APFloat::rmTowardNegative);
+    hi.roundToIntegral(llvm::APFloat::rmTowardPositive);
+    return FloatRange(lo, hi, m_mayBeNaN);
+  }
+
+  FloatRange sqrt() const {
+    const llvm::fltSemantics &sem = getSemantics();
+    bool mayBeNaN = m_mayBeNaN || (m_hasNumbers && m_min.isNegative() &&
+                                   !m_min.isZero());
+    if (!m_hasNumbers || (m_max.isNegative() && !m_max.isZero()))
+      return nan(sem, mayBeNaN);
+    // Evaluate on the host where that is known to be correctly rounded and
+    // widen by an ulp to cover the other rounding modes.
+    llvm::APFloat lo(m_min.isNegative() ? llvm::APFloat::getZero(sem) : m_min);
+    llvm::APFloat hi(m_max);
+    if (&sem == &ConstantExpr::widthToFloatSemantics(Expr::Int32)) {
+      lo = llvm::APFloat(std::sqrt(lo.convertToFloat()));
+      hi = llvm::APFloat(std::sqrt(hi.convertToFloat()));
+    } else if (&sem == &ConstantExpr::widthToFloatSemantics(Expr::Int64)) {
+      lo = llvm::APFloat(std::sqrt(lo.convertToDouble()));
+      hi = llvm::APFloat(std::sqrt(hi.convertToDouble()));
+    } else {
+      return FloatRange(llvm::APFloat::getZero(sem),
+                        llvm::APFloat::getInf(sem), mayBeNaN);
+    }
+    if (!lo.isZero())
+      lo.next(/*nextDown=*/true);
+    if (!hi.isInfinity())
+      hi.next(/*nextDown=*/false);
+    return FloatRange(lo, hi, mayBeNaN);
+  }
+
+  FloatRange add(const FloatRange &b) const {
+    bool mayBeNaN = m_mayBeNaN || b.m_mayBeNaN ||
+                    (containsInfinity(false) && b.containsInfinity(true)) ||
+                    (containsInfinity(true) && b.containsInfinity(false));
+    return corners(b, Expr::FAdd, mayBeNaN);
+  }
+  FloatRange sub(const FloatRange &b) const { return add(b.neg()); }
+  FloatRange mul(const FloatRange &b) const {
+    bool mayBeNaN =
+        m_mayBeNaN || b.m_mayBeNaN ||
+        (containsZero() && (b.containsInfinity(false) ||
+                            b.containsInfinity(true))) ||
+        (b.containsZero() && (containsInfinity(false) ||
+                              containsInfinity(true)));
+    return corners(b, Expr::FMul, mayBeNaN);
+  }
+  FloatRange div(const FloatRange &b) const {
+    bool mayBeNaN = m_mayBeNaN || b.m_mayBeNaN ||
+                    (containsZero() && b.containsZero()) ||
+                    ((containsInfinity(false) || containsInfinity(true)) &&
+                     (b.containsInfinity(false) || b.containsInfinity(true)));
+    // Division is only monotone when the divisor has a fixed sign.
+    if (b.containsZero())
+      return full(getSemantics(), mayBeNaN);
+    return corners(b, Expr::FDiv, mayBeNaN);
+  }
+  FloatRange fmin(const FloatRange &b) const {
+    return minmax(b, /*isMin=*/true);
+  }
+  FloatRange fmax(const FloatRange &b) const {
+    return minmax(b, /*isMin=*/false);
+  }
+
+private:
+  static llvm::APFloat apply(llvm::APFloat a, const llvm::APFloat &b,
+                             Expr::Kind op, llvm::APFloat::roundingMode rm) {
+    switch (op) {
+    case Expr::FAdd:
+      a.add(b, rm);
+      break;
+    case Expr::FMul:
+      a.multiply(b, rm);
+      break;
+    case Expr::FDiv:
+      a.divide(b, rm);
+      break;
+    default:
+      llvm_unreachable("unexpected floating point operation");
+    }
+    return a;
+  }
+
+  /// Evaluate \p op on the corners of both ranges. Only sound for operations
+  /// which are monotone in each argument over the given ranges.
+  FloatRange corners(const FloatRange &b, Expr::Kind op, bool mayBeNaN) const {
+    const llvm::fltSemantics &sem = getSemantics();
+    if (!m_hasNumbers || !b.m_hasNumbers)
+      return nan(sem, mayBeNaN);
+    llvm::APFloat lo(llvm::APFloat::getInf(sem, false));
+    llvm::APFloat hi(llvm::APFloat::getInf(sem, true));
+    for (const llvm::APFloat *x : {&m_min, &m_max}) {
+      for (const llvm::APFloat *y : {&b.m_min, &b.m_max}) {
+        llvm::APFloat down = apply(*x, *y, op, llvm::APFloat::rmTowardNegative);
+        llvm::APFloat up = apply(*x, *y, op, llvm::APFloat::rmTowardPositive);
+        if (down.isNaN() || up.isNaN())
+          return full(sem, true);
+        if (down.compare(lo) == llvm::APFloat::cmpLessThan)
+          lo = down;
+        if (up.compare(hi) == llvm::APFloat::cmpGreaterThan)
+          hi = up;
+      }
+    }
+    // Long doubles may be evaluated natively rather than through APFloat (see
+    // TryNativeX87FP80EvalArith), so allow for the last bit to differ.
+    if (&sem == &ConstantExpr::widthToFloatSemantics(Expr::Fl80)) {
+      lo.next(/*nextDown=*/true);
+      hi.next(/*nextDown=*/false);
+    }
+    return FloatRange(lo, hi, mayBeNaN);
+  }
+
+  FloatRange minmax(const FloatRange &b, bool isMin) const {
+    // minnum/maxnum only return NaN if both arguments are NaN, and a NaN
+    // argument otherwise lets the other one through unchanged.
+    bool mayBeNaN = m_mayBeNaN && b.m_mayBeNaN;
+    if (!m_hasNumbers || !b.m_hasNumbers) {
+      FloatRange r = m_hasNumbers ? *this : b;
+      return FloatRange(r.m_min, r.m_max, mayBeNaN);
+    }
+    auto pick = [isMin](const llvm::APFloat &x, const llvm::APFloat &y) {
+      bool xLess = x.compare(y) == llvm::APFloat::cmpLessThan;
+      return (xLess == isMin) ? x : y;
+    };
+    FloatRange r(pick(m_min, b.m_min), pick(m_max, b.m_max), mayBeNaN);
+    if (m_mayBeNaN)
+      r = r.set_union(b);
+    if (b.m_mayBeNaN)
+      r = r.set_union(*this);
+    return FloatRange(r.m_min, r.m_max, mayBeNaN);
+  }
+};
+
+inline llvm::raw_ostream &operator<<(llvm::raw_ostream &os,
+                                     const FloatRange &fr) {
+  fr.print(os);
+  return os;
+}
+
 // XXX waste of space, rather have ByteValueRange
 typedef ValueRange CexValueData;
 
@@ -420,6 +704,14 @@ class CexData {
 public:
   std::map<const Array*, CexObjectData*> objects;
 
+  /// exactFloatRanges - Conservative floating point ranges for expressions
+  /// constrained by floating point comparisons and predicates.
+  std::map<ref<Expr>, FloatRange> exactFloatRanges;
+
+  /// floatContradiction - Set when the floating point constraints propogated
+  /// so far were found to be unsatisfiable.
+  bool floatContradiction = false;
+
   CexData(const CexData&); // DO NOT IMPLEMENT
   void operator=(const CexData&); // DO NOT IMPLEMENT
 
@@ -776,6 +1068,46 @@ public:
       break;
     }
 
+    case Expr::FOEq:
+    case Expr::FOLt:
+    case Expr::FOLe:
+    case Expr::FOGt:
+    case Expr::FOGe: {
+      BinaryExpr *be = cast<BinaryExpr>(e);
+
+      // XXX heuristic / lossy, like the integer comparisons
+
+      if (range.isFixed() && isFloatWidth(be->left->getWidth())) {
+        FloatRange left = evalFloatRange(be->left);
+        FloatRange right = evalFloatRange(be->right);
+
+        if (right.isFixed()) {
+          propogatePossibleFloatValues(
+              be->left, solveFloatComparison(e->getKind(), right, range.min()));
+        } else if (left.isFixed()) {
+          propogatePossibleFloatValues(
+              be->right,
+              solveFloatComparison(mirrorFloatComparison(e->getKind()), left,
+                                   range.min()));
+        }
+      }
+      break;
+    }
+
+    case Expr::IsNaN:
+    case Expr::IsInfinite:
+    case Expr::IsNormal:
+    case Expr::IsSubnormal: {
+      ref<Expr> kid = e->getKid(0);
+      if (range.isFixed() && isFloatWidth(kid->getWidth()))
+        propogatePossibleFloatValues(
+            kid, floatPredicateTarget(
+                     e->getKind(),
+                     ConstantExpr::widthToFloatSemantics(kid->getWidth()),
+                     range.min()));
+      break;
+    }
+
     case Expr::Ne:
     case Expr::Ugt:
     case Expr::Uge:
@@ -916,6 +1248,44 @@ public:
       break;
     }
 
+    case Expr::FOEq:
+    case Expr::FOLt:
+    case Expr::FOLe:
+    case Expr::FOGt:
+    case Expr::FOGe: {
+      BinaryExpr *be = cast<BinaryExpr>(e);
+      if (range.isFixed() && isFloatWidth(be->left->getWidth())) {
+        FloatRange left = evalFloatRange(be->left);
+        FloatRange right = evalFloatRange(be->right);
+        propogateExactFloatValues(
+            be->left, solveFloatComparison(e->getKind(), right, range.min()));
+        propogateExactFloatValues(
+            be->right, solveFloatComparison(
+                           mirrorFloatComparison(e->getKind()), left,
+                           range.min()));
+        if (!evalFloatPredicate(e).contains(range.min()))
+          floatContradiction = true;
+      }
+      break;
+    }
+
+    case Expr::IsNaN:
+    case Expr::IsInfinite:
+    case Expr::IsNormal:
+    case Expr::IsSubnormal: {
+      ref<Expr> kid = e->getKid(0);
+      if (range.isFixed() && isFloatWidth(kid->getWidth())) {
+        propogateExactFloatValues(
+            kid, solveFloatPredicate(
+                     e->getKind(),
+                     ConstantExpr::widthToFloatSemantics(kid->getWidth()),
+                     range.min()));
+        if (!evalFloatPredicate(e).contains(range.min()))
+          floatContradiction = true;
+      }
+      break;
+    }
+
     case Expr::Ne:
     case Expr::Ugt:
     case Expr::Uge:
@@ -933,6 +1303,482 @@ public:
     return ce.evaluate(e);
   }
 
+  /// isFloatWidth - Whether expressions of the given width can be interpreted
+  /// as floating point values.
+  static bool isFloatWidth(Expr::Width w) {
+    return w == Expr::Int16 || w == Expr::Int32 || w == Expr::Int64 ||
+           w == Expr::Fl80 || w == Expr::Int128;
+  }
+
+  static Expr::Kind mirrorFloatComparison(Expr::Kind k) {
+    switch (k) {
+    case Expr::FOLt: return Expr::FOGt;
+    case Expr::FOLe: return Expr::FOGe;
+    case Expr::FOGt: return Expr::FOLt;
+    case Expr::FOGe: return Expr::FOLe;
+    default: return k;
+    }
+  }
+
+  static FloatRange floatsBelow(const llvm::APFloat &bound, bool strict,
+                                bool mayBeNaN) {
+    const llvm::fltSemantics &sem = bound.getSemantics();
+    llvm::APFloat hi(bound);
+    if (strict) {
+      if (hi.isInfinity() && hi.isNegative())
+        return FloatRange::nan(sem, mayBeNaN);
+      hi.next(/*nextDown=*/true);
+    }
+    return FloatRange(llvm::APFloat::getInf(sem, true), hi, mayBeNaN);
+  }
+
+  static FloatRange floatsAbove(const llvm::APFloat &bound, bool strict,
+                                bool mayBeNaN) {
+    const llvm::fltSemantics &sem = bound.getSemantics();
+    llvm::APFloat lo(bound);
+    if (strict) {
+      if (lo.isInfinity() && !lo.isNegative())
+        return FloatRange::nan(sem, mayBeNaN);
+      lo.next(/*nextDown=*/false);
+    }
+    return FloatRange(lo, llvm::APFloat::getInf(sem, false), mayBeNaN);
+  }
+
+  /// solveFloatComparison - Return a superset of the values x for which
+  /// (x \a kind y) evaluates to \a result for some y in \a other.
+  static FloatRange solveFloatComparison(Expr::Kind kind,
+                                         const FloatRange &other,
+                                         bool result) {
+    const llvm::fltSemantics &sem = other.getSemantics();
+    if (!result) {
+      // Ordered comparisons are false whenever either side is NaN.
+      if (other.mayBeNaN() || !other.hasNumbers())
+        return FloatRange::full(sem);
+      switch (kind) {
+      case Expr::FOLt: return floatsAbove(other.min(), false, true);
+      case Expr::FOLe: return floatsAbove(other.min(), true, true);
+      case Expr::FOGt: return floatsBelow(other.max(), false, true);
+      case Expr::FOGe: return floatsBelow(other.max(), true, true);
+      default: return FloatRange::full(sem);
+      }
+    }
+
+    if (!other.hasNumbers())
+      return FloatRange::nan(sem, false);
+    switch (kind) {
+    case Expr::FOEq: return FloatRange(other.min(), other.max(), false);
+    case Expr::FOLt: return floatsBelow(other.max(), true, false);
+    case Expr::FOLe: return floatsBelow(other.max(), false, false);
+    case Expr::FOGt: return floatsAbove(other.min(), true, false);
+    case Expr::FOGe: return floatsAbove(other.min(), false, false);
+    default: return FloatRange::full(sem);
+    }
+  }
+
+  /// solveFloatPredicate - Return a superset of the values for which the
+  /// floating point predicate \a kind evaluates to \a result.
+  static FloatRange solveFloatPredicate(Expr::Kind kind,
+                                        const llvm::fltSemantics &sem,
+                                        bool result) {
+    switch (kind) {
+    case Expr::IsNaN:
+      return result ? FloatRange::nan(sem) : FloatRange::full(sem, false);
+    case Expr::IsInfinite:
+      return result ? FloatRange::full(sem, false)
+                    : FloatRange(llvm::APFloat::getLargest(sem, true),
+                                 llvm::APFloat::getLargest(sem, false), true);
+    case Expr::IsNormal:
+      return result ? FloatRange::full(sem, false) : FloatRange::full(sem);
+    case Expr::IsSubnormal:
+      return result
+                 ? FloatRange(llvm::APFloat::getSmallestNormalized(sem, true),
+                              llvm::APFloat::getSmallestNormalized(sem, false),
+                              false)
+                 : FloatRange::full(sem);
+    default:
+      return FloatRange::full(sem);
+    }
+  }
+
+  /// floatPredicateTarget - Return a representative set of values for which
+  /// the floating point predicate \a kind evaluates to \a result.
+  static FloatRange floatPredicateTarget(Expr::Kind kind,
+                                         const llvm::fltSemantics &sem,
+                                         bool result) {
+    switch (kind) {
+    case Expr::IsInfinite:
+      if (result)
+        return FloatRange(llvm::APFloat::getInf(sem, false));
+      break;
+    case Expr::IsNormal:
+      return FloatRange(result ? llvm::APFloat(sem, 1)
+                               : llvm::APFloat::getZero(sem));
+    case Expr::IsSubnormal:
+      return FloatRange(result ? llvm::APFloat::getSmallest(sem)
+                               : llvm::APFloat::getZero(sem));
+    default:
+      break;
+    }
+    return solveFloatPredicate(kind, sem, result);
+  }
+
+  void propogatePossibleFloatValues(ref<Expr> e, FloatRange range) {
+    KLEE_DEBUG(llvm::errs() << "propogate float: " << range << " for\n"
+               << e << "\n");
+
+    if (range.isEmpty())
+      return;
+
+    switch (e->getKind()) {
+    case Expr::Constant:
+      break;
+
+    case Expr::Select: {
+      SelectExpr *se = cast<SelectExpr>(e);
+      ref<Expr> cond = evaluatePossible(se->cond);
+      if (!cond->isFalse())
+        propogatePossibleFloatValues(se->trueExpr, range);
+      if (!cond->isTrue())
+        propogatePossibleFloatValues(se->falseExpr, range);
+      break;
+    }
+
+    case Expr::FNeg:
+      propogatePossibleFloatValues(e->getKid(0), range.neg());
+      break;
+
+    case Expr::FAbs:
+      if (range.hasNumbers() && !range.max().isNegative())
+        range = FloatRange(range.min().isNegative()
+                               ? llvm::APFloat::getZero(range.getSemantics())
+                               : range.min(),
+                           range.max(), range.mayBeNaN());
+      propogatePossibleFloatValues(e->getKid(0), range);
+      break;
+
+    case Expr::FPExt:
+    case Expr::FPTrunc:
+      propogatePossibleFloatValues(
+          e->getKid(0),
+          range.convert(ConstantExpr::widthToFloatSemantics(
+              e->getKid(0)->getWidth())));
+      break;
+
+    case Expr::FSqrt:
+      if (range.hasNumbers() && !range.max().isNegative()) {
+        FloatRange root(range.min().isNegative()
+                            ? llvm::APFloat::getZero(range.getSemantics())
+                            : range.min(),
+                        range.max(), false);
+        propogatePossibleFloatValues(e->getKid(0), root.mul(root));
+      }
+      break;
+
+      // Invert arithmetic against a constant operand. Rounding makes this
+      // inexact, which is fine as these are only guesses.
+
+    case Expr::FAdd:
+    case Expr::FSub:
+    case Expr::FMul:
+    case Expr::FDiv: {
+      BinaryExpr *be = cast<BinaryExpr>(e);
+      ConstantExpr *CE = dyn_cast<ConstantExpr>(be->right);
+      bool constantOnRight = CE != nullptr;
+      if (!CE)
+        CE = dyn_cast<ConstantExpr>(be->left);
+      if (!CE)
+        break;
+      llvm::APFloat value = CE->getAPFloatValue();
+      if (value.isNaN() || value.isInfinity() ||
+          (value.isZero() &&
+           (e->getKind() == Expr::FMul || e->getKind() == Expr::FDiv)))
+        break;
+
+      FloatRange c(value);
+      ref<Expr> other = constantOnRight ? be->left : be->right;
+      switch (e->getKind()) {
+      case Expr::FAdd:
+        propogatePossibleFloatValues(other, range.sub(c));
+        break;
+      case Expr::FSub:
+        propogatePossibleFloatValues(other, constantOnRight ? range.add(c)
+                                                            : c.sub(range));
+        break;
+      case Expr::FMul:
+        propogatePossibleFloatValues(other, range.div(c));
+        break;
+      case Expr::FDiv:
+        if (constantOnRight)
+          propogatePossibleFloatValues(other, range.mul(c));
+        break;
+      default:
+        break;
+      }
+      break;
+    }
+
+    default: {
+      // Pick a representative value and propogate its bit pattern.
+      Expr::Width w = e->getWidth();
+      if (w > 64 || w == Expr::Fl80 || !isFloatWidth(w))
+        break;
+
+      // Prefer values which are consistent with the exact ranges.
+      FloatRange exact = range.set_intersection(evalFloatRange(e));
+      if (!exact.isEmpty())
+        range = exact;
+
+      ref<Expr> current = evaluatePossible(e);
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(current))
+        if (range.contains(CE->getAPFloatValue()))
+          break;
+
+      const llvm::fltSemantics &sem = range.getSemantics();
+      llvm::APFloat value = llvm::APFloat::getZero(sem);
+      if (range.hasNumbers()) {
+        if (!range.containsZero())
+          value = !range.min().isInfinity()
+                      ? range.min()
+                      : !range.max().isInfinity() ? range.max() : range.min();
+      } else {
+        value = llvm::APFloat::getQNaN(sem);
+      }
+      propogatePossibleValue(e, value.bitcastToAPInt().getZExtValue());
+      break;
+    }
+    }
+  }
+
+  void propogateExactFloatValues(ref<Expr> e, FloatRange range) {
+    FloatRange current = evalFloatRange(e).set_intersection(range);
+    if (current.isEmpty()) {
+      floatContradiction = true;
+      return;
+    }
+
+    switch (e->getKind()) {
+    case Expr::Constant:
+      return;
+
+    case Expr::FNeg:
+      propogateExactFloatValues(e->getKid(0), current.neg());
+      break;
+
+    case Expr::FAbs: {
+      const llvm::fltSemantics &sem = current.getSemantics();
+      FloatRange kid = FloatRange::nan(sem, current.mayBeNaN());
+      if (current.hasNumbers()) {
+        llvm::APFloat lo(current.max());
+        lo.changeSign();
+        kid = kid.set_union(FloatRange(lo, current.max(), false));
+      }
+      propogateExactFloatValues(e->getKid(0), kid);
+      break;
+    }
+
+    case Expr::FPExt:
+      // Extension is exact, so the bounds carry over to the operand.
+      propogateExactFloatValues(
+          e->getKid(0),
+          current.convert(ConstantExpr::widthToFloatSemantics(
+              e->getKid(0)->getWidth())));
+      break;
+
+    default:
+      break;
+    }
+
+    auto it = exactFloatRanges.find(e);
+    if (it == exactFloatRanges.end())
+      exactFloatRanges.insert(std::make_pair(e, current));
+    else
+      it->second = current;
+  }
+
+  /// evalFloatRange - Compute a conservative range for the floating point
+  /// value of \a e, given the current exact values.
+  FloatRange evalFloatRange(const ref<Expr> &e) {
+    const llvm::fltSemantics &sem =
+        ConstantExpr::widthToFloatSemantics(e->getWidth());
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(e))
+      return FloatRange(CE->getAPFloatValue());
+
+    FloatRange res = FloatRange::full(sem);
+    switch (e->getKind()) {
+    case Expr::Select: {
+      SelectExpr *se = cast<SelectExpr>(e);
+      ref<Expr> cond = evaluateExact(se->cond);
+      if (cond->isTrue())
+        res = evalFloatRange(se->trueExpr);
+      else if (cond->isFalse())
+        res = evalFloatRange(se->falseExpr);
+      else
+        res = evalFloatRange(se->trueExpr)
+                  .set_union(evalFloatRange(se->falseExpr));
+      break;
+    }
+
+    case Expr::FAdd:
+      res = evalFloatRange(e->getKid(0)).add(evalFloatRange(e->getKid(1)));
+      break;
+    case Expr::FSub:
+      res = evalFloatRange(e->getKid(0)).sub(evalFloatRange(e->getKid(1)));
+      break;
+    case Expr::FMul:
+      res = evalFloatRange(e->getKid(0)).mul(evalFloatRange(e->getKid(1)));
+      break;
+    case Expr::FDiv:
+      res = evalFloatRange(e->getKid(0)).div(evalFloatRange(e->getKid(1)));
+      break;
+    case Expr::FMin:
+      res = evalFloatRange(e->getKid(0)).fmin(evalFloatRange(e->getKid(1)));
+      break;
+    case Expr::FMax:
+      res = evalFloatRange(e->getKid(0)).fmax(evalFloatRange(e->getKid(1)));
+      break;
+    case Expr::FSqrt:
+      res = evalFloatRange(e->getKid(0)).sqrt();
+      break;
+    case Expr::FRint:
+      res = evalFloatRange(e->getKid(0)).rint();
+      break;
+    case Expr::FAbs:
+      res = evalFloatRange(e->getKid(0)).abs();
+      break;
+    case Expr::FNeg:
+      res = evalFloatRange(e->getKid(0)).neg();
+      break;
+    case Expr::FPExt:
+    case Expr::FPTrunc:
+      res = evalFloatRange(e->getKid(0)).convert(sem);
+      break;
+
+    case Expr::UIToFP:
+    case Expr::SIToFP: {
+      ref<Expr> kid = evaluateExact(e->getKid(0));
+      Expr::Width w = kid->getWidth();
+      bool isSigned = e->getKind() == Expr::SIToFP;
+      llvm::APInt lo = isSigned ? llvm::APInt::getSignedMinValue(w)
+                                : llvm::APInt::getMinValue(w);
+      llvm::APInt hi = isSigned ? llvm::APInt::getSignedMaxValue(w)
+                                : llvm::APInt::getMaxValue(w);
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(kid))
+        lo = hi = CE->getAPValue();
+      llvm::APFloat flo(sem), fhi(sem);
+      flo.convertFromAPInt(lo, isSigned, llvm::APFloat::rmTowardNegative);
+      fhi.convertFromAPInt(hi, isSigned, llvm::APFloat::rmTowardPositive);
+      res = FloatRange(flo, fhi, false);
+      break;
+    }
+
+    case Expr::FRem:
+      break;
+
+    default: {
+      // The range evaluator is not precise enough for multi-byte reads, so
+      // only use fully determined values.
+      ref<Expr> value = evaluateExact(e);
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(value))
+        res = FloatRange(CE->getAPFloatValue());
+      break;
+    }
+    }
+
+    auto it = exactFloatRanges.find(e);
+    if (it != exactFloatRanges.end())
+      res = res.set_intersection(it->second);
+    return res;
+  }
+
+  /// evalFloatPredicate - Evaluate a floating point comparison or predicate
+  /// over the current exact ranges, returning the range of possible truth
+  /// values.
+  ValueRange evalFloatPredicate(const ref<Expr> &e) {
+    bool mayBeTrue, mustBeTrue;
+    switch (e->getKind()) {
+    case Expr::FOEq:
+    case Expr::FOLt:
+    case Expr::FOLe:
+    case Expr::FOGt:
+    case Expr::FOGe: {
+      if (!isFloatWidth(e->getKid(0)->getWidth()))
+        return ValueRange(0, 1);
+      FloatRange left = evalFloatRange(e->getKid(0));
+      FloatRange right = evalFloatRange(e->getKid(1));
+      if (e->getKind() == Expr::FOGt || e->getKind() == Expr::FOGe)
+        std::swap(left, right);
+      bool strict = e->getKind() == Expr::FOLt || e->getKind() == Expr::FOGt;
+      if (!left.hasNumbers() || !right.hasNumbers())
+        return ValueRange(0);
+      bool ordered = !left.mayBeNaN() && !right.mayBeNaN();
+
+      llvm::APFloat::cmpResult lowCmp = left.min().compare(right.max());
+      llvm::APFloat::cmpResult highCmp = left.max().compare(right.min());
+      if (e->getKind() == Expr::FOEq) {
+        mayBeTrue = lowCmp != llvm::APFloat::cmpGreaterThan &&
+                    highCmp != llvm::APFloat::cmpLessThan;
+        mustBeTrue = ordered && left.isFixed() && right.isFixed() &&
+                     lowCmp == llvm::APFloat::cmpEqual;
+      } else if (strict) {
+        mayBeTrue = lowCmp == llvm::APFloat::cmpLessThan;
+        mustBeTrue = ordered && highCmp == llvm::APFloat::cmpLessThan;
+      } else {
+        mayBeTrue = lowCmp != llvm::APFloat::cmpGreaterThan;
+        mustBeTrue = ordered && highCmp != llvm::APFloat::cmpGreaterThan;
+      }
+      break;
+    }
+
+    case Expr::IsNaN:
+    case Expr::IsInfinite:
+    case Expr::IsNormal:
+    case Expr::IsSubnormal: {
+      ref<Expr> kid = e->getKid(0);
+      if (!isFloatWidth(kid->getWidth()))
+        return ValueRange(0, 1);
+      FloatRange range = evalFloatRange(kid);
+      const llvm::fltSemantics &sem = range.getSemantics();
+      FloatRange whenTrue = solveFloatPredicate(e->getKind(), sem, true);
+      FloatRange whenFalse = solveFloatPredicate(e->getKind(), sem, false);
+      mayBeTrue = !range.set_intersection(whenTrue).isEmpty();
+      mustBeTrue = range.set_intersection(whenFalse).isEmpty();
+      break;
+    }
+
+    default:
+      return ValueRange(0, 1);
+    }
+
+    if (mustBeTrue)
+      return ValueRange(1);
+    return mayBeTrue ? ValueRange(0, 1) : ValueRange(0);
+  }
+
+  /// evalFloatTruth - Evaluate a boolean expression built from floating point
+  /// comparisons and predicates, looking through negations.
+  ValueRange evalFloatTruth(const ref<Expr> &e) {
+    ValueRange res(0, 1);
+    switch (e->getKind()) {
+    case Expr::Not:
+      res = evalFloatTruth(e->getKid(0));
+      break;
+    case Expr::Eq: {
+      ConstantExpr *CE = dyn_cast<ConstantExpr>(e->getKid(0));
+      if (!CE || CE->getWidth() != Expr::Bool)
+        return res;
+      res = evalFloatTruth(e->getKid(1));
+      if (CE->isTrue())
+        return res;
+      break;
+    }
+    default:
+      return evalFloatPredicate(e);
+    }
+
+    // Negate the result.
+    return res.isFixed() ? ValueRange(!res.min()) : res;
+  }
+
   /// evaluate - Try to evaluate the given expression using a consistent fixed
   /// value for the current set of possible ranges.
   ref<Expr> evaluatePossible(ref<Expr> e) {
@@ -968,6 +1814,9 @@ public:
       }
       llvm::errs() << "]\n";
     }
+    for (const auto &entry : exactFloatRanges)
+      llvm::errs() << "float   : " << entry.second << " for " << entry.first
+                   << "\n";
   }
 };
 
@@ -1017,6 +1866,13 @@ static bool propogateValues(const Query& query, CexData &cd,
   }
 
   KLEE_DEBUG(cd.dump());
+
+  // If the floating point ranges are contradictory there is no assignment
+  // satisfying the constraints (and the negated query), so it is valid.
+  if (cd.floatContradiction) {
+    isValid = true;
+    return true;
+  }
   
   // Check the result.
   bool hasSatisfyingAssignment = true;
@@ -1025,7 +1881,8 @@ static bool propogateValues(const Query& query, CexData &cd,
       hasSatisfyingAssignment = false;
 
     // If the query is known to be true, then we have proved validity.
-    if (cd.evaluateExact(query.expr)->isTrue()) {
+    if (cd.evaluateExact(query.expr)->isTrue() ||
+        cd.evalFloatTruth(query.expr) == ValueRange(1)) {
       isValid = true;
       return true;
     }
@@ -1037,7 +1894,8 @@ static bool propogateValues(const Query& query, CexData &cd,
 
     // If this constraint is known to be false, then we can prove anything, so
     // the query is valid.
-    if (cd.evaluateExact(constraint)->isFalse()) {
+    if (cd.evaluateExact(constraint)->isFalse() ||
+        cd.evalFloatTruth(constraint) == ValueRange(0)) {
       isValid = true;
       return true;
     }
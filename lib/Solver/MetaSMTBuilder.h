@@ -17,6 +17,7 @@
 #include "klee/Expr/Expr.h"
 #include "klee/Expr/ExprHashMap.h"
 #include "klee/Expr/ExprPPrinter.h"
+#include "klee/Expr/FPBitvectorLowering.h"
 
 #ifdef ENABLE_METASMT
 
@@ -628,6 +629,11 @@ MetaSMTBuilder<SolverContext>::constructActual(ref<Expr> e, int *width_out) {
   //     ExprPPrinter::printSingleExpr(llvm::errs(), e);
   //     llvm::errs() << "\n";
 
+  // Floating point operations are lowered to bitvector operations on the
+  // IEEE-754 bit patterns, the solvers are only used through QF_BV.
+  if (isLowerableFloatingPoint(e))
+    return construct(lowerFloatingPoint(e), width_out);
+
   switch (e->getKind()) {
 
   case Expr::Constant: {
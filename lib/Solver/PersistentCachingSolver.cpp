@@ -0,0 +1,276 @@
+//===-- PersistentCachingSolver.cpp ---------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A query cache which is stored in an SQLite database, so that it survives
+// the process and can be shared between runs of KLEE on similar programs.
+//
+// Queries are looked up by their canonical key (see CanonicalQueryKey.h),
+// which does not depend on array names. Only the hash of the key is indexed,
+// the full key is stored alongside the result and compared on lookup.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CanonicalQueryKey.h"
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverImpl.h"
+#include "klee/Solver/SolverStats.h"
+#include "klee/Support/ErrorHandling.h"
+
+#include <sqlite3.h>
+
+#include <cstring>
+#include <string>
+
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+
+class PersistentCachingSolver : public SolverImpl {
+  /// The kind of result stored for a query.
+  enum ResultKind { Truth = 0, Value = 1, InitialValues = 2 };
+
+  Solver *solver;
+  std::string path;
+  sqlite3 *db;
+  sqlite3_stmt *lookupStmt;
+  sqlite3_stmt *insertStmt;
+  /// The process which opened \a db.
+  pid_t owner;
+
+  void open();
+  /// Reopen the database if this is a process forked after it was opened.
+  void checkOwner();
+  bool lookup(const CanonicalQueryKey &key, ResultKind kind,
+              std::string &result);
+  void insert(const CanonicalQueryKey &key, ResultKind kind,
+              const std::string &result);
+
+public:
+  PersistentCachingSolver(Solver *s, const std::string &path);
+  ~PersistentCachingSolver() override;
+
+  bool computeTruth(const Query &, bool &isValid) override;
+  bool computeValue(const Query &, ref<Expr> &result) override;
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char>> &values,
+                            bool &hasSolution) override;
+  SolverRunStatus getOperationStatusCode() override {
+    return solver->impl->getOperationStatusCode();
+  }
+  char *getConstraintLog(const Query &query) override {
+    return solver->impl->getConstraintLog(query);
+  }
+  void setCoreSolverTimeout(time::Span timeout) override {
+    solver->impl->setCoreSolverTimeout(timeout);
+  }
+};
+
+PersistentCachingSolver::PersistentCachingSolver(Solver *s,
+                                                 const std::string &path)
+    : solver(s), path(path), db(nullptr), lookupStmt(nullptr),
+      insertStmt(nullptr), owner(0) {
+  open();
+  klee_message("Using persistent query cache %s", path.c_str());
+}
+
+void PersistentCachingSolver::open() {
+  owner = getpid();
+  if (sqlite3_open(path.c_str(), &db) != SQLITE_OK) {
+    std::string error = sqlite3_errmsg(db);
+    sqlite3_close(db);
+    klee_error("Can't open query cache database %s: %s", path.c_str(),
+               error.c_str());
+  }
+
+  // Several runs may share the cache, wait for their writes instead of
+  // failing.
+  sqlite3_busy_timeout(db, 10000);
+
+  char *errMsg = nullptr;
+  const char *setup =
+      "PRAGMA synchronous = OFF;"
+      "PRAGMA journal_mode = WAL;"
+      "CREATE TABLE IF NOT EXISTS queries ("
+      "  hash INTEGER NOT NULL,"
+      "  kind INTEGER NOT NULL,"
+      "  key BLOB NOT NULL,"
+      "  result BLOB NOT NULL);"
+      "CREATE INDEX IF NOT EXISTS queries_hash ON queries (hash, kind);";
+  if (sqlite3_exec(db, setup, nullptr, nullptr, &errMsg) != SQLITE_OK) {
+    std::string error = errMsg ? errMsg : "unknown error";
+    sqlite3_free(errMsg);
+    klee_error("Can't set up query cache database %s: %s", path.c_str(),
+               error.c_str());
+  }
+
+  if (sqlite3_prepare_v2(db,
+                         "SELECT key, result FROM queries "
+                         "WHERE hash = ?1 AND kind = ?2",
+                         -1, &lookupStmt, nullptr) != SQLITE_OK ||
+      sqlite3_prepare_v2(db,
+                         "INSERT INTO queries (hash, kind, key, result) "
+                         "VALUES (?1, ?2, ?3, ?4)",
+                         -1, &insertStmt, nullptr) != SQLITE_OK)
+    klee_error("Cannot create prepared statement: %s", sqlite3_errmsg(db));
+}
+
+void PersistentCachingSolver::checkOwner() {
+  if (owner == getpid())
+    return;
+  // SQLite connections must not be used across fork(), so the connection of
+  // the parent is abandoned rather than closed.
+  db = nullptr;
+  lookupStmt = insertStmt = nullptr;
+  open();
+}
+
+PersistentCachingSolver::~PersistentCachingSolver() {
+  if (owner == getpid()) {
+    sqlite3_finalize(lookupStmt);
+    sqlite3_finalize(insertStmt);
+    sqlite3_close(db);
+  }
+  delete solver;
+}
+
+bool PersistentCachingSolver::lookup(const CanonicalQueryKey &key,
+                                     ResultKind kind, std::string &result) {
+  checkOwner();
+  const std::string &str = key.str();
+  sqlite3_bind_int64(lookupStmt, 1, static_cast<sqlite3_int64>(key.hash()));
+  sqlite3_bind_int(lookupStmt, 2, kind);
+
+  bool found = false;
+  while (sqlite3_step(lookupStmt) == SQLITE_ROW) {
+    const void *candidate = sqlite3_column_blob(lookupStmt, 0);
+    int size = sqlite3_column_bytes(lookupStmt, 0);
+    if (static_cast<size_t>(size) != str.size() ||
+        std::memcmp(candidate, str.data(), size) != 0)
+      continue;
+    const char *data =
+        static_cast<const char *>(sqlite3_column_blob(lookupStmt, 1));
+    result.assign(data, data + sqlite3_column_bytes(lookupStmt, 1));
+    found = true;
+    break;
+  }
+  sqlite3_reset(lookupStmt);
+
+  if (found)
+    ++stats::queryPersistentCacheHits;
+  else
+    ++stats::queryPersistentCacheMisses;
+  return found;
+}
+
+void PersistentCachingSolver::insert(const CanonicalQueryKey &key,
+                                     ResultKind kind,
+                                     const std::string &result) {
+  checkOwner();
+  const std::string &str = key.str();
+  sqlite3_bind_int64(insertStmt, 1, static_cast<sqlite3_int64>(key.hash()));
+  sqlite3_bind_int(insertStmt, 2, kind);
+  sqlite3_bind_blob(insertStmt, 3, str.data(), str.size(), SQLITE_STATIC);
+  sqlite3_bind_blob(insertStmt, 4, result.data(), result.size(),
+                    SQLITE_STATIC);
+  if (sqlite3_step(insertStmt) != SQLITE_DONE)
+    klee_warning("Can't insert into query cache: %s", sqlite3_errmsg(db));
+  sqlite3_reset(insertStmt);
+}
+
+bool PersistentCachingSolver::computeTruth(const Query &query,
+                                           bool &isValid) {
+  CanonicalQueryKey key(query);
+  std::string result;
+  if (lookup(key, Truth, result) && result.size() == 1) {
+    isValid = result[0];
+    return true;
+  }
+
+  if (!solver->impl->computeTruth(query, isValid))
+    return false;
+  insert(key, Truth, std::string(1, isValid));
+  return true;
+}
+
+bool PersistentCachingSolver::computeValue(const Query &query,
+                                           ref<Expr> &result) {
+  CanonicalQueryKey key(query);
+  std::string cached;
+  // The width comes from the query, only the value bits are stored.
+  Expr::Width width = query.expr->getWidth();
+  unsigned numWords = llvm::APInt::getNumWords(width);
+  if (lookup(key, Value, cached) && cached.size() == numWords * 8) {
+    std::vector<uint64_t> words(numWords);
+    std::memcpy(words.data(), cached.data(), cached.size());
+    result = ConstantExpr::alloc(llvm::APInt(width, words));
+    return true;
+  }
+
+  if (!solver->impl->computeValue(query, result))
+    return false;
+  if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(result)) {
+    const llvm::APInt &value = ce->getAPValue();
+    insert(key, Value,
+           std::string(reinterpret_cast<const char *>(value.getRawData()),
+                       value.getNumWords() * 8));
+  }
+  return true;
+}
+
+bool PersistentCachingSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
+  CanonicalQueryKey key(query, &objects);
+
+  // The result is a flag for whether there is a solution, followed by the
+  // values of all objects in order.
+  size_t expectedSize = 1;
+  for (const auto object : objects)
+    expectedSize += object->size;
+
+  std::string cached;
+  if (lookup(key, InitialValues, cached) &&
+      (cached.size() == expectedSize || cached == std::string(1, 0))) {
+    hasSolution = cached[0];
+    if (hasSolution) {
+      const unsigned char *pos =
+          reinterpret_cast<const unsigned char *>(cached.data()) + 1;
+      values.reserve(objects.size());
+      for (const auto object : objects) {
+        values.emplace_back(pos, pos + object->size);
+        pos += object->size;
+      }
+    }
+    return true;
+  }
+
+  if (!solver->impl->computeInitialValues(query, objects, values, hasSolution))
+    return false;
+
+  std::string result(1, hasSolution);
+  if (hasSolution) {
+    for (const auto &value : values)
+      result.append(value.begin(), value.end());
+  }
+  insert(key, InitialValues, result);
+  return true;
+}
+
+} // namespace
+
+Solver *klee::createPersistentCachingSolver(Solver *s,
+                                            const std::string &path) {
+  return new Solver(new PersistentCachingSolver(s, path));
+}
@@ -0,0 +1,317 @@
+//===-- PortfolioSolver.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A core solver which races several backends against each other. Every query
+// is handed to each backend in its own forked process, the first successful
+// answer is copied back through shared memory and the remaining processes are
+// killed.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/Assignment.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/ExprUtil.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverImpl.h"
+#include "klee/Solver/SolverStats.h"
+#include "klee/Statistics/TimerStatIncrementer.h"
+#include "klee/Support/ErrorHandling.h"
+
+#include "llvm/Support/Errno.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+
+// See STPSolver.cpp for why Darwin gets a smaller region.
+#ifdef __APPLE__
+const unsigned slotSize = 1 << 16;
+#else
+const unsigned slotSize = 1 << 20;
+#endif
+
+/// The header of each backend's slot in the shared memory region, followed by
+/// the counterexample bytes.
+struct SlotHeader {
+  bool success;
+  bool hasSolution;
+};
+
+class PortfolioSolverImpl : public SolverImpl {
+private:
+  std::vector<std::pair<std::string, Solver *>> solvers;
+  std::vector<uint64_t> wins;
+  unsigned char *sharedMemory;
+  /// The process which allocated the shared memory region, processes forked
+  /// from it need their own.
+  pid_t sharedMemoryOwner;
+  time::Span timeout;
+  SolverRunStatus runStatusCode;
+
+  void allocateSharedMemory();
+
+  unsigned char *getSlot(unsigned index) {
+    return sharedMemory + index * (sizeof(SlotHeader) + slotSize);
+  }
+
+  void runInChild(unsigned index, int notifyFd, const Query &query,
+                  const std::vector<const Array *> &objects);
+
+public:
+  explicit PortfolioSolverImpl(
+      std::vector<std::pair<std::string, Solver *>> solvers);
+  ~PortfolioSolverImpl() override;
+
+  char *getConstraintLog(const Query &) override;
+  void setCoreSolverTimeout(time::Span timeout) override;
+
+  bool computeTruth(const Query &, bool &isValid) override;
+  bool computeValue(const Query &, ref<Expr> &result) override;
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char>> &values,
+                            bool &hasSolution) override;
+  SolverRunStatus getOperationStatusCode() override { return runStatusCode; }
+};
+
+PortfolioSolverImpl::PortfolioSolverImpl(
+    std::vector<std::pair<std::string, Solver *>> _solvers)
+    : solvers(std::move(_solvers)), wins(solvers.size(), 0),
+      runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
+  assert(!solvers.empty() && "portfolio needs at least one solver");
+  allocateSharedMemory();
+}
+
+void PortfolioSolverImpl::allocateSharedMemory() {
+  int id = shmget(IPC_PRIVATE, solvers.size() * (sizeof(SlotHeader) + slotSize),
+                  IPC_CREAT | 0700);
+  if (id < 0)
+    llvm::report_fatal_error("unable to allocate shared memory region");
+  sharedMemory = (unsigned char *)shmat(id, nullptr, 0);
+  if (sharedMemory == (void *)-1)
+    llvm::report_fatal_error("unable to attach shared memory region");
+  shmctl(id, IPC_RMID, nullptr);
+  sharedMemoryOwner = getpid();
+}
+
+PortfolioSolverImpl::~PortfolioSolverImpl() {
+  for (unsigned i = 0; i < solvers.size(); ++i) {
+    if (wins[i])
+      klee_message("Portfolio solver: %s answered %llu queries first",
+                   solvers[i].first.c_str(), (unsigned long long)wins[i]);
+    delete solvers[i].second;
+  }
+  shmdt(sharedMemory);
+}
+
+char *PortfolioSolverImpl::getConstraintLog(const Query &query) {
+  return solvers.front().second->getConstraintLog(query);
+}
+
+void PortfolioSolverImpl::setCoreSolverTimeout(time::Span _timeout) {
+  timeout = _timeout;
+  for (auto &solver : solvers)
+    solver.second->setCoreSolverTimeout(timeout);
+}
+
+bool PortfolioSolverImpl::computeTruth(const Query &query, bool &isValid) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char>> values;
+  bool hasSolution;
+
+  if (!computeInitialValues(query, objects, values, hasSolution))
+    return false;
+
+  isValid = !hasSolution;
+  return true;
+}
+
+bool PortfolioSolverImpl::computeValue(const Query &query,
+                                       ref<Expr> &result) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char>> values;
+  bool hasSolution;
+
+  // Find the object used in the expression, and compute an assignment
+  // for them.
+  findSymbolicObjects(query.expr, objects);
+  if (!computeInitialValues(query.withFalse(), objects, values, hasSolution))
+    return false;
+  assert(hasSolution && "state has invalid constraint set");
+
+  // Evaluate the expression with the computed assignment.
+  Assignment a(objects, values);
+  result = a.evaluate(query.expr);
+
+  return true;
+}
+
+void PortfolioSolverImpl::runInChild(unsigned index, int notifyFd,
+                                     const Query &query,
+                                     const std::vector<const Array *> &objects) {
+  std::vector<std::vector<unsigned char>> values;
+  bool hasSolution = false;
+  bool success = solvers[index].second->impl->computeInitialValues(
+      query, objects, values, hasSolution);
+
+  unsigned char *slot = getSlot(index);
+  SlotHeader header = {success, hasSolution};
+  unsigned char *pos = slot + sizeof(SlotHeader);
+  if (success && hasSolution) {
+    for (const auto &value : values) {
+      std::memcpy(pos, value.data(), value.size());
+      pos += value.size();
+    }
+  }
+  std::memcpy(slot, &header, sizeof(header));
+
+  // The parent only reads the slot after receiving the index.
+  ssize_t res;
+  do {
+    res = write(notifyFd, &index, sizeof(index));
+  } while (res < 0 && errno == EINTR);
+  _exit(0);
+}
+
+bool PortfolioSolverImpl::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char>> &values, bool &hasSolution) {
+  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+  TimerStatIncrementer t(stats::queryTime);
+
+  if (sharedMemoryOwner != getpid()) {
+    shmdt(sharedMemory);
+    allocateSharedMemory();
+  }
+
+  unsigned sum = 0;
+  for (const auto object : objects)
+    sum += object->size;
+  if (sum >= slotSize)
+    llvm::report_fatal_error("not enough shared memory for counterexample");
+
+  ++stats::queries;
+  ++stats::queryCounterexamples;
+
+  int fds[2];
+  if (pipe(fds) < 0) {
+    klee_warning("pipe failed (for portfolio solver) - %s",
+                 llvm::sys::StrError(errno).c_str());
+    return false;
+  }
+
+  fflush(stdout);
+  fflush(stderr);
+
+  std::vector<pid_t> pids;
+  for (unsigned i = 0; i < solvers.size(); ++i) {
+    pid_t pid = fork();
+    if (pid == -1) {
+      klee_warning("fork failed (for portfolio solver) - %s",
+                   llvm::sys::StrError(errno).c_str());
+      runStatusCode = SOLVER_RUN_STATUS_FORK_FAILED;
+      break;
+    }
+    if (pid == 0) {
+      close(fds[0]);
+      runInChild(i, fds[1], query, objects);
+    }
+    pids.push_back(pid);
+  }
+  close(fds[1]);
+
+  // Wait for the first backend which succeeds. Backends which fail or crash
+  // drop out of the race, once all of them are gone the pipe reads EOF.
+  int winner = -1;
+  unsigned pending = pids.size();
+  auto deadline = timeout ? time::getWallTime() + timeout : time::Point();
+  while (pending && winner < 0) {
+    int waitMs = -1;
+    if (timeout) {
+      time::Point now = time::getWallTime();
+      if (deadline <= now) {
+        runStatusCode = SOLVER_RUN_STATUS_TIMEOUT;
+        break;
+      }
+      waitMs = std::max<int>(1, (deadline - now).toMicroseconds() / 1000);
+    }
+
+    struct pollfd pfd = {fds[0], POLLIN, 0};
+    int ready = poll(&pfd, 1, waitMs);
+    if (ready < 0 && errno == EINTR)
+      continue;
+    if (ready == 0)
+      continue;
+
+    unsigned index;
+    ssize_t res = ready < 0 ? -1 : read(fds[0], &index, sizeof(index));
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res != sizeof(index))
+      break;
+    --pending;
+
+    SlotHeader header;
+    std::memcpy(&header, getSlot(index), sizeof(header));
+    if (header.success)
+      winner = index;
+  }
+  close(fds[0]);
+
+  for (pid_t pid : pids) {
+    kill(pid, SIGKILL);
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+      ;
+  }
+
+  if (winner < 0) {
+    if (runStatusCode == SOLVER_RUN_STATUS_TIMEOUT)
+      klee_warning("Portfolio solver timed out");
+    return false;
+  }
+
+  ++wins[winner];
+  unsigned char *slot = getSlot(winner);
+  SlotHeader header;
+  std::memcpy(&header, slot, sizeof(header));
+  hasSolution = header.hasSolution;
+  if (hasSolution) {
+    unsigned char *pos = slot + sizeof(SlotHeader);
+    values.reserve(objects.size());
+    for (const auto object : objects) {
+      values.emplace_back(pos, pos + object->size);
+      pos += object->size;
+    }
+    ++stats::queriesInvalid;
+    runStatusCode = SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+  } else {
+    ++stats::queriesValid;
+    runStatusCode = SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+  }
+  return true;
+}
+
+} // namespace
+
+Solver *klee::createPortfolioSolver(
+    std::vector<std::pair<std::string, Solver *>> solvers) {
+  return new Solver(new PortfolioSolverImpl(std::move(solvers)));
+}
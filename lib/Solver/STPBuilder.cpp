@@ -12,6 +12,7 @@
 
 #include "klee/ADT/Bits.h"
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/FPBitvectorLowering.h"
 #include "klee/Solver/Solver.h"
 #include "klee/Solver/SolverStats.h"
 
@@ -518,6 +519,11 @@ ExprHandle STPBuilder::constructActual(ref<Expr> e, int *width_out) {
 
   ++stats::queryConstructs;
 
+  // STP has no floating point theory, so floating point operations are
+  // lowered to bitvector operations on the IEEE-754 bit patterns.
+  if (isLowerableFloatingPoint(e))
+    return construct(lowerFloatingPoint(e), width_out);
+
   switch (e->getKind()) {
   case Expr::Constant: {
     ConstantExpr *CE = cast<ConstantExpr>(e);
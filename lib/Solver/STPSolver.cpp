@@ -46,6 +46,9 @@ llvm::cl::opt<bool> IgnoreSolverFailures(
 
 static unsigned char *shared_memory_ptr = nullptr;
 static int shared_memory_id = 0;
+// The process which allocated the region. Processes forked from it for
+// -distributed-workers need a region of their own.
+static pid_t shared_memory_owner = 0;
 // Darwin by default has a very small limit on the maximum amount of shared
 // memory, which will quickly be exhausted by KLEE running its tests in
 // parallel. For now, we work around this by just requesting a smaller size --
@@ -57,6 +60,17 @@ static const unsigned shared_memory_size = 1 << 16;
 static const unsigned shared_memory_size = 1 << 20;
 #endif
 
+static void allocateSharedMemory() {
+  shared_memory_id = shmget(IPC_PRIVATE, shared_memory_size, IPC_CREAT | 0700);
+  if (shared_memory_id < 0)
+    llvm::report_fatal_error("unable to allocate shared memory region");
+  shared_memory_ptr = (unsigned char *)shmat(shared_memory_id, nullptr, 0);
+  if (shared_memory_ptr == (void *)-1)
+    llvm::report_fatal_error("unable to attach shared memory region");
+  shmctl(shared_memory_id, IPC_RMID, nullptr);
+  shared_memory_owner = getpid();
+}
+
 static void stp_error_handler(const char *err_msg) {
   fprintf(stderr, "error: STP Error: %s\n", err_msg);
   abort();
@@ -109,14 +123,7 @@ STPSolverImpl::STPSolverImpl(bool useForkedSTP, bool optimizeDivides)
 
   if (useForkedSTP) {
     assert(shared_memory_id == 0 && "shared memory id already allocated");
-    shared_memory_id =
-        shmget(IPC_PRIVATE, shared_memory_size, IPC_CREAT | 0700);
-    if (shared_memory_id < 0)
-      llvm::report_fatal_error("unable to allocate shared memory region");
-    shared_memory_ptr = (unsigned char *)shmat(shared_memory_id, nullptr, 0);
-    if (shared_memory_ptr == (void *)-1)
-      llvm::report_fatal_error("unable to attach shared memory region");
-    shmctl(shared_memory_id, IPC_RMID, nullptr);
+    allocateSharedMemory();
   }
 }
 
@@ -214,6 +221,11 @@ runAndGetCexForked(::VC vc, STPBuilder *builder, ::VCExpr q,
                    const std::vector<const Array *> &objects,
                    std::vector<std::vector<unsigned char>> &values,
                    bool &hasSolution, time::Span timeout) {
+  if (shared_memory_owner != getpid()) {
+    shmdt(shared_memory_ptr);
+    allocateSharedMemory();
+  }
+
   unsigned char *pos = shared_memory_ptr;
   unsigned sum = 0;
   for (const auto object : objects)
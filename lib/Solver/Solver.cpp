@@ -12,6 +12,8 @@
 #include "klee/Expr/Constraints.h"
 #include "klee/Solver/SolverImpl.h"
 
+#include "llvm/ADT/Hashing.h"
+
 using namespace klee;
 
 const char *Solver::validity_to_str(Validity v) {
@@ -221,6 +223,10 @@ std::pair< ref<Expr>, ref<Expr> > Solver::getRange(const Query& query) {
                         ConstantExpr::create(max, width));
 }
 
+std::size_t Query::hash() const {
+  return llvm::hash_combine(constraints.hash(), expr->hash());
+}
+
 void Query::dump() const {
   llvm::errs() << "Constraints [\n";
   for (const auto &constraint : constraints)
@@ -35,9 +35,6 @@ cl::extrahelp TimeFormatInfo(
     "'1h10min' (= '70min'), '5min10s' but not '3.5min', '8S'\n"
     "       The following units are supported: h, min, s, ms, us, ns.\n");
 
-cl::OptionCategory SolvingCat("Constraint solving options",
-                              "These options impact constraint solving.");
-
 cl::opt<bool> UseFastCexSolver(
     "use-fast-cex-solver", cl::init(false),
     cl::desc("Enable an experimental range-based solver (default=false)"),
@@ -47,10 +44,30 @@ cl::opt<bool> UseCexCache("use-cex-cache", cl::init(true),
                           cl::desc("Use the counterexample cache (default=true)"),
                           cl::cat(SolvingCat));
 
+cl::opt<bool> UsePersistentQueryCache(
+    "use-persistent-query-cache", cl::init(false),
+    cl::desc("Cache solver results in a database which is reused across runs "
+             "(default=false)"),
+    cl::cat(SolvingCat));
+
+cl::opt<std::string> PersistentQueryCachePath(
+    "persistent-query-cache-path",
+    cl::desc("Database for -use-persistent-query-cache, share it between runs "
+             "to reuse results (default=query-cache.sqlite in the output "
+             "directory)"),
+    cl::cat(SolvingCat));
+
 cl::opt<bool> UseBranchCache("use-branch-cache", cl::init(true),
                              cl::desc("Use the branch cache (default=true)"),
                              cl::cat(SolvingCat));
 
+cl::opt<bool> CanonicalizeCachedArrays(
+    "canonicalize-cached-arrays", cl::init(false),
+    cl::desc("Rename arrays in order of first occurrence before looking up "
+             "queries in the branch and counterexample caches, so that hits "
+             "do not depend on array names (default=false)"),
+    cl::cat(SolvingCat));
+
 cl::opt<bool>
     UseIndependentSolver("use-independent-solver", cl::init(true),
                          cl::desc("Use constraint independence (default=true)"),
@@ -195,10 +212,26 @@ cl::opt<CoreSolverType> CoreSolverToUse(
                clEnumValN(METASMT_SOLVER, "metasmt",
                           "metaSMT" METASMT_IS_DEFAULT_STR),
                clEnumValN(DUMMY_SOLVER, "dummy", "Dummy solver"),
-               clEnumValN(Z3_SOLVER, "z3", "Z3" Z3_IS_DEFAULT_STR)
+               clEnumValN(Z3_SOLVER, "z3", "Z3" Z3_IS_DEFAULT_STR),
+               clEnumValN(Z3_BITBLAST_SOLVER, "z3-bitblast",
+                          "Z3 with floating point lowered to bitvectors"),
+               clEnumValN(PORTFOLIO_SOLVER, "portfolio",
+                          "Race the solvers given by --portfolio-solvers")
                    KLEE_LLVM_CL_VAL_END),
     cl::init(DEFAULT_CORE_SOLVER), cl::cat(SolvingCat));
 
+cl::list<CoreSolverType> PortfolioSolvers(
+    "portfolio-solvers", cl::CommaSeparated,
+    cl::desc("Comma-separated list of solvers raced by the portfolio solver "
+             "(default=all available)"),
+    cl::values(clEnumValN(STP_SOLVER, "stp", "STP"),
+               clEnumValN(METASMT_SOLVER, "metasmt", "metaSMT"),
+               clEnumValN(Z3_SOLVER, "z3", "Z3"),
+               clEnumValN(Z3_BITBLAST_SOLVER, "z3-bitblast",
+                          "Z3 with floating point lowered to bitvectors")
+                   KLEE_LLVM_CL_VAL_END),
+    cl::cat(SolvingCat));
+
 cl::opt<CoreSolverType> DebugCrossCheckCoreSolverWith(
     "debug-crosscheck-core-solver",
     cl::desc(
@@ -207,6 +240,8 @@ cl::opt<CoreSolverType> DebugCrossCheckCoreSolverWith(
                clEnumValN(METASMT_SOLVER, "metasmt", "metaSMT"),
                clEnumValN(DUMMY_SOLVER, "dummy", "Dummy solver"),
                clEnumValN(Z3_SOLVER, "z3", "Z3"),
+               clEnumValN(Z3_BITBLAST_SOLVER, "z3-bitblast",
+                          "Z3 with floating point lowered to bitvectors"),
                clEnumValN(NO_SOLVER, "none", "Do not crosscheck (default)")
                    KLEE_LLVM_CL_VAL_END),
     cl::init(NO_SOLVER), cl::cat(SolvingCat));
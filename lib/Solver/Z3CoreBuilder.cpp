@@ -15,6 +15,7 @@
 #include "Z3CoreBuilder.h"
 #include "klee/ADT/Bits.h"
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/FPBitvectorLowering.h"
 #include "klee/Solver/SolverStats.h"
 
 #include "llvm/Support/CommandLine.h"
@@ -205,6 +206,11 @@ Z3ASTHandle Z3CoreBuilder::constructActual(ref<Expr> e, int *width_out) {
 
   ++stats::queryConstructs;
 
+  // Floating point operations are lowered to bitvector operations, unlike
+  // Z3BitvectorBuilder which uses Z3's floating point theory.
+  if (isLowerableFloatingPoint(e))
+    return construct(lowerFloatingPoint(e), width_out);
+
   switch (e->getKind()) {
   case Expr::Constant: {
     ConstantExpr *CE = cast<ConstantExpr>(e);
@@ -573,6 +579,7 @@ Z3ASTHandle Z3CoreBuilder::constructActual(ref<Expr> e, int *width_out) {
         case Expr::Sgt:
         case Expr::Sge:
 #endif
+
   default:
     assert(0 && "unhandled Expr type");
     return getTrue();
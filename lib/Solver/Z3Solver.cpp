@@ -30,6 +30,8 @@
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/ErrorHandling.h"
 
+#include <unordered_set>
+
 namespace {
 // NOTE: Very useful for debugging Z3 behaviour. These files can be given to
 // the z3 binary to replay all Z3 API calls using its `-log` option.
@@ -52,9 +54,54 @@ llvm::cl::opt<unsigned>
     Z3VerbosityLevel("debug-z3-verbosity", llvm::cl::init(0),
                      llvm::cl::desc("Z3 verbosity level (default=0)"),
                      llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<bool> Z3Incremental(
+    "z3-incremental", llvm::cl::init(false),
+    llvm::cl::desc("Keep Z3 solvers alive across queries and only assert the "
+                   "constraints not shared with a previously asserted "
+                   "constraint prefix, using push/pop (default=false)"),
+    llvm::cl::cat(klee::SolvingCat));
+
+llvm::cl::opt<unsigned> Z3IncrementalSolvers(
+    "z3-incremental-solvers", llvm::cl::init(4),
+    llvm::cl::desc("Maximum number of Z3 solvers, each holding a different "
+                   "constraint prefix, kept alive by --z3-incremental "
+                   "(default=4)"),
+    llvm::cl::cat(klee::SolvingCat));
 }
 
 namespace klee {
+
+/// A Z3 solver kept alive across queries in incremental mode. Its assertion
+/// stack mirrors a prefix of the constraint set of the last query it solved:
+/// scope \p i holds constraint \p i together with the constant array
+/// assertions and side constraints that were needed to translate it.
+struct Z3IncrementalSolver {
+  struct Frame {
+    ref<Expr> constraint;
+    /// Constant arrays whose assertions were first added in this scope.
+    std::vector<const Array *> constantArrays;
+  };
+
+  ::Z3_solver solver;
+  std::vector<Frame> frames;
+  std::unordered_set<const Array *> assertedConstantArrays;
+  /// Logical timestamp of the last use, for LRU eviction.
+  uint64_t lastUse;
+
+  Z3IncrementalSolver(::Z3_solver solver) : solver(solver), lastUse(0) {}
+
+  /// Number of leading constraints of \p constraints already asserted.
+  size_t commonPrefix(const ConstraintSet &constraints) const {
+    size_t n = 0;
+    for (auto it = constraints.begin(), ie = constraints.end();
+         it != ie && n < frames.size() && frames[n].constraint == *it;
+         ++it, ++n)
+      ;
+    return n;
+  }
+};
+
 class Z3SolverImpl : public SolverImpl {
 private:
   Z3Builder *builder;
@@ -65,6 +112,16 @@ private:
   ::Z3_params solverParameters;
   // Parameter symbols
   ::Z3_symbol timeoutParamStrSymbol;
+  // Solvers kept alive by `--z3-incremental`
+  std::vector<std::unique_ptr<Z3IncrementalSolver>> incrementalSolvers;
+  uint64_t incrementalUseCounter;
+
+  Z3IncrementalSolver &getIncrementalSolver(const ConstraintSet &constraints);
+  void assertConstantArrays(::Z3_solver theSolver,
+                            ConstantArrayFinder &constantArrays,
+                            std::vector<const Array *> *newArrays,
+                            std::unordered_set<const Array *> *asserted);
+  void assertSideConstraints(::Z3_solver theSolver);
 
   bool internalRunSolver(const Query &,
                          const std::vector<const Array *> *objects,
@@ -102,7 +159,8 @@ public:
 };
 
 Z3SolverImpl::Z3SolverImpl(Z3BuilderType type)
-    : builderType(type), runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
+    : builderType(type), runStatusCode(SOLVER_RUN_STATUS_FAILURE),
+      incrementalUseCounter(0) {
   switch (type) {
       case KLEE_CORE:
           builder = new Z3CoreBuilder(
@@ -156,6 +214,9 @@ Z3SolverImpl::Z3SolverImpl(Z3BuilderType type)
 }
 
 Z3SolverImpl::~Z3SolverImpl() {
+  for (auto &incremental : incrementalSolvers)
+    Z3_solver_dec_ref(builder->ctx, incremental->solver);
+  incrementalSolvers.clear();
   Z3_params_dec_ref(builder->ctx, solverParameters);
   delete builder;
 }
@@ -279,37 +340,59 @@ bool Z3SolverImpl::computeInitialValues(
   return internalRunSolver(query, &objects, &values, hasSolution);
 }
 
-bool Z3SolverImpl::internalRunSolver(
-    const Query &query, const std::vector<const Array *> *objects,
-    std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
-
-  TimerStatIncrementer t(stats::queryTime);
-  // NOTE: Z3 will switch to using a slower solver internally if push/pop are
-  // used so for now it is likely that creating a new solver each time is the
-  // right way to go until Z3 changes its behaviour.
-  //
-  // TODO: Investigate using a custom tactic as described in
-  // https://github.com/klee/klee/issues/653
-  Z3_solver theSolver = Z3_mk_solver(builder->ctx);
-  Z3_solver_inc_ref(builder->ctx, theSolver);
-  Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
+Z3IncrementalSolver &
+Z3SolverImpl::getIncrementalSolver(const ConstraintSet &constraints) {
+  // Pick the solver sharing the longest constraint prefix with the query.
+  Z3IncrementalSolver *best = nullptr;
+  size_t bestPrefix = 0;
+  for (auto &incremental : incrementalSolvers) {
+    size_t prefix = incremental->commonPrefix(constraints);
+    if (!best || prefix > bestPrefix ||
+        (prefix == bestPrefix && incremental->lastUse > best->lastUse)) {
+      best = incremental.get();
+      bestPrefix = prefix;
+    }
+  }
 
-  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+  // Nothing to share: rather than clobbering another solver's prefix, start a
+  // fresh solver if there is room, otherwise recycle the least recently used.
+  if (bestPrefix == 0) {
+    if (incrementalSolvers.size() <
+        std::max(1u, (unsigned)Z3IncrementalSolvers)) {
+      Z3_solver theSolver = Z3_mk_solver(builder->ctx);
+      Z3_solver_inc_ref(builder->ctx, theSolver);
+      incrementalSolvers.emplace_back(new Z3IncrementalSolver(theSolver));
+      best = incrementalSolvers.back().get();
+    } else {
+      for (auto &incremental : incrementalSolvers)
+        if (incremental->lastUse < best->lastUse)
+          best = incremental.get();
+    }
+  }
 
-  ConstantArrayFinder constant_arrays_in_query;
-  for (auto const &constraint : query.constraints) {
-    Z3_solver_assert(builder->ctx, theSolver, builder->construct(constraint));
-    constant_arrays_in_query.visit(constraint);
+  // Discard the scopes of constraints not shared with this query.
+  if (unsigned pops = best->frames.size() - bestPrefix) {
+    Z3_solver_pop(builder->ctx, best->solver, pops);
+    for (auto it = best->frames.begin() + bestPrefix, ie = best->frames.end();
+         it != ie; ++it)
+      for (const Array *array : it->constantArrays)
+        best->assertedConstantArrays.erase(array);
+    best->frames.erase(best->frames.begin() + bestPrefix, best->frames.end());
   }
-  ++stats::queries;
-  if (objects)
-    ++stats::queryCounterexamples;
 
-  Z3ASTHandle z3QueryExpr =
-      Z3ASTHandle(builder->construct(query.expr), builder->ctx);
-  constant_arrays_in_query.visit(query.expr);
+  best->lastUse = ++incrementalUseCounter;
+  return *best;
+}
 
-  for (auto const &constant_array : constant_arrays_in_query.results) {
+void Z3SolverImpl::assertConstantArrays(
+    ::Z3_solver theSolver, ConstantArrayFinder &constantArrays,
+    std::vector<const Array *> *newArrays,
+    std::unordered_set<const Array *> *asserted) {
+  for (auto const &constant_array : constantArrays.results) {
+    if (asserted && !asserted->insert(constant_array).second)
+      continue;
+    if (newArrays)
+      newArrays->push_back(constant_array);
     assert(builder->constant_array_assertions.count(constant_array) == 1 &&
            "Constant array found in query, but not handled by Z3Builder");
     for (auto const &arrayIndexValueExpr :
@@ -317,26 +400,108 @@ bool Z3SolverImpl::internalRunSolver(
       Z3_solver_assert(builder->ctx, theSolver, arrayIndexValueExpr);
     }
   }
+}
 
-  // KLEE Queries are validity queries i.e.
-  // ∀ X Constraints(X) → query(X)
-  // but Z3 works in terms of satisfiability so instead we ask the
-  // negation of the equivalent i.e.
-  // ∃ X Constraints(X) ∧ ¬ query(X)
-  Z3_solver_assert(
-      builder->ctx, theSolver,
-      Z3ASTHandle(Z3_mk_not(builder->ctx, z3QueryExpr), builder->ctx));
-
-  // Assert an generated side constraints we have to this last so that all other
-  // constraints have been traversed so we have all the side constraints needed.
+void Z3SolverImpl::assertSideConstraints(::Z3_solver theSolver) {
   for (std::vector<Z3ASTHandle>::iterator it = builder->sideConstraints.begin(),
                ie = builder->sideConstraints.end(); it != ie; ++it) {
     Z3ASTHandle sideConstraint = *it;
     Z3_solver_assert(builder->ctx, theSolver, sideConstraint);
   }
+  builder->clearSideConstraints();
+}
 
+bool Z3SolverImpl::internalRunSolver(
+    const Query &query, const std::vector<const Array *> *objects,
+    std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
+
+  TimerStatIncrementer t(stats::queryTime);
+  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+
+  Z3_solver theSolver;
+  if (Z3Incremental) {
+    // NOTE: Z3 switches to a slower solver internally once push/pop are used,
+    // so this only pays off when queries share long constraint prefixes.
+    Z3IncrementalSolver &incremental = getIncrementalSolver(query.constraints);
+    theSolver = incremental.solver;
+    Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
+
+    // Each constraint past the shared prefix gets its own scope so that it
+    // can be retracted independently by a later query.
+    for (auto it = query.constraints.begin() + incremental.frames.size(),
+              ie = query.constraints.end();
+         it != ie; ++it) {
+      Z3_solver_push(builder->ctx, theSolver);
+      Z3IncrementalSolver::Frame frame;
+      frame.constraint = *it;
+      Z3_solver_assert(builder->ctx, theSolver, builder->construct(*it));
+      ConstantArrayFinder constant_arrays_in_constraint;
+      constant_arrays_in_constraint.visit(*it);
+      assertConstantArrays(theSolver, constant_arrays_in_constraint,
+                           &frame.constantArrays,
+                           &incremental.assertedConstantArrays);
+      assertSideConstraints(theSolver);
+      incremental.frames.push_back(std::move(frame));
+    }
+
+    // The query expression lives in a scope of its own that is popped once
+    // the query has been answered.
+    Z3_solver_push(builder->ctx, theSolver);
+    Z3ASTHandle z3QueryExpr =
+        Z3ASTHandle(builder->construct(query.expr), builder->ctx);
+    Z3_solver_assert(
+        builder->ctx, theSolver,
+        Z3ASTHandle(Z3_mk_not(builder->ctx, z3QueryExpr), builder->ctx));
+    ConstantArrayFinder constant_arrays_in_expr;
+    constant_arrays_in_expr.visit(query.expr);
+    std::unordered_set<const Array *> asserted(
+        incremental.assertedConstantArrays);
+    assertConstantArrays(theSolver, constant_arrays_in_expr,
+                         /*newArrays=*/nullptr, &asserted);
+    assertSideConstraints(theSolver);
+  } else {
+    // NOTE: Z3 will switch to using a slower solver internally if push/pop are
+    // used so for now it is likely that creating a new solver each time is the
+    // right way to go until Z3 changes its behaviour.
+    //
+    // TODO: Investigate using a custom tactic as described in
+    // https://github.com/klee/klee/issues/653
+    theSolver = Z3_mk_solver(builder->ctx);
+    Z3_solver_inc_ref(builder->ctx, theSolver);
+    Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
+
+    ConstantArrayFinder constant_arrays_in_query;
+    for (auto const &constraint : query.constraints) {
+      Z3_solver_assert(builder->ctx, theSolver, builder->construct(constraint));
+      constant_arrays_in_query.visit(constraint);
+    }
+
+    Z3ASTHandle z3QueryExpr =
+        Z3ASTHandle(builder->construct(query.expr), builder->ctx);
+    constant_arrays_in_query.visit(query.expr);
+
+    assertConstantArrays(theSolver, constant_arrays_in_query,
+                         /*newArrays=*/nullptr, /*asserted=*/nullptr);
+
+    // KLEE Queries are validity queries i.e.
+    // ∀ X Constraints(X) → query(X)
+    // but Z3 works in terms of satisfiability so instead we ask the
+    // negation of the equivalent i.e.
+    // ∃ X Constraints(X) ∧ ¬ query(X)
+    Z3_solver_assert(
+        builder->ctx, theSolver,
+        Z3ASTHandle(Z3_mk_not(builder->ctx, z3QueryExpr), builder->ctx));
+
+    // Assert an generated side constraints we have to this last so that all
+    // other constraints have been traversed so we have all the side
+    // constraints needed.
+    assertSideConstraints(theSolver);
+  }
+  ++stats::queries;
+  if (objects)
+    ++stats::queryCounterexamples;
 
-    if (dumpedQueriesFile) {
+  if (dumpedQueriesFile) {
     *dumpedQueriesFile << "; start Z3 query\n";
     *dumpedQueriesFile << Z3_solver_to_string(builder->ctx, theSolver);
     *dumpedQueriesFile << "(check-sat)\n";
@@ -349,7 +514,10 @@ bool Z3SolverImpl::internalRunSolver(
   runStatusCode = handleSolverResponse(theSolver, satisfiable, objects, values,
                                        hasSolution);
 
-  Z3_solver_dec_ref(builder->ctx, theSolver);
+  if (Z3Incremental)
+    Z3_solver_pop(builder->ctx, theSolver, 1);
+  else
+    Z3_solver_dec_ref(builder->ctx, theSolver);
   // Clear the builder's cache to prevent memory usage exploding.
   // By using ``autoClearConstructCache=false`` and clearning now
   // we allow Z3_ast expressions to be shared from an entire
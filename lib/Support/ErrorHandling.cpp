@@ -17,7 +17,9 @@
 #include <stdarg.h>
 #include <assert.h>
 #include <string.h>
+#include <pthread.h>
 
+#include <mutex>
 #include <set>
 
 using namespace klee;
@@ -31,6 +33,26 @@ static const char *warningOncePrefix = "WARNING ONCE";
 static const char *errorPrefix = "ERROR";
 static const char *notePrefix = "NOTE";
 
+// Messages are also printed by the test writer thread of klee, so lines of
+// different threads must not interleave.
+static std::mutex messageLock;
+
+// A process forked while another thread prints a message would inherit the
+// lock held forever, and would write buffered messages of its parent again
+// when it exits. Forking therefore waits for the message and flushes them.
+static void lockMessagesForFork() {
+  messageLock.lock();
+  if (klee::klee_message_file)
+    fflush(klee::klee_message_file);
+  if (klee::klee_warning_file)
+    fflush(klee::klee_warning_file);
+}
+
+static void unlockMessagesAfterFork() { messageLock.unlock(); }
+
+static const int messageLockAtFork = pthread_atfork(
+    lockMessagesForFork, unlockMessagesAfterFork, unlockMessagesAfterFork);
+
 namespace klee {
 cl::OptionCategory MiscCat("Miscellaneous options", "");
 }
@@ -117,6 +139,7 @@ static void klee_vfmessage(FILE *fp, const char *pfx, const char *msg,
 */
 static void klee_vmessage(const char *pfx, bool onlyToFile, const char *msg,
                           va_list ap) {
+  std::lock_guard<std::mutex> lock(messageLock);
   if (!onlyToFile) {
     va_list ap2;
     va_copy(ap2, ap);
@@ -170,8 +193,12 @@ void klee::klee_warning_once(const void *id, const char *msg, ...) {
   else
     key = std::make_pair(id, "calling external");
 
-  if (!keys.count(key)) {
-    keys.insert(key);
+  bool inserted;
+  {
+    std::lock_guard<std::mutex> lock(messageLock);
+    inserted = keys.insert(key).second;
+  }
+  if (inserted) {
     va_list ap;
     va_start(ap, msg);
     klee_vmessage(warningOncePrefix, WarningsOnlyToFile, msg, ap);
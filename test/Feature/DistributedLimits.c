@@ -0,0 +1,22 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --distributed-workers=2 --distributed-depth=2 --max-instructions=1000000 %t1.bc 2>&1 | FileCheck %s
+
+int main() {
+  unsigned char x;
+  klee_make_symbolic(&x, sizeof x, "x");
+
+  // 16 paths of about 100000 instructions each. Each worker explores half of
+  // them within -max-instructions, together they must stop early.
+  volatile unsigned sink = 0;
+  for (int i = 0; i < 4; ++i)
+    if (x & (1 << i))
+      sink = i;
+  for (unsigned i = 0; i < 10000; ++i)
+    sink = i;
+
+  return 0;
+}
+
+// CHECK: distributing 4 paths to 2 workers
+// CHECK: KLEE: done: partially completed paths = {{[1-9]}}
@@ -0,0 +1,29 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --distributed-workers=2 --distributed-depth=2 %t1.bc 2>&1 | FileCheck %s
+// RUN: test -d %t.klee-out/worker-2
+// RUN: find %t.klee-out -maxdepth 1 -name '*.ktest' | wc -l | grep -x 16
+// RUN: find %t.klee-out -maxdepth 1 -name '*.assert.err' | wc -l | grep -x 1
+// RUN: find %t.klee-out/worker-1 -name '*.ktest' | wc -l | grep -x 0
+// RUN: find %t.klee-out -name '*.path' -o -name 'paths.ts' | wc -l | grep -x 0
+
+#include <assert.h>
+
+int main() {
+  unsigned char x;
+  klee_make_symbolic(&x, sizeof x, "x");
+
+  // 16 paths, exactly one of which fails. The coordinator hands the 4
+  // prefixes of depth 2 to the workers.
+  unsigned count = 0;
+  for (int i = 0; i < 4; ++i)
+    if (x & (1 << i))
+      ++count;
+  if ((x & 0xF) == 0xF)
+    assert(count != 4);
+
+  return 0;
+}
+
+// CHECK: distributing 4 paths to 2 workers
+// CHECK: KLEE: done: generated tests = 16
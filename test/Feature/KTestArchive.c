@@ -0,0 +1,25 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.klee-out2
+// RUN: %klee --output-dir=%t.klee-out --write-ktest-archive --compress-ktest-archive %t1.bc
+// RUN: not ls %t.klee-out/*.ktest
+// RUN: %ktest-tool %t.klee-out/tests.ktests | grep -c "^ktest file" | grep -x 4
+// RUN: %klee --output-dir=%t.klee-out2 --replay-ktest-dir=%t.klee-out %t1.bc 2>&1 | FileCheck %s
+// RUN: rm -rf %t.klee-out2
+// RUN: %klee --output-dir=%t.klee-out2 --seed-dir=%t.klee-out --only-seed %t1.bc 2>&1 | FileCheck %s -check-prefix=CHECK-SEED
+
+// The tests of an archive can be listed, replayed and used as seeds.
+
+// CHECK: KLEE: replaying: {{.*}} (4/4)
+// CHECK-SEED: using 4 seeds
+
+int main() {
+  unsigned char x;
+  klee_make_symbolic(&x, sizeof x, "x");
+
+  int count = 0;
+  if (x & 1)
+    ++count;
+  if (x & 2)
+    ++count;
+  return count;
+}
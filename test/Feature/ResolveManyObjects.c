@@ -0,0 +1,32 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out %t1.bc 2>&1 | FileCheck %s
+
+// A symbolic pointer into one of many heap objects resolves to exactly the
+// objects it can point to, whether they are next to each other or not.
+
+#include <assert.h>
+#include <stdlib.h>
+
+#define N 100
+
+int main() {
+  char *objects[N];
+  for (int i = 0; i < N; ++i)
+    objects[i] = malloc(4);
+
+  unsigned i;
+  klee_make_symbolic(&i, sizeof i, "i");
+  klee_assume(i < N);
+  klee_assume(i % 25 == 3);
+
+  // 4 objects
+  char *p = objects[i];
+  *p = 1;
+  assert(objects[i][0] == 1);
+
+  for (int j = 0; j < N; ++j)
+    free(objects[j]);
+  return 0;
+}
+// CHECK: KLEE: done: completed paths = 4
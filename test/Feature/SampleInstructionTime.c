@@ -0,0 +1,15 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --sample-instruction-time=1ms %t1.bc
+// RUN: grep "^event: Itime : InstructionTimes" %t.klee-out/run.istats
+// RUN: rm -rf %t.klee-out
+// RUN: not %klee --output-dir=%t.klee-out --track-instruction-time --sample-instruction-time=1ms %t1.bc 2>&1 | FileCheck %s
+
+// CHECK: --track-instruction-time and --sample-instruction-time cannot be enabled at the same time
+
+int main() {
+  unsigned sum = 0;
+  for (unsigned i = 0; i < 100000; ++i)
+    sum += i * i;
+  return sum == 0;
+}
@@ -0,0 +1,41 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --switch-type=internal %t1.bc 2>&1 | FileCheck %s
+
+// Only the cases the constraints leave feasible are forked to, including
+// when some of them are infeasible and when the default case is not.
+
+#include <assert.h>
+#include <stdio.h>
+
+int main() {
+  unsigned char x;
+  klee_make_symbolic(&x, sizeof x, "x");
+  klee_assume(x >= 2 & x <= 5);
+
+  switch (x) {
+  case 0:
+  case 1:
+  case 6:
+    assert(0 && "infeasible case");
+    break;
+  case 2:
+  case 3:
+    printf("low\n");
+    break;
+  case 4:
+    printf("four\n");
+    break;
+  case 5:
+    printf("five\n");
+    break;
+  default:
+    assert(0 && "infeasible default");
+  }
+
+  // CHECK-DAG: low
+  // CHECK-DAG: four
+  // CHECK-DAG: five
+  // CHECK: KLEE: done: completed paths = 3
+  return 0;
+}
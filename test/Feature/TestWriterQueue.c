@@ -0,0 +1,29 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --test-writer-queue=1 --write-kqueries --write-paths %t1.bc
+// RUN: find %t.klee-out -name '*.ktest' | wc -l | grep -x 16
+// RUN: find %t.klee-out -name '*.kquery' | wc -l | grep -x 16
+// RUN: find %t.klee-out -name '*.path' | wc -l | grep -x 16
+// RUN: test -f %t.klee-out/test000016.ktest
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --test-writer-queue=0 %t1.bc
+// RUN: find %t.klee-out -name '*.ktest' | wc -l | grep -x 16
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --max-tests=3 %t1.bc 2>&1 | FileCheck %s
+
+// All test cases are written, whether in the background or not, before
+// KLEE reports them.
+
+// CHECK: KLEE: done: generated tests = 3
+
+int main() {
+  unsigned char x;
+  klee_make_symbolic(&x, sizeof x, "x");
+
+  unsigned count = 0;
+  for (int i = 0; i < 4; ++i)
+    if (x & (1 << i))
+      ++count;
+
+  return count;
+}
@@ -0,0 +1,34 @@
+// RUN: %clang %s -emit-llvm -O0 -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --libc=klee --fp-runtime --native-fp-models --output-dir=%t.klee-out --exit-on-error %t1.bc > %t-output.txt 2>&1
+// RUN: FileCheck -input-file=%t-output.txt %s
+// REQUIRES: fp-runtime
+#include "klee/klee.h"
+#include <assert.h>
+#include <math.h>
+
+int main() {
+  double a, b;
+  klee_make_symbolic(&a, sizeof(a), "a");
+  klee_make_symbolic(&b, sizeof(b), "b");
+
+  // Concrete arguments are evaluated on the host.
+  assert(exp(0.0) == 1.0);
+  assert(cos(0.0) == 1.0);
+  assert(pow(2.0, 10.0) == 1024.0);
+
+  // Symbolic results are constrained by the properties of each function.
+  if (a > 0.0)
+    assert(exp(a) >= 1.0);
+  if (a > 1.0)
+    assert(log(a) >= 0.0);
+  if (!isnan(a) && !isinf(a))
+    assert(sin(a) <= 1.0 && cos(a) >= -1.0);
+  assert(pow(a, 0.0) == 1.0);
+
+  // The same arguments give the same result.
+  assert(exp(b) == exp(b) || isnan(b));
+  return 0;
+}
+// CHECK-NOT: ASSERTION FAIL
+// CHECK: KLEE: done: completed paths
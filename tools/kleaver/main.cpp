@@ -215,7 +215,8 @@ static bool EvaluateInputAST(const char *Filename,
                                    getQueryLogPath(ALL_QUERIES_SMT2_FILE_NAME),
                                    getQueryLogPath(SOLVER_QUERIES_SMT2_FILE_NAME),
                                    getQueryLogPath(ALL_QUERIES_KQUERY_FILE_NAME),
-                                   getQueryLogPath(SOLVER_QUERIES_KQUERY_FILE_NAME));
+                                   getQueryLogPath(SOLVER_QUERIES_KQUERY_FILE_NAME),
+                                   getQueryLogPath(PERSISTENT_QUERY_CACHE_FILE_NAME));
 
   unsigned Index = 0;
   for (std::vector<Decl*>::iterator it = Decls.begin(),
@@ -266,9 +266,71 @@ void ensure_capsyschroot(const char *executable) {
 }
 #endif
 
+/* Replay the test in input, which was read from input_fname, on
+   executable. */
+static void replay_input(char *executable, char *program,
+                         const char *input_fname, int first) {
+  int prg_argc;
+  char ** prg_argv;
+  unsigned i;
+
+  if (!input) {
+    fprintf(stderr, "KLEE-REPLAY: ERROR: input file %s not valid.\n",
+            input_fname);
+    exit(1);
+  }
+
+  obj_index = 0;
+  prg_argc = input->numArgs;
+  prg_argv = input->args;
+  prg_argv[0] = program;
+  klee_init_env(&prg_argc, &prg_argv);
+  if (!first)
+    fputc('\n', stderr);
+  fprintf(stderr, "KLEE-REPLAY: NOTE: Test file: %s\n"
+                  "KLEE-REPLAY: NOTE: Arguments: ", input_fname);
+  for (i=0; i != (unsigned) prg_argc; ++i) {
+    char *s = prg_argv[i];
+    if (s[0]=='A' && s[1] && !s[2]) s[1] = '\0';
+    fprintf(stderr, "\"%s\" ", prg_argv[i]);
+  }
+  fputc('\n', stderr);
+
+  /* Create the input files, pipes, etc. */
+  replay_create_files(&__exe_fs);
+
+  /* Run the test case machinery in a subprocess, eventually this parent
+     process should be a script or something which shells out to the actual
+     execution tool. */
+  int pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    _exit(66);
+  } else if (pid == 0) {
+    /* Run the executable */
+    run_monitored(executable, prg_argc, prg_argv);
+    _exit(0);
+  } else {
+    /* Wait for the executable to finish. */
+    int res, status;
+
+    do {
+      res = waitpid(pid, &status, 0);
+    } while (res < 0 && errno == EINTR);
+
+    // Delete all files in the replay directory
+    replay_delete_files();
+
+    if (res < 0) {
+      perror("waitpid");
+      _exit(66);
+    }
+  }
+}
+
 static void usage(void) {
   fprintf(stderr,
-    "Usage: %s [option]... <executable> <ktest-file>...\n"
+    "Usage: %s [option]... <executable> <ktest-file|ktest-archive>...\n"
     "   or: %s --create-files-only <ktest-file>\n"
     "\n"
     "-r, --chroot-to-dir=DIR  use chroot jail, requires CAP_SYS_CHROOT\n"
@@ -354,61 +416,28 @@ int main(int argc, char** argv) {
   int idx = 0;
   for (idx = optind + 1; idx != argc; ++idx) {
     char* input_fname = argv[idx];
-    unsigned i;
 
-    input = kTest_fromFile(input_fname);
-    if (!input) {
-      fprintf(stderr, "KLEE-REPLAY: ERROR: input file %s not valid.\n",
-              input_fname);
-      exit(1);
-    }
-
-    obj_index = 0;
-    prg_argc = input->numArgs;
-    prg_argv = input->args;
-    prg_argv[0] = argv[optind];
-    klee_init_env(&prg_argc, &prg_argv);
-    if (idx > 2)
-      fputc('\n', stderr);
-    fprintf(stderr, "KLEE-REPLAY: NOTE: Test file: %s\n"
-                    "KLEE-REPLAY: NOTE: Arguments: ", input_fname);
-    for (i=0; i != (unsigned) prg_argc; ++i) {
-      char *s = prg_argv[i];
-      if (s[0]=='A' && s[1] && !s[2]) s[1] = '\0';
-      fprintf(stderr, "\"%s\" ", prg_argv[i]);
-    }
-    fputc('\n', stderr);
-
-    /* Create the input files, pipes, etc. */
-    replay_create_files(&__exe_fs);
-
-    /* Run the test case machinery in a subprocess, eventually this parent
-       process should be a script or something which shells out to the actual
-       execution tool. */
-    int pid = fork();
-    if (pid < 0) {
-      perror("fork");
-      _exit(66);
-    } else if (pid == 0) {
-      /* Run the executable */
-      run_monitored(executable, prg_argc, prg_argv);
-      _exit(0);
-    } else {
-      /* Wait for the executable to finish. */
-      int res, status;
-
-      do {
-        res = waitpid(pid, &status, 0);
-      } while (res < 0 && errno == EINTR);
-
-      // Delete all files in the replay directory
-      replay_delete_files();
-
-      if (res < 0) {
-        perror("waitpid");
-        _exit(66);
+    if (kTest_isKTestArchive(input_fname)) {
+      KTestArchive *archive = kTestArchive_open(input_fname, 0);
+      unsigned i;
+      if (!archive) {
+        fprintf(stderr, "KLEE-REPLAY: ERROR: input file %s not valid.\n",
+                input_fname);
+        exit(1);
       }
+      for (i = 0; i != kTestArchive_numTests(archive); ++i) {
+        char name[PATH_MAX];
+        snprintf(name, sizeof(name), "%s:%u", input_fname,
+                 kTestArchive_getID(archive, i));
+        input = kTestArchive_read(archive, i);
+        replay_input(executable, argv[optind], name, idx == optind + 1 && !i);
+      }
+      kTestArchive_close(archive);
+      continue;
     }
+
+    input = kTest_fromFile(input_fname);
+    replay_input(executable, argv[optind], input_fname, idx == optind + 1);
   }
 
   return 0;
@@ -49,17 +49,30 @@
 #endif
 
 #include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cerrno>
+#include <condition_variable>
+#include <cstring>
 #include <ctime>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iterator>
+#include <mutex>
+#include <new>
+#include <set>
 #include <sstream>
+#include <thread>
 
 
 using namespace llvm;
@@ -120,6 +133,28 @@ namespace {
                           cl::desc("Write .sym.path files for each test case (default=false)"),
                           cl::cat(TestCaseCat));
 
+    cl::opt<bool>
+            WriteKTestArchive("write-ktest-archive",
+                              cl::desc("Append the .ktest files to the archive tests.ktests in the output "
+                                       "directory instead of writing them one by one (default=false)"),
+                              cl::init(false),
+                              cl::cat(TestCaseCat));
+
+    cl::opt<bool>
+            CompressKTestArchive("compress-ktest-archive",
+                                 cl::desc("Compress the tests in the archive of --write-ktest-archive "
+                                          "(default=false)"),
+                                 cl::init(false),
+                                 cl::cat(TestCaseCat));
+
+    cl::opt<unsigned>
+            TestWriterQueue("test-writer-queue",
+                            cl::desc("Write the files of test cases on a background thread, with at most "
+                                     "this many test cases waiting to be written. Set to 0 to write them "
+                                     "before execution continues (default=64)"),
+                            cl::init(64),
+                            cl::cat(TestCaseCat));
+
 
     /*** Startup options ***/
 
@@ -242,13 +277,13 @@ namespace {
 
     cl::list<std::string>
             ReplayKTestFile("replay-ktest-file",
-                            cl::desc("Specify a ktest file to use for replay"),
+                            cl::desc("Specify a ktest file or test archive to use for replay"),
                             cl::value_desc("ktest file"),
                             cl::cat(ReplayCat));
 
     cl::list<std::string>
             ReplayKTestDir("replay-ktest-dir",
-                           cl::desc("Specify a directory to replay ktest files from"),
+                           cl::desc("Specify a directory to replay ktest files and test archives from"),
                            cl::value_desc("output directory"),
                            cl::cat(ReplayCat));
 
@@ -259,15 +294,40 @@ namespace {
                            cl::cat(ReplayCat));
 
 
+    /*** Distributed exploration options ***/
+
+    cl::OptionCategory DistributedCat("Distributed exploration options",
+                                      "These options control exploring with worker processes "
+                                      "which are coordinated over local sockets.");
+
+    cl::opt<unsigned>
+            DistributedWorkers("distributed-workers",
+                               cl::desc("Explore up to -distributed-depth, then hand the paths of "
+                                        "the remaining states to this many worker processes, which "
+                                        "replay them as prefixes and explore the rest. Tests and "
+                                        "coverage of the workers are merged at the end, and -max-tests, "
+                                        "-max-instructions and -max-memory apply to all of them "
+                                        "together (default=0 (off))"),
+                               cl::init(0),
+                               cl::cat(DistributedCat));
+
+    cl::opt<unsigned>
+            DistributedDepth("distributed-depth",
+                             cl::desc("Number of branches after which states are handed to the "
+                                      "workers (default=8)"),
+                             cl::init(8),
+                             cl::cat(DistributedCat));
+
+
 
     cl::list<std::string>
             SeedOutFile("seed-file",
-                        cl::desc(".ktest file to be used as seed"),
+                        cl::desc(".ktest file or test archive to be used as seed"),
                         cl::cat(SeedingCat));
 
     cl::list<std::string>
             SeedOutDir("seed-dir",
-                       cl::desc("Directory with .ktest files to be used as seeds"),
+                       cl::desc("Directory with .ktest files or test archives to be used as seeds"),
                        cl::cat(SeedingCat));
 
     cl::opt<unsigned>
@@ -280,7 +340,7 @@ namespace {
 
     cl::opt<unsigned>
             MaxTests("max-tests",
-                     cl::desc("Stop execution after generating the given number of tests. Extra tests corresponding to partially explored paths will also be dumped.  Set to 0 to disable (default=0)"),
+                     cl::desc("Stop execution after generating the given number of tests, counting the tests of all worker processes. Extra tests corresponding to partially explored paths will also be dumped.  Set to 0 to disable (default=0)"),
                      cl::init(0),
                      cl::cat(TerminationCat));
 
@@ -304,16 +364,86 @@ namespace klee {
 
 /***/
 
+/// Messages between the coordinator and the workers of -distributed-workers
+/// are a tag, the length of the payload and the payload.
+enum DistributedMessage : char {
+    DM_Job = 'J',          // a path prefix to explore, in either direction
+    DM_DonationDone = 'E', // the worker has answered a donation request
+    DM_Idle = 'I',         // the worker has explored its job
+    DM_Quit = 'Q',         // there are no more jobs
+    DM_Coverage = 'C',     // the IDs of the instructions a worker covered
+    DM_Summary = 'S',      // the test and path counts of a worker
+};
+
+static bool sendMessage(int fd, char tag, const std::string &payload) {
+    std::string message(1, tag);
+    uint32_t size = payload.size();
+    message.append(reinterpret_cast<const char *>(&size), sizeof(size));
+    message += payload;
+    for (size_t done = 0; done < message.size();) {
+        ssize_t n = send(fd, message.data() + done, message.size() - done,
+                         MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+static bool receiveAll(int fd, char *buffer, size_t size) {
+    for (size_t done = 0; done < size;) {
+        ssize_t n = recv(fd, buffer + done, size - done, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+static bool receiveMessage(int fd, char &tag, std::string &payload) {
+    uint32_t size;
+    if (!receiveAll(fd, &tag, 1) ||
+        !receiveAll(fd, reinterpret_cast<char *>(&size), sizeof(size)))
+        return false;
+    payload.resize(size);
+    return receiveAll(fd, &payload[0], size);
+}
+
 class KleeHandler : public InterpreterHandler {
 private:
+    /// Everything written for a test case. It is taken from the state by the
+    /// interpreter thread, so that writing it does not touch any expressions.
+    struct TestCase {
+        unsigned id;
+        uint32_t stateID;
+        time::Span snapshotTime; // time taken to fill in the test case
+        bool hasSolution;
+        std::vector<std::pair<std::string, std::vector<unsigned char> > > objects;
+        // the files written verbatim, by suffix
+        std::vector<std::pair<std::string, std::string> > files;
+        bool hasPath, hasSymPath;
+        std::vector<unsigned char> path, symPath;
+        bool hasCov;
+        std::vector<std::pair<std::string, std::set<unsigned> > > cov;
+    };
+
     Interpreter *m_interpreter;
     TreeStreamWriter *m_pathWriter, *m_symPathWriter;
+    // the file of m_pathWriter, a temporary one unless -write-paths
+    std::string m_pathFile;
     std::unique_ptr<llvm::raw_ostream> m_infoFile;
 
     SmallString<128> m_outputDirectory;
 
     unsigned m_numTotalTests;     // Number of tests received from the interpreter
-    unsigned m_numGeneratedTests; // Number of tests successfully generated
+    // Number of tests with a solution, written or not, in memory shared with
+    // forked worker processes
+    std::atomic<unsigned> *m_numSolvedTests;
+    std::atomic<unsigned> m_numGeneratedTests; // Number of tests successfully generated
     unsigned m_pathsCompleted; // number of completed paths
   unsigned m_pathsExplored; // number of partially explored and completed paths
 
@@ -321,6 +451,29 @@ private:
     int m_argc;
     char **m_argv;
 
+    // -distributed-workers: the socket to the coordinator in a worker, the
+    // paths of the donated states in the coordinator
+    int m_coordinatorSocket;
+    std::deque<std::string> m_donatedPaths;
+
+    // -test-writer-queue: the test cases waiting for the writer thread
+    std::deque<std::unique_ptr<TestCase> > m_testQueue;
+    std::mutex m_testQueueLock;
+    std::condition_variable m_testQueueChanged;
+    std::thread m_testWriter;
+    bool m_testWriterDone; // exit the writer thread once the queue is empty
+
+    // -write-ktest-archive: the archive, opened by the first test written
+    KTestArchive *m_testArchive;
+
+    bool writeKTest(KTest &b, unsigned id);
+
+    void openPathWriter();
+
+    void queueTestCase(std::unique_ptr<TestCase> tc);
+    void runTestWriter();
+    void writeTestCase(const TestCase &tc);
+
 public:
     KleeHandler(int argc, char **argv);
     ~KleeHandler();
@@ -341,6 +494,29 @@ public:
                          const char *errorSuffix,
                          uint32_t stateID);
 
+    /// Wait until all test cases are written and stop the writer thread.
+    void flushTestCases();
+
+    void startWorker(unsigned id);
+
+    void donateStates(const std::vector<const ExecutionState *> &states);
+
+    void setCoordinatorSocket(int fd) { m_coordinatorSocket = fd; }
+    std::deque<std::string> takeDonatedPaths() { return std::move(m_donatedPaths); }
+
+    /// Flush everything which a forked process would write again.
+    void prepareFork();
+
+    /// The test and path counts, as sent by a worker.
+    std::string getSummary();
+
+    /// Write the remaining tests and return the summary of this worker.
+    std::string finishWorker();
+
+    /// Move the tests of worker \a id into the output directory, after the
+    /// tests of this process, and add the counts in \a summary.
+    void mergeWorker(unsigned id, const std::string &summary);
+
     std::string getOutputFilename(const std::string &filename);
     std::unique_ptr<llvm::raw_fd_ostream> openOutputFile(const std::string &filename);
     std::string getTestFilename(const std::string &suffix, unsigned id);
@@ -353,13 +529,28 @@ public:
     static void getKTestFilesInDir(std::string directoryPath,
                                    std::vector<std::string> &results);
 
+    /// Read the tests of a .ktest file or a test archive. Returns false if
+    /// any of them could not be read.
+    static bool readKTests(const std::string &path, std::vector<KTest *> &results);
+
     static std::string getRunTimeLibraryPath(const char *argv0);
 };
 
+// The handler whose queued test cases are written when klee_error() exits.
+static KleeHandler *theHandler = nullptr;
+
 KleeHandler::KleeHandler(int argc, char **argv)
         : m_interpreter(0), m_pathWriter(0), m_symPathWriter(0),
-          m_outputDirectory(), m_numTotalTests(0), m_numGeneratedTests(0),
-          m_pathsCompleted(0), m_pathsExplored(0), m_argc(argc), m_argv(argv) {
+          m_outputDirectory(), m_numTotalTests(0), m_numSolvedTests(nullptr),
+          m_numGeneratedTests(0), m_pathsCompleted(0), m_pathsExplored(0),
+          m_argc(argc), m_argv(argv), m_coordinatorSocket(-1),
+          m_testWriterDone(false), m_testArchive(nullptr) {
+
+    void *shared = mmap(nullptr, sizeof(std::atomic<unsigned>),
+                        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+        klee_error("cannot allocate the test counter: %s", strerror(errno));
+    m_numSolvedTests = new (shared) std::atomic<unsigned>(0);
 
     // create output directory (OutputDir or "klee-out-<i>")
     bool dir_given = OutputDir != "";
@@ -427,20 +618,149 @@ KleeHandler::KleeHandler(int argc, char **argv)
 }
 
 KleeHandler::~KleeHandler() {
+    flushTestCases();
     delete m_pathWriter;
+    if (m_pathWriter && !WritePaths)
+        unlink(m_pathFile.c_str());
     delete m_symPathWriter;
     fclose(klee_warning_file);
     fclose(klee_message_file);
+    munmap(m_numSolvedTests, sizeof(std::atomic<unsigned>));
+}
+
+void KleeHandler::startWorker(unsigned id) {
+    // The parent flushed its test cases in prepareFork(), the worker writes
+    // its own.
+    theHandler = this;
+
+    // Workers write to a subdirectory of the output directory of the process
+    // which forked them, with their own test numbering.
+    SmallString<128> directory(m_outputDirectory);
+    sys::path::append(directory, "worker-" + std::to_string(id));
+    if (mkdir(directory.c_str(), 0775) < 0)
+        klee_error("cannot create \"%s\": %s", directory.c_str(), strerror(errno));
+    m_outputDirectory = directory;
+
+    m_numTotalTests = m_numGeneratedTests = 0;
+    m_pathsCompleted = m_pathsExplored = 0;
+
+    fclose(klee_warning_file);
+    std::string file_path = getOutputFilename("warnings.txt");
+    if ((klee_warning_file = fopen(file_path.c_str(), "w")) == NULL)
+        klee_error("cannot open file \"%s\": %s", file_path.c_str(), strerror(errno));
+
+    fclose(klee_message_file);
+    file_path = getOutputFilename("messages.txt");
+    if ((klee_message_file = fopen(file_path.c_str(), "w")) == NULL)
+        klee_error("cannot open file \"%s\": %s", file_path.c_str(), strerror(errno));
+
+    m_infoFile = openOutputFile("info");
+
+    // The parent flushed its path streams before forking.
+    if (m_pathWriter) {
+        delete m_pathWriter;
+        openPathWriter();
+    }
+    if (m_symPathWriter) {
+        delete m_symPathWriter;
+        m_symPathWriter = new TreeStreamWriter(getOutputFilename("symPaths.ts"));
+        assert(m_symPathWriter->good());
+        m_interpreter->setSymbolicPathWriter(m_symPathWriter);
+    }
+}
+
+void KleeHandler::donateStates(const std::vector<const ExecutionState *> &states) {
+    for (const ExecutionState *state : states) {
+        std::vector<unsigned char> branches;
+        m_pathWriter->readStream(m_interpreter->getPathStreamID(*state), branches);
+        std::string path(branches.begin(), branches.end());
+        if (m_coordinatorSocket >= 0)
+            sendMessage(m_coordinatorSocket, DM_Job, path);
+        else
+            m_donatedPaths.push_back(std::move(path));
+    }
+    if (m_coordinatorSocket >= 0)
+        sendMessage(m_coordinatorSocket, DM_DonationDone, "");
+}
+
+void KleeHandler::prepareFork() {
+    // The writer thread would not exist in the forked process.
+    flushTestCases();
+    getInfoStream().flush();
+    if (m_pathWriter)
+        m_pathWriter->flush();
+    if (m_symPathWriter)
+        m_symPathWriter->flush();
+    fflush(nullptr);
+}
+
+std::string KleeHandler::getSummary() {
+    std::stringstream summary;
+    summary << m_numTotalTests << ' ' << m_numGeneratedTests.load() << ' '
+            << m_pathsCompleted << ' ' << m_pathsExplored;
+    return summary.str();
+}
+
+std::string KleeHandler::finishWorker() {
+    flushTestCases();
+    return getSummary();
+}
+
+void KleeHandler::mergeWorker(unsigned id, const std::string &summary) {
+    // The merged tests are written directly, after the queued ones.
+    flushTestCases();
+    std::string directory = getOutputFilename("worker-" + std::to_string(id));
+    std::error_code ec;
+    for (sys::fs::directory_iterator it(directory, ec), ie; it != ie && !ec;
+         it.increment(ec)) {
+        std::string name = sys::path::filename(it->path()).str();
+        unsigned test;
+        int suffix = 0;
+        if (sscanf(name.c_str(), "test%u.%n", &test, &suffix) != 1 || !suffix)
+            continue;
+        std::string merged =
+                getOutputFilename(getTestFilename(name.substr(suffix), m_numTotalTests + test));
+        if (rename(it->path().c_str(), merged.c_str()) < 0)
+            klee_warning("unable to move %s: %s", it->path().c_str(), strerror(errno));
+    }
+    if (ec)
+        klee_warning("unable to read %s: %s", directory.c_str(), ec.message().c_str());
+
+    std::string archivePath = directory + "/tests.ktests";
+    if (kTest_isKTestArchive(archivePath.c_str())) {
+        KTestArchive *archive = kTestArchive_open(archivePath.c_str(), 0);
+        unsigned numTests = archive ? kTestArchive_numTests(archive) : 0;
+        bool merged = archive;
+        for (unsigned i = 0; i < numTests; ++i) {
+            KTest *test = kTestArchive_read(archive, i);
+            if (!test || !writeKTest(*test, m_numTotalTests + kTestArchive_getID(archive, i)))
+                merged = false;
+            if (test)
+                kTest_free(test);
+        }
+        if (archive)
+            kTestArchive_close(archive);
+        if (merged)
+            unlink(archivePath.c_str());
+        else
+            klee_warning("unable to merge the tests of %s", archivePath.c_str());
+    }
+
+    unsigned totalTests = 0, generatedTests = 0, pathsCompleted = 0, pathsExplored = 0;
+    std::istringstream(summary) >> totalTests >> generatedTests >> pathsCompleted >>
+            pathsExplored;
+    m_numTotalTests += totalTests;
+    m_numGeneratedTests += generatedTests;
+    m_pathsCompleted += pathsCompleted;
+    m_pathsExplored += pathsExplored;
 }
 
 void KleeHandler::setInterpreter(Interpreter *i) {
     m_interpreter = i;
 
-    if (WritePaths) {
-        m_pathWriter = new TreeStreamWriter(getOutputFilename("paths.ts"));
-        assert(m_pathWriter->good());
-        m_interpreter->setPathWriter(m_pathWriter);
-    }
+    // Distributed exploration describes the donated states by their paths.
+    if (WritePaths || DistributedWorkers)
+        openPathWriter();
 
     if (WriteSymPaths) {
         m_symPathWriter = new TreeStreamWriter(getOutputFilename("symPaths.ts"));
@@ -449,6 +769,22 @@ void KleeHandler::setInterpreter(Interpreter *i) {
     }
 }
 
+void KleeHandler::openPathWriter() {
+    if (WritePaths) {
+        m_pathFile = getOutputFilename("paths.ts");
+    } else {
+        // The paths are only needed while running, so they are kept out of
+        // the output directory.
+        SmallString<128> path;
+        if (std::error_code ec = sys::fs::createTemporaryFile("klee-paths", "ts", path))
+            klee_error("unable to create temporary path file: %s", ec.message().c_str());
+        m_pathFile = path.str().str();
+    }
+    m_pathWriter = new TreeStreamWriter(m_pathFile);
+    assert(m_pathWriter->good());
+    m_interpreter->setPathWriter(m_pathWriter);
+}
+
 std::string KleeHandler::getOutputFilename(const std::string &filename) {
     SmallString<128> path = m_outputDirectory;
     sys::path::append(path,filename);
@@ -488,70 +824,29 @@ void KleeHandler::processTestCase(const ExecutionState &state,
                                   const char *errorSuffix,
                                   uint32_t stateID) {
     if (!WriteNone) {
-        std::vector< std::pair<std::string, std::vector<unsigned char> > > out;
-        bool success = m_interpreter->getSymbolicSolution(state, out);
+        std::unique_ptr<TestCase> tc(new TestCase());
+        tc->hasSolution = m_interpreter->getSymbolicSolution(state, tc->objects);
 
-        if (!success)
+        if (!tc->hasSolution)
             klee_warning("unable to get symbolic solution, losing test case");
 
         const auto start_time = time::getWallTime();
 
-        unsigned id = ++m_numTotalTests;
-
-        if (success) {
-            KTest b;
-            b.numArgs = m_argc;
-            b.args = m_argv;
-            b.symArgvs = 0;
-            b.symArgvLen = 0;
-            b.numObjects = out.size();
-            b.objects = new KTestObject[b.numObjects];
-            assert(b.objects);
-            for (unsigned i=0; i<b.numObjects; i++) {
-                KTestObject *o = &b.objects[i];
-                o->name = const_cast<char*>(out[i].first.c_str());
-                o->numBytes = out[i].second.size();
-                o->bytes = new unsigned char[o->numBytes];
-                assert(o->bytes);
-                std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
-            }
-
-            if (!kTest_toFile(&b, getOutputFilename(getTestFilename("ktest", id)).c_str())) {
-                klee_warning("unable to write output test case, losing it");
-            } else {
-                klee_message("GENERATE: %s, stateID=%d", getOutputFilename(getTestFilename("ktest", id)).c_str(), (int)stateID);
-                ++m_numGeneratedTests;
-            }
-
-            for (unsigned i=0; i<b.numObjects; i++)
-                delete[] b.objects[i].bytes;
-            delete[] b.objects;
-        }
+        tc->id = ++m_numTotalTests;
+        tc->stateID = stateID;
 
-        if (errorMessage) {
-            auto f = openTestFile(errorSuffix, id);
-            if (f)
-                *f << errorMessage;
-        }
+        if (errorMessage)
+            tc->files.emplace_back(errorSuffix, errorMessage);
 
-        if (m_pathWriter) {
-            std::vector<unsigned char> concreteBranches;
+        tc->hasPath = WritePaths;
+        if (WritePaths)
             m_pathWriter->readStream(m_interpreter->getPathStreamID(state),
-                                     concreteBranches);
-            auto f = openTestFile("path", id);
-            if (f) {
-                for (const auto &branch : concreteBranches) {
-                    *f << branch << '\n';
-                }
-            }
-        }
+                                     tc->path);
 
         if (errorMessage || WriteKQueries) {
             std::string constraints;
             m_interpreter->getConstraintLog(state, constraints,Interpreter::KQUERY);
-            auto f = openTestFile("kquery", id);
-            if (f)
-                *f << constraints;
+            tc->files.emplace_back("kquery", std::move(constraints));
         }
 
         if (WriteCVCs) {
@@ -559,61 +854,192 @@ void KleeHandler::processTestCase(const ExecutionState &state,
             // SMT-LIBv2 not CVC which is a bit confusing
             std::string constraints;
             m_interpreter->getConstraintLog(state, constraints, Interpreter::STP);
-            auto f = openTestFile("cvc", id);
-            if (f)
-                *f << constraints;
+            tc->files.emplace_back("cvc", std::move(constraints));
         }
 
         if (WriteSMT2s) {
             std::string constraints;
             m_interpreter->getConstraintLog(state, constraints, Interpreter::SMTLIB2);
-            auto f = openTestFile("smt2", id);
-            if (f)
-                *f << constraints;
+            tc->files.emplace_back("smt2", std::move(constraints));
         }
 
-        if (m_symPathWriter) {
-            std::vector<unsigned char> symbolicBranches;
+        tc->hasSymPath = m_symPathWriter;
+        if (m_symPathWriter)
             m_symPathWriter->readStream(m_interpreter->getSymbolicPathStreamID(state),
-                                        symbolicBranches);
-            auto f = openTestFile("sym.path", id);
-            if (f) {
-                for (const auto &branch : symbolicBranches) {
-                    *f << branch << '\n';
-                }
-            }
-        }
+                                        tc->symPath);
 
+        tc->hasCov = WriteCov;
         if (WriteCov) {
             std::map<const std::string*, std::set<unsigned> > cov;
             m_interpreter->getCoveredLines(state, cov);
-            auto f = openTestFile("cov", id);
-            if (f) {
-                for (const auto &entry : cov) {
-                    for (const auto &line : entry.second) {
-                        *f << *entry.first << ':' << line << '\n';
-                    }
-                }
-            }
+            for (auto &entry : cov)
+                tc->cov.emplace_back(*entry.first, std::move(entry.second));
         }
 
-        if (m_numGeneratedTests == MaxTests)
+        // Tests still waiting to be written count towards -max-tests.
+        if (tc->hasSolution && ++*m_numSolvedTests >= MaxTests && MaxTests)
             m_interpreter->setHaltExecution(true);
 
-        if (WriteTestInfo) {
-            time::Span elapsed_time(time::getWallTime() - start_time);
-            auto f = openTestFile("info", id);
-            if (f)
-                *f << "Time to generate test case: " << elapsed_time << '\n';
-        }
+        tc->snapshotTime = time::getWallTime() - start_time;
+        queueTestCase(std::move(tc));
     } // if (!WriteNone)
 
     if (errorMessage && OptExitOnError) {
+        flushTestCases();
         m_interpreter->prepareForEarlyExit();
         klee_error("EXITING ON ERROR:\n%s\n", errorMessage);
     }
 }
 
+void KleeHandler::queueTestCase(std::unique_ptr<TestCase> tc) {
+    if (!TestWriterQueue) {
+        writeTestCase(*tc);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_testQueueLock);
+    if (!m_testWriter.joinable()) {
+        m_testWriterDone = false;
+        m_testWriter = std::thread(&KleeHandler::runTestWriter, this);
+    }
+    // Execution waits while the writer falls behind.
+    m_testQueueChanged.wait(lock, [this] {
+        return m_testQueue.size() < TestWriterQueue;
+    });
+    m_testQueue.push_back(std::move(tc));
+    m_testQueueChanged.notify_all();
+}
+
+void KleeHandler::runTestWriter() {
+    std::unique_lock<std::mutex> lock(m_testQueueLock);
+    while (true) {
+        m_testQueueChanged.wait(lock, [this] {
+            return !m_testQueue.empty() || m_testWriterDone;
+        });
+        if (m_testQueue.empty())
+            return;
+        std::unique_ptr<TestCase> tc = std::move(m_testQueue.front());
+        m_testQueue.pop_front();
+        m_testQueueChanged.notify_all();
+
+        lock.unlock();
+        writeTestCase(*tc);
+        lock.lock();
+    }
+}
+
+void KleeHandler::flushTestCases() {
+    // The writer thread cannot wait for itself, e.g. when it exits.
+    if (m_testWriter.joinable() &&
+        m_testWriter.get_id() != std::this_thread::get_id()) {
+        {
+            std::lock_guard<std::mutex> lock(m_testQueueLock);
+            m_testWriterDone = true;
+            m_testQueueChanged.notify_all();
+        }
+        m_testWriter.join();
+    }
+
+    // Closing the archive writes its index.
+    if (m_testArchive) {
+        if (!kTestArchive_close(m_testArchive))
+            klee_warning("unable to write the index of %s",
+                         getOutputFilename("tests.ktests").c_str());
+        m_testArchive = nullptr;
+    }
+}
+
+bool KleeHandler::writeKTest(KTest &b, unsigned id) {
+    if (!WriteKTestArchive)
+        return kTest_toFile(&b, getOutputFilename(getTestFilename("ktest", id)).c_str());
+
+    if (!m_testArchive) {
+        std::string path = getOutputFilename("tests.ktests");
+        m_testArchive = kTestArchive_open(path.c_str(), 1);
+        if (!m_testArchive) {
+            klee_warning("unable to open %s: %s", path.c_str(), strerror(errno));
+            return false;
+        }
+    }
+    return kTestArchive_append(m_testArchive, &b, id, CompressKTestArchive);
+}
+
+void KleeHandler::writeTestCase(const TestCase &tc) {
+    const auto start_time = time::getWallTime();
+
+    if (tc.hasSolution) {
+        KTest b;
+        b.numArgs = m_argc;
+        b.args = m_argv;
+        b.symArgvs = 0;
+        b.symArgvLen = 0;
+        b.numObjects = tc.objects.size();
+        b.objects = new KTestObject[b.numObjects];
+        assert(b.objects);
+        for (unsigned i=0; i<b.numObjects; i++) {
+            KTestObject *o = &b.objects[i];
+            o->name = const_cast<char*>(tc.objects[i].first.c_str());
+            o->numBytes = tc.objects[i].second.size();
+            o->bytes = const_cast<unsigned char*>(tc.objects[i].second.data());
+        }
+
+        if (!writeKTest(b, tc.id)) {
+            klee_warning("unable to write output test case, losing it");
+        } else {
+            std::string name = WriteKTestArchive
+                    ? getOutputFilename("tests.ktests") + ":" + std::to_string(tc.id)
+                    : getOutputFilename(getTestFilename("ktest", tc.id));
+            klee_message("GENERATE: %s, stateID=%d", name.c_str(), (int)tc.stateID);
+            ++m_numGeneratedTests;
+        }
+
+        delete[] b.objects;
+    }
+
+    for (const auto &file : tc.files) {
+        auto f = openTestFile(file.first, tc.id);
+        if (f)
+            *f << file.second;
+    }
+
+    if (tc.hasPath) {
+        auto f = openTestFile("path", tc.id);
+        if (f) {
+            for (const auto &branch : tc.path) {
+                *f << branch << '\n';
+            }
+        }
+    }
+
+    if (tc.hasSymPath) {
+        auto f = openTestFile("sym.path", tc.id);
+        if (f) {
+            for (const auto &branch : tc.symPath) {
+                *f << branch << '\n';
+            }
+        }
+    }
+
+    if (tc.hasCov) {
+        auto f = openTestFile("cov", tc.id);
+        if (f) {
+            for (const auto &entry : tc.cov) {
+                for (const auto &line : entry.second) {
+                    *f << entry.first << ':' << line << '\n';
+                }
+            }
+        }
+    }
+
+    if (WriteTestInfo) {
+        time::Span elapsed_time(tc.snapshotTime +
+                                (time::getWallTime() - start_time));
+        auto f = openTestFile("info", tc.id);
+        if (f)
+            *f << "Time to generate test case: " << elapsed_time << '\n';
+    }
+}
+
 // load a .path file
 void KleeHandler::loadPathFile(std::string name,
                                std::vector<bool> &buffer) {
@@ -636,7 +1062,8 @@ void KleeHandler::getKTestFilesInDir(std::string directoryPath,
     llvm::sys::fs::directory_iterator i(directoryPath, ec), e;
     for (; i != e && !ec; i.increment(ec)) {
         auto f = i->path();
-        if (f.size() >= 6 && f.substr(f.size()-6,f.size()) == ".ktest") {
+        if ((f.size() >= 6 && f.substr(f.size()-6,f.size()) == ".ktest") ||
+            (f.size() >= 7 && f.substr(f.size()-7,f.size()) == ".ktests")) {
             results.push_back(f);
         }
     }
@@ -648,6 +1075,30 @@ void KleeHandler::getKTestFilesInDir(std::string directoryPath,
     }
 }
 
+bool KleeHandler::readKTests(const std::string &path,
+                             std::vector<KTest *> &results) {
+    if (!kTest_isKTestArchive(path.c_str())) {
+        KTest *test = kTest_fromFile(path.c_str());
+        if (test)
+            results.push_back(test);
+        return test;
+    }
+
+    KTestArchive *archive = kTestArchive_open(path.c_str(), 0);
+    if (!archive)
+        return false;
+    bool success = true;
+    for (unsigned i = 0, e = kTestArchive_numTests(archive); i != e; ++i) {
+        KTest *test = kTestArchive_read(archive, i);
+        if (test)
+            results.push_back(test);
+        else
+            success = false;
+    }
+    kTestArchive_close(archive);
+    return success;
+}
+
 std::string KleeHandler::getRunTimeLibraryPath(const char *argv0) {
     // allow specifying the path to the runtime library
     const char *env = getenv("KLEE_RUNTIME_LIBRARY_PATH");
@@ -1019,6 +1470,20 @@ void externalsAndGlobalsCheck(const llvm::Module *m) {
 
 static Interpreter *theInterpreter = 0;
 
+// klee_error() exits without destroying the handler, so the queued test
+// cases are written here.
+static void flushTestCasesAtExit() {
+    if (theHandler)
+        theHandler->flushTestCases();
+}
+
+// Processes forked by the solvers have no test writer thread and must leave
+// the test cases to their parent, even when they exit through klee_error().
+// Workers take over the handler again in KleeHandler::startWorker().
+static void forgetHandlerInChild() {
+    theHandler = nullptr;
+}
+
 static std::atomic_bool interrupted{false};
 
 // Pulled out so it can be easily called from a debugger.
@@ -1044,6 +1509,208 @@ static void interrupt_handle() {
     interrupted = true;
 }
 
+static void donation_request_handle(int) {
+    if (theInterpreter)
+        theInterpreter->requestDonation();
+}
+
+/// Explore the path prefixes in \a jobs in a worker of -distributed-workers,
+/// as they are sent by the coordinator over \a fd.
+static void runDistributedWorker(KleeHandler &handler, Interpreter &interpreter,
+                                 unsigned id, int fd, Function *mainFn,
+                                 int argc, char **argv, char **envp) {
+    interpreter.startWorker(id);
+    interpreter.setDonationDepth(0);
+    handler.setCoordinatorSocket(fd);
+
+    char tag;
+    std::string payload;
+    std::vector<bool> prefix;
+    while (!interrupted && receiveMessage(fd, tag, payload) && tag == DM_Job) {
+        prefix.clear();
+        for (char branch : payload)
+            prefix.push_back(branch == '1');
+        interpreter.setReplayPathPrefix(&prefix);
+        interpreter.runFunctionAsMain(mainFn, argc, argv, envp);
+        interpreter.setReplayPathPrefix(nullptr);
+        if (!sendMessage(fd, DM_Idle, ""))
+            break;
+    }
+
+    std::vector<unsigned> covered;
+    interpreter.getCoveredInstructions(covered);
+    sendMessage(fd, DM_Coverage,
+                std::string(reinterpret_cast<const char *>(covered.data()),
+                            covered.size() * sizeof(unsigned)));
+    sendMessage(fd, DM_Summary, handler.finishWorker());
+    close(fd);
+}
+
+/// Hand the paths donated up to -distributed-depth to worker processes and
+/// merge their results. Whenever a worker is idle and there are no paths
+/// left, a busy worker is asked to donate half of its states. Returns true
+/// in the workers.
+static bool runDistributedCoordinator(KleeHandler &handler, Interpreter &interpreter,
+                                      Function *mainFn, int argc, char **argv,
+                                      char **envp) {
+    struct Worker {
+        pid_t pid;
+        int fd;
+        bool busy, donationRequested;
+        time::Point lastRequest;
+        std::string job, coverage, summary;
+    };
+    std::vector<Worker> workers;
+
+    // Branches split by a switch or a symbolic pointer are not recorded, so
+    // the paths of different states can be equal or prefixes of each other,
+    // and the replay of a prefix explores every path which extends it. A path
+    // is therefore dropped if a queued job or a job running elsewhere is a
+    // prefix of it, and queued jobs which extend it are dropped in its favour.
+    // The paths donated by a worker extend its own job, whose states it gave
+    // away.
+    std::deque<std::string> jobs;
+    auto isPrefix = [](const std::string &prefix, const std::string &path) {
+        return path.compare(0, prefix.size(), prefix) == 0;
+    };
+    auto addJob = [&](std::string path, const Worker *donor) {
+        for (const std::string &job : jobs)
+            if (isPrefix(job, path))
+                return;
+        for (const Worker &w : workers)
+            if (&w != donor && w.busy && isPrefix(w.job, path))
+                return;
+        jobs.erase(std::remove_if(jobs.begin(), jobs.end(),
+                                  [&](const std::string &job) {
+                                      return isPrefix(path, job);
+                                  }),
+                   jobs.end());
+        jobs.push_back(std::move(path));
+    };
+    for (auto &path : handler.takeDonatedPaths())
+        addJob(std::move(path), nullptr);
+    if (jobs.empty() || interpreter.getHaltExecution())
+        return false;
+
+    // Installed before forking, so no worker can miss a request.
+    signal(SIGUSR1, donation_request_handle);
+    interpreter.shareLimitsWithWorkers();
+    for (unsigned id = 1; id <= DistributedWorkers; ++id) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+            klee_error("unable to create socket for worker: %s", strerror(errno));
+        handler.prepareFork();
+        pid_t pid = fork();
+        if (pid < 0)
+            klee_error("unable to fork worker: %s", strerror(errno));
+        if (pid == 0) {
+            close(fds[0]);
+            for (const Worker &w : workers)
+                close(w.fd);
+            runDistributedWorker(handler, interpreter, id, fds[1], mainFn, argc,
+                                 argv, envp);
+            return true;
+        }
+        close(fds[1]);
+        workers.push_back({pid, fds[0], false, false, time::Point(), "", ""});
+    }
+    klee_message("distributing %zu paths to %u workers", jobs.size(),
+                 DistributedWorkers.getValue());
+
+    unsigned live = workers.size();
+    std::vector<pollfd> fds;
+    std::vector<Worker *> polled;
+    char tag;
+    std::string payload;
+    while (live) {
+        const bool halted = interrupted || interpreter.getHaltExecution();
+        unsigned busy = 0;
+        for (Worker &w : workers) {
+            if (w.fd >= 0 && !w.busy && !jobs.empty() && !halted &&
+                sendMessage(w.fd, DM_Job, jobs.front())) {
+                w.job = std::move(jobs.front());
+                jobs.pop_front();
+                w.busy = true;
+            }
+            busy += w.busy;
+        }
+        if (!busy && (jobs.empty() || halted))
+            break;
+
+        if (jobs.empty() && busy < live) {
+            const auto now = time::getWallTime();
+            for (Worker &w : workers) {
+                if (w.busy && !w.donationRequested &&
+                    now - w.lastRequest >= time::seconds(1)) {
+                    kill(w.pid, SIGUSR1);
+                    w.donationRequested = true;
+                    w.lastRequest = now;
+                    break;
+                }
+            }
+        }
+
+        fds.clear();
+        polled.clear();
+        for (Worker &w : workers) {
+            if (w.fd >= 0) {
+                fds.push_back({w.fd, POLLIN, 0});
+                polled.push_back(&w);
+            }
+        }
+        if (poll(fds.data(), fds.size(), 100) < 0 && errno != EINTR)
+            klee_error("unable to poll workers: %s", strerror(errno));
+        for (unsigned i = 0; i < fds.size(); ++i) {
+            if (!fds[i].revents)
+                continue;
+            Worker &w = *polled[i];
+            if (!receiveMessage(w.fd, tag, payload)) {
+                if (w.busy)
+                    klee_warning("worker (pid %d) exited before finishing its paths", w.pid);
+                close(w.fd);
+                w.fd = -1;
+                w.busy = false;
+                --live;
+                continue;
+            }
+            switch (tag) {
+                case DM_Job: addJob(std::move(payload), &w); break;
+                case DM_DonationDone: w.donationRequested = false; break;
+                case DM_Idle: w.busy = false; break;
+                case DM_Coverage: w.coverage = std::move(payload); break;
+                case DM_Summary: w.summary = std::move(payload); break;
+            }
+        }
+    }
+
+    // Collect the results of the workers.
+    std::set<unsigned> covered;
+    for (unsigned id = 1; id <= workers.size(); ++id) {
+        Worker &w = workers[id - 1];
+        if (w.fd >= 0) {
+            sendMessage(w.fd, DM_Quit, "");
+            while (receiveMessage(w.fd, tag, payload)) {
+                if (tag == DM_Coverage)
+                    w.coverage = std::move(payload);
+                else if (tag == DM_Summary)
+                    w.summary = std::move(payload);
+            }
+            close(w.fd);
+        }
+        int status;
+        while (waitpid(w.pid, &status, 0) < 0 && errno == EINTR)
+            ;
+
+        std::vector<unsigned> ids(w.coverage.size() / sizeof(unsigned));
+        memcpy(ids.data(), w.coverage.data(), ids.size() * sizeof(unsigned));
+        covered.insert(ids.begin(), ids.end());
+        handler.mergeWorker(id, w.summary);
+    }
+    interpreter.mergeCoveredInstructions(
+            std::vector<unsigned>(covered.begin(), covered.end()));
+    return false;
+}
+
 static void interrupt_handle_watchdog() {
     // just wait for the child to finish
 }
@@ -1443,6 +2110,14 @@ int main(int argc, char **argv, char **envp) {
         KleeHandler::loadPathFile(ReplayPathFile, replayPath);
     }
 
+    if (DistributedWorkers) {
+        if (ReplayPathFile != "" || !ReplayKTestDir.empty() ||
+            !ReplayKTestFile.empty() || !SeedOutFile.empty() || !SeedOutDir.empty())
+            klee_error("--distributed-workers cannot be used with replaying or seeding");
+        if (!DistributedDepth)
+            klee_error("--distributed-depth must be positive");
+    }
+
     Interpreter::InterpreterOptions IOpts;
     IOpts.MakeConcreteSymbolic = MakeConcreteSymbolic;
   std::unique_ptr<KleeHandler> handler =
@@ -1452,6 +2127,9 @@ int main(int argc, char **argv, char **envp) {
   theInterpreter = interpreter.get();
     assert(interpreter);
   handler->setInterpreter(interpreter.get());
+  theHandler = handler.get();
+  atexit(flushTestCasesAtExit);
+  pthread_atfork(nullptr, nullptr, forgetHandlerInChild);
 
     for (int i=0; i<argc; i++) {
         handler->getInfoStream() << argv[i] << (i+1<argc ? " ":"\n");
@@ -1473,6 +2151,10 @@ int main(int argc, char **argv, char **envp) {
         interpreter->setReplayPath(&replayPath);
     }
 
+    if (DistributedWorkers) {
+        interpreter->setDonationDepth(DistributedDepth);
+    }
+
 
     auto startTime = std::time(nullptr);
     { // output clock info and start time
@@ -1484,6 +2166,7 @@ int main(int argc, char **argv, char **envp) {
         handler->getInfoStream().flush();
     }
 
+    bool isDistributedWorker = false;
     if (!ReplayKTestDir.empty() || !ReplayKTestFile.empty()) {
         assert(SeedOutFile.empty());
         assert(SeedOutDir.empty());
@@ -1497,10 +2180,7 @@ int main(int argc, char **argv, char **envp) {
         for (std::vector<std::string>::iterator
                      it = kTestFiles.begin(), ie = kTestFiles.end();
              it != ie; ++it) {
-            KTest *out = kTest_fromFile(it->c_str());
-            if (out) {
-                kTests.push_back(out);
-            } else {
+            if (!KleeHandler::readKTests(*it, kTests)) {
                 klee_warning("unable to open: %s\n", (*it).c_str());
             }
         }
@@ -1521,7 +2201,7 @@ int main(int argc, char **argv, char **envp) {
             interpreter->setReplayKTest(out);
             llvm::errs() << "KLEE: replaying: " << *it << " (" << kTest_numBytes(out)
                          << " bytes)"
-                         << " (" << ++i << "/" << kTestFiles.size() << ")\n";
+                         << " (" << ++i << "/" << kTests.size() << ")\n";
             // XXX should put envp in .ktest ?
             interpreter->runFunctionAsMain(mainFn, out->numArgs, out->args, pEnvp);
             if (interrupted) break;
@@ -1536,11 +2216,9 @@ int main(int argc, char **argv, char **envp) {
         for (std::vector<std::string>::iterator
                      it = SeedOutFile.begin(), ie = SeedOutFile.end();
              it != ie; ++it) {
-            KTest *out = kTest_fromFile(it->c_str());
-            if (!out) {
+            if (!KleeHandler::readKTests(*it, seeds)) {
                 klee_error("unable to open: %s\n", (*it).c_str());
             }
-            seeds.push_back(out);
         }
         for (std::vector<std::string>::iterator
                      it = SeedOutDir.begin(), ie = SeedOutDir.end();
@@ -1550,11 +2228,9 @@ int main(int argc, char **argv, char **envp) {
             for (std::vector<std::string>::iterator
                          it2 = kTestFiles.begin(), ie = kTestFiles.end();
                  it2 != ie; ++it2) {
-                KTest *out = kTest_fromFile(it2->c_str());
-                if (!out) {
+                if (!KleeHandler::readKTests(*it2, seeds)) {
                     klee_error("unable to open: %s\n", (*it2).c_str());
                 }
-                seeds.push_back(out);
             }
             if (kTestFiles.empty()) {
                 klee_error("seeds directory is empty: %s\n", (*it).c_str());
@@ -1573,6 +2249,10 @@ int main(int argc, char **argv, char **envp) {
             }
         }
         interpreter->runFunctionAsMain(mainFn, pArgc, pArgv, pEnvp);
+        if (DistributedWorkers) {
+            isDistributedWorker = runDistributedCoordinator(
+                    *handler, *interpreter, mainFn, pArgc, pArgv, pEnvp);
+        }
 
         while (!seeds.empty()) {
             kTest_free(seeds.back());
@@ -1580,6 +2260,8 @@ int main(int argc, char **argv, char **envp) {
         }
     }
 
+    handler->flushTestCases();
+
     auto endTime = std::time(nullptr);
     { // output end and elapsed time
         std::uint32_t h;
@@ -1645,18 +2327,22 @@ int main(int argc, char **argv, char **envp) {
      << "KLEE: done: generated tests = "
           << handler->getNumTestCases() << '\n';
 
-    bool useColors = llvm::errs().is_displayed();
-    if (useColors)
-        llvm::errs().changeColor(llvm::raw_ostream::GREEN,
-                /*bold=*/true,
-                /*bg=*/false);
+    // The coordinator reports the merged results of the workers.
+    if (!isDistributedWorker) {
+        bool useColors = llvm::errs().is_displayed();
+        if (useColors)
+            llvm::errs().changeColor(llvm::raw_ostream::GREEN,
+                    /*bold=*/true,
+                    /*bg=*/false);
 
-    llvm::errs() << stats.str();
+        llvm::errs() << stats.str();
 
-    if (useColors)
-        llvm::errs().resetColor();
+        if (useColors)
+            llvm::errs().resetColor();
+    }
 
     handler->getInfoStream() << stats.str();
 
+    theHandler = nullptr;
     return 0;
 }
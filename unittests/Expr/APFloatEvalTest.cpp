@@ -0,0 +1,110 @@
+//===-- APFloatEvalTest.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/Expr.h"
+#include "klee/util/APFloatEval.h"
+
+#include "llvm/ADT/APFloat.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+const unsigned NumOperations = 1000;
+
+/// A chain of fp80 arithmetic like the runs which the executor evaluates
+/// under one HostRoundingModeScope (see Executor::executeNativeFP80Run):
+/// x = x * 1.1 + 0.3 - x / 7.
+ref<ConstantExpr> evalChain(llvm::APFloat::roundingMode rm) {
+  const llvm::fltSemantics &sem = ConstantExpr::widthToFloatSemantics(80);
+  ref<ConstantExpr> x = ConstantExpr::alloc(llvm::APFloat(sem, 2));
+  ref<ConstantExpr> a = ConstantExpr::alloc(llvm::APFloat(sem, "1.1"));
+  ref<ConstantExpr> b = ConstantExpr::alloc(llvm::APFloat(sem, "0.3"));
+  ref<ConstantExpr> c = ConstantExpr::alloc(llvm::APFloat(sem, 7));
+  for (unsigned i = 0; i < NumOperations; i += 4)
+    x = x->FMul(a, rm)->FAdd(b, rm)->FSub(x->FDiv(c, rm), rm);
+  return x;
+}
+
+#if defined(__x86_64__)
+TEST(APFloatEvalTest, ScopeSharesSwitch) {
+  const auto rm = llvm::APFloat::rmTowardPositive;
+  std::uint64_t before = HostRoundingModeScope::getNumSwitches();
+  ref<ConstantExpr> separate = evalChain(rm);
+  EXPECT_EQ(NumOperations, HostRoundingModeScope::getNumSwitches() - before);
+
+  before = HostRoundingModeScope::getNumSwitches();
+  ref<ConstantExpr> shared;
+  {
+    HostRoundingModeScope scope(rm);
+    shared = evalChain(rm);
+  }
+  EXPECT_EQ(1u, HostRoundingModeScope::getNumSwitches() - before);
+  EXPECT_EQ(separate->getAPValue(), shared->getAPValue());
+
+  // The result depends on the rounding mode, so the mode was in effect.
+  EXPECT_NE(separate->getAPValue(),
+            evalChain(llvm::APFloat::rmTowardNegative)->getAPValue());
+}
+
+TEST(APFloatEvalTest, NestedScopes) {
+  const auto up = llvm::APFloat::rmTowardPositive;
+  const auto down = llvm::APFloat::rmTowardNegative;
+  ref<ConstantExpr> expected = evalChain(down);
+  {
+    HostRoundingModeScope outer(up);
+    {
+      HostRoundingModeScope inner(down);
+      EXPECT_EQ(expected->getAPValue(), evalChain(down)->getAPValue());
+      EXPECT_EQ(FE_DOWNWARD, fegetround());
+    }
+    EXPECT_EQ(FE_UPWARD, fegetround());
+  }
+  EXPECT_EQ(FE_TONEAREST, fegetround());
+}
+#endif
+
+TEST(APFloatEvalTest, NearestNeedsNoSwitch) {
+  std::uint64_t before = HostRoundingModeScope::getNumSwitches();
+  evalChain(llvm::APFloat::rmNearestTiesToEven);
+  EXPECT_EQ(0u, HostRoundingModeScope::getNumSwitches() - before);
+}
+
+// Run with --gtest_also_run_disabled_tests to compare the cost of a switch
+// per operation with one switch for the whole chain, as in the executor.
+TEST(APFloatEvalTest, DISABLED_Benchmark) {
+  const auto rm = llvm::APFloat::rmTowardZero;
+  const unsigned repetitions = 200;
+  auto measure = [&](bool shared) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < repetitions; ++i) {
+      if (shared) {
+        HostRoundingModeScope scope(rm);
+        evalChain(rm);
+      } else {
+        evalChain(rm);
+      }
+    }
+    return std::chrono::duration<double, std::micro>(
+               std::chrono::steady_clock::now() - start)
+               .count();
+  };
+  double separate = measure(false), shared = measure(true);
+  std::printf("%u fp80 operations: %.0fus with a switch per operation, "
+              "%.0fus with a shared switch\n",
+              repetitions * NumOperations, separate, shared);
+}
+
+} // namespace
@@ -0,0 +1,54 @@
+//===-- ArrayCacheTest.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+TEST(ArrayCacheTest, ConstantArraysAreSharedByContents) {
+  ArrayCache cache;
+  std::vector<uint8_t> contents = {1, 2, 3, 4};
+  EXPECT_EQ(nullptr, cache.findConstantArray(contents));
+
+  const Array *a = cache.CreateConstantArray("a", contents);
+  ASSERT_TRUE(a->isConstantArray());
+  EXPECT_EQ("a", a->name);
+  EXPECT_EQ(4u, a->size);
+  EXPECT_EQ(3u, a->constantValues[2]->getZExtValue());
+
+  // The name of a later array with the same contents is ignored.
+  EXPECT_EQ(a, cache.CreateConstantArray("b", contents));
+  EXPECT_EQ(a, cache.findConstantArray(contents));
+
+  contents[3] = 5;
+  EXPECT_EQ(nullptr, cache.findConstantArray(contents));
+  const Array *c = cache.CreateConstantArray("c", contents);
+  EXPECT_NE(a, c);
+  EXPECT_EQ(5u, c->constantValues[3]->getZExtValue());
+
+  contents.push_back(0);
+  EXPECT_EQ(nullptr, cache.findConstantArray(contents));
+}
+
+TEST(ArrayCacheTest, NamedConstantArraysAreDistinct) {
+  ArrayCache cache;
+  std::vector<ref<ConstantExpr>> values(2, ConstantExpr::create(1, Expr::Int8));
+  const Array *a = cache.CreateArray("a", 2, values.data(), values.data() + 2);
+  const Array *b = cache.CreateArray("b", 2, values.data(), values.data() + 2);
+  EXPECT_NE(a, b);
+  EXPECT_EQ(nullptr, cache.findConstantArray({1, 1}));
+}
+
+} // namespace
@@ -0,0 +1,108 @@
+//===-- ArrayCanonicalizerTest.cpp ----------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/ArrayCanonicalizer.h"
+#include "klee/Expr/Expr.h"
+
+using namespace klee;
+
+namespace {
+
+ArrayCache AC;
+
+/// x[0] + y[0] < y[1], where y has been updated at index x[1].
+ref<Expr> makeExpr(const Array *x, const Array *y) {
+  ref<Expr> x0 = ReadExpr::create(UpdateList(x, nullptr),
+                                  ConstantExpr::create(0, Expr::Int32));
+  ref<Expr> x1 = ReadExpr::create(UpdateList(x, nullptr),
+                                  ConstantExpr::create(1, Expr::Int32));
+  UpdateList yUpdates(y, nullptr);
+  yUpdates.extend(ZExtExpr::create(x1, Expr::Int32), x0);
+  ref<Expr> y0 = ReadExpr::create(UpdateList(y, nullptr),
+                                  ConstantExpr::create(0, Expr::Int32));
+  ref<Expr> y1 =
+      ReadExpr::create(yUpdates, ConstantExpr::create(1, Expr::Int32));
+  return UltExpr::create(AddExpr::create(x0, y0), y1);
+}
+
+TEST(ArrayCanonicalizerTest, EqualUpToNames) {
+  CanonicalArrayCache cache;
+  const Array *a = AC.CreateArray("a", 2), *b = AC.CreateArray("b", 2);
+  const Array *c = AC.CreateArray("c", 2), *d = AC.CreateArray("d", 2);
+
+  ArrayCanonicalizer first(cache), second(cache);
+  ref<Expr> e1 = first.visit(makeExpr(a, b));
+  ref<Expr> e2 = second.visit(makeExpr(c, d));
+  EXPECT_EQ(0, e1->compare(*e2));
+  EXPECT_NE(makeExpr(a, b), makeExpr(c, d));
+
+  // Both canonicalizers number the arrays the same and map back to their
+  // own originals.
+  EXPECT_EQ(first.getCanonical(a), second.getCanonical(c));
+  EXPECT_EQ(first.getCanonical(b), second.getCanonical(d));
+  EXPECT_NE(first.getCanonical(a), first.getCanonical(b));
+  EXPECT_EQ(a, first.getOriginal(first.getCanonical(a)));
+  EXPECT_EQ(d, second.getOriginal(second.getCanonical(d)));
+  EXPECT_EQ(nullptr, first.getCanonical(c));
+}
+
+TEST(ArrayCanonicalizerTest, OrderOfOccurrence) {
+  CanonicalArrayCache cache;
+  const Array *a = AC.CreateArray("a", 2), *b = AC.CreateArray("b", 2);
+
+  // Swapping the roles of the arrays gives the same canonical expression.
+  ArrayCanonicalizer first(cache), second(cache);
+  ref<Expr> e1 = first.visit(makeExpr(a, b));
+  ref<Expr> e2 = second.visit(makeExpr(b, a));
+  EXPECT_EQ(0, e1->compare(*e2));
+  EXPECT_EQ(first.getCanonical(a), second.getCanonical(b));
+
+  // Distinct arrays stay distinct.
+  ArrayCanonicalizer third(cache);
+  ref<Expr> e3 = third.visit(makeExpr(a, a));
+  EXPECT_NE(0, e1->compare(*e3));
+}
+
+TEST(ArrayCanonicalizerTest, ArrayShapes) {
+  CanonicalArrayCache cache;
+  std::vector<ref<ConstantExpr>> ones(2, ConstantExpr::create(1, Expr::Int8));
+  std::vector<ref<ConstantExpr>> twos(2, ConstantExpr::create(2, Expr::Int8));
+  const Array *small = AC.CreateArray("s", 2), *large = AC.CreateArray("l", 4);
+  const Array *c1 = AC.CreateArray("c1", 2, ones.data(), ones.data() + 2);
+  const Array *c2 = AC.CreateArray("c2", 2, twos.data(), twos.data() + 2);
+  const Array *c3 = AC.CreateArray("c3", 2, ones.data(), ones.data() + 2);
+
+  // The first array of every query has the same number, so only the shape
+  // and contents tell the canonical arrays apart.
+  const Array *index = AC.CreateArray("i", 4);
+  auto canonical = [&](const Array *array) {
+    ArrayCanonicalizer canonicalizer(cache);
+    canonicalizer.visit(ReadExpr::create(
+        UpdateList(array, nullptr), Expr::createTempRead(index, Expr::Int32)));
+    return canonicalizer.getCanonical(array);
+  };
+  EXPECT_NE(canonical(small), canonical(large));
+  EXPECT_NE(canonical(c1), canonical(c2));
+  EXPECT_EQ(canonical(c1), canonical(c3));
+  EXPECT_TRUE(canonical(c1)->isConstantArray());
+  EXPECT_EQ(ones, canonical(c1)->constantValues);
+}
+
+TEST(ArrayCanonicalizerTest, ConstantsAreUnchanged) {
+  CanonicalArrayCache cache;
+  ArrayCanonicalizer canonicalizer(cache);
+  ref<Expr> e = AddExpr::create(ConstantExpr::create(1, Expr::Int32),
+                                ConstantExpr::create(2, Expr::Int32));
+  EXPECT_EQ(e.get(), canonicalizer.visit(e).get());
+}
+
+} // namespace
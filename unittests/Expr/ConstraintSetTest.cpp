@@ -0,0 +1,201 @@
+//===-- ConstraintSetTest.cpp ---------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+ArrayCache AC;
+const Array *array = AC.CreateArray("arr", 1024);
+
+/// The constraint arr[i] == i % 256.
+ref<Expr> makeConstraint(unsigned i) {
+  return EqExpr::create(
+      ReadExpr::create(UpdateList(array, nullptr),
+                       ConstantExpr::create(i, Expr::Int32)),
+      ConstantExpr::create(i % 256, Expr::Int8));
+}
+
+std::vector<ref<Expr>> toVector(const ConstraintSet &cs) {
+  return std::vector<ref<Expr>>(cs.begin(), cs.end());
+}
+
+TEST(ConstraintSetTest, Iteration) {
+  ConstraintSet cs;
+  EXPECT_TRUE(cs.empty());
+  EXPECT_EQ(cs.begin(), cs.end());
+
+  std::vector<ref<Expr>> expected;
+  for (unsigned i = 0; i < 100; ++i) {
+    expected.push_back(makeConstraint(i));
+    cs.push_back(expected.back());
+  }
+  EXPECT_EQ(100u, cs.size());
+  EXPECT_EQ(expected, toVector(cs));
+  EXPECT_EQ(100, cs.end() - cs.begin());
+  EXPECT_EQ(expected[70], *(cs.begin() + 70));
+  EXPECT_EQ(expected[99], *--cs.end());
+  EXPECT_TRUE(ConstraintSet(expected) == cs);
+}
+
+TEST(ConstraintSetTest, CopiesDiverge) {
+  // Fork in the middle of a chunk and at a chunk boundary.
+  for (unsigned prefix : {40u, 64u}) {
+    ConstraintSet parent;
+    std::vector<ref<Expr>> expected;
+    for (unsigned i = 0; i < prefix; ++i) {
+      expected.push_back(makeConstraint(i));
+      parent.push_back(expected.back());
+    }
+
+    ConstraintSet child(parent);
+    EXPECT_TRUE(child == parent);
+    std::vector<ref<Expr>> expectedParent(expected), expectedChild(expected);
+    for (unsigned i = 0; i < 50; ++i) {
+      expectedParent.push_back(makeConstraint(prefix + i));
+      parent.push_back(expectedParent.back());
+      expectedChild.push_back(makeConstraint(prefix + 100 + i));
+      child.push_back(expectedChild.back());
+    }
+    EXPECT_EQ(expectedParent, toVector(parent));
+    EXPECT_EQ(expectedChild, toVector(child));
+    EXPECT_FALSE(child == parent);
+  }
+}
+
+TEST(ConstraintSetTest, IteratorsSurviveSharedGrowth) {
+  ConstraintSet a;
+  a.push_back(makeConstraint(0));
+  ConstraintSet b(a);
+
+  // Growing b must not move the constraints a is iterating over.
+  auto it = a.begin();
+  const ref<Expr> *first = &*it;
+  for (unsigned i = 1; i < 100; ++i)
+    b.push_back(makeConstraint(i));
+  EXPECT_EQ(first, &*it);
+  EXPECT_EQ(1u, a.size());
+  EXPECT_EQ(100u, b.size());
+}
+
+/// A read of \a name at constant \a index.
+ref<Expr> readAt(const char *name, unsigned index) {
+  return ReadExpr::create(UpdateList(AC.CreateArray(name, 16), nullptr),
+                          ConstantExpr::create(index, Expr::Int32));
+}
+
+ref<Expr> isZero(ref<Expr> e) { return Expr::createIsZero(e); }
+
+TEST(ConstraintSetTest, DependentConstraints) {
+  ref<Expr> c0 = isZero(readAt("a", 0));
+  ref<Expr> c1 = isZero(readAt("b", 0));
+  ref<Expr> c2 = EqExpr::create(readAt("a", 1), readAt("c", 0));
+  // Reads c at a symbolic index, so it depends on all bytes of c.
+  ref<Expr> c3 = isZero(ReadExpr::create(
+      UpdateList(AC.CreateArray("c", 16), nullptr),
+      ZExtExpr::create(readAt("d", 0), Expr::Int32)));
+  ConstraintSet cs(std::vector<ref<Expr>>{c0, c1, c2, c3});
+
+  std::vector<ref<Expr>> result;
+  cs.getDependentConstraints(isZero(readAt("a", 0)), result);
+  EXPECT_EQ(std::vector<ref<Expr>>({c0}), result);
+
+  result.clear();
+  cs.getDependentConstraints(isZero(readAt("c", 5)), result);
+  EXPECT_EQ(std::vector<ref<Expr>>({c2, c3}), result);
+
+  result.clear();
+  cs.getDependentConstraints(isZero(readAt("e", 0)), result);
+  EXPECT_TRUE(result.empty());
+
+  // Extending a copy joins factors in the copy only.
+  ConstraintSet copy(cs);
+  ref<Expr> c4 = EqExpr::create(readAt("a", 0), readAt("b", 0));
+  copy.push_back(c4);
+  result.clear();
+  copy.getDependentConstraints(isZero(readAt("b", 0)), result);
+  EXPECT_EQ(std::vector<ref<Expr>>({c0, c1, c4}), result);
+  result.clear();
+  cs.getDependentConstraints(isZero(readAt("b", 0)), result);
+  EXPECT_EQ(std::vector<ref<Expr>>({c1}), result);
+
+  // A query can join factors too.
+  result.clear();
+  cs.getDependentConstraints(
+      EqExpr::create(readAt("a", 1), readAt("b", 0)), result);
+  EXPECT_EQ(std::vector<ref<Expr>>({c1, c2, c3}), result);
+}
+
+TEST(ConstraintSetTest, DependentConstraintsAfterRewrite) {
+  ref<Expr> c0 = UltExpr::create(readAt("a", 1), ConstantExpr::create(10, 8));
+  ref<Expr> c1 = isZero(readAt("b", 0));
+  ref<Expr> c2 = UltExpr::create(readAt("a", 0), readAt("a", 1));
+  ConstraintSet cs;
+  ConstraintManager cm(cs);
+  for (const auto &c : {c0, c1, c2})
+    cm.addConstraint(c);
+  std::vector<ref<Expr>> result;
+  cs.getDependentConstraints(isZero(readAt("b", 0)), result);
+  EXPECT_EQ(std::vector<ref<Expr>>({c1}), result);
+
+  // a[1] == 5 turns c0 into true, which is dropped, and rewrites c2, so the
+  // partition has to follow c1 to the front.
+  ref<Expr> eq =
+      EqExpr::create(ConstantExpr::create(5, Expr::Int8), readAt("a", 1));
+  cm.addConstraint(eq);
+  std::vector<ref<Expr>> constraints(cs.begin(), cs.end());
+  ASSERT_EQ(3u, constraints.size());
+  EXPECT_EQ(c1, constraints[0]);
+  EXPECT_EQ(eq, constraints[2]);
+
+  result.clear();
+  cs.getDependentConstraints(isZero(readAt("b", 0)), result);
+  EXPECT_EQ(std::vector<ref<Expr>>({c1}), result);
+  result.clear();
+  cs.getDependentConstraints(isZero(readAt("a", 0)), result);
+  EXPECT_EQ(std::vector<ref<Expr>>({constraints[1], eq}), result);
+}
+
+TEST(ConstraintSetTest, Hash) {
+  ConstraintSet a, b;
+  EXPECT_EQ(a.hash(), b.hash());
+  for (unsigned i = 0; i < 70; ++i) {
+    a.push_back(makeConstraint(i));
+    b.push_back(makeConstraint(i));
+  }
+  EXPECT_EQ(a.hash(), b.hash());
+
+  // Copies which diverge in a shared chunk hash their own constraints.
+  ConstraintSet c(a);
+  a.push_back(makeConstraint(100));
+  c.push_back(makeConstraint(101));
+  b.push_back(makeConstraint(101));
+  EXPECT_NE(a.hash(), c.hash());
+  EXPECT_EQ(b.hash(), c.hash());
+  EXPECT_TRUE(b == c);
+
+  // The order of the constraints matters.
+  ConstraintSet d, e;
+  d.push_back(makeConstraint(1));
+  d.push_back(makeConstraint(2));
+  e.push_back(makeConstraint(2));
+  e.push_back(makeConstraint(1));
+  EXPECT_NE(d.hash(), e.hash());
+  EXPECT_FALSE(d == e);
+}
+
+} // namespace
@@ -264,4 +264,35 @@ TEST(ExprTest, ReadExprFoldingSymbolicIndexUpdate) {
     EXPECT_EQ(Expr::Read, read.get()->getKind());
   }
 }
+
+TEST(ExprTest, HashConsing) {
+  Expr::hashConsing = true;
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 4);
+  auto makeSum = [&]() {
+    return AddExpr::create(Expr::createTempRead(array, Expr::Int32),
+                           ConstantExpr::create(7, Expr::Int32));
+  };
+
+  ref<Expr> a = makeSum(), b = makeSum();
+  EXPECT_EQ(a.get(), b.get());
+  EXPECT_NE(a.get(), SubExpr::create(Expr::createTempRead(array, Expr::Int32),
+                                     ConstantExpr::create(7, Expr::Int32))
+                         .get());
+
+  // Float and integer constants with the same bits stay apart.
+  ref<ConstantExpr> i = ConstantExpr::create(0x3f800000, Expr::Int32);
+  ref<ConstantExpr> f = ConstantExpr::alloc(llvm::APFloat(1.0f));
+  EXPECT_NE(i.get(), f.get());
+  EXPECT_TRUE(f->isFloat());
+  EXPECT_EQ(f.get(), ConstantExpr::alloc(llvm::APFloat(1.0f)).get());
+
+  // Expressions are dropped from the table once they die.
+  a = b = nullptr;
+  ref<Expr> c = makeSum();
+  EXPECT_EQ(c.get(), makeSum().get());
+
+  Expr::hashConsing = false;
+  EXPECT_NE(c.get(), makeSum().get());
+}
 }
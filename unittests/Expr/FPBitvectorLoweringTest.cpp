@@ -0,0 +1,239 @@
+//===-- FPBitvectorLoweringTest.cpp ---------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/Expr.h"
+#include "klee/Expr/FPBitvectorLowering.h"
+
+#include "llvm/ADT/APFloat.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+const llvm::APFloat::roundingMode roundingModes[] = {
+    llvm::APFloat::rmNearestTiesToEven, llvm::APFloat::rmNearestTiesToAway,
+    llvm::APFloat::rmTowardPositive, llvm::APFloat::rmTowardNegative,
+    llvm::APFloat::rmTowardZero};
+
+bool isNaNConstant(const ref<ConstantExpr> &ce) {
+  if (ce->getWidth() == Expr::Bool ||
+      &ConstantExpr::widthToFloatSemantics(ce->getWidth()) ==
+          &llvm::APFloat::Bogus())
+    return false;
+  return ce->getAPFloatValue().isNaN();
+}
+
+/// Lower \a e, whose operands are all constants, and check the result folds
+/// to the same constant as evaluating \a e directly. NaN results only need
+/// to agree on being NaN.
+void checkLowering(const ref<Expr> &e, const ref<Expr> &expected) {
+  ref<ConstantExpr> want = dyn_cast<ConstantExpr>(expected);
+  ASSERT_TRUE(!want.isNull());
+  ref<ConstantExpr> got = dyn_cast<ConstantExpr>(lowerFloatingPoint(e));
+  ASSERT_TRUE(!got.isNull());
+  ASSERT_EQ(want->getWidth(), got->getWidth());
+  if (isNaNConstant(want) && isNaNConstant(got))
+    return;
+  std::string str;
+  llvm::raw_string_ostream os(str);
+  e->print(os);
+  EXPECT_EQ(want->getAPValue(), got->getAPValue()) << os.str();
+}
+
+/// The IEEE-754 remainder of \a a and \a b, which the lowering of FRem
+/// follows, unlike the constant folding.
+ref<Expr> ieeeRemainder(const ref<ConstantExpr> &a,
+                        const ref<ConstantExpr> &b) {
+  llvm::APFloat result = a->getAPFloatValue();
+  result.remainder(b->getAPFloatValue());
+  return ConstantExpr::alloc(result);
+}
+
+/// Interesting values of the given width: zeros, infinities, NaN, the
+/// smallest and largest subnormals and normals, small integers, halves and
+/// random bit patterns.
+std::vector<ref<ConstantExpr>> sampleValues(Expr::Width width,
+                                            unsigned randomCount) {
+  const llvm::fltSemantics &sem = ConstantExpr::widthToFloatSemantics(width);
+  std::vector<llvm::APFloat> floats = {
+      llvm::APFloat::getZero(sem, false),
+      llvm::APFloat::getZero(sem, true),
+      llvm::APFloat::getInf(sem, false),
+      llvm::APFloat::getInf(sem, true),
+      llvm::APFloat::getNaN(sem),
+      llvm::APFloat::getSmallest(sem, false),
+      llvm::APFloat::getSmallest(sem, true),
+      llvm::APFloat::getSmallestNormalized(sem, false),
+      llvm::APFloat::getLargest(sem, false),
+      llvm::APFloat::getLargest(sem, true)};
+  for (int i = -5; i <= 5; ++i) {
+    llvm::APFloat f(sem, i);
+    floats.push_back(f);
+    llvm::APFloat half(sem, 2 * i + 1);
+    half.divide(llvm::APFloat(sem, 2), llvm::APFloat::rmNearestTiesToEven);
+    floats.push_back(half);
+  }
+  llvm::APFloat subnormal = llvm::APFloat::getSmallestNormalized(sem, true);
+  subnormal.next(/*nextDown=*/false);
+  floats.push_back(subnormal);
+
+  std::vector<ref<ConstantExpr>> values;
+  for (const llvm::APFloat &f : floats)
+    values.push_back(ConstantExpr::alloc(f));
+
+  std::mt19937_64 rng(width);
+  for (unsigned i = 0; i < randomCount; ++i) {
+    uint64_t words[2] = {rng(), rng()};
+    values.push_back(ConstantExpr::alloc(
+        llvm::APInt(width, llvm::makeArrayRef(words, (width + 63) / 64))));
+  }
+  return values;
+}
+
+const Expr::Width testedWidths[] = {Expr::Int16, Expr::Int32, Expr::Int64};
+
+TEST(FPBitvectorLoweringTest, BinaryArithmetic) {
+  for (Expr::Width width : testedWidths) {
+    auto values = sampleValues(width, 12);
+    for (auto &a : values) {
+      for (auto &b : values) {
+        for (auto rm : roundingModes) {
+          checkLowering(FAddExpr::alloc(a, b, rm), FAddExpr::create(a, b, rm));
+          checkLowering(FSubExpr::alloc(a, b, rm), FSubExpr::create(a, b, rm));
+          checkLowering(FMulExpr::alloc(a, b, rm), FMulExpr::create(a, b, rm));
+          checkLowering(FDivExpr::alloc(a, b, rm), FDivExpr::create(a, b, rm));
+        }
+        auto rm = llvm::APFloat::rmNearestTiesToEven;
+        checkLowering(FRemExpr::alloc(a, b, rm), ieeeRemainder(a, b));
+        // Constant folding gives NaN if either operand is NaN, the lowering
+        // follows fp.max and fp.min instead.
+        if (isNaNConstant(a) || isNaNConstant(b))
+          continue;
+        checkLowering(FMaxExpr::alloc(a, b, rm), FMaxExpr::create(a, b, rm));
+        checkLowering(FMinExpr::alloc(a, b, rm), FMinExpr::create(a, b, rm));
+      }
+    }
+  }
+}
+
+TEST(FPBitvectorLoweringTest, Comparisons) {
+  for (Expr::Width width : testedWidths) {
+    auto values = sampleValues(width, 12);
+    for (auto &a : values) {
+      for (auto &b : values) {
+        checkLowering(FOEqExpr::alloc(a, b), FOEqExpr::create(a, b));
+        checkLowering(FOLtExpr::alloc(a, b), FOLtExpr::create(a, b));
+        checkLowering(FOLeExpr::alloc(a, b), FOLeExpr::create(a, b));
+        checkLowering(FOGtExpr::alloc(a, b), FOGtExpr::create(a, b));
+        checkLowering(FOGeExpr::alloc(a, b), FOGeExpr::create(a, b));
+      }
+    }
+  }
+}
+
+TEST(FPBitvectorLoweringTest, UnaryOperations) {
+  for (Expr::Width width : testedWidths) {
+    for (auto &a : sampleValues(width, 200)) {
+      for (auto rm : roundingModes) {
+        // Concrete square roots are evaluated natively, which has neither
+        // half precision nor rounding to nearest with ties away from zero.
+        if (width != Expr::Int16 && rm != llvm::APFloat::rmNearestTiesToAway)
+          checkLowering(FSqrtExpr::alloc(a, rm), FSqrtExpr::create(a, rm));
+        checkLowering(FRintExpr::alloc(a, rm), FRintExpr::create(a, rm));
+      }
+      checkLowering(FAbsExpr::alloc(a), FAbsExpr::create(a));
+      checkLowering(FNegExpr::alloc(a), FNegExpr::create(a));
+      checkLowering(IsNaNExpr::alloc(a), IsNaNExpr::create(a));
+      checkLowering(IsInfiniteExpr::alloc(a), IsInfiniteExpr::create(a));
+      checkLowering(IsNormalExpr::alloc(a), IsNormalExpr::create(a));
+      checkLowering(IsSubnormalExpr::alloc(a), IsSubnormalExpr::create(a));
+    }
+  }
+}
+
+TEST(FPBitvectorLoweringTest, Conversions) {
+  for (Expr::Width from : testedWidths) {
+    for (auto &a : sampleValues(from, 200)) {
+      for (auto rm : roundingModes) {
+        for (Expr::Width to : testedWidths) {
+          if (to > from)
+            checkLowering(FPExtExpr::alloc(a, to), FPExtExpr::create(a, to));
+          else if (to < from)
+            checkLowering(FPTruncExpr::alloc(a, to, rm),
+                          FPTruncExpr::create(a, to, rm));
+        }
+        for (Expr::Width to : {Expr::Int8, Expr::Int32, Expr::Int64}) {
+          checkLowering(FPToUIExpr::alloc(a, to, rm),
+                        FPToUIExpr::create(a, to, rm));
+          checkLowering(FPToSIExpr::alloc(a, to, rm),
+                        FPToSIExpr::create(a, to, rm));
+        }
+      }
+    }
+  }
+
+  std::mt19937_64 rng(0);
+  for (unsigned i = 0; i < 200; ++i) {
+    for (Expr::Width from : {Expr::Int8, Expr::Int32, Expr::Int64}) {
+      ref<ConstantExpr> a = ConstantExpr::create(
+          rng() & (i < 100 ? 0xFFFF : ~UINT64_C(0)) &
+              (from == 64 ? ~UINT64_C(0) : (UINT64_C(1) << from) - 1),
+          from);
+      for (auto rm : roundingModes) {
+        for (Expr::Width to : testedWidths) {
+          checkLowering(UIToFPExpr::alloc(a, to, rm),
+                        UIToFPExpr::create(a, to, rm));
+          checkLowering(SIToFPExpr::alloc(a, to, rm),
+                        SIToFPExpr::create(a, to, rm));
+        }
+      }
+    }
+  }
+}
+
+TEST(FPBitvectorLoweringTest, X87Operations) {
+  const llvm::fltSemantics &sem = llvm::APFloat::x87DoubleExtended();
+  std::vector<ref<ConstantExpr>> values;
+  for (double d : {0.0, -0.0, 1.0, -2.5, 3.0, 1e300, 1e-310})
+    values.push_back(ConstantExpr::alloc(llvm::APFloat(d)));
+  for (auto &v : values)
+    v = cast<ConstantExpr>(FPExtExpr::create(v, Expr::Fl80));
+  values.push_back(ConstantExpr::alloc(llvm::APFloat::getInf(sem, true)));
+  values.push_back(ConstantExpr::alloc(llvm::APFloat::getSmallest(sem, false)));
+
+  auto rm = llvm::APFloat::rmNearestTiesToEven;
+  for (auto &a : values) {
+    for (auto &b : values) {
+      checkLowering(FAddExpr::alloc(a, b, rm), FAddExpr::create(a, b, rm));
+      checkLowering(FMulExpr::alloc(a, b, rm), FMulExpr::create(a, b, rm));
+      checkLowering(FDivExpr::alloc(a, b, rm), FDivExpr::create(a, b, rm));
+      checkLowering(FRemExpr::alloc(a, b, rm), ieeeRemainder(a, b));
+      checkLowering(FOLtExpr::alloc(a, b), FOLtExpr::create(a, b));
+    }
+    checkLowering(FSqrtExpr::alloc(a, rm), FSqrtExpr::create(a, rm));
+    checkLowering(FPTruncExpr::alloc(a, Expr::Int64, rm),
+                  FPTruncExpr::create(a, Expr::Int64, rm));
+  }
+}
+
+TEST(FPBitvectorLoweringTest, Lowerable) {
+  ref<Expr> one = ConstantExpr::alloc(llvm::APFloat(1.0));
+  EXPECT_TRUE(isLowerableFloatingPoint(
+      FRemExpr::alloc(one, one, llvm::APFloat::rmNearestTiesToEven)));
+  EXPECT_FALSE(isLowerableFloatingPoint(AddExpr::alloc(one, one)));
+}
+
+} // namespace
@@ -0,0 +1,119 @@
+//===-- KTestArchiveTest.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/ADT/KTest.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+/// A test with a single object of \a numBytes copies of \a byte.
+struct TestCase {
+  std::vector<unsigned char> bytes;
+  char name[4] = "obj";
+  char arg[5] = "prog";
+  char *args[1] = {arg};
+  KTestObject object;
+  KTest test;
+
+  TestCase(unsigned numBytes, unsigned char byte) : bytes(numBytes, byte) {
+    object = {name, numBytes, bytes.data()};
+    test = {kTest_getCurrentVersion(), 1, args, 0, 0, 1, &object};
+  }
+};
+
+void expectTest(KTest *test, unsigned numBytes, unsigned char byte) {
+  ASSERT_NE(nullptr, test);
+  ASSERT_EQ(1u, test->numArgs);
+  EXPECT_STREQ("prog", test->args[0]);
+  ASSERT_EQ(1u, test->numObjects);
+  EXPECT_STREQ("obj", test->objects[0].name);
+  EXPECT_EQ(std::vector<unsigned char>(numBytes, byte),
+            std::vector<unsigned char>(test->objects[0].bytes,
+                                       test->objects[0].bytes + numBytes));
+  kTest_free(test);
+}
+
+TEST(KTestArchiveTest, AppendAndRead) {
+  const char *path = "archive1.ktests";
+  unlink(path);
+
+  KTestArchive *archive = kTestArchive_open(path, 1);
+  ASSERT_NE(nullptr, archive);
+  TestCase small(4, 'a'), large(4096, 'b');
+  ASSERT_TRUE(kTestArchive_append(archive, &small.test, 1, 0));
+  ASSERT_TRUE(kTestArchive_append(archive, &large.test, 7, 1));
+  ASSERT_TRUE(kTestArchive_close(archive));
+  EXPECT_TRUE(kTest_isKTestArchive(path));
+  EXPECT_FALSE(kTest_isKTestFile(path));
+
+  // Reopening for appending keeps the tests and rewrites the index.
+  archive = kTestArchive_open(path, 1);
+  ASSERT_NE(nullptr, archive);
+  ASSERT_EQ(2u, kTestArchive_numTests(archive));
+  ASSERT_TRUE(kTestArchive_append(archive, &small.test, 8, 1));
+  ASSERT_TRUE(kTestArchive_close(archive));
+
+  archive = kTestArchive_open(path, 0);
+  ASSERT_NE(nullptr, archive);
+  ASSERT_EQ(3u, kTestArchive_numTests(archive));
+  EXPECT_EQ(1u, kTestArchive_getID(archive, 0));
+  EXPECT_EQ(7u, kTestArchive_getID(archive, 1));
+  EXPECT_EQ(8u, kTestArchive_getID(archive, 2));
+  expectTest(kTestArchive_read(archive, 1), 4096, 'b');
+  expectTest(kTestArchive_read(archive, 0), 4, 'a');
+  expectTest(kTestArchive_read(archive, 2), 4, 'a');
+  EXPECT_EQ(nullptr, kTestArchive_read(archive, 3));
+  EXPECT_TRUE(kTestArchive_close(archive));
+  unlink(path);
+}
+
+TEST(KTestArchiveTest, MissingIndex) {
+  const char *path = "archive2.ktests";
+  unlink(path);
+
+  KTestArchive *archive = kTestArchive_open(path, 1);
+  ASSERT_NE(nullptr, archive);
+  TestCase test(16, 'c');
+  ASSERT_TRUE(kTestArchive_append(archive, &test.test, 1, 0));
+  ASSERT_TRUE(kTestArchive_append(archive, &test.test, 2, 0));
+  ASSERT_TRUE(kTestArchive_close(archive));
+
+  // Cut off the index and the last byte of the last record, as if the
+  // process writing the archive had been killed.
+  FILE *f = fopen(path, "rb");
+  ASSERT_NE(nullptr, f);
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fclose(f);
+  long indexSize = 4 + 4 + 2 * (4 + 8) + 8 + 4;
+  ASSERT_EQ(0, truncate(path, size - indexSize - 1));
+
+  archive = kTestArchive_open(path, 1);
+  ASSERT_NE(nullptr, archive);
+  ASSERT_EQ(1u, kTestArchive_numTests(archive));
+  ASSERT_TRUE(kTestArchive_append(archive, &test.test, 3, 0));
+  ASSERT_TRUE(kTestArchive_close(archive));
+
+  archive = kTestArchive_open(path, 0);
+  ASSERT_NE(nullptr, archive);
+  ASSERT_EQ(2u, kTestArchive_numTests(archive));
+  EXPECT_EQ(3u, kTestArchive_getID(archive, 1));
+  expectTest(kTestArchive_read(archive, 1), 16, 'c');
+  EXPECT_TRUE(kTestArchive_close(archive));
+  unlink(path);
+}
+
+} // namespace
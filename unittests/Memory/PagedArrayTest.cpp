@@ -0,0 +1,237 @@
+//===-- PagedArrayTest.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "Core/PagedArray.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+typedef PagedArray<std::uint8_t> ByteArray;
+const unsigned PageSize = ByteArray::PageSize;
+
+TEST(PagedArrayTest, UnwrittenPagesAreNotAllocated) {
+  std::uint64_t before = PagedArrayStats::privateBytes;
+  {
+    ByteArray a(3 * PageSize + 5, 7);
+    EXPECT_EQ(before, PagedArrayStats::privateBytes);
+    EXPECT_EQ(7, a.get(0));
+    EXPECT_EQ(7, a.get(3 * PageSize + 4));
+
+    a.set(PageSize + 1, 1);
+    EXPECT_LT(before, PagedArrayStats::privateBytes);
+    EXPECT_EQ(1, a.get(PageSize + 1));
+    EXPECT_EQ(7, a.get(PageSize));
+
+    a.fill(0);
+    EXPECT_EQ(before, PagedArrayStats::privateBytes);
+    EXPECT_EQ(0, a.get(PageSize + 1));
+  }
+  EXPECT_EQ(before, PagedArrayStats::privateBytes);
+}
+
+TEST(PagedArrayTest, PagesOnlyHoldTheirElements) {
+  std::uint64_t before = PagedArrayStats::privateBytes;
+  {
+    ByteArray small(4);
+    small.set(1, 1);
+    EXPECT_GT(before + 64, PagedArrayStats::privateBytes);
+
+    ByteArray a(PageSize + 10);
+    a.set(PageSize + 1, 2);
+    EXPECT_GT(before + 128, PagedArrayStats::privateBytes);
+
+    // Growing the array grows its partial last page.
+    a.resize(2 * PageSize);
+    a.set(2 * PageSize - 1, 3);
+    EXPECT_EQ(2, a.get(PageSize + 1));
+    EXPECT_EQ(0, a.get(PageSize + 10));
+    EXPECT_EQ(3, a.get(2 * PageSize - 1));
+  }
+  EXPECT_EQ(before, PagedArrayStats::privateBytes);
+}
+
+TEST(PagedArrayTest, NonTrivialElements) {
+  auto value = std::make_shared<int>(1);
+  {
+    PagedArray<std::shared_ptr<int>> a(10);
+    a.set(3, value);
+    PagedArray<std::shared_ptr<int>> b(a);
+    b.set(4, value);
+    a.resize(20);
+    EXPECT_EQ(value, a.get(3));
+    EXPECT_EQ(nullptr, a.get(19));
+    EXPECT_EQ(4, value.use_count());
+  }
+  EXPECT_EQ(1, value.use_count());
+}
+
+TEST(PagedArrayTest, CopyOnWrite) {
+  std::uint64_t shared = PagedArrayStats::sharedBytes;
+  ByteArray a(2 * PageSize);
+  a.set(0, 1);
+  a.set(PageSize, 2);
+  {
+    ByteArray b(a);
+    EXPECT_LT(shared, PagedArrayStats::sharedBytes);
+
+    // Writing to b copies only the page written to.
+    b.set(1, 3);
+    EXPECT_EQ(3, b.get(1));
+    EXPECT_EQ(0, a.get(1));
+    EXPECT_EQ(1, b.get(0));
+    EXPECT_EQ(2, b.get(PageSize));
+    EXPECT_LT(shared, PagedArrayStats::sharedBytes);
+
+    b.set(PageSize, 4);
+    EXPECT_EQ(2, a.get(PageSize));
+    EXPECT_EQ(shared, PagedArrayStats::sharedBytes);
+  }
+  EXPECT_EQ(1, a.get(0));
+  EXPECT_EQ(shared, PagedArrayStats::sharedBytes);
+}
+
+TEST(PagedArrayTest, CopyInAndOut) {
+  unsigned size = 2 * PageSize + 3;
+  ByteArray a(size);
+  a.set(PageSize + 2, 9);
+  std::vector<std::uint8_t> buffer(size);
+  a.copyTo(buffer.data());
+  EXPECT_EQ(9, buffer[PageSize + 2]);
+  EXPECT_EQ(0, buffer[size - 1]);
+  EXPECT_TRUE(a.equals(buffer.data()));
+
+  // Assigning unchanged contents keeps the pages shared.
+  ByteArray b(a);
+  std::uint64_t shared = PagedArrayStats::sharedBytes;
+  b.assign(buffer.data());
+  EXPECT_EQ(shared, PagedArrayStats::sharedBytes);
+
+  buffer[size - 1] = 5;
+  EXPECT_FALSE(b.equals(buffer.data()));
+  b.assign(buffer.data());
+  EXPECT_TRUE(b.equals(buffer.data()));
+  EXPECT_EQ(5, b.get(size - 1));
+  EXPECT_EQ(0, a.get(size - 1));
+  EXPECT_EQ(shared, PagedArrayStats::sharedBytes);
+}
+
+TEST(PagedArrayTest, BitArray) {
+  PagedBitArray bits(100, true);
+  PagedBitArray copy(bits);
+  std::uint64_t shared = PagedArrayStats::sharedBytes;
+  EXPECT_TRUE(copy.get(99));
+  // Setting a bit which is already set leaves the page alone.
+  copy.set(42);
+  EXPECT_EQ(shared, PagedArrayStats::sharedBytes);
+  copy.unset(42);
+  EXPECT_FALSE(copy.get(42));
+  EXPECT_TRUE(bits.get(42));
+}
+
+TEST(PagedArrayTest, GrowingBitArray) {
+  PagedBitArray a;
+  EXPECT_EQ(0u, a.getSize());
+  a.resize(5000);
+  ASSERT_LE(5000u, a.getSize());
+  a.set(3);
+  a.set(4999);
+
+  PagedBitArray b(a);
+  b.resize(100000);
+  b.set(99999);
+  EXPECT_GT(100000u, a.getSize());
+
+  std::vector<unsigned> set;
+  b.forEachSet([&](unsigned index) { set.push_back(index); });
+  EXPECT_EQ(std::vector<unsigned>({3, 4999, 99999}), set);
+
+  a.swap(b);
+  EXPECT_TRUE(a.get(99999));
+  EXPECT_GT(100000u, b.getSize());
+  b.clear();
+  set.clear();
+  b.forEachSet([&](unsigned index) { set.push_back(index); });
+  EXPECT_TRUE(set.empty());
+  EXPECT_TRUE(a.get(3));
+}
+
+TEST(PagedArrayTest, CoverageStats) {
+  std::uint64_t objects = PagedArrayStats::privateBytes;
+  std::uint64_t coverage = CoverageArrayStats::privateBytes;
+  {
+    CoverageBitArray covered(1000);
+    covered.set(10);
+    EXPECT_LT(coverage, CoverageArrayStats::privateBytes);
+    EXPECT_EQ(objects, PagedArrayStats::privateBytes);
+  }
+  EXPECT_EQ(coverage, CoverageArrayStats::privateBytes);
+}
+
+TEST(PagedArrayTest, SmallObjectState) {
+  // The storage of a 4-byte ObjectState with one concrete and one symbolic
+  // byte: the concrete store, both masks and the known symbolics.
+  static const int symbolic = 0;
+  std::uint64_t before = PagedArrayStats::privateBytes;
+  {
+    ByteArray concreteStore(4);
+    PagedBitArray concreteMask(4, true), flushMask(4, false);
+    SparsePagedArray<const int *> knownSymbolics(4);
+    concreteStore.set(0, 1);
+    concreteMask.unset(1);
+    flushMask.set(1);
+    knownSymbolics.set(1, &symbolic);
+    EXPECT_GE(before + 64, PagedArrayStats::privateBytes);
+  }
+  EXPECT_EQ(before, PagedArrayStats::privateBytes);
+}
+
+TEST(PagedArrayTest, SparseUntilManyElements) {
+  typedef SparsePagedArray<const int *> Sparse;
+  static const int values[Sparse::MaxSparse + 1] = {};
+  unsigned size = 4 * PageSize;
+  std::uint64_t before = PagedArrayStats::privateBytes;
+
+  Sparse a(size);
+  EXPECT_EQ(nullptr, a.get(17));
+  for (unsigned i = 0; i != Sparse::MaxSparse; ++i)
+    a.set(i * 97, &values[i]);
+  EXPECT_FALSE(a.isDense());
+  EXPECT_EQ(before, PagedArrayStats::privateBytes);
+  EXPECT_EQ(&values[3], a.get(3 * 97));
+  EXPECT_EQ(nullptr, a.get(3 * 97 + 1));
+
+  // Unsetting an element makes room for another one.
+  a.set(3 * 97, nullptr);
+  EXPECT_EQ(nullptr, a.get(3 * 97));
+  a.set(size - 1, &values[3]);
+  EXPECT_FALSE(a.isDense());
+
+  Sparse b(a);
+  b.set(1, &values[Sparse::MaxSparse]);
+  EXPECT_TRUE(b.isDense());
+  EXPECT_FALSE(a.isDense());
+  EXPECT_EQ(nullptr, a.get(1));
+  EXPECT_EQ(&values[Sparse::MaxSparse], b.get(1));
+  EXPECT_EQ(&values[3], b.get(size - 1));
+  EXPECT_EQ(&values[5], b.get(5 * 97));
+
+  b.clear();
+  EXPECT_FALSE(b.isDense());
+  EXPECT_EQ(nullptr, b.get(5 * 97));
+  EXPECT_EQ(before, PagedArrayStats::privateBytes);
+}
+
+} // namespace
@@ -0,0 +1,112 @@
+//===-- CanonicalCachingTest.cpp ------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverCmdLine.h"
+#include "klee/Solver/SolverImpl.h"
+
+#include <memory>
+
+using namespace klee;
+
+namespace {
+ArrayCache AC;
+
+/// A backend which counts the queries it gets and fills every object with
+/// the first character of its name.
+class CountingSolverImpl : public SolverImpl {
+  unsigned &count;
+
+public:
+  explicit CountingSolverImpl(unsigned &count) : count(count) {}
+
+  bool computeTruth(const Query &, bool &isValid) override {
+    ++count;
+    isValid = false;
+    return true;
+  }
+  bool computeValue(const Query &, ref<Expr> &result) override {
+    return false;
+  }
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char>> &values,
+                            bool &hasSolution) override {
+    ++count;
+    for (const auto object : objects)
+      values.emplace_back(object->size, object->name[0]);
+    hasSolution = true;
+    return true;
+  }
+  SolverRunStatus getOperationStatusCode() override {
+    return SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+  }
+};
+
+class CanonicalCachingTest : public ::testing::Test {
+protected:
+  CanonicalCachingTest() { CanonicalizeCachedArrays = true; }
+  ~CanonicalCachingTest() { CanonicalizeCachedArrays = false; }
+
+  /// The query x[0] + y[0] == 0, with x of size 2 and y of size 4.
+  Query makeQuery(const Array *x, const Array *y) {
+    ref<Expr> sum = AddExpr::create(Expr::createTempRead(x, Expr::Int8),
+                                    Expr::createTempRead(y, Expr::Int8));
+    return Query(constraints, EqExpr::create(
+                                  sum, ConstantExpr::create(0, Expr::Int8)));
+  }
+
+  unsigned count = 0;
+  ConstraintSet constraints;
+};
+
+TEST_F(CanonicalCachingTest, BranchCacheIgnoresNames) {
+  std::unique_ptr<Solver> solver(
+      createCachingSolver(new Solver(new CountingSolverImpl(count))));
+  bool isValid;
+  ASSERT_TRUE(solver->impl->computeTruth(
+      makeQuery(AC.CreateArray("a", 2), AC.CreateArray("b", 4)), isValid));
+  ASSERT_TRUE(solver->impl->computeTruth(
+      makeQuery(AC.CreateArray("c", 2), AC.CreateArray("d", 4)), isValid));
+  EXPECT_FALSE(isValid);
+  EXPECT_EQ(1u, count);
+}
+
+TEST_F(CanonicalCachingTest, CexCacheMapsModelsBack) {
+  std::unique_ptr<Solver> solver(
+      createCexCachingSolver(new Solver(new CountingSolverImpl(count))));
+  const Array *a = AC.CreateArray("a", 2), *b = AC.CreateArray("b", 4);
+  const Array *c = AC.CreateArray("c", 2), *d = AC.CreateArray("d", 4);
+  std::vector<std::vector<unsigned char>> values;
+  bool hasSolution;
+  ASSERT_TRUE(solver->impl->computeInitialValues(makeQuery(a, b), {a, b},
+                                                 values, hasSolution));
+  ASSERT_TRUE(hasSolution);
+  EXPECT_EQ(1u, count);
+
+  // The model found for a and b answers the same query over c and d, with
+  // the values of a for c and of b for d. Objects which do not occur in the
+  // query get zeros.
+  const Array *unused = AC.CreateArray("u", 3);
+  values.clear();
+  ASSERT_TRUE(solver->impl->computeInitialValues(
+      makeQuery(c, d), {d, unused, c}, values, hasSolution));
+  ASSERT_TRUE(hasSolution);
+  EXPECT_EQ(1u, count);
+  ASSERT_EQ(3u, values.size());
+  EXPECT_EQ(std::vector<unsigned char>(4, 'b'), values[0]);
+  EXPECT_EQ(std::vector<unsigned char>(3, 0), values[1]);
+  EXPECT_EQ(std::vector<unsigned char>(2, 'a'), values[2]);
+}
+} // namespace
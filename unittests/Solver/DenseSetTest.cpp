@@ -0,0 +1,119 @@
+//===-- DenseSetTest.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/ADT/DenseSet.h"
+
+#include <chrono>
+#include <functional>
+#include <cstdio>
+#include <set>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+std::vector<unsigned> toVector(const DenseSet<unsigned> &s) {
+  return std::vector<unsigned>(s.begin(), s.end());
+}
+
+TEST(DenseSetTest, AddAndIterate) {
+  DenseSet<unsigned> s;
+  EXPECT_TRUE(s.begin() == s.end());
+
+  s.add(130);
+  s.add(3);
+  s.add(64);
+  s.add(3);
+  EXPECT_EQ(std::vector<unsigned>({3, 64, 130}), toVector(s));
+  EXPECT_TRUE(s.contains(64));
+  EXPECT_FALSE(s.contains(65));
+  EXPECT_FALSE(s.contains(100000));
+}
+
+TEST(DenseSetTest, AddRange) {
+  for (unsigned start : {0u, 5u, 63u, 64u}) {
+    for (unsigned end : {start, start + 1, 64u, 65u, 200u}) {
+      DenseSet<unsigned> s;
+      s.add(start, end);
+      std::vector<unsigned> expected;
+      for (unsigned i = start; i < end; ++i)
+        expected.push_back(i);
+      EXPECT_EQ(expected, toVector(s)) << start << " " << end;
+    }
+  }
+}
+
+TEST(DenseSetTest, UnionAndIntersection) {
+  DenseSet<unsigned> a, b, c;
+  a.add(1);
+  a.add(1000);
+  b.add(2);
+  b.add(1000);
+  c.add(2);
+
+  EXPECT_TRUE(a.intersects(b));
+  EXPECT_TRUE(b.intersects(a));
+  EXPECT_FALSE(a.intersects(c));
+  EXPECT_FALSE(c.intersects(a));
+
+  EXPECT_TRUE(c.add(a));
+  EXPECT_EQ(std::vector<unsigned>({1, 2, 1000}), toVector(c));
+  EXPECT_FALSE(c.add(b));
+  EXPECT_FALSE(a.add(DenseSet<unsigned>()));
+}
+
+// Run with --gtest_also_run_disabled_tests to compare with std::set on the
+// byte offsets of accesses to a 64KB buffer.
+TEST(DenseSetTest, DISABLED_Benchmark) {
+  const unsigned size = 64 * 1024, repetitions = 20;
+
+  auto time = [](const char *name, const std::function<bool()> &run) {
+    auto start = std::chrono::steady_clock::now();
+    bool result = run();
+    std::printf("%s: %.0fus (%d)\n", name,
+                std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - start)
+                    .count(),
+                result);
+  };
+
+  time("std::set", [&]() {
+    bool result = false;
+    for (unsigned r = 0; r < repetitions; ++r) {
+      std::set<unsigned> even, odd;
+      for (unsigned i = 0; i < size; i += 2) {
+        even.insert(i);
+        odd.insert(i + 1);
+      }
+      for (unsigned i : even)
+        result |= odd.count(i) != 0;
+      odd.insert(even.begin(), even.end());
+    }
+    return result;
+  });
+
+  time("DenseSet", [&]() {
+    bool result = false;
+    for (unsigned r = 0; r < repetitions; ++r) {
+      DenseSet<unsigned> even, odd;
+      for (unsigned i = 0; i < size; i += 2) {
+        even.add(i);
+        odd.add(i + 1);
+      }
+      result |= even.intersects(odd);
+      odd.add(even);
+    }
+    return result;
+  });
+}
+
+} // namespace
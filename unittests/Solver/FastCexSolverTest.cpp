@@ -0,0 +1,114 @@
+//===-- FastCexSolverTest.cpp ---------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Solver/Solver.h"
+
+#include "llvm/ADT/APFloat.h"
+
+#include <cstring>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+ArrayCache AC;
+
+class FastCexSolverTest : public ::testing::Test {
+protected:
+  // The dummy solver fails every query, so anything answered comes from the
+  // fast counterexample solver itself.
+  FastCexSolverTest() : solver(createFastCexSolver(createDummySolver())) {
+    array = AC.CreateArray("x", 8);
+    x = Expr::createTempRead(array, Expr::Int64);
+  }
+
+  ~FastCexSolverTest() { delete solver; }
+
+  static ref<Expr> fp(double value) {
+    return ConstantExpr::alloc(llvm::APFloat(value));
+  }
+
+  Solver *solver;
+  const Array *array;
+  ref<Expr> x;
+  ConstraintSet constraints;
+};
+
+TEST_F(FastCexSolverTest, DisjointFloatRanges) {
+  ConstraintManager cm(constraints);
+  cm.addConstraint(FOLtExpr::create(x, fp(1.0)));
+  cm.addConstraint(FOGtExpr::create(x, fp(2.0)));
+
+  bool result;
+  ASSERT_TRUE(solver->mustBeTrue(
+      Query(constraints, FOEqExpr::create(x, fp(3.0))), result));
+  ASSERT_TRUE(result);
+}
+
+TEST_F(FastCexSolverTest, FloatImplication) {
+  ConstraintManager cm(constraints);
+  cm.addConstraint(FOGtExpr::create(x, fp(2.0)));
+
+  bool result;
+  ASSERT_TRUE(solver->mustBeTrue(
+      Query(constraints, FOGtExpr::create(x, fp(1.0))), result));
+  ASSERT_TRUE(result);
+  ASSERT_TRUE(solver->mustBeTrue(
+      Query(constraints, FOGeExpr::create(x, fp(2.0))), result));
+  ASSERT_TRUE(result);
+}
+
+TEST_F(FastCexSolverTest, FloatArithmetic) {
+  ConstraintManager cm(constraints);
+  cm.addConstraint(FOGeExpr::create(x, fp(0.0)));
+  cm.addConstraint(FOLeExpr::create(x, fp(10.0)));
+
+  ref<Expr> sum =
+      FAddExpr::create(x, fp(1.0), llvm::APFloat::rmNearestTiesToEven);
+  bool result;
+  ASSERT_TRUE(
+      solver->mustBeTrue(Query(constraints, FOLeExpr::create(sum, fp(11.0))),
+                         result));
+  ASSERT_TRUE(result);
+}
+
+TEST_F(FastCexSolverTest, NaNIsUnordered) {
+  ConstraintManager cm(constraints);
+  cm.addConstraint(IsNaNExpr::create(x));
+
+  bool result;
+  ASSERT_TRUE(solver->mustBeFalse(
+      Query(constraints, FOLtExpr::create(x, fp(1.0))), result));
+  ASSERT_TRUE(result);
+}
+
+TEST_F(FastCexSolverTest, FloatCounterexample) {
+  ConstraintManager cm(constraints);
+  cm.addConstraint(FOGtExpr::create(x, fp(2.0)));
+
+  ref<Expr> query = FOGtExpr::create(x, fp(3.0));
+  bool result;
+  ASSERT_TRUE(solver->mustBeTrue(Query(constraints, query), result));
+  ASSERT_FALSE(result);
+
+  std::vector<const Array *> objects{array};
+  std::vector<std::vector<unsigned char>> values;
+  ASSERT_TRUE(solver->getInitialValues(Query(constraints, query), objects,
+                                       values));
+  double value;
+  std::memcpy(&value, values[0].data(), sizeof(value));
+  ASSERT_GT(value, 2.0);
+  ASSERT_LE(value, 3.0);
+}
+} // namespace
@@ -0,0 +1,182 @@
+//===-- PersistentCachingSolverTest.cpp -----------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverImpl.h"
+
+#include "../../lib/Solver/CanonicalQueryKey.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+
+#include <memory>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+ArrayCache AC;
+
+/// A backend which answers every query the same way and counts how often it
+/// was asked.
+class CountingSolverImpl : public SolverImpl {
+  unsigned &count;
+
+public:
+  explicit CountingSolverImpl(unsigned &count) : count(count) {}
+
+  bool computeTruth(const Query &, bool &isValid) override {
+    ++count;
+    isValid = true;
+    return true;
+  }
+  bool computeValue(const Query &query, ref<Expr> &result) override {
+    ++count;
+    result = ConstantExpr::create(1, query.expr->getWidth());
+    return true;
+  }
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char>> &values,
+                            bool &hasSolution) override {
+    ++count;
+    for (const auto object : objects)
+      values.emplace_back(object->size, 7);
+    hasSolution = true;
+    return true;
+  }
+  SolverRunStatus getOperationStatusCode() override {
+    return SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+  }
+};
+
+class PersistentCachingSolverTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    llvm::SmallString<128> tmp;
+    ASSERT_FALSE(
+        llvm::sys::fs::createTemporaryFile("query-cache", "sqlite", tmp));
+    path = tmp.str().str();
+  }
+  void TearDown() override {
+    llvm::sys::fs::remove(path);
+    llvm::sys::fs::remove(path + "-wal");
+    llvm::sys::fs::remove(path + "-shm");
+  }
+
+  /// A query \a x + 1 == 5 over a fresh array of the given name.
+  Query makeQuery(const std::string &name, const Array *&array) {
+    array = AC.CreateArray(name, 4);
+    ref<Expr> x = Expr::createTempRead(array, Expr::Int32);
+    ref<Expr> e = EqExpr::create(
+        AddExpr::create(x, ConstantExpr::create(1, Expr::Int32)),
+        ConstantExpr::create(5, Expr::Int32));
+    return Query(constraints, e);
+  }
+
+  std::string path;
+  ConstraintSet constraints;
+};
+
+TEST_F(PersistentCachingSolverTest, KeyIgnoresArrayNames) {
+  const Array *a, *b;
+  Query qa = makeQuery("a", a);
+  Query qb = makeQuery("b", b);
+  EXPECT_EQ(CanonicalQueryKey(qa).str(), CanonicalQueryKey(qb).str());
+
+  const Array *c = AC.CreateArray("c", 8);
+  Query qc(constraints, EqExpr::create(Expr::createTempRead(c, Expr::Int32),
+                                       ConstantExpr::create(4, Expr::Int32)));
+  EXPECT_NE(CanonicalQueryKey(qa).str(), CanonicalQueryKey(qc).str());
+}
+
+TEST_F(PersistentCachingSolverTest, ResultsSurviveTheSolver) {
+  unsigned count = 0;
+  const Array *a, *b;
+  Query qa = makeQuery("first", a);
+  {
+    std::unique_ptr<Solver> solver(createPersistentCachingSolver(
+        new Solver(new CountingSolverImpl(count)), path));
+    bool isValid;
+    ASSERT_TRUE(solver->impl->computeTruth(qa, isValid));
+    ref<Expr> value;
+    ASSERT_TRUE(solver->impl->computeValue(qa, value));
+    std::vector<std::vector<unsigned char>> values;
+    bool hasSolution;
+    ASSERT_TRUE(
+        solver->impl->computeInitialValues(qa, {a}, values, hasSolution));
+    EXPECT_EQ(3u, count);
+  }
+
+  // A solver which cannot answer anything, so every result must come from
+  // the database. The array names differ from the first run.
+  Query qb = makeQuery("second", b);
+  std::unique_ptr<Solver> solver(
+      createPersistentCachingSolver(createDummySolver(), path));
+  bool isValid = false;
+  ASSERT_TRUE(solver->impl->computeTruth(qb, isValid));
+  EXPECT_TRUE(isValid);
+  ref<Expr> value;
+  ASSERT_TRUE(solver->impl->computeValue(qb, value));
+  EXPECT_TRUE(value->isTrue());
+  std::vector<std::vector<unsigned char>> values;
+  bool hasSolution = false;
+  ASSERT_TRUE(
+      solver->impl->computeInitialValues(qb, {b}, values, hasSolution));
+  EXPECT_TRUE(hasSolution);
+  ASSERT_EQ(1u, values.size());
+  EXPECT_EQ(std::vector<unsigned char>(4, 7), values[0]);
+
+  // Different objects are a different query.
+  const Array *other = AC.CreateArray("other", 2);
+  values.clear();
+  EXPECT_FALSE(solver->impl->computeInitialValues(qb, {b, other}, values,
+                                                  hasSolution));
+}
+
+TEST_F(PersistentCachingSolverTest, ForkedProcessUsesItsOwnConnection) {
+  unsigned count = 0;
+  std::unique_ptr<Solver> solver(createPersistentCachingSolver(
+      new Solver(new CountingSolverImpl(count)), path));
+  const Array *a, *b;
+  Query qa = makeQuery("parent", a);
+  bool isValid;
+  ASSERT_TRUE(solver->impl->computeTruth(qa, isValid));
+  EXPECT_EQ(1u, count);
+
+  // The child answers a new query with the solver it inherited, which must
+  // reopen the database rather than use the connection of the parent.
+  Query qb = makeQuery("child", b);
+  pid_t pid = fork();
+  ASSERT_NE(-1, pid);
+  if (pid == 0) {
+    ref<Expr> value;
+    bool ok = solver->impl->computeValue(qb, value) && count == 2;
+    _exit(ok ? 0 : 1);
+  }
+  int status;
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(0, WEXITSTATUS(status));
+
+  // The parent still uses its own connection and sees the child's result.
+  ref<Expr> value;
+  ASSERT_TRUE(solver->impl->computeValue(qb, value));
+  EXPECT_TRUE(value->isTrue());
+  ASSERT_TRUE(solver->impl->computeTruth(qa, isValid));
+  EXPECT_EQ(1u, count);
+}
+} // namespace
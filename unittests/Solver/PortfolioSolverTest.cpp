@@ -0,0 +1,120 @@
+//===-- PortfolioSolverTest.cpp -------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverImpl.h"
+
+#include <memory>
+
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+ArrayCache AC;
+
+/// A backend which answers every query with the same assignment, optionally
+/// after sleeping.
+class FixedSolverImpl : public SolverImpl {
+  unsigned char value;
+  unsigned delaySeconds;
+
+public:
+  FixedSolverImpl(unsigned char value, unsigned delaySeconds)
+      : value(value), delaySeconds(delaySeconds) {}
+
+  bool computeTruth(const Query &, bool &isValid) override { return false; }
+  bool computeValue(const Query &, ref<Expr> &result) override {
+    return false;
+  }
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char>> &values,
+                            bool &hasSolution) override {
+    if (delaySeconds)
+      sleep(delaySeconds);
+    for (const auto object : objects)
+      values.emplace_back(object->size, value);
+    hasSolution = true;
+    return true;
+  }
+  SolverRunStatus getOperationStatusCode() override {
+    return SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+  }
+};
+
+Solver *createFixedSolver(unsigned char value, unsigned delaySeconds = 0) {
+  return new Solver(new FixedSolverImpl(value, delaySeconds));
+}
+
+class PortfolioSolverTest : public ::testing::Test {
+protected:
+  PortfolioSolverTest() {
+    array = AC.CreateArray("x", 4);
+    x = Expr::createTempRead(array, Expr::Int8);
+  }
+
+  bool getValues(Solver *solver, std::vector<unsigned char> &value) {
+    std::vector<const Array *> objects{array};
+    std::vector<std::vector<unsigned char>> values;
+    if (!solver->getInitialValues(
+            Query(constraints, ConstantExpr::alloc(0, Expr::Bool)), objects,
+            values))
+      return false;
+    value = values[0];
+    return true;
+  }
+
+  const Array *array;
+  ref<Expr> x;
+  ConstraintSet constraints;
+};
+
+TEST_F(PortfolioSolverTest, FastestSolverWins) {
+  std::unique_ptr<Solver> solver(createPortfolioSolver(
+      {{"slow", createFixedSolver(1, 60)}, {"fast", createFixedSolver(2)}}));
+
+  std::vector<unsigned char> value;
+  ASSERT_TRUE(getValues(solver.get(), value));
+  ASSERT_EQ(std::vector<unsigned char>(4, 2), value);
+}
+
+TEST_F(PortfolioSolverTest, FailingSolversDropOut) {
+  std::unique_ptr<Solver> solver(createPortfolioSolver(
+      {{"dummy", createDummySolver()}, {"fixed", createFixedSolver(3, 1)}}));
+
+  std::vector<unsigned char> value;
+  ASSERT_TRUE(getValues(solver.get(), value));
+  ASSERT_EQ(std::vector<unsigned char>(4, 3), value);
+}
+
+TEST_F(PortfolioSolverTest, AllSolversFail) {
+  std::unique_ptr<Solver> solver(createPortfolioSolver(
+      {{"dummy1", createDummySolver()}, {"dummy2", createDummySolver()}}));
+
+  std::vector<unsigned char> value;
+  ASSERT_FALSE(getValues(solver.get(), value));
+}
+
+TEST_F(PortfolioSolverTest, Timeout) {
+  std::unique_ptr<Solver> solver(
+      createPortfolioSolver({{"slow", createFixedSolver(1, 60)}}));
+  solver->setCoreSolverTimeout(time::seconds(1));
+
+  std::vector<unsigned char> value;
+  ASSERT_FALSE(getValues(solver.get(), value));
+  ASSERT_EQ(SolverImpl::SOLVER_RUN_STATUS_TIMEOUT,
+            solver->impl->getOperationStatusCode());
+}
+} // namespace
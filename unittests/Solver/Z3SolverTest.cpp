@@ -10,6 +10,7 @@
 
 #include <algorithm>
 #include <iterator>
+#include <memory>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -69,3 +70,27 @@ TEST_F(Z3SolverTest, GetConstraintLog) {
   ASSERT_STRNE(Occurence, nullptr);
   free(ConstraintsString);
 }
+
+TEST(Z3BitblastSolverTest, FloatingPointRemainder) {
+  std::unique_ptr<Solver> solver(
+      createCoreSolver(CoreSolverType::Z3_BITBLAST_SOLVER));
+  ASSERT_TRUE(solver);
+  solver->setCoreSolverTimeout(time::Span("10s"));
+
+  // The IEEE remainder of -7.5 and 2.0 is 0.5, fmod() would give -1.5.
+  ConstraintSet Constraints;
+  ConstraintManager cm(Constraints);
+  const Array *array = AC.CreateArray("x", 8);
+  ref<Expr> x = Expr::createTempRead(array, Expr::Int64);
+  cm.addConstraint(EqExpr::create(x, ConstantExpr::alloc(llvm::APFloat(-7.5))));
+
+  ref<Expr> rem =
+      FRemExpr::create(x, ConstantExpr::alloc(llvm::APFloat(2.0)),
+                       llvm::APFloat::rmNearestTiesToEven);
+  bool result;
+  ASSERT_TRUE(solver->mustBeTrue(
+      Query(Constraints,
+            EqExpr::create(rem, ConstantExpr::alloc(llvm::APFloat(0.5)))),
+      result));
+  EXPECT_TRUE(result);
+}